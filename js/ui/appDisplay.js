@@ -3023,6 +3023,10 @@ export const AppIcon = GObject.registerClass({
         super._onDragBegin();
     }
 
+    get gicon() {
+        return this.app.icon;
+    }
+
     _createIcon(iconSize) {
         return this.app.create_icon_texture(iconSize);
     }
@@ -38,6 +38,7 @@ export class ExtensionManager extends Signals.EventEmitter {
 
         this._extensions = new Map();
         this._unloadedExtensions = new Map();
+        this._stylesheetLoads = new WeakMap();
         this._enabledExtensions = [];
         this._extensionOrder = [];
         this._checkVersion = false;
@@ -113,21 +114,22 @@ export class ExtensionManager extends Signals.EventEmitter {
             if (!path.endsWith('-dark.css') && !path.endsWith('-light.css'))
                 continue;
 
-            try {
-                this._unloadExtensionStylesheet(ext);
-                this._loadExtensionStylesheet(ext);
-            } catch (e) {
+            this._unloadExtensionStylesheet(ext);
+            this._loadExtensionStylesheet(ext).catch(e => {
                 this._callExtensionDisable(ext.uuid);
                 this.logExtensionError(ext.uuid, e);
-            }
+            });
         }
     }
 
-    _loadExtensionStylesheet(extension) {
+    async _loadExtensionStylesheet(extension) {
         if (extension.state !== ExtensionState.ACTIVE &&
             extension.state !== ExtensionState.ACTIVATING)
             return;
 
+        const load = {};
+        this._stylesheetLoads.set(extension, load);
+
         const variant = Main.getStyleVariant();
         const stylesheetNames = [
             `${global.sessionMode}-${variant}.css`,
@@ -135,22 +137,41 @@ export class ExtensionManager extends Signals.EventEmitter {
             `${global.sessionMode}.css`,
             'stylesheet.css',
         ];
-        const theme = St.ThemeContext.get_for_stage(global.stage).get_theme();
+        const themeContext = St.ThemeContext.get_for_stage(global.stage);
         for (const name of stylesheetNames) {
+            const stylesheetFile = extension.dir.get_child(name);
+            let theme;
             try {
-                const stylesheetFile = extension.dir.get_child(name);
-                theme.load_stylesheet(stylesheetFile);
-                extension.stylesheet = stylesheetFile;
-                break;
+                // Main.loadTheme() may replace the theme during the load
+                do {
+                    theme = themeContext.get_theme();
+                    // eslint-disable-next-line no-await-in-loop
+                    await theme.load_stylesheet_async(stylesheetFile, null);
+                } while (theme !== themeContext.get_theme());
             } catch (e) {
                 if (e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.NOT_FOUND))
                     continue; // not an error
                 throw e;
             }
+
+            // The extension may have been disabled, or its stylesheet
+            // loaded again for another variant, in the meantime
+            if (this._stylesheetLoads.get(extension) !== load) {
+                if (!extension.stylesheet?.equal(stylesheetFile))
+                    theme.unload_stylesheet(stylesheetFile);
+                return;
+            }
+
+            this._stylesheetLoads.delete(extension);
+            extension.stylesheet = stylesheetFile;
+            return;
         }
     }
 
     _unloadExtensionStylesheet(extension) {
+        // Also discards a load that is still in progress
+        this._stylesheetLoads.delete(extension);
+
         if (!extension.stylesheet)
             return;
 
@@ -257,7 +278,7 @@ export class ExtensionManager extends Signals.EventEmitter {
         this._changeExtensionState(extension, ExtensionState.ACTIVATING);
 
         try {
-            this._loadExtensionStylesheet(extension);
+            await this._loadExtensionStylesheet(extension);
         } catch (e) {
             this.logExtensionError(uuid, e);
             return;
@@ -1176,8 +1176,10 @@ export const IconGrid = GObject.registerClass({
             row_spacing: 0,
         });
         const layoutManager = new IconGridLayout(layoutParams);
-        const pagesChangedId = layoutManager.connect('pages-changed',
-            () => this.emit('pages-changed'));
+        const pagesChangedId = layoutManager.connect('pages-changed', () => {
+            this._prefetchPages();
+            this.emit('pages-changed');
+        });
 
         super._init({
             style_class: 'icon-grid',
@@ -1189,8 +1191,52 @@ export const IconGrid = GObject.registerClass({
         this._gridModes = defaultGridModes;
         this._currentPage = 0;
         this._currentMode = -1;
+        this._prefetchIds = [];
+
+        this.connect('destroy', () => {
+            layoutManager.disconnect(pagesChangedId);
+            this._cancelPrefetch();
+        });
+    }
+
+    _cancelPrefetch() {
+        const cache = St.TextureCache.get_default();
+        this._prefetchIds.forEach(id => cache.cancel_prefetch(id));
+        this._prefetchIds = [];
+    }
+
+    _prefetchPage(pageIndex, priority) {
+        const items = this.getItemsAtPage(pageIndex).filter(
+            item => item.visible && item.gicon && item.icon?.icon);
+        if (items.length === 0)
+            return;
+
+        // All icons of a grid have the same size and style
+        const {iconSize, icon} = items[0].icon;
+        const themeNode = icon.peek_theme_node();
+        if (!themeNode)
+            return;
+
+        const {scaleFactor} = St.ThemeContext.get_for_stage(global.stage);
+        const id = St.TextureCache.get_default().prefetch_gicons(this,
+            themeNode, items.map(item => item.gicon), iconSize,
+            scaleFactor, icon.get_resource_scale(), priority);
+        this._prefetchIds.push(id);
+    }
+
+    // Loads the icons of the current page ahead of the other ones, and
+    // those of the next page in the background. What was prefetched for
+    // the previous page and not started yet is dropped.
+    _prefetchPages() {
+        this._cancelPrefetch();
+
+        if (this._currentPage >= this.nPages)
+            return;
+
+        this._prefetchPage(this._currentPage, GLib.PRIORITY_HIGH);
 
-        this.connect('destroy', () => layoutManager.disconnect(pagesChangedId));
+        if (this._currentPage + 1 < this.nPages)
+            this._prefetchPage(this._currentPage + 1, GLib.PRIORITY_LOW);
     }
 
     vfunc_child_added(child) {
@@ -1363,6 +1409,7 @@ export const IconGrid = GObject.registerClass({
         }
 
         this._currentPage = pageIndex;
+        this._prefetchPages();
 
         if (!this.mapped)
             animate = false;
@@ -107,6 +107,7 @@ let _cssStylesheet = null;
 let _themeResource = null;
 let _oskResource = null;
 let _iconResource = null;
+let _themeSerial = 0;
 let _workspacesAdjustment = null;
 let _workspaceAdjustmentRegistry = null;
 
@@ -647,14 +648,46 @@ export function loadTheme() {
     if (theme.default_stylesheet == null)
         throw new Error(`No valid stylesheet found for '${sessionMode.stylesheetName}'`);
 
-    if (previousTheme) {
-        let customStylesheets = previousTheme.get_custom_stylesheets();
+    const serial = ++_themeSerial;
 
-        for (let i = 0; i < customStylesheets.length; i++)
-            theme.load_stylesheet(customStylesheets[i]);
+    if (!previousTheme || previousTheme.get_custom_stylesheets().length === 0) {
+        themeContext.set_theme(theme);
+        return;
     }
 
-    themeContext.set_theme(theme);
+    // Keep the previous theme until the custom stylesheets are loaded
+    // into the new one, so that they don't go missing for a while
+    _loadCustomStylesheets(theme, previousTheme).then(() => {
+        // Superseded by a later call
+        if (serial === _themeSerial)
+            themeContext.set_theme(theme);
+    });
+}
+
+async function _loadCustomStylesheets(theme, previousTheme) {
+    const loaded = [];
+    let pending;
+
+    // Extensions can load stylesheets into the previous theme meanwhile
+    const isLoaded = file => loaded.some(f => f.equal(file));
+    while ((pending = previousTheme.get_custom_stylesheets().filter(f => !isLoaded(f))).length > 0) {
+        for (const file of pending) {
+            try {
+                // eslint-disable-next-line no-await-in-loop
+                await theme.load_stylesheet_async(file, null);
+            } catch (e) {
+                logError(e, `Failed to load stylesheet ${file.get_uri()}`);
+            }
+            loaded.push(file);
+        }
+    }
+
+    // ... or unload them
+    const customStylesheets = previousTheme.get_custom_stylesheets();
+    for (const file of loaded) {
+        if (!customStylesheets.some(f => f.equal(file)))
+            theme.unload_stylesheet(file);
+    }
 }
 
 /**
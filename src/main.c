@@ -315,10 +315,151 @@ malloc_statistics_callback (ShellPerfLog *perf_log,
 #endif /* defined (HAVE_MALLINFO) || defined (HAVE_MALLINFO2) */
 }
 
+static const char *decode_lane_names[] = {
+  [ST_DECODE_LANE_VISIBLE] = "visible",
+  [ST_DECODE_LANE_PREFETCH] = "prefetch",
+  [ST_DECODE_LANE_BACKGROUND] = "background",
+};
+
+static const char *decode_latency_names[ST_DECODE_N_LATENCY_BUCKETS] = {
+  "Under1ms", "Under4ms", "Under16ms", "Under64ms", "Under256ms", "Over256ms",
+};
+
+static void
+st_statistics_callback (ShellPerfLog *perf_log,
+                        gpointer      data)
+{
+  ClutterStage *stage = shell_global_get_stage (shell_global_get ());
+  StThemeContext *context;
+  guint hits, misses;
+  guint n_nodes, n_evicted;
+  guint n_pages, n_images, n_atlas_evictions;
+  guint n_draws, n_switches;
+  guint n_entries;
+  gsize n_bytes;
+  guint n_decoded, n_cancelled;
+  guint n_icon_hits, n_icon_misses, n_icon_evictions;
+  guint latency[ST_DECODE_N_LATENCY_BUCKETS];
+  guint lane;
+  int i;
+
+  if (stage == NULL)
+    return;
+
+  context = st_theme_context_get_for_stage (stage);
+  st_theme_context_get_style_cache_stats (context, &hits, &misses);
+  st_theme_context_get_node_cache_stats (context, &n_nodes, &n_evicted);
+
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.styleCache.hits",
+                                     hits);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.styleCache.misses",
+                                     misses);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.nodeCache.size",
+                                     n_nodes);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.nodeCache.evictions",
+                                     n_evicted);
+
+  st_texture_cache_get_shadow_cache_stats (st_texture_cache_get_default (),
+                                           &hits, &misses, &n_bytes);
+
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.shadowCache.hits",
+                                     hits);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.shadowCache.misses",
+                                     misses);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.shadowCache.size",
+                                     n_bytes);
+
+  st_texture_cache_get_atlas_stats (st_texture_cache_get_default (),
+                                    &n_pages, &n_images, &n_atlas_evictions);
+
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureAtlas.pages",
+                                     n_pages);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureAtlas.images",
+                                     n_images);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureAtlas.evictions",
+                                     n_atlas_evictions);
+
+  st_texture_cache_get_texture_draw_stats (st_texture_cache_get_default (),
+                                           &n_draws, &n_switches);
+
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureDraws",
+                                     n_draws);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureSwitches",
+                                     n_switches);
+
+  st_texture_cache_get_cache_stats (st_texture_cache_get_default (),
+                                    &n_entries, &n_bytes, &n_evicted);
+
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureCache.entries",
+                                     n_entries);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureCache.size",
+                                     n_bytes);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.textureCache.evictions",
+                                     n_evicted);
+
+  st_texture_cache_get_icon_info_cache_stats (st_texture_cache_get_default (),
+                                              &n_icon_hits, &n_icon_misses,
+                                              &n_icon_evictions);
+
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.iconInfoCache.hits",
+                                     n_icon_hits);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.iconInfoCache.misses",
+                                     n_icon_misses);
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "st.iconInfoCache.evictions",
+                                     n_icon_evictions);
+
+  for (lane = 0; lane < G_N_ELEMENTS (decode_lane_names); lane++)
+    {
+      g_autofree char *decoded_name = NULL;
+      g_autofree char *cancelled_name = NULL;
+
+      st_texture_cache_get_decode_stats (st_texture_cache_get_default (), lane,
+                                         &n_decoded, &n_cancelled, latency);
+
+      decoded_name = g_strdup_printf ("st.decode.%s.decoded",
+                                      decode_lane_names[lane]);
+      cancelled_name = g_strdup_printf ("st.decode.%s.cancelled",
+                                        decode_lane_names[lane]);
+
+      shell_perf_log_update_statistic_i (perf_log, decoded_name, n_decoded);
+      shell_perf_log_update_statistic_i (perf_log, cancelled_name, n_cancelled);
+
+      for (i = 0; i < ST_DECODE_N_LATENCY_BUCKETS; i++)
+        {
+          g_autofree char *name = NULL;
+
+          name = g_strdup_printf ("st.decode.%s.latency%s",
+                                  decode_lane_names[lane],
+                                  decode_latency_names[i]);
+          shell_perf_log_update_statistic_i (perf_log, name, latency[i]);
+        }
+    }
+}
+
 static void
 shell_perf_log_init (void)
 {
   ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  guint lane;
+  int i;
 
   /* For probably historical reasons, mallinfo() defines the returned values,
    * even those in bytes as int, not size_t. We're determined not to use
@@ -340,6 +481,116 @@ shell_perf_log_init (void)
   shell_perf_log_add_statistics_callback (perf_log,
                                           malloc_statistics_callback,
                                           NULL, NULL);
+
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.styleCache.hits",
+                                   "Number of theme nodes that shared the style of an identical node",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.styleCache.misses",
+                                   "Number of theme nodes that were matched against the theme",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.nodeCache.size",
+                                   "Number of interned theme nodes",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.nodeCache.evictions",
+                                   "Number of unused theme nodes evicted from the intern table",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.shadowCache.hits",
+                                   "Number of box shadows that reused a blurred texture",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.shadowCache.misses",
+                                   "Number of box shadows that had to be blurred",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.shadowCache.size",
+                                   "Size of the cached box shadow textures, in bytes",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureAtlas.pages",
+                                   "Number of textures shared by small images",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureAtlas.images",
+                                   "Number of small images drawn from shared textures",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureAtlas.evictions",
+                                   "Number of times unused images were dropped from a full shared texture",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureDraws",
+                                   "Number of textures drawn by St",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureSwitches",
+                                   "Number of St texture draws that used a different GL texture than the draw before",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureCache.entries",
+                                   "Number of cached images and icons",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureCache.size",
+                                   "Size of the textures of cached images and icons, in bytes",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureCache.evictions",
+                                   "Number of unused images and icons freed to stay within the cache budget",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.iconInfoCache.hits",
+                                   "Number of icon theme lookups that were cached",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.iconInfoCache.misses",
+                                   "Number of icon theme lookups that searched the theme directories",
+                                   "i");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.iconInfoCache.evictions",
+                                   "Number of unused icon theme lookups dropped to stay within the cache size",
+                                   "i");
+
+  for (lane = 0; lane < G_N_ELEMENTS (decode_lane_names); lane++)
+    {
+      g_autofree char *decoded_name = NULL;
+      g_autofree char *cancelled_name = NULL;
+
+      decoded_name = g_strdup_printf ("st.decode.%s.decoded",
+                                      decode_lane_names[lane]);
+      cancelled_name = g_strdup_printf ("st.decode.%s.cancelled",
+                                        decode_lane_names[lane]);
+
+      shell_perf_log_define_statistic (perf_log,
+                                       decoded_name,
+                                       "Number of images decoded in worker threads",
+                                       "i");
+      shell_perf_log_define_statistic (perf_log,
+                                       cancelled_name,
+                                       "Number of image decodes cancelled before they started",
+                                       "i");
+
+      for (i = 0; i < ST_DECODE_N_LATENCY_BUCKETS; i++)
+        {
+          g_autofree char *name = NULL;
+
+          name = g_strdup_printf ("st.decode.%s.latency%s",
+                                  decode_lane_names[lane],
+                                  decode_latency_names[i]);
+          shell_perf_log_define_statistic (perf_log,
+                                           name,
+                                           "Number of image requests that waited this long to be decoded",
+                                           "i");
+        }
+    }
+
+  shell_perf_log_add_statistics_callback (perf_log,
+                                          st_statistics_callback,
+                                          NULL, NULL);
 }
 
 static void
@@ -25,6 +25,12 @@
 #define RESCAN_TIMEOUT_MS 2500
 #define MAX_RESCAN_RETRIES 6
 
+/* Keep the icon lookups of every app for the sizes of the app grid,
+ * the dash and the search results. Cached lookups don't hold on to the
+ * rendered icons, so this costs a few hundred bytes per lookup. */
+#define ICON_LOOKUPS_PER_APP 3
+#define MIN_ICON_LOOKUPS 32
+
 /* The event id for starting an aggregate timer for each app. The payload is
  * the app id.
  */
@@ -348,6 +354,16 @@ rescan_icon_theme (ShellAppSystem *self)
                                                  self);
 }
 
+static void
+update_icon_info_cache_size (ShellAppCache *cache)
+{
+  guint n_apps = g_list_length (shell_app_cache_get_all (cache));
+
+  st_texture_cache_set_icon_info_cache_size (st_texture_cache_get_default (),
+                                             MAX (MIN_ICON_LOOKUPS,
+                                                  n_apps * ICON_LOOKUPS_PER_APP));
+}
+
 static void
 installed_changed (ShellAppCache  *cache,
                    ShellAppSystem *self)
@@ -355,6 +371,7 @@ installed_changed (ShellAppCache  *cache,
   GPtrArray *windows = g_ptr_array_new ();
 
   rescan_icon_theme (self);
+  update_icon_info_cache_size (cache);
   scan_alias_to_id (self);
 
   scan_startup_wm_class_to_id (self);
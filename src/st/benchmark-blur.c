@@ -0,0 +1,251 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * benchmark-blur.c: micro-benchmark for the shadow blur
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Creates shadows of the sizes the shell typically prerenders with
+ * _st_create_shadow_cairo_pattern() and prints one JSON object per
+ * shadow:
+ *
+ *   {"shadow": "icon", "implementation": "avx2", "width": 48,
+ *    "height": 48, "blur": 6.0, "us_per_shadow": 41.2, "max_error": 0}
+ *
+ * max_error is the largest difference between a blurred pixel and the
+ * result of the original blur implementation, which is kept below;
+ * the program fails if it's more than 1, since that would visibly
+ * change the shadows of the theme. Set ST_BLUR_IMPLEMENTATION=scalar to
+ * time the portable code path.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st-private.h"
+
+#define DEFAULT_ITERATIONS 200
+
+typedef struct
+{
+  const char *name;
+  int width;
+  int height;
+  double blur;
+  gboolean inset;
+} ShadowCase;
+
+static const ShadowCase shadow_cases[] = {
+  { "text", 120, 18, 2.0, FALSE },
+  { "icon", 48, 48, 6.0, FALSE },
+  { "button", 160, 36, 4.0, FALSE },
+  { "popup-menu", 280, 320, 10.0, FALSE },
+  { "inset", 200, 120, 8.0, TRUE },
+  { "osd", 400, 300, 24.0, FALSE },
+};
+
+static cairo_pattern_t *
+create_source_pattern (const ShadowCase *shadow_case)
+{
+  cairo_surface_t *surface;
+  cairo_pattern_t *pattern;
+  cairo_t *cr;
+  double radius = MIN (shadow_case->width, shadow_case->height) / 4.0;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                                        shadow_case->width,
+                                        shadow_case->height);
+
+  /* a rounded box, so that there are antialiased edges to blur */
+  cr = cairo_create (surface);
+  cairo_new_sub_path (cr);
+  cairo_arc (cr, shadow_case->width - radius, radius, radius, -M_PI / 2, 0);
+  cairo_arc (cr, shadow_case->width - radius, shadow_case->height - radius,
+             radius, 0, M_PI / 2);
+  cairo_arc (cr, radius, shadow_case->height - radius, radius, M_PI / 2, M_PI);
+  cairo_arc (cr, radius, radius, radius, M_PI, 3 * M_PI / 2);
+  cairo_close_path (cr);
+  cairo_fill (cr);
+  cairo_destroy (cr);
+
+  pattern = cairo_pattern_create_for_surface (surface);
+  cairo_surface_destroy (surface);
+
+  return pattern;
+}
+
+/* The blur as it was implemented before it was optimized, in double
+ * precision, truncating every weighted pixel as it's added */
+static guchar *
+reference_blur_pixels (const guchar *pixels_in,
+                       int           width_in,
+                       int           height_in,
+                       int           rowstride_in,
+                       double        blur,
+                       int          *width_out,
+                       int          *height_out,
+                       int          *rowstride_out)
+{
+  g_autofree double *kernel = NULL;
+  g_autofree guchar *line = NULL;
+  guchar *pixels_out;
+  double sigma = blur / 2.0;
+  double sum = 0.0;
+  int n_values = (int) (5 * sigma);
+  int half = n_values / 2;
+  int x_in, y_in, x_out, y_out, i;
+
+  *width_out = width_in + 2 * half;
+  *height_out = height_in + 2 * half;
+  *rowstride_out = (*width_out + 3) & ~3;
+
+  pixels_out = g_malloc0 (*rowstride_out * *height_out);
+  line = g_malloc0 (*rowstride_out);
+
+  kernel = g_new (double, n_values);
+  for (i = 0; i < n_values; i++)
+    {
+      kernel[i] = exp (-(i - half) * (i - half) / (2 * sigma * sigma));
+      sum += kernel[i];
+    }
+  for (i = 0; i < n_values; i++)
+    kernel[i] /= sum;
+
+  for (x_in = 0; x_in < width_in; x_in++)
+    for (y_out = 0; y_out < *height_out; y_out++)
+      {
+        guchar *pixel_out = pixels_out + y_out * *rowstride_out + x_in + half;
+
+        y_in = y_out - half;
+
+        for (i = MAX (half - y_in, 0); i < MIN (height_in + half - y_in, n_values); i++)
+          *pixel_out += pixels_in[(y_in + i - half) * rowstride_in + x_in] * kernel[i];
+      }
+
+  for (y_out = 0; y_out < *height_out; y_out++)
+    {
+      memcpy (line, pixels_out + y_out * *rowstride_out, *rowstride_out);
+
+      for (x_out = 0; x_out < *width_out; x_out++)
+        {
+          guchar *pixel_out = pixels_out + y_out * *rowstride_out + x_out;
+
+          *pixel_out = 0;
+          for (i = MAX (half - x_out, 0); i < MIN (*width_out + half - x_out, n_values); i++)
+            *pixel_out += line[x_out + i - half] * kernel[i];
+        }
+    }
+
+  return pixels_out;
+}
+
+static int
+compute_max_error (cairo_surface_t *surface_in,
+                   cairo_surface_t *surface_out,
+                   double           blur,
+                   gboolean         inset)
+{
+  const guchar *pixels_out = cairo_image_surface_get_data (surface_out);
+  int rowstride_out = cairo_image_surface_get_stride (surface_out);
+  g_autofree guchar *expected = NULL;
+  int width, height, rowstride;
+  int max_error = 0;
+  int x, y;
+
+  expected = reference_blur_pixels (cairo_image_surface_get_data (surface_in),
+                                    cairo_image_surface_get_width (surface_in),
+                                    cairo_image_surface_get_height (surface_in),
+                                    cairo_image_surface_get_stride (surface_in),
+                                    blur,
+                                    &width, &height, &rowstride);
+
+  g_assert (width == cairo_image_surface_get_width (surface_out));
+  g_assert (height == cairo_image_surface_get_height (surface_out));
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        int value = expected[y * rowstride + x];
+        int error;
+
+        if (inset)
+          value = 255 - value;
+
+        error = ABS (value - pixels_out[y * rowstride_out + x]);
+        max_error = MAX (max_error, error);
+      }
+
+  return max_error;
+}
+
+static gboolean
+run_case (const ShadowCase *shadow_case,
+          int               iterations)
+{
+  g_autoptr (StShadow) shadow = NULL;
+  cairo_pattern_t *src_pattern;
+  cairo_pattern_t *shadow_pattern = NULL;
+  cairo_surface_t *surface_in, *surface_out;
+  CoglColor color;
+  gint64 start_time, time_us;
+  int max_error;
+  int iteration;
+
+  cogl_color_init_from_4f (&color, 0.0, 0.0, 0.0, 1.0);
+  shadow = st_shadow_new (&color, 0.0, 0.0,
+                          shadow_case->blur, 0.0, shadow_case->inset);
+  src_pattern = create_source_pattern (shadow_case);
+
+  start_time = g_get_monotonic_time ();
+  for (iteration = 0; iteration < iterations; iteration++)
+    {
+      g_clear_pointer (&shadow_pattern, cairo_pattern_destroy);
+      shadow_pattern = _st_create_shadow_cairo_pattern (shadow, src_pattern);
+    }
+  time_us = g_get_monotonic_time () - start_time;
+
+  cairo_pattern_get_surface (src_pattern, &surface_in);
+  cairo_pattern_get_surface (shadow_pattern, &surface_out);
+  max_error = compute_max_error (surface_in, surface_out,
+                                 shadow_case->blur, shadow_case->inset);
+
+  g_print ("{\"shadow\": \"%s\", \"implementation\": \"%s\", "
+           "\"width\": %d, \"height\": %d, "
+           "\"blur\": %.1f, \"us_per_shadow\": %.1f, \"max_error\": %d}\n",
+           shadow_case->name, _st_get_blur_implementation_name (),
+           shadow_case->width, shadow_case->height,
+           shadow_case->blur, (double) time_us / iterations, max_error);
+
+  cairo_pattern_destroy (shadow_pattern);
+  cairo_pattern_destroy (src_pattern);
+
+  return max_error <= 1;
+}
+
+int
+main (int argc, char **argv)
+{
+  int iterations = DEFAULT_ITERATIONS;
+  gboolean success = TRUE;
+  guint i;
+
+  if (argc > 1)
+    iterations = MAX (atoi (argv[1]), 1);
+
+  for (i = 0; i < G_N_ELEMENTS (shadow_cases); i++)
+    success &= run_case (&shadow_cases[i], iterations);
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,493 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * benchmark-theme.c: micro-benchmark for CSS matching and property lookup
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Styles synthetic widget trees that look like the ones the shell
+ * builds (the app grid, a popup menu, the notification list) with the
+ * real theme, and prints one JSON object per tree and phase:
+ *
+ *   {"mode": "compiled", "tree": "app-grid", "phase": "match",
+ *    "nodes": 393, "ns_per_node": 2113.4, "allocs_per_node": 7.2}
+ *
+ * The stylesheet is benchmarked as it is parsed from CSS, and, when the
+ * output of st-compile-stylesheet is passed too, as it is loaded from
+ * its compiled form; the shell only ships the latter. Each mode first
+ * times loading the stylesheet:
+ *
+ *   {"mode": "parsed", "phase": "load", "us_per_load": 4182.7,
+ *    "allocs_per_load": 52113.0}
+ *
+ * Phases, in the order they run on a fresh tree:
+ *
+ *   create:    st_theme_node_new()
+ *   match:     _st_theme_get_matched_properties(), bypassing all caches
+ *   cascade:   the first property lookup on each node, which runs
+ *              ensure_properties() including the shared style cache
+ *   accessors: a round of the st_theme_node_get_*() calls a widget
+ *              makes when it is allocated and painted
+ *   intern:    st_theme_context_intern_node()
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <clutter/clutter.h>
+#include <meta-test/meta-context-test.h>
+#include <meta/meta-backend.h>
+
+#include "st-bin.h"
+#include "st-box-layout.h"
+#include "st-button.h"
+#include "st-compiled-stylesheet.h"
+#include "st-icon.h"
+#include "st-label.h"
+#include "st-scroll-view.h"
+#include "st-theme.h"
+#include "st-theme-context.h"
+#include "st-theme-private.h"
+
+#define DEFAULT_ITERATIONS 50
+
+typedef enum
+{
+  PHASE_CREATE,
+  PHASE_MATCH,
+  PHASE_CASCADE,
+  PHASE_ACCESSORS,
+  PHASE_INTERN,
+
+  N_PHASES
+} Phase;
+
+static const char *phase_names[N_PHASES] = {
+  "create",
+  "match",
+  "cascade",
+  "accessors",
+  "intern",
+};
+
+typedef struct
+{
+  gint64 time_us;
+  guint64 n_allocations;
+} PhaseTotals;
+
+static StThemeContext *theme_context;
+
+/* Allocations made by the main thread while a phase is measured.
+ * The compositor's own threads keep allocating in the background,
+ * so counting is per thread. */
+static __thread gboolean counting_allocations;
+static __thread guint64 n_allocations;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+  if (counting_allocations)
+    n_allocations++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  if (counting_allocations)
+    n_allocations++;
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  if (counting_allocations)
+    n_allocations++;
+  return __libc_realloc (ptr, size);
+}
+#endif
+
+static void
+phase_begin (gint64 *start_time)
+{
+  counting_allocations = TRUE;
+  n_allocations = 0;
+  *start_time = g_get_monotonic_time ();
+}
+
+static void
+phase_end (PhaseTotals *totals,
+           gint64       start_time)
+{
+  totals->time_us += g_get_monotonic_time () - start_time;
+  counting_allocations = FALSE;
+  totals->n_allocations += n_allocations;
+}
+
+static StThemeNode *
+add_node (GPtrArray   *nodes,
+          StThemeNode *parent,
+          GType        element_type,
+          const char  *element_class,
+          const char  *pseudo_class)
+{
+  StThemeNode *node;
+
+  node = st_theme_node_new (theme_context, parent, NULL,
+                            element_type, NULL, element_class, pseudo_class, NULL);
+  g_ptr_array_add (nodes, node);
+
+  return node;
+}
+
+static void
+build_app_grid (GPtrArray   *nodes,
+                StThemeNode *root)
+{
+  StThemeNode *view, *grid;
+  int i;
+
+  view = add_node (nodes, root, ST_TYPE_SCROLL_VIEW, "apps-scroll-view", NULL);
+  grid = add_node (nodes, view, ST_TYPE_WIDGET, "icon-grid", NULL);
+
+  for (i = 0; i < 96; i++)
+    {
+      StThemeNode *tile, *icon;
+
+      tile = add_node (nodes, grid, ST_TYPE_BUTTON, "overview-tile",
+                       i == 5 ? "hover" : NULL);
+      icon = add_node (nodes, tile, ST_TYPE_BOX_LAYOUT, "overview-icon", NULL);
+      add_node (nodes, icon, ST_TYPE_ICON, NULL, NULL);
+      add_node (nodes, icon, ST_TYPE_LABEL, NULL, NULL);
+
+      if (i % 8 == 0)
+        add_node (nodes, tile, ST_TYPE_WIDGET, "app-grid-running-dot", NULL);
+    }
+
+  add_node (nodes, root, ST_TYPE_BOX_LAYOUT, "page-indicators", NULL);
+}
+
+static void
+build_popup_menu (GPtrArray   *nodes,
+                  StThemeNode *root)
+{
+  StThemeNode *boxpointer, *menu, *content;
+  int i;
+
+  boxpointer = add_node (nodes, root, ST_TYPE_WIDGET, "popup-menu-boxpointer", NULL);
+  menu = add_node (nodes, boxpointer, ST_TYPE_BIN, "popup-menu", NULL);
+  content = add_node (nodes, menu, ST_TYPE_BOX_LAYOUT, "popup-menu-content", NULL);
+
+  for (i = 0; i < 24; i++)
+    {
+      StThemeNode *item;
+
+      if (i % 6 == 5)
+        {
+          item = add_node (nodes, content, ST_TYPE_WIDGET, "popup-separator-menu-item", NULL);
+          add_node (nodes, item, ST_TYPE_WIDGET, "popup-separator-menu-item-separator", NULL);
+          continue;
+        }
+
+      item = add_node (nodes, content, ST_TYPE_BOX_LAYOUT, "popup-menu-item",
+                       i == 2 ? "hover" : NULL);
+      add_node (nodes, item, ST_TYPE_ICON, "popup-menu-ornament", NULL);
+      add_node (nodes, item, ST_TYPE_ICON, "popup-menu-icon", NULL);
+      add_node (nodes, item, ST_TYPE_LABEL, NULL, NULL);
+    }
+}
+
+static void
+build_notification_list (GPtrArray   *nodes,
+                         StThemeNode *root)
+{
+  StThemeNode *list, *view;
+  int i;
+
+  list = add_node (nodes, root, ST_TYPE_BOX_LAYOUT, "message-list", NULL);
+  view = add_node (nodes, list, ST_TYPE_SCROLL_VIEW, "message-view", NULL);
+
+  for (i = 0; i < 32; i++)
+    {
+      StThemeNode *message, *header, *content;
+
+      message = add_node (nodes, view, ST_TYPE_BUTTON, "message",
+                          i == 0 ? "hover" : NULL);
+
+      header = add_node (nodes, message, ST_TYPE_BOX_LAYOUT, "message-header", NULL);
+      add_node (nodes, header, ST_TYPE_ICON, "message-source-icon", NULL);
+      add_node (nodes, header, ST_TYPE_LABEL, "message-source-title", NULL);
+      add_node (nodes, header, ST_TYPE_LABEL, "event-time", NULL);
+      add_node (nodes, header, ST_TYPE_BUTTON, "message-close-button", NULL);
+
+      content = add_node (nodes, message, ST_TYPE_BOX_LAYOUT, "message-content", NULL);
+      add_node (nodes, content, ST_TYPE_LABEL, "message-title", NULL);
+      add_node (nodes, content, ST_TYPE_LABEL, "message-body", NULL);
+    }
+
+  add_node (nodes, list, ST_TYPE_LABEL, "message-list-placeholder", NULL);
+}
+
+static void
+query_node (StThemeNode *node)
+{
+  CoglColor color;
+  StSide side;
+
+  st_theme_node_get_background_color (node, &color);
+  st_theme_node_get_foreground_color (node, &color);
+  st_theme_node_get_font (node);
+  st_theme_node_get_background_image (node);
+  st_theme_node_get_box_shadow (node);
+  st_theme_node_get_text_shadow (node);
+  st_theme_node_get_width (node);
+  st_theme_node_get_height (node);
+  st_theme_node_get_transition_duration (node);
+
+  for (side = ST_SIDE_TOP; side <= ST_SIDE_LEFT; side++)
+    {
+      st_theme_node_get_border_width (node, side);
+      st_theme_node_get_border_color (node, side, &color);
+      st_theme_node_get_padding (node, side);
+      st_theme_node_get_margin (node, side);
+    }
+}
+
+static void
+run_tree (const char *mode_name,
+          const char *tree_name,
+          void      (*build) (GPtrArray   *nodes,
+                              StThemeNode *root),
+          StTheme    *theme,
+          int         iterations)
+{
+  PhaseTotals totals[N_PHASES] = { { 0, } };
+  StThemeNode *root;
+  guint n_nodes = 0;
+  int iteration;
+  Phase phase;
+
+  root = st_theme_context_get_root_node (theme_context);
+
+  for (iteration = 0; iteration < iterations; iteration++)
+    {
+      GPtrArray *nodes = g_ptr_array_new_with_free_func (g_object_unref);
+      gint64 start_time;
+      guint i;
+
+      phase_begin (&start_time);
+      build (nodes, root);
+      phase_end (&totals[PHASE_CREATE], start_time);
+
+      phase_begin (&start_time);
+      for (i = 0; i < nodes->len; i++)
+        g_ptr_array_unref (_st_theme_get_matched_properties (theme, nodes->pdata[i]));
+      phase_end (&totals[PHASE_MATCH], start_time);
+
+      phase_begin (&start_time);
+      for (i = 0; i < nodes->len; i++)
+        {
+          CoglColor color;
+
+          st_theme_node_get_foreground_color (nodes->pdata[i], &color);
+        }
+      phase_end (&totals[PHASE_CASCADE], start_time);
+
+      phase_begin (&start_time);
+      for (i = 0; i < nodes->len; i++)
+        query_node (nodes->pdata[i]);
+      phase_end (&totals[PHASE_ACCESSORS], start_time);
+
+      phase_begin (&start_time);
+      for (i = 0; i < nodes->len; i++)
+        st_theme_context_intern_node (theme_context, nodes->pdata[i]);
+      phase_end (&totals[PHASE_INTERN], start_time);
+
+      n_nodes += nodes->len;
+      g_ptr_array_unref (nodes);
+    }
+
+  for (phase = 0; phase < N_PHASES; phase++)
+    {
+      g_print ("{\"mode\": \"%s\", \"tree\": \"%s\", \"phase\": \"%s\", "
+               "\"nodes\": %u, \"ns_per_node\": %.1f, \"allocs_per_node\": %.2f}\n",
+               mode_name, tree_name, phase_names[phase], n_nodes / iterations,
+               totals[phase].time_us * 1000.0 / n_nodes,
+               (double) totals[phase].n_allocations / n_nodes);
+    }
+}
+
+/* StTheme looks for the compiled form of a stylesheet next to it, so
+ * copy the stylesheet, and @compiled if set, into a directory of their
+ * own; this keeps a compiled stylesheet next to the source one from
+ * being used when benchmarking the parser. */
+static GFile *
+copy_stylesheet (GFile *stylesheet,
+                 GFile *compiled)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GFile) dir = NULL;
+  g_autofree char *dir_path = NULL;
+  g_autofree char *basename = NULL;
+  g_autofree char *compiled_name = NULL;
+  GFile *copy;
+
+  dir_path = g_dir_make_tmp ("st-benchmark-theme-XXXXXX", &error);
+  if (dir_path == NULL)
+    g_error ("Failed to create a temporary directory: %s", error->message);
+
+  dir = g_file_new_for_path (dir_path);
+  basename = g_file_get_basename (stylesheet);
+  copy = g_file_get_child (dir, basename);
+
+  if (!g_file_copy (stylesheet, copy, G_FILE_COPY_NONE, NULL, NULL, NULL, &error))
+    g_error ("Failed to copy the stylesheet: %s", error->message);
+
+  if (compiled != NULL)
+    {
+      g_autoptr (GFile) compiled_copy = NULL;
+
+      compiled_name = g_strconcat (basename, ST_COMPILED_STYLESHEET_SUFFIX, NULL);
+      compiled_copy = g_file_get_child (dir, compiled_name);
+
+      if (!g_file_copy (compiled, compiled_copy, G_FILE_COPY_NONE,
+                        NULL, NULL, NULL, &error))
+        g_error ("Failed to copy the compiled stylesheet: %s", error->message);
+    }
+
+  return copy;
+}
+
+static void
+remove_stylesheet (GFile *copy)
+{
+  g_autoptr (GFile) dir = g_file_get_parent (copy);
+  g_autoptr (GFileEnumerator) enumerator = NULL;
+  GFile *child;
+
+  enumerator = g_file_enumerate_children (dir, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                          G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  while (enumerator != NULL &&
+         g_file_enumerator_iterate (enumerator, NULL, &child, NULL, NULL) &&
+         child != NULL)
+    g_file_delete (child, NULL, NULL);
+
+  g_file_delete (dir, NULL, NULL);
+}
+
+static void
+run_mode (const char *mode_name,
+          GFile      *stylesheet,
+          GFile      *compiled,
+          int         iterations)
+{
+  g_autoptr (GFile) file = NULL;
+  PhaseTotals load_totals = { 0, };
+  StTheme *theme;
+  int iteration;
+
+  file = copy_stylesheet (stylesheet, compiled);
+
+  for (iteration = 0; iteration < iterations; iteration++)
+    {
+      gint64 start_time;
+
+      phase_begin (&start_time);
+      theme = st_theme_new (NULL, file, NULL);
+      phase_end (&load_totals, start_time);
+
+      g_object_unref (theme);
+    }
+
+  g_print ("{\"mode\": \"%s\", \"phase\": \"load\", "
+           "\"us_per_load\": %.1f, \"allocs_per_load\": %.1f}\n",
+           mode_name,
+           (double) load_totals.time_us / iterations,
+           (double) load_totals.n_allocations / iterations);
+
+  theme = st_theme_new (NULL, file, NULL);
+  st_theme_context_set_theme (theme_context, theme);
+
+  run_tree (mode_name, "app-grid", build_app_grid, theme, iterations);
+  run_tree (mode_name, "popup-menu", build_popup_menu, theme, iterations);
+  run_tree (mode_name, "notification-list", build_notification_list, theme, iterations);
+
+  g_object_unref (theme);
+  remove_stylesheet (file);
+}
+
+int
+main (int argc, char **argv)
+{
+  MetaContext *context;
+  g_autoptr (GError) error = NULL;
+  MetaBackend *backend;
+  ClutterActor *stage;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) compiled = NULL;
+  g_autofree char *cwd = NULL;
+  int iterations = DEFAULT_ITERATIONS;
+
+  /* meta_init() cds to $HOME */
+  cwd = g_get_current_dir ();
+
+  context = meta_create_test_context (META_CONTEXT_TEST_TYPE_TEST,
+                                      META_CONTEXT_TEST_FLAG_NONE);
+  if (!meta_context_configure (context, &argc, &argv, &error))
+    g_error ("Failed to configure: %s", error->message);
+
+  if (argc < 2)
+    g_error ("Usage: %s STYLESHEET [COMPILED-STYLESHEET] [ITERATIONS]", argv[0]);
+
+  file = g_file_new_for_commandline_arg (argv[1]);
+  argv++, argc--;
+
+  if (argc > 1 && g_str_has_suffix (argv[1], ST_COMPILED_STYLESHEET_SUFFIX))
+    {
+      compiled = g_file_new_for_commandline_arg (argv[1]);
+      argv++, argc--;
+    }
+
+  if (argc > 1)
+    iterations = MAX (atoi (argv[1]), 1);
+
+  if (!meta_context_setup (context, &error))
+    g_error ("Failed to setup: %s", error->message);
+
+  if (chdir (cwd) < 0)
+    g_error ("chdir('%s') failed: %s", cwd, g_strerror (errno));
+
+  backend = meta_context_get_backend (context);
+  stage = meta_backend_get_stage (backend);
+
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+
+  run_mode ("parsed", file, NULL, iterations);
+  if (compiled != NULL)
+    run_mode ("compiled", file, compiled, iterations);
+
+  g_object_unref (context);
+
+  return EXIT_SUCCESS;
+}
@@ -93,6 +93,9 @@ cr_declaration_new (CRStatement * a_statement,
         }
         memset (result, 0, sizeof (CRDeclaration));
         result->property = a_property;
+        if (a_property->stryng)
+                result->property_quark =
+                        g_quark_from_string (a_property->stryng->str);
         result->value = a_value;
 
         if (a_value) {
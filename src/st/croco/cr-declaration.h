@@ -63,6 +63,9 @@ struct _CRDeclaration
 	/*does the declaration have the important keyword ?*/
 	gboolean important ;
 
+	/*the property name, interned as a GQuark*/
+	GQuark property_quark ;
+
 	glong ref_count ;
 
 	CRParsingLocation location ;
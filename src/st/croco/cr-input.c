@@ -78,6 +78,26 @@ struct _CRInputPriv {
 
 #define PRIVATE(object) (object)->priv
 
+#define W CR_ASCII_WHITE_SPACE
+#define N CR_ASCII_NMCHAR
+
+/**
+ *The #CRAsciiClass of each ascii character.
+ */
+static const guint8 gv_ascii_classes[128] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, W, W, 0, W, W, 0, 0, /* 0x00 */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x10 */
+        W, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, N, 0, 0, /* 0x20 */
+        N, N, N, N, N, N, N, N, N, N, 0, 0, 0, 0, 0, 0, /* 0x30 */
+        0, N, N, N, N, N, N, N, N, N, N, N, N, N, N, N, /* 0x40 */
+        N, N, N, N, N, N, N, N, N, N, N, 0, 0, 0, 0, N, /* 0x50 */
+        0, N, N, N, N, N, N, N, N, N, N, N, N, N, N, N, /* 0x60 */
+        N, N, N, N, N, N, N, N, N, N, N, 0, 0, 0, 0, 0  /* 0x70 */
+};
+
+#undef W
+#undef N
+
 /***************************
  *private constants
  **************************/
@@ -85,6 +105,8 @@ struct _CRInputPriv {
 
 static CRInput *cr_input_new_real (void);
 
+static void cr_input_advance_ascii (CRInput * a_this, gulong a_len);
+
 static CRInput *
 cr_input_new_real (void)
 {
@@ -463,11 +485,18 @@ cr_input_read_char (CRInput * a_this, guint32 * a_char)
                 return CR_END_OF_INPUT_ERROR;
         }
 
-        status = cr_utils_read_char_from_utf8_buf
-                (PRIVATE (a_this)->in_buf
-                 +
-                 PRIVATE (a_this)->next_byte_index,
-                 nb_bytes_left, a_char, &consumed);
+        if (PRIVATE (a_this)->in_buf[PRIVATE (a_this)->next_byte_index]
+            < 0x80) {
+                *a_char = PRIVATE (a_this)->in_buf
+                        [PRIVATE (a_this)->next_byte_index];
+                consumed = 1;
+        } else {
+                status = cr_utils_read_char_from_utf8_buf
+                        (PRIVATE (a_this)->in_buf
+                         +
+                         PRIVATE (a_this)->next_byte_index,
+                         nb_bytes_left, a_char, &consumed);
+        }
 
         if (status == CR_OK) {
                 /*update next byte index */
@@ -704,13 +733,16 @@ enum CRStatus
 cr_input_consume_white_spaces (CRInput * a_this, gulong * a_nb_chars)
 {
         enum CRStatus status = CR_OK;
-        guint32 cur_char = 0,
-                nb_consumed = 0;
+        guint32 cur_char = 0;
+        gulong nb_consumed = 0;
 
         g_return_val_if_fail (a_this && PRIVATE (a_this) && a_nb_chars,
                               CR_BAD_PARAM_ERROR);
 
-        for (nb_consumed = 0;
+        nb_consumed = cr_input_consume_ascii_run
+                (a_this, CR_ASCII_WHITE_SPACE, *a_nb_chars, NULL);
+
+        for (;
              ((*a_nb_chars > 0) && (nb_consumed < *a_nb_chars));
              nb_consumed++) {
                 status = cr_input_peek_char (a_this, &cur_char);
@@ -738,6 +770,155 @@ cr_input_consume_white_spaces (CRInput * a_this, gulong * a_nb_chars)
         return status;
 }
 
+/**
+ *Moves the current position a_len ascii characters forward,
+ *updating the line and column numbers exactly as a_len calls
+ *to cr_input_read_char() would.
+ */
+static void
+cr_input_advance_ascii (CRInput * a_this, gulong a_len)
+{
+        const guchar *cur =
+                PRIVATE (a_this)->in_buf + PRIVATE (a_this)->next_byte_index;
+        const guchar *end = cur + a_len;
+
+        while (cur < end) {
+                const guchar *nl = memchr (cur, '\n', end - cur);
+                gulong nb_chars = (nl ? nl : end) - cur;
+
+                if (nb_chars > 0) {
+                        if (PRIVATE (a_this)->end_of_line == TRUE) {
+                                PRIVATE (a_this)->col = 1;
+                                PRIVATE (a_this)->line++;
+                                PRIVATE (a_this)->end_of_line = FALSE;
+                                nb_chars--;
+                        }
+                        PRIVATE (a_this)->col += nb_chars;
+                }
+
+                if (!nl)
+                        break;
+
+                if (PRIVATE (a_this)->end_of_line == TRUE) {
+                        PRIVATE (a_this)->col = 1;
+                        PRIVATE (a_this)->line++;
+                }
+                PRIVATE (a_this)->end_of_line = TRUE;
+                cur = nl + 1;
+        }
+
+        PRIVATE (a_this)->next_byte_index += a_len;
+}
+
+/**
+ * cr_input_consume_ascii_run:
+ *@a_this: the "this pointer" of the current instance of #CRInput.
+ *@a_classes: a mask of #CRAsciiClass values.
+ *@a_max: the maximum number of characters to consume.
+ *@a_str: if not NULL, the consumed characters are appended to it.
+ *
+ *Consumes the longest run of ascii characters that belong to one
+ *of @a_classes, without decoding them one by one. Line and column
+ *numbers are updated as cr_input_read_char() would.
+ *
+ *Returns the number of characters consumed.
+ */
+gulong
+cr_input_consume_ascii_run (CRInput * a_this, guint a_classes,
+                            gulong a_max, GString * a_str)
+{
+        const guchar *start = NULL;
+        glong nb_bytes_left = 0;
+        gulong len = 0;
+
+        g_return_val_if_fail (a_this && PRIVATE (a_this), 0);
+
+        nb_bytes_left = cr_input_get_nb_bytes_left (a_this);
+        if (nb_bytes_left <= 0)
+                return 0;
+
+        if ((gulong) nb_bytes_left < a_max)
+                a_max = nb_bytes_left;
+
+        start = PRIVATE (a_this)->in_buf + PRIVATE (a_this)->next_byte_index;
+        while (len < a_max
+               && start[len] < 0x80
+               && (gv_ascii_classes[start[len]] & a_classes))
+                len++;
+
+        if (len) {
+                if (a_str)
+                        g_string_append_len (a_str, (const gchar *) start,
+                                             len);
+                cr_input_advance_ascii (a_this, len);
+        }
+
+        return len;
+}
+
+/**
+ * cr_input_consume_ascii_until:
+ *@a_this: the "this pointer" of the current instance of #CRInput.
+ *@a_byte: the ascii character to stop at.
+ *@a_str: if not NULL, the consumed characters are appended to it.
+ *
+ *Consumes ascii characters up to, but not including, the next
+ *occurrence of @a_byte, the next non-ascii character or the end of
+ *the input, whichever comes first. The input is scanned a machine
+ *word at a time, which makes skipping over long runs such as
+ *comment bodies cheap. Line and column numbers are updated as
+ *cr_input_read_char() would.
+ *
+ *Returns the number of characters consumed.
+ */
+gulong
+cr_input_consume_ascii_until (CRInput * a_this, guchar a_byte,
+                              GString * a_str)
+{
+        const guint64 ones = G_GUINT64_CONSTANT (0x0101010101010101);
+        const guint64 highs = G_GUINT64_CONSTANT (0x8080808080808080);
+        const guint64 pattern = ones * a_byte;
+        const guchar *start = NULL;
+        glong nb_bytes_left = 0;
+        gulong len = 0;
+
+        g_return_val_if_fail (a_this && PRIVATE (a_this) && a_byte < 0x80,
+                              0);
+
+        nb_bytes_left = cr_input_get_nb_bytes_left (a_this);
+        if (nb_bytes_left <= 0)
+                return 0;
+
+        start = PRIVATE (a_this)->in_buf + PRIVATE (a_this)->next_byte_index;
+
+        /*
+         *A word is skipped as a whole if none of its bytes has its
+         *high bit set (non-ascii) and none of them equals a_byte,
+         *i.e, if (word ^ pattern) has no zero byte.
+         */
+        for (; len + sizeof (guint64) <= (gulong) nb_bytes_left;
+             len += sizeof (guint64)) {
+                guint64 word, diff;
+
+                memcpy (&word, start + len, sizeof (guint64));
+                diff = word ^ pattern;
+                if ((((diff - ones) & ~diff) | word) & highs)
+                        break;
+        }
+        while (len < (gulong) nb_bytes_left
+               && start[len] < 0x80 && start[len] != a_byte)
+                len++;
+
+        if (len) {
+                if (a_str)
+                        g_string_append_len (a_str, (const gchar *) start,
+                                             len);
+                cr_input_advance_ascii (a_this, len);
+        }
+
+        return len;
+}
+
 /**
  * cr_input_peek_char:
  *@a_this: the current instance of #CRInput.
@@ -772,6 +953,14 @@ cr_input_peek_char (CRInput const * a_this, guint32 * a_char)
                 return CR_END_OF_INPUT_ERROR;
         }
 
+        /*ascii is by far the most common case in stylesheets*/
+        if (PRIVATE (a_this)->in_buf[PRIVATE (a_this)->next_byte_index]
+            < 0x80) {
+                *a_char = PRIVATE (a_this)->in_buf
+                        [PRIVATE (a_this)->next_byte_index];
+                return CR_OK;
+        }
+
         status = cr_utils_read_char_from_utf8_buf
                 (PRIVATE (a_this)->in_buf +
                  PRIVATE (a_this)->next_byte_index,
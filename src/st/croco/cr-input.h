@@ -59,6 +59,16 @@ struct _CRInputPos
         glong next_byte_index ;
 } ;
 
+/**
+ *Classes of ascii characters that the tokenizer
+ *consumes in bulk, see cr_input_consume_ascii_run().
+ */
+enum CRAsciiClass
+{
+        CR_ASCII_WHITE_SPACE = 1 << 0, /* [ \t\r\n\f] */
+        CR_ASCII_NMCHAR = 1 << 1 /* [a-zA-Z0-9_-] */
+} ;
+
 CRInput *
 cr_input_new_from_buf (guchar *a_buf, gulong a_len,
                        enum CREncoding a_enc, gboolean a_free_buf) ;
@@ -91,6 +101,14 @@ cr_input_consume_char (CRInput *a_this, guint32 a_char) ;
 enum CRStatus
 cr_input_consume_white_spaces (CRInput *a_this, gulong *a_nb_chars) ;
 
+gulong
+cr_input_consume_ascii_run (CRInput *a_this, guint a_classes,
+                            gulong a_max, GString *a_str) ;
+
+gulong
+cr_input_consume_ascii_until (CRInput *a_this, guchar a_byte,
+                              GString *a_str) ;
+
 enum CRStatus
 cr_input_peek_byte (CRInput const *a_this, enum CRSeekPos a_origin,
                     gulong a_offset, guchar *a_byte) ;
@@ -127,6 +127,17 @@ struct _CRTerm
          */
         gpointer app_data ;
 
+        /*
+         *The color a function term evaluates to, as 0xRRGGBBAA,
+         *cached by the application. It's valid while
+         *cached_color_generation matches the accent generation of
+         *the theme context. Generations start at 1, so a
+         *cached_color_generation of 0 means that cached_color is
+         *unset, whatever its value.
+         */
+        guint32 cached_color ;
+        guint cached_color_generation ;
+
         glong ref_count ;
 
         /**
@@ -290,6 +290,12 @@ cr_tknzr_parse_w (CRTknzr * a_this,
         RECORD_CUR_BYTE_ADDR (a_this, a_start);
         *a_end = *a_start;
 
+        if (cr_input_consume_ascii_run (PRIVATE (a_this)->input,
+                                        CR_ASCII_WHITE_SPACE, G_MAXULONG,
+                                        NULL) > 0) {
+                RECORD_CUR_BYTE_ADDR (a_this, a_end);
+        }
+
         for (;;) {
                 gboolean is_eof = FALSE;
 
@@ -448,6 +454,8 @@ cr_tknzr_parse_comment (CRTknzr * a_this,
         ENSURE_PARSING_COND (cur_char == '*');
         comment = cr_string_new ();
         for (;;) { /* [^*]* */
+                cr_input_consume_ascii_until (PRIVATE (a_this)->input, '*',
+                                              comment->stryng);
                 PEEK_NEXT_CHAR (a_this, &next_char);
                 if (next_char == '*')
                         break;
@@ -470,6 +478,9 @@ cr_tknzr_parse_comment (CRTknzr * a_this,
                 READ_NEXT_CHAR(a_this, &cur_char);
                 g_string_append_unichar (comment->stryng, cur_char);
                 for (;;) { /* [^*]* */
+                        cr_input_consume_ascii_until
+                                (PRIVATE (a_this)->input, '*',
+                                 comment->stryng);
                         PEEK_NEXT_CHAR (a_this, &next_char);
                         if (next_char == '*')
                                 break;
@@ -964,6 +975,10 @@ cr_tknzr_parse_ident (CRTknzr * a_this, CRString ** a_str)
         }
         g_string_append_unichar (stringue->stryng, tmp_char);
         for (;;) {
+                /*plain ascii nmchars need no escape or utf8 handling*/
+                cr_input_consume_ascii_run (PRIVATE (a_this)->input,
+                                            CR_ASCII_NMCHAR, G_MAXULONG,
+                                            stringue->stryng);
                 status = cr_tknzr_parse_nmchar (a_this, 
                                                 &tmp_char, 
                                                 NULL);
@@ -1049,6 +1064,9 @@ cr_tknzr_parse_name (CRTknzr * a_this,
                         break;                
                 g_string_append_unichar ((*a_str)->stryng, 
                                          tmp_char);
+                cr_input_consume_ascii_run (PRIVATE (a_this)->input,
+                                            CR_ASCII_NMCHAR, G_MAXULONG,
+                                            (*a_str)->stryng);
         }
         if (i > 0) {
                 cr_parsing_location_copy 
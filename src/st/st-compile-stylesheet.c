@@ -0,0 +1,80 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-compile-stylesheet.c: Build-time generator for compiled stylesheets
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "st-compiled-stylesheet.h"
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GBytes) source = NULL;
+  g_autoptr (GBytes) compiled = NULL;
+  CRStyleSheet *stylesheet;
+  enum CRStatus status;
+  char *contents;
+  gsize length;
+
+  if (argc != 3)
+    {
+      g_printerr ("Usage: %s INPUT.css OUTPUT.css%s\n",
+                  argv[0], ST_COMPILED_STYLESHEET_SUFFIX);
+      return EXIT_FAILURE;
+    }
+
+  if (!g_file_get_contents (argv[1], &contents, &length, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  source = g_bytes_new_take (contents, length);
+
+  status = cr_om_parser_simply_parse_buf ((const guchar *) contents,
+                                          length,
+                                          CR_UTF_8,
+                                          &stylesheet);
+  if (status != CR_OK)
+    {
+      g_printerr ("Error parsing stylesheet '%s'; errcode:%d\n",
+                  argv[1], status);
+      return EXIT_FAILURE;
+    }
+
+  compiled = _st_compiled_stylesheet_new (stylesheet, source, &error);
+  cr_stylesheet_destroy (stylesheet);
+
+  if (compiled == NULL)
+    {
+      g_printerr ("Can't compile stylesheet '%s': %s\n",
+                  argv[1], error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (!g_file_set_contents (argv[2],
+                            g_bytes_get_data (compiled, NULL),
+                            g_bytes_get_size (compiled),
+                            &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
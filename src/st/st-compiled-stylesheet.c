@@ -0,0 +1,856 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-compiled-stylesheet.c: Precompiled form of a CSS stylesheet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Parsing the bundled theme with libcroco means tokenizing a few
+ * hundred kilobytes of CSS at every startup. A compiled stylesheet
+ * stores the result of that parse as a flat table that can be mapped
+ * straight out of a file or GResource. Loading it still builds the
+ * libcroco statements, selectors and terms StTheme works with, but
+ * from the table, which skips tokenizing and parsing the CSS:
+ *
+ *   header:  magic, format version, SHA-256 of the CSS source
+ *   strings: NUL-terminated strings, referenced by byte offset
+ *   records: the statements, as a stream of little-endian 32-bit words
+ *
+ * The table is only used when the digest matches the source it sits
+ * next to, so an edited stylesheet silently falls back to the parser.
+ *
+ * Only what StTheme consumes is stored: rulesets and @import rules.
+ * @media, @page, @font-face and @charset rules never take part in the
+ * cascade and are dropped.
+ */
+
+#include <string.h>
+
+#include "st-compiled-stylesheet.h"
+
+#define COMPILED_MAGIC "StCSS\r\n\032"
+#define COMPILED_VERSION 1
+
+#define NO_STRING G_MAXUINT32
+
+/* Bounds recursion through nested function terms like
+ * st-lighten(st-mix(...)) when reading untrusted data */
+#define MAX_TERM_NESTING 32
+
+typedef struct
+{
+  char    magic[8];
+  guint32 version;
+  guint32 strings_size;
+  guint32 n_words;
+  guint32 reserved;
+  guint8  source_digest[32];
+} CompiledHeader;
+
+G_STATIC_ASSERT (sizeof (CompiledHeader) == 56);
+
+static void
+compute_digest (GBytes *source,
+                guint8  digest[32])
+{
+  GChecksum *checksum;
+  gsize digest_len = 32;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum,
+                     g_bytes_get_data (source, NULL),
+                     g_bytes_get_size (source));
+  g_checksum_get_digest (checksum, digest, &digest_len);
+  g_checksum_free (checksum);
+}
+
+/* Writing */
+
+typedef struct
+{
+  GByteArray *strings;
+  GHashTable *string_offsets;
+  GArray *words;
+} Writer;
+
+static void
+write_word (Writer  *writer,
+            guint32  word)
+{
+  word = GUINT32_TO_LE (word);
+  g_array_append_val (writer->words, word);
+}
+
+static void
+write_double (Writer *writer,
+              double  value)
+{
+  guint64 bits;
+
+  memcpy (&bits, &value, sizeof (bits));
+  write_word (writer, (guint32) (bits & G_MAXUINT32));
+  write_word (writer, (guint32) (bits >> 32));
+}
+
+static void
+write_string (Writer   *writer,
+              CRString *str)
+{
+  gpointer offset;
+
+  if (str == NULL || str->stryng == NULL)
+    {
+      write_word (writer, NO_STRING);
+      return;
+    }
+
+  if (!g_hash_table_lookup_extended (writer->string_offsets, str->stryng->str,
+                                     NULL, &offset))
+    {
+      offset = GUINT_TO_POINTER (writer->strings->len);
+      g_byte_array_append (writer->strings,
+                           (const guint8 *) str->stryng->str,
+                           strlen (str->stryng->str) + 1);
+      g_hash_table_insert (writer->string_offsets,
+                           g_strdup (str->stryng->str), offset);
+    }
+
+  write_word (writer, GPOINTER_TO_UINT (offset));
+}
+
+static gboolean
+write_terms (Writer  *writer,
+             CRTerm  *terms,
+             GError **error)
+{
+  CRTerm *term;
+  guint n_terms = 0;
+
+  for (term = terms; term; term = term->next)
+    n_terms++;
+
+  write_word (writer, n_terms);
+
+  for (term = terms; term; term = term->next)
+    {
+      write_word (writer, term->type);
+      write_word (writer, term->unary_op);
+      write_word (writer, term->the_operator);
+
+      switch (term->type)
+        {
+        case TERM_NUMBER:
+          write_word (writer, term->content.num->type);
+          write_double (writer, term->content.num->val);
+          break;
+
+        case TERM_FUNCTION:
+          write_string (writer, term->content.str);
+          if (!write_terms (writer, term->ext_content.func_param, error))
+            return FALSE;
+          break;
+
+        case TERM_STRING:
+        case TERM_IDENT:
+        case TERM_URI:
+        case TERM_HASH:
+          write_string (writer, term->content.str);
+          break;
+
+        case TERM_RGB:
+          write_word (writer, (guint32) term->content.rgb->red);
+          write_word (writer, (guint32) term->content.rgb->green);
+          write_word (writer, (guint32) term->content.rgb->blue);
+          write_word (writer, term->content.rgb->is_percentage);
+          break;
+
+        case TERM_UNICODERANGE:
+        case TERM_NO_TYPE:
+        default:
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                       "Unsupported term type %d", term->type);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+write_additional_sels (Writer          *writer,
+                       CRAdditionalSel *add_sels,
+                       GError         **error)
+{
+  CRAdditionalSel *add_sel;
+  guint n_add_sels = 0;
+
+  for (add_sel = add_sels; add_sel; add_sel = add_sel->next)
+    n_add_sels++;
+
+  write_word (writer, n_add_sels);
+
+  for (add_sel = add_sels; add_sel; add_sel = add_sel->next)
+    {
+      write_word (writer, add_sel->type);
+
+      switch (add_sel->type)
+        {
+        case CLASS_ADD_SELECTOR:
+          write_string (writer, add_sel->content.class_name);
+          break;
+
+        case ID_ADD_SELECTOR:
+          write_string (writer, add_sel->content.id_name);
+          break;
+
+        case PSEUDO_CLASS_ADD_SELECTOR:
+          write_word (writer, add_sel->content.pseudo->type);
+          write_string (writer, add_sel->content.pseudo->name);
+          write_string (writer, add_sel->content.pseudo->extra);
+          break;
+
+        case ATTRIBUTE_ADD_SELECTOR:
+          {
+            CRAttrSel *attr_sel;
+            guint n_attr_sels = 0;
+
+            for (attr_sel = add_sel->content.attr_sel; attr_sel; attr_sel = attr_sel->next)
+              n_attr_sels++;
+
+            write_word (writer, n_attr_sels);
+
+            for (attr_sel = add_sel->content.attr_sel; attr_sel; attr_sel = attr_sel->next)
+              {
+                write_string (writer, attr_sel->name);
+                write_string (writer, attr_sel->value);
+                write_word (writer, attr_sel->match_way);
+              }
+          }
+          break;
+
+        case NO_ADD_SELECTOR:
+        default:
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                       "Unsupported selector type %d", add_sel->type);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+write_ruleset (Writer    *writer,
+               CRRuleSet *ruleset,
+               GError   **error)
+{
+  CRSelector *sel;
+  CRDeclaration *decl;
+  guint n_sels = 0, n_decls = 0;
+
+  for (sel = ruleset->sel_list; sel; sel = sel->next)
+    n_sels++;
+
+  write_word (writer, n_sels);
+
+  for (sel = ruleset->sel_list; sel; sel = sel->next)
+    {
+      CRSimpleSel *simple_sel;
+      guint n_simple_sels = 0;
+
+      for (simple_sel = sel->simple_sel; simple_sel; simple_sel = simple_sel->next)
+        n_simple_sels++;
+
+      write_word (writer, n_simple_sels);
+
+      for (simple_sel = sel->simple_sel; simple_sel; simple_sel = simple_sel->next)
+        {
+          write_word (writer, simple_sel->type_mask);
+          write_word (writer, simple_sel->is_case_sentive);
+          write_string (writer, simple_sel->name);
+          write_word (writer, simple_sel->combinator);
+
+          if (!write_additional_sels (writer, simple_sel->add_sel, error))
+            return FALSE;
+        }
+    }
+
+  for (decl = ruleset->decl_list; decl; decl = decl->next)
+    n_decls++;
+
+  write_word (writer, n_decls);
+
+  for (decl = ruleset->decl_list; decl; decl = decl->next)
+    {
+      write_string (writer, decl->property);
+      write_word (writer, decl->important);
+
+      if (!write_terms (writer, decl->value, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * _st_compiled_stylesheet_new:
+ * @stylesheet: a stylesheet parsed from @source
+ * @source: the CSS text @stylesheet was parsed from
+ * @error: location to store error
+ *
+ * Serializes @stylesheet into the compiled format, keyed by the
+ * digest of @source.
+ *
+ * Returns: (transfer full): the compiled stylesheet, or %NULL if
+ *   @stylesheet uses something the format can't represent
+ */
+GBytes *
+_st_compiled_stylesheet_new (CRStyleSheet  *stylesheet,
+                             GBytes        *source,
+                             GError       **error)
+{
+  static const guint8 padding[4] = { 0 };
+  CompiledHeader header = { 0 };
+  CRStatement *stmt;
+  GByteArray *result;
+  Writer writer;
+  guint n_stmts = 0;
+  gboolean success = TRUE;
+
+  writer.strings = g_byte_array_new ();
+  writer.string_offsets = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, NULL);
+  writer.words = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  for (stmt = stylesheet->statements; stmt; stmt = stmt->next)
+    if (stmt->type == RULESET_STMT || stmt->type == AT_IMPORT_RULE_STMT)
+      n_stmts++;
+
+  write_word (&writer, n_stmts);
+
+  for (stmt = stylesheet->statements; stmt && success; stmt = stmt->next)
+    {
+      switch (stmt->type)
+        {
+        case RULESET_STMT:
+          write_word (&writer, RULESET_STMT);
+          success = write_ruleset (&writer, stmt->kind.ruleset, error);
+          break;
+
+        case AT_IMPORT_RULE_STMT:
+          write_word (&writer, AT_IMPORT_RULE_STMT);
+          write_string (&writer, stmt->kind.import_rule->url);
+          break;
+
+        case AT_MEDIA_RULE_STMT:
+        case AT_RULE_STMT:
+        case AT_PAGE_RULE_STMT:
+        case AT_CHARSET_RULE_STMT:
+        case AT_FONT_FACE_RULE_STMT:
+        default:
+          break;
+        }
+    }
+
+  if (success && writer.strings->len >= G_MAXUINT32 - 3)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Stylesheet is too large");
+      success = FALSE;
+    }
+
+  if (!success)
+    {
+      g_byte_array_unref (writer.strings);
+      g_hash_table_destroy (writer.string_offsets);
+      g_array_unref (writer.words);
+      return NULL;
+    }
+
+  memcpy (header.magic, COMPILED_MAGIC, sizeof (header.magic));
+  header.version = GUINT32_TO_LE (COMPILED_VERSION);
+  header.strings_size = GUINT32_TO_LE (writer.strings->len);
+  header.n_words = GUINT32_TO_LE (writer.words->len);
+  compute_digest (source, header.source_digest);
+
+  result = g_byte_array_new ();
+  g_byte_array_append (result, (const guint8 *) &header, sizeof (header));
+  g_byte_array_append (result, writer.strings->data, writer.strings->len);
+  g_byte_array_append (result, padding, (4 - writer.strings->len % 4) % 4);
+  g_byte_array_append (result, (const guint8 *) writer.words->data,
+                       writer.words->len * sizeof (guint32));
+
+  g_byte_array_unref (writer.strings);
+  g_hash_table_destroy (writer.string_offsets);
+  g_array_unref (writer.words);
+
+  return g_byte_array_free_to_bytes (result);
+}
+
+/* Reading
+ *
+ * Every reader stops at the first inconsistency and flags it; the
+ * partially built stylesheet is then thrown away as a whole.
+ */
+
+typedef struct
+{
+  const char *strings;
+  gsize strings_size;
+  const guint8 *words;
+  gsize n_words;
+  gsize pos;
+  gboolean error;
+} Reader;
+
+static guint32
+read_word (Reader *reader)
+{
+  guint32 word;
+
+  if (reader->error || reader->pos >= reader->n_words)
+    {
+      reader->error = TRUE;
+      return 0;
+    }
+
+  memcpy (&word, reader->words + reader->pos * sizeof (guint32), sizeof (word));
+  reader->pos++;
+
+  return GUINT32_FROM_LE (word);
+}
+
+/* Every counted item takes at least one word, which bounds how much a
+ * corrupt count can make us allocate */
+static guint32
+read_count (Reader *reader)
+{
+  guint32 count = read_word (reader);
+
+  if (count > reader->n_words - reader->pos)
+    {
+      reader->error = TRUE;
+      return 0;
+    }
+
+  return count;
+}
+
+static double
+read_double (Reader *reader)
+{
+  guint64 bits;
+  double value;
+
+  bits = read_word (reader);
+  bits |= (guint64) read_word (reader) << 32;
+  memcpy (&value, &bits, sizeof (value));
+
+  return value;
+}
+
+static CRString *
+read_string (Reader   *reader,
+             gboolean  nullable)
+{
+  guint32 offset = read_word (reader);
+
+  if (reader->error)
+    return NULL;
+
+  if (offset == NO_STRING && nullable)
+    return NULL;
+
+  if (offset >= reader->strings_size)
+    {
+      reader->error = TRUE;
+      return NULL;
+    }
+
+  return cr_string_new_from_string (reader->strings + offset);
+}
+
+static CRTerm *
+read_terms (Reader *reader,
+            guint   nesting)
+{
+  CRTerm *terms = NULL;
+  guint32 i, n_terms;
+
+  if (nesting > MAX_TERM_NESTING)
+    {
+      reader->error = TRUE;
+      return NULL;
+    }
+
+  n_terms = read_count (reader);
+
+  for (i = 0; i < n_terms && !reader->error; i++)
+    {
+      CRTerm *term = cr_term_new ();
+      guint32 type;
+
+      terms = cr_term_append_term (terms, term);
+
+      type = read_word (reader);
+      term->unary_op = read_word (reader);
+      term->the_operator = read_word (reader);
+
+      switch (type)
+        {
+        case TERM_NUMBER:
+          {
+            enum CRNumType num_type = read_word (reader);
+            double val = read_double (reader);
+
+            cr_term_set_number (term, cr_num_new_with_val (val, num_type));
+          }
+          break;
+
+        case TERM_FUNCTION:
+          {
+            CRString *name = read_string (reader, FALSE);
+            CRTerm *params = read_terms (reader, nesting + 1);
+
+            cr_term_set_function (term, name, params);
+          }
+          break;
+
+        case TERM_STRING:
+          cr_term_set_string (term, read_string (reader, FALSE));
+          break;
+
+        case TERM_IDENT:
+          cr_term_set_ident (term, read_string (reader, FALSE));
+          break;
+
+        case TERM_URI:
+          cr_term_set_uri (term, read_string (reader, FALSE));
+          break;
+
+        case TERM_HASH:
+          cr_term_set_hash (term, read_string (reader, FALSE));
+          break;
+
+        case TERM_RGB:
+          {
+            CRRgb *rgb = cr_rgb_new ();
+
+            rgb->red = (gint32) read_word (reader);
+            rgb->green = (gint32) read_word (reader);
+            rgb->blue = (gint32) read_word (reader);
+            rgb->is_percentage = read_word (reader) != 0;
+
+            cr_term_set_rgb (term, rgb);
+          }
+          break;
+
+        default:
+          reader->error = TRUE;
+          break;
+        }
+    }
+
+  if (reader->error && terms)
+    {
+      cr_term_destroy (terms);
+      return NULL;
+    }
+
+  return terms;
+}
+
+static CRAttrSel *
+read_attr_sels (Reader *reader)
+{
+  CRAttrSel *attr_sels = NULL;
+  guint32 i, n_attr_sels;
+
+  n_attr_sels = read_count (reader);
+
+  for (i = 0; i < n_attr_sels && !reader->error; i++)
+    {
+      CRAttrSel *attr_sel = cr_attr_sel_new ();
+
+      if (attr_sels)
+        cr_attr_sel_append_attr_sel (attr_sels, attr_sel);
+      else
+        attr_sels = attr_sel;
+
+      attr_sel->name = read_string (reader, FALSE);
+      attr_sel->value = read_string (reader, TRUE);
+      attr_sel->match_way = read_word (reader);
+    }
+
+  if (reader->error && attr_sels)
+    {
+      cr_attr_sel_destroy (attr_sels);
+      return NULL;
+    }
+
+  return attr_sels;
+}
+
+static CRAdditionalSel *
+read_additional_sels (Reader *reader)
+{
+  CRAdditionalSel *add_sels = NULL;
+  guint32 i, n_add_sels;
+
+  n_add_sels = read_count (reader);
+
+  for (i = 0; i < n_add_sels && !reader->error; i++)
+    {
+      enum AddSelectorType type = read_word (reader);
+      CRAdditionalSel *add_sel;
+
+      switch (type)
+        {
+        case CLASS_ADD_SELECTOR:
+          add_sel = cr_additional_sel_new_with_type (type);
+          add_sel->content.class_name = read_string (reader, FALSE);
+          break;
+
+        case ID_ADD_SELECTOR:
+          add_sel = cr_additional_sel_new_with_type (type);
+          add_sel->content.id_name = read_string (reader, FALSE);
+          break;
+
+        case PSEUDO_CLASS_ADD_SELECTOR:
+          add_sel = cr_additional_sel_new_with_type (type);
+          add_sel->content.pseudo = cr_pseudo_new ();
+          add_sel->content.pseudo->type = read_word (reader);
+          add_sel->content.pseudo->name = read_string (reader, FALSE);
+          add_sel->content.pseudo->extra = read_string (reader, TRUE);
+          break;
+
+        case ATTRIBUTE_ADD_SELECTOR:
+          add_sel = cr_additional_sel_new_with_type (type);
+          add_sel->content.attr_sel = read_attr_sels (reader);
+          break;
+
+        case NO_ADD_SELECTOR:
+        default:
+          reader->error = TRUE;
+          continue;
+        }
+
+      add_sels = cr_additional_sel_append (add_sels, add_sel);
+    }
+
+  if (reader->error && add_sels)
+    {
+      cr_additional_sel_destroy (add_sels);
+      return NULL;
+    }
+
+  return add_sels;
+}
+
+static CRSelector *
+read_selectors (Reader *reader)
+{
+  CRSelector *sels = NULL;
+  guint32 i, n_sels;
+
+  n_sels = read_count (reader);
+
+  for (i = 0; i < n_sels && !reader->error; i++)
+    {
+      CRSimpleSel *simple_sels = NULL;
+      guint32 j, n_simple_sels;
+
+      n_simple_sels = read_count (reader);
+
+      for (j = 0; j < n_simple_sels && !reader->error; j++)
+        {
+          CRSimpleSel *simple_sel = cr_simple_sel_new ();
+
+          simple_sels = cr_simple_sel_append_simple_sel (simple_sels, simple_sel);
+
+          simple_sel->type_mask = read_word (reader);
+          simple_sel->is_case_sentive = read_word (reader) != 0;
+          simple_sel->name = read_string (reader, TRUE);
+          simple_sel->combinator = read_word (reader);
+          simple_sel->add_sel = read_additional_sels (reader);
+        }
+
+      if (simple_sels == NULL)
+        {
+          reader->error = TRUE;
+          break;
+        }
+
+      sels = cr_selector_append (sels, cr_selector_new (simple_sels));
+    }
+
+  if (sels == NULL || reader->error)
+    {
+      reader->error = TRUE;
+      if (sels)
+        cr_selector_destroy (sels);
+      return NULL;
+    }
+
+  return sels;
+}
+
+static gboolean
+read_ruleset (Reader       *reader,
+              CRStyleSheet *stylesheet,
+              CRStatement **stmt_out)
+{
+  CRStatement *stmt;
+  CRSelector *sels;
+  guint32 i, n_decls;
+
+  sels = read_selectors (reader);
+  if (sels == NULL)
+    return FALSE;
+
+  stmt = cr_statement_new_ruleset (stylesheet, sels, NULL, NULL);
+  *stmt_out = stmt;
+
+  n_decls = read_count (reader);
+
+  for (i = 0; i < n_decls && !reader->error; i++)
+    {
+      CRString *property = read_string (reader, FALSE);
+      gboolean important = read_word (reader) != 0;
+      CRTerm *value = read_terms (reader, 0);
+      CRDeclaration *decl;
+
+      if (property == NULL)
+        {
+          if (value)
+            cr_term_destroy (value);
+          break;
+        }
+
+      /* Goes through the constructor so the property is interned
+       * exactly like it is for parsed declarations */
+      decl = cr_declaration_new (stmt, property, value);
+      decl->important = important;
+      cr_statement_ruleset_append_decl (stmt, decl);
+    }
+
+  return !reader->error;
+}
+
+/**
+ * _st_compiled_stylesheet_load:
+ * @compiled: the contents of a compiled stylesheet
+ * @source: the CSS text the caller wants a stylesheet for
+ *
+ * Rebuilds a stylesheet from its compiled form. This fails if
+ * @compiled wasn't generated from exactly @source, or is damaged.
+ *
+ * Returns: (transfer full) (nullable): the stylesheet, or %NULL
+ *   if the caller should parse @source instead
+ */
+CRStyleSheet *
+_st_compiled_stylesheet_load (GBytes *compiled,
+                              GBytes *source)
+{
+  CompiledHeader header;
+  CRStyleSheet *stylesheet;
+  CRStatement *tail = NULL;
+  const guint8 *data;
+  Reader reader = { 0 };
+  guint8 digest[32];
+  gsize size, words_offset;
+  guint32 i, n_stmts;
+
+  data = g_bytes_get_data (compiled, &size);
+  if (size < sizeof (header))
+    return NULL;
+
+  memcpy (&header, data, sizeof (header));
+  if (memcmp (header.magic, COMPILED_MAGIC, sizeof (header.magic)) != 0 ||
+      GUINT32_FROM_LE (header.version) != COMPILED_VERSION)
+    return NULL;
+
+  reader.strings_size = GUINT32_FROM_LE (header.strings_size);
+  reader.n_words = GUINT32_FROM_LE (header.n_words);
+
+  words_offset = sizeof (header) + reader.strings_size + (4 - reader.strings_size % 4) % 4;
+  if (words_offset < sizeof (header) ||
+      (size - sizeof (header)) / sizeof (guint32) < reader.n_words ||
+      words_offset + reader.n_words * sizeof (guint32) != size)
+    return NULL;
+
+  reader.strings = (const char *) data + sizeof (header);
+  reader.words = data + words_offset;
+
+  /* Any offset into the pool then yields a terminated string */
+  if (reader.strings_size > 0 && reader.strings[reader.strings_size - 1] != '\0')
+    return NULL;
+
+  compute_digest (source, digest);
+  if (memcmp (digest, header.source_digest, sizeof (digest)) != 0)
+    return NULL;
+
+  stylesheet = cr_stylesheet_new (NULL);
+
+  n_stmts = read_count (&reader);
+
+  for (i = 0; i < n_stmts && !reader.error; i++)
+    {
+      CRStatement *stmt = NULL;
+
+      switch (read_word (&reader))
+        {
+        case RULESET_STMT:
+          read_ruleset (&reader, stylesheet, &stmt);
+          break;
+
+        case AT_IMPORT_RULE_STMT:
+          {
+            CRString *url = read_string (&reader, FALSE);
+
+            if (url)
+              stmt = cr_statement_new_at_import_rule (stylesheet, url, NULL, NULL);
+          }
+          break;
+
+        default:
+          reader.error = TRUE;
+          break;
+        }
+
+      if (stmt == NULL)
+        continue;
+
+      /* Link by hand; cr_statement_append() walks the whole list */
+      if (tail)
+        {
+          tail->next = stmt;
+          stmt->prev = tail;
+        }
+      else
+        {
+          stylesheet->statements = stmt;
+        }
+
+      tail = stmt;
+    }
+
+  if (reader.error || reader.pos != reader.n_words)
+    {
+      cr_stylesheet_destroy (stylesheet);
+      return NULL;
+    }
+
+  return stylesheet;
+}
@@ -0,0 +1,38 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-compiled-stylesheet.h: Precompiled form of a CSS stylesheet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "croco/libcroco.h"
+
+G_BEGIN_DECLS
+
+/* A compiled stylesheet lives next to its source, e.g.
+ * gnome-shell-dark.css.stc for gnome-shell-dark.css */
+#define ST_COMPILED_STYLESHEET_SUFFIX ".stc"
+
+GBytes       *_st_compiled_stylesheet_new  (CRStyleSheet  *stylesheet,
+                                            GBytes        *source,
+                                            GError       **error);
+
+CRStyleSheet *_st_compiled_stylesheet_load (GBytes        *compiled,
+                                            GBytes        *source);
+
+G_END_DECLS
@@ -0,0 +1,242 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-decode-scheduler.c: Worker threads for decoding images
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Images and icons are decoded by a few threads of our own rather than
+ * by the GLib thread pool that g_task_run_in_thread() uses, so that
+ * opening the overview doesn't starve the other users of that pool, and
+ * so that the icons shown on screen are decoded before the ones that
+ * are only prefetched.
+ *
+ * Tasks run by increasing GTask priority, and in the order they were
+ * queued within a priority. The number of threads can be set with the
+ * ST_DECODE_THREADS environment variable. Tasks that are cancelled
+ * before a thread picks them up return G_IO_ERROR_CANCELLED without
+ * being run.
+ *
+ * The latency statistics count from when the image was requested, which
+ * for the texture cache is when the request was queued behind the other
+ * loads, until a thread starts on it.
+ */
+
+#include "config.h"
+
+#include "st-decode-scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_MAX_THREADS 4
+
+typedef struct
+{
+  GTask *task;
+  GTaskThreadFunc task_func;
+  int priority;
+  guint64 serial;
+  gint64 queue_time;
+} DecodeJob;
+
+typedef struct
+{
+  guint n_decoded;
+  guint n_cancelled;
+  guint latency_histogram[ST_DECODE_N_LATENCY_BUCKETS];
+} LaneStats;
+
+static GThreadPool *decode_pool;
+static guint64 next_serial;
+
+static GMutex stats_lock;
+static LaneStats lane_stats[ST_DECODE_N_LANES];
+
+StDecodeLane
+_st_decode_lane_for_priority (int priority)
+{
+  if (priority <= G_PRIORITY_DEFAULT)
+    return ST_DECODE_LANE_VISIBLE;
+  else if (priority <= G_PRIORITY_LOW)
+    return ST_DECODE_LANE_PREFETCH;
+  else
+    return ST_DECODE_LANE_BACKGROUND;
+}
+
+/* Buckets are a factor of 4 apart: below 1ms, 4ms, 16ms, 64ms, 256ms
+ * and above */
+static int
+latency_bucket (gint64 latency_us)
+{
+  gint64 limit = 1000;
+  int i;
+
+  for (i = 0; i < ST_DECODE_N_LATENCY_BUCKETS - 1; i++)
+    {
+      if (latency_us < limit)
+        return i;
+
+      limit *= 4;
+    }
+
+  return ST_DECODE_N_LATENCY_BUCKETS - 1;
+}
+
+static void
+run_job (gpointer data,
+         gpointer user_data)
+{
+  DecodeJob *job = data;
+  LaneStats *stats = &lane_stats[_st_decode_lane_for_priority (job->priority)];
+  gint64 now = g_get_monotonic_time ();
+  gboolean cancelled;
+
+  cancelled = g_task_return_error_if_cancelled (job->task);
+
+  g_mutex_lock (&stats_lock);
+  if (cancelled)
+    {
+      stats->n_cancelled++;
+    }
+  else
+    {
+      stats->n_decoded++;
+      if (job->queue_time != 0)
+        stats->latency_histogram[latency_bucket (now - job->queue_time)]++;
+    }
+  g_mutex_unlock (&stats_lock);
+
+  if (!cancelled)
+    job->task_func (job->task,
+                    g_task_get_source_object (job->task),
+                    g_task_get_task_data (job->task),
+                    g_task_get_cancellable (job->task));
+
+  g_object_unref (job->task);
+  g_free (job);
+}
+
+static int
+compare_jobs (gconstpointer a,
+              gconstpointer b,
+              gpointer      user_data)
+{
+  const DecodeJob *job_a = a;
+  const DecodeJob *job_b = b;
+
+  if (job_a->priority != job_b->priority)
+    return job_a->priority < job_b->priority ? -1 : 1;
+
+  return job_a->serial < job_b->serial ? -1 : 1;
+}
+
+static int
+get_max_threads (void)
+{
+  const char *env = g_getenv ("ST_DECODE_THREADS");
+  int n_threads = 0;
+
+  if (env != NULL)
+    n_threads = atoi (env);
+
+  if (n_threads <= 0)
+    n_threads = CLAMP (g_get_num_processors () / 2, 1, DEFAULT_MAX_THREADS);
+
+  return n_threads;
+}
+
+static GThreadPool *
+get_decode_pool (void)
+{
+  if (g_once_init_enter (&decode_pool))
+    {
+      GThreadPool *pool;
+
+      pool = g_thread_pool_new (run_job, NULL, get_max_threads (), FALSE, NULL);
+      g_thread_pool_set_sort_function (pool, compare_jobs, NULL);
+
+      g_once_init_leave (&decode_pool, pool);
+    }
+
+  return decode_pool;
+}
+
+/**
+ * _st_decode_scheduler_run:
+ * @task: a #GTask
+ * @task_func: the function to run in a worker thread
+ *
+ * Like g_task_run_in_thread(), but uses the decode threads, and the
+ * priority of @task to order it against the other decodes. Must be
+ * called from the main thread.
+ */
+void
+_st_decode_scheduler_run (GTask           *task,
+                          GTaskThreadFunc  task_func)
+{
+  _st_decode_scheduler_run_queued (task, task_func, g_get_monotonic_time ());
+}
+
+/**
+ * _st_decode_scheduler_run_queued:
+ * @task: a #GTask
+ * @task_func: the function to run in a worker thread
+ * @queue_time: the monotonic time the image was requested at, or 0 if
+ *   an earlier task for the same image was counted already
+ *
+ * Like _st_decode_scheduler_run(), for images that waited before they
+ * got to the decode threads.
+ */
+void
+_st_decode_scheduler_run_queued (GTask           *task,
+                                 GTaskThreadFunc  task_func,
+                                 gint64           queue_time)
+{
+  DecodeJob *job;
+
+  job = g_new0 (DecodeJob, 1);
+  job->task = g_object_ref (task);
+  job->task_func = task_func;
+  job->priority = g_task_get_priority (task);
+  job->serial = next_serial++;
+  job->queue_time = queue_time;
+
+  g_thread_pool_push (get_decode_pool (), job, NULL);
+}
+
+void
+_st_decode_scheduler_get_stats (StDecodeLane  lane,
+                                guint        *n_decoded,
+                                guint        *n_cancelled,
+                                guint        *latency_histogram)
+{
+  LaneStats *stats;
+
+  g_return_if_fail (lane < ST_DECODE_N_LANES);
+
+  stats = &lane_stats[lane];
+
+  g_mutex_lock (&stats_lock);
+
+  if (n_decoded)
+    *n_decoded = stats->n_decoded;
+  if (n_cancelled)
+    *n_cancelled = stats->n_cancelled;
+  if (latency_histogram)
+    memcpy (latency_histogram, stats->latency_histogram,
+            sizeof (stats->latency_histogram));
+
+  g_mutex_unlock (&stats_lock);
+}
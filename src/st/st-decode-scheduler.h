@@ -0,0 +1,47 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-decode-scheduler.h: Worker threads for decoding images
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "st-texture-cache.h"
+
+G_BEGIN_DECLS
+
+#define ST_DECODE_N_LANES (ST_DECODE_LANE_BACKGROUND + 1)
+
+/* Priorities up to G_PRIORITY_DEFAULT are for visible images, up to
+ * G_PRIORITY_LOW for prefetched ones */
+#define ST_DECODE_PRIORITY_BACKGROUND (G_PRIORITY_LOW + 100)
+
+StDecodeLane _st_decode_lane_for_priority      (int               priority);
+
+void         _st_decode_scheduler_run          (GTask            *task,
+                                                GTaskThreadFunc   task_func);
+
+void         _st_decode_scheduler_run_queued   (GTask            *task,
+                                                GTaskThreadFunc   task_func,
+                                                gint64            queue_time);
+
+void         _st_decode_scheduler_get_stats    (StDecodeLane      lane,
+                                                guint            *n_decoded,
+                                                guint            *n_cancelled,
+                                                guint            *latency_histogram);
+
+G_END_DECLS
@@ -0,0 +1,759 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-icon-raster-cache.c: Persistent cache of rendered icons
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Loading the icons of the app grid and the dash decodes and, for SVG
+ * icons, rasterizes every one of them again at each login. The
+ * rendered icons are kept in a single file instead, which is mapped
+ * into memory at startup, so that a cached icon can be uploaded from
+ * the mapping without being decoded or copied.
+ *
+ * The file is written in host byte order, and is simply ignored if it
+ * doesn't look right:
+ *
+ *   PackHeader
+ *   PackEntry[n_entries]
+ *   file names, not nul-terminated
+ *   premultiplied RGBA pixels of each icon, 16-byte aligned
+ *
+ * Icons are looked up by the modification times of their file and of
+ * the index.theme of their icon theme, so an icon that changed doesn't
+ * match anymore and is left to age out. Icons that weren't used for
+ * MAX_AGE_DAYS are dropped, and when the cache is full the least
+ * recently used ones make room for new ones.
+ *
+ * Lookups are meant to be done from the decode threads. New icons are
+ * kept in memory as they were rendered, and the whole file is written
+ * again from a thread a few seconds after the last change, leaving out
+ * icons whose file changed in the meantime; the pixels of new icons are
+ * premultiplied there too.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "st-icon-raster-cache.h"
+
+#define PACK_MAGIC "StIcnRas"
+#define PACK_VERSION 2
+#define PACK_BYTE_ORDER 0x01020304
+#define PACK_DATA_ALIGNMENT 16
+#define PACK_ALIGN(offset) (((offset) + PACK_DATA_ALIGNMENT - 1) & \
+                            ~(gsize) (PACK_DATA_ALIGNMENT - 1))
+
+/* Icons larger than this are not worth the space */
+#define MAX_ICON_SIZE 512
+
+#define SAVE_DELAY_S 5
+
+/* Icons not used for this long are dropped */
+#define MAX_AGE_DAYS 30
+
+/* How often the time an icon was last used is updated. Only changes
+ * this coarse cause the file to be written again. */
+#define LAST_USED_RESOLUTION_S (24 * 60 * 60)
+
+typedef struct
+{
+  char magic[8];
+  guint32 byte_order;
+  guint32 version;
+  guint32 n_entries;
+  guint32 reserved;
+} PackHeader;
+
+typedef struct
+{
+  gint64 mtime;
+  gint64 theme_mtime;
+  gint64 last_used;
+  guint32 filename_offset;
+  guint32 filename_length;
+  guint32 size;
+  guint32 scale;
+  guint32 has_colors;
+  guint32 width;
+  guint32 height;
+  guint32 data_offset;
+  guint8 colors[16];
+} PackEntry;
+
+G_STATIC_ASSERT (sizeof (PackHeader) == 24);
+G_STATIC_ASSERT (sizeof (PackEntry) == 72);
+G_STATIC_ASSERT (sizeof (((StIconRasterKey *) NULL)->colors) == 16);
+
+/* Immutable once created except for last_used and link, which are
+ * protected by the lock of the cache, so that it can be written out
+ * from a thread */
+typedef struct
+{
+  StIconRasterKey key; /* must be first, see raster_key_hash() */
+  char *filename;
+  int width;
+  int height;
+  GBytes *pixels; /* premultiplied RGBA, 4 * width bytes per row */
+  GdkPixbuf *pixbuf; /* instead of pixels for icons added in this session */
+  gint64 last_used; /* in seconds since the epoch */
+  GList link;
+} RasterEntry;
+
+struct _StIconRasterCache
+{
+  gatomicrefcount ref_count;
+
+  char *path;
+
+  GMutex lock;
+  GHashTable *entries; /* Set: RasterEntry * */
+  GQueue lru; /* RasterEntry *, most recently used first */
+  gsize n_bytes;
+  GSource *save_source;
+};
+
+static guint
+raster_key_hash (gconstpointer data)
+{
+  const StIconRasterKey *key = data;
+
+  return g_str_hash (key->filename) ^
+         (guint) key->mtime ^
+         (guint) key->theme_mtime ^
+         (key->size << 16) ^
+         (key->scale << 8) ^
+         key->has_colors;
+}
+
+static gboolean
+raster_key_equal (gconstpointer a,
+                  gconstpointer b)
+{
+  const StIconRasterKey *key_a = a;
+  const StIconRasterKey *key_b = b;
+
+  return key_a->mtime == key_b->mtime &&
+         key_a->theme_mtime == key_b->theme_mtime &&
+         key_a->size == key_b->size &&
+         key_a->scale == key_b->scale &&
+         key_a->has_colors == key_b->has_colors &&
+         memcmp (key_a->colors, key_b->colors, sizeof (key_a->colors)) == 0 &&
+         strcmp (key_a->filename, key_b->filename) == 0;
+}
+
+static gint64
+get_now (void)
+{
+  return g_get_real_time () / G_USEC_PER_SEC;
+}
+
+static RasterEntry *
+raster_entry_new (const StIconRasterKey *key,
+                  int                    width,
+                  int                    height,
+                  gint64                 last_used)
+{
+  RasterEntry *entry = g_atomic_rc_box_new0 (RasterEntry);
+
+  entry->key = *key;
+  entry->filename = g_strdup (key->filename);
+  entry->key.filename = entry->filename;
+  entry->width = width;
+  entry->height = height;
+  entry->last_used = last_used;
+  entry->link.data = entry;
+
+  return entry;
+}
+
+static void
+raster_entry_clear (RasterEntry *entry)
+{
+  g_free (entry->filename);
+  g_clear_pointer (&entry->pixels, g_bytes_unref);
+  g_clear_object (&entry->pixbuf);
+}
+
+static RasterEntry *
+raster_entry_ref (RasterEntry *entry)
+{
+  return g_atomic_rc_box_acquire (entry);
+}
+
+static void
+raster_entry_unref (RasterEntry *entry)
+{
+  g_atomic_rc_box_release_full (entry, (GDestroyNotify) raster_entry_clear);
+}
+
+static gsize
+raster_entry_get_n_bytes (RasterEntry *entry)
+{
+  return (gsize) entry->width * entry->height * 4;
+}
+
+/* Writes the pixels of @entry, premultiplied, to @dest */
+static void
+raster_entry_copy_pixels (RasterEntry *entry,
+                          guint8      *dest)
+{
+  const guint8 *src;
+  int n_channels, rowstride;
+  int x, y;
+
+  if (entry->pixels != NULL)
+    {
+      memcpy (dest, g_bytes_get_data (entry->pixels, NULL),
+              raster_entry_get_n_bytes (entry));
+      return;
+    }
+
+  src = gdk_pixbuf_read_pixels (entry->pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (entry->pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (entry->pixbuf);
+
+  for (y = 0; y < entry->height; y++)
+    {
+      const guint8 *s = src + y * rowstride;
+      guint8 *d = dest + y * entry->width * 4;
+
+      for (x = 0; x < entry->width; x++)
+        {
+          guint alpha = n_channels == 4 ? s[3] : 255;
+
+          d[0] = (s[0] * alpha + 127) / 255;
+          d[1] = (s[1] * alpha + 127) / 255;
+          d[2] = (s[2] * alpha + 127) / 255;
+          d[3] = alpha;
+
+          s += n_channels;
+          d += 4;
+        }
+    }
+}
+
+static gboolean on_save_timeout (gpointer user_data);
+
+/* Called with the lock held */
+static void
+raster_cache_queue_save (StIconRasterCache *cache)
+{
+  if (cache->save_source != NULL)
+    {
+      g_source_destroy (cache->save_source);
+      g_source_unref (cache->save_source);
+    }
+
+  cache->save_source = g_timeout_source_new_seconds (SAVE_DELAY_S);
+  g_source_set_callback (cache->save_source, on_save_timeout, cache, NULL);
+  g_source_set_static_name (cache->save_source, "[gnome-shell] on_save_timeout");
+  g_source_attach (cache->save_source, NULL);
+}
+
+/* Called with the lock held */
+static void
+raster_cache_remove (StIconRasterCache *cache,
+                     RasterEntry       *entry)
+{
+  g_queue_unlink (&cache->lru, &entry->link);
+  cache->n_bytes -= raster_entry_get_n_bytes (entry);
+  g_hash_table_remove (cache->entries, entry);
+}
+
+/* Takes ownership of @entry, evicting the least recently used icons if
+ * the cache would be too large. Called with the lock held. */
+static void
+raster_cache_add (StIconRasterCache *cache,
+                  RasterEntry       *entry)
+{
+  gsize n_bytes = raster_entry_get_n_bytes (entry);
+  RasterEntry *old_entry;
+
+  old_entry = g_hash_table_lookup (cache->entries, &entry->key);
+  if (old_entry != NULL)
+    raster_cache_remove (cache, old_entry);
+
+  while (cache->n_bytes + n_bytes > ST_ICON_RASTER_CACHE_MAX_BYTES &&
+         cache->lru.tail != NULL)
+    raster_cache_remove (cache, cache->lru.tail->data);
+
+  g_hash_table_add (cache->entries, entry);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  cache->n_bytes += n_bytes;
+}
+
+static gboolean
+raster_entry_is_expired (gint64 last_used,
+                         gint64 now)
+{
+  return now - last_used > (gint64) MAX_AGE_DAYS * 24 * 60 * 60;
+}
+
+static void
+raster_cache_load (StIconRasterCache *cache)
+{
+  g_autoptr (GMappedFile) map = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GPtrArray) loaded = NULL;
+  const PackHeader *header;
+  const PackEntry *pack_entries;
+  const guint8 *data;
+  gint64 now = get_now ();
+  gboolean expired = FALSE;
+  gsize length;
+  guint32 i;
+
+  map = g_mapped_file_new (cache->path, FALSE, NULL);
+  if (map == NULL)
+    return;
+
+  bytes = g_mapped_file_get_bytes (map);
+  data = g_bytes_get_data (bytes, &length);
+
+  if (length < sizeof (PackHeader))
+    return;
+
+  header = (const PackHeader *) data;
+  if (memcmp (header->magic, PACK_MAGIC, sizeof (header->magic)) != 0 ||
+      header->byte_order != PACK_BYTE_ORDER ||
+      header->version != PACK_VERSION ||
+      header->n_entries > (length - sizeof (PackHeader)) / sizeof (PackEntry))
+    {
+      g_debug ("Ignoring invalid icon cache %s", cache->path);
+      return;
+    }
+
+  pack_entries = (const PackEntry *) (data + sizeof (PackHeader));
+  loaded = g_ptr_array_new ();
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      const PackEntry *pack_entry = &pack_entries[i];
+      g_autofree char *filename = NULL;
+      StIconRasterKey key = { 0, };
+      RasterEntry *entry;
+      gsize n_pixel_bytes;
+
+      if (pack_entry->width == 0 || pack_entry->width > MAX_ICON_SIZE ||
+          pack_entry->height == 0 || pack_entry->height > MAX_ICON_SIZE)
+        continue;
+
+      if (raster_entry_is_expired (pack_entry->last_used, now))
+        {
+          expired = TRUE;
+          continue;
+        }
+
+      n_pixel_bytes = (gsize) pack_entry->width * pack_entry->height * 4;
+
+      if (pack_entry->filename_offset > length ||
+          pack_entry->filename_length > length - pack_entry->filename_offset ||
+          pack_entry->data_offset > length ||
+          n_pixel_bytes > length - pack_entry->data_offset)
+        continue;
+
+      filename = g_strndup ((const char *) data + pack_entry->filename_offset,
+                            pack_entry->filename_length);
+
+      key.filename = filename;
+      key.mtime = pack_entry->mtime;
+      key.theme_mtime = pack_entry->theme_mtime;
+      key.size = pack_entry->size;
+      key.scale = pack_entry->scale;
+      key.has_colors = pack_entry->has_colors != 0;
+      memcpy (key.colors, pack_entry->colors, sizeof (key.colors));
+
+      entry = raster_entry_new (&key,
+                                pack_entry->width, pack_entry->height,
+                                pack_entry->last_used);
+
+      /* Keeps the file mapped for as long as the icon is cached */
+      entry->pixels = g_bytes_new_from_bytes (bytes, pack_entry->data_offset,
+                                              n_pixel_bytes);
+
+      g_ptr_array_add (loaded, entry);
+    }
+
+  /* The file was written most recently used first */
+  for (i = loaded->len; i > 0; i--)
+    raster_cache_add (cache, loaded->pdata[i - 1]);
+
+  if (expired)
+    raster_cache_queue_save (cache);
+}
+
+static gboolean
+raster_entry_is_current (RasterEntry *entry)
+{
+  GStatBuf stat_buf;
+
+  return g_stat (entry->filename, &stat_buf) == 0 &&
+         stat_buf.st_mtime == entry->key.mtime;
+}
+
+typedef struct
+{
+  RasterEntry *entry;
+  gint64 last_used;
+} SaveEntry;
+
+static void
+save_entry_clear (SaveEntry *save_entry)
+{
+  raster_entry_unref (save_entry->entry);
+}
+
+static void
+raster_cache_write (const char *path,
+                    GArray     *entries)
+{
+  g_autoptr (GArray) current = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree char *dirname = NULL;
+  g_autofree guint8 *buffer = NULL;
+  PackHeader *header;
+  PackEntry *pack_entries;
+  gsize filename_offset, data_offset, length;
+  gint64 now = get_now ();
+  guint i;
+
+  current = g_array_new (FALSE, FALSE, sizeof (SaveEntry));
+  for (i = 0; i < entries->len; i++)
+    {
+      SaveEntry *save_entry = &g_array_index (entries, SaveEntry, i);
+
+      if (!raster_entry_is_expired (save_entry->last_used, now) &&
+          raster_entry_is_current (save_entry->entry))
+        g_array_append_val (current, *save_entry);
+    }
+
+  filename_offset = sizeof (PackHeader) + current->len * sizeof (PackEntry);
+  data_offset = filename_offset;
+  for (i = 0; i < current->len; i++)
+    {
+      RasterEntry *entry = g_array_index (current, SaveEntry, i).entry;
+
+      data_offset += strlen (entry->filename);
+    }
+
+  data_offset = PACK_ALIGN (data_offset);
+  length = data_offset;
+  for (i = 0; i < current->len; i++)
+    {
+      RasterEntry *entry = g_array_index (current, SaveEntry, i).entry;
+
+      length += PACK_ALIGN (raster_entry_get_n_bytes (entry));
+    }
+
+  buffer = g_malloc0 (length);
+
+  header = (PackHeader *) buffer;
+  memcpy (header->magic, PACK_MAGIC, sizeof (header->magic));
+  header->byte_order = PACK_BYTE_ORDER;
+  header->version = PACK_VERSION;
+  header->n_entries = current->len;
+
+  pack_entries = (PackEntry *) (buffer + sizeof (PackHeader));
+
+  for (i = 0; i < current->len; i++)
+    {
+      SaveEntry *save_entry = &g_array_index (current, SaveEntry, i);
+      RasterEntry *entry = save_entry->entry;
+      PackEntry *pack_entry = &pack_entries[i];
+      gsize filename_length = strlen (entry->filename);
+
+      pack_entry->mtime = entry->key.mtime;
+      pack_entry->theme_mtime = entry->key.theme_mtime;
+      pack_entry->last_used = save_entry->last_used;
+      pack_entry->filename_offset = filename_offset;
+      pack_entry->filename_length = filename_length;
+      pack_entry->size = entry->key.size;
+      pack_entry->scale = entry->key.scale;
+      pack_entry->has_colors = entry->key.has_colors;
+      pack_entry->width = entry->width;
+      pack_entry->height = entry->height;
+      pack_entry->data_offset = data_offset;
+      memcpy (pack_entry->colors, entry->key.colors, sizeof (pack_entry->colors));
+
+      memcpy (buffer + filename_offset, entry->filename, filename_length);
+      raster_entry_copy_pixels (entry, buffer + data_offset);
+
+      filename_offset += filename_length;
+      data_offset += PACK_ALIGN (raster_entry_get_n_bytes (entry));
+    }
+
+  dirname = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dirname, 0700) < 0)
+    {
+      g_warning ("Failed to create %s: %s", dirname, g_strerror (errno));
+      return;
+    }
+
+  if (!g_file_set_contents_full (path, (const char *) buffer, length,
+                                 G_FILE_SET_CONTENTS_CONSISTENT, 0600,
+                                 &error))
+    g_warning ("Failed to write icon cache: %s", error->message);
+}
+
+/* Called with the lock held. The entries are most recently used first. */
+static GArray *
+raster_cache_snapshot (StIconRasterCache *cache)
+{
+  GArray *entries;
+  GList *l;
+
+  entries = g_array_sized_new (FALSE, FALSE, sizeof (SaveEntry),
+                               cache->lru.length);
+  g_array_set_clear_func (entries, (GDestroyNotify) save_entry_clear);
+
+  for (l = cache->lru.head; l; l = l->next)
+    {
+      RasterEntry *entry = l->data;
+      SaveEntry save_entry = { raster_entry_ref (entry), entry->last_used };
+
+      g_array_append_val (entries, save_entry);
+    }
+
+  return entries;
+}
+
+typedef struct
+{
+  char *path;
+  GArray *entries;
+} SaveData;
+
+static void
+save_data_free (SaveData *data)
+{
+  g_free (data->path);
+  g_array_unref (data->entries);
+  g_free (data);
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+  SaveData *data = task_data;
+
+  raster_cache_write (data->path, data->entries);
+}
+
+static gboolean
+on_save_timeout (gpointer user_data)
+{
+  StIconRasterCache *cache = user_data;
+  g_autoptr (GTask) task = NULL;
+  SaveData *data;
+
+  data = g_new0 (SaveData, 1);
+  data->path = g_strdup (cache->path);
+
+  g_mutex_lock (&cache->lock);
+  g_clear_pointer (&cache->save_source, g_source_unref);
+  data->entries = raster_cache_snapshot (cache);
+  g_mutex_unlock (&cache->lock);
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_task_data (task, data, (GDestroyNotify) save_data_free);
+  g_task_run_in_thread (task, save_thread);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * _st_icon_raster_cache_new: (skip)
+ * @path: the file the icons are kept in
+ *
+ * Creates a cache of rendered icons, with the icons that were stored in
+ * @path before.
+ *
+ * Returns: (transfer full): a new #StIconRasterCache
+ */
+StIconRasterCache *
+_st_icon_raster_cache_new (const char *path)
+{
+  StIconRasterCache *cache = g_new0 (StIconRasterCache, 1);
+
+  g_atomic_ref_count_init (&cache->ref_count);
+  cache->path = g_strdup (path);
+  g_mutex_init (&cache->lock);
+  cache->entries = g_hash_table_new_full (raster_key_hash, raster_key_equal,
+                                          (GDestroyNotify) raster_entry_unref,
+                                          NULL);
+  g_queue_init (&cache->lru);
+
+  raster_cache_load (cache);
+
+  return cache;
+}
+
+/**
+ * _st_icon_raster_cache_ref: (skip)
+ * @cache: a #StIconRasterCache
+ *
+ * Returns: (transfer full): @cache
+ */
+StIconRasterCache *
+_st_icon_raster_cache_ref (StIconRasterCache *cache)
+{
+  g_atomic_ref_count_inc (&cache->ref_count);
+
+  return cache;
+}
+
+/**
+ * _st_icon_raster_cache_unref: (skip)
+ * @cache: a #StIconRasterCache
+ *
+ * Drops a reference to @cache. When the last one is dropped, icons that
+ * were added since the last time the file was written are written
+ * first.
+ */
+void
+_st_icon_raster_cache_unref (StIconRasterCache *cache)
+{
+  if (!g_atomic_ref_count_dec (&cache->ref_count))
+    return;
+
+  if (cache->save_source != NULL)
+    {
+      g_autoptr (GArray) entries = raster_cache_snapshot (cache);
+
+      g_source_destroy (cache->save_source);
+      g_clear_pointer (&cache->save_source, g_source_unref);
+      raster_cache_write (cache->path, entries);
+    }
+
+  g_hash_table_destroy (cache->entries);
+  g_mutex_clear (&cache->lock);
+  g_free (cache->path);
+  g_free (cache);
+}
+
+/**
+ * _st_icon_raster_cache_lookup: (skip)
+ * @cache: a #StIconRasterCache
+ * @key: what the icon was rendered from
+ * @width: (out): width of the icon
+ * @height: (out): height of the icon
+ * @rowstride: (out): rowstride of the pixels
+ *
+ * Looks up an icon previously stored with _st_icon_raster_cache_insert(),
+ * in this session or an earlier one. Icons from this session are
+ * premultiplied by this call, so it's best called from a thread.
+ *
+ * Returns: (transfer full) (nullable): the premultiplied RGBA pixels of
+ *   the icon, or %NULL
+ */
+GBytes *
+_st_icon_raster_cache_lookup (StIconRasterCache     *cache,
+                              const StIconRasterKey *key,
+                              int                   *width,
+                              int                   *height,
+                              int                   *rowstride)
+{
+  RasterEntry *entry;
+  GBytes *pixels;
+  gint64 now = get_now ();
+  guint8 *data;
+
+  g_mutex_lock (&cache->lock);
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry != NULL)
+    {
+      raster_entry_ref (entry);
+
+      g_queue_unlink (&cache->lru, &entry->link);
+      g_queue_push_head_link (&cache->lru, &entry->link);
+
+      if (now - entry->last_used > LAST_USED_RESOLUTION_S)
+        {
+          entry->last_used = now;
+          raster_cache_queue_save (cache);
+        }
+    }
+
+  g_mutex_unlock (&cache->lock);
+
+  if (entry == NULL)
+    return NULL;
+
+  *width = entry->width;
+  *height = entry->height;
+  *rowstride = entry->width * 4;
+
+  if (entry->pixels != NULL)
+    {
+      pixels = g_bytes_ref (entry->pixels);
+    }
+  else
+    {
+      data = g_malloc (raster_entry_get_n_bytes (entry));
+      raster_entry_copy_pixels (entry, data);
+      pixels = g_bytes_new_take (data, raster_entry_get_n_bytes (entry));
+    }
+
+  raster_entry_unref (entry);
+
+  return pixels;
+}
+
+/**
+ * _st_icon_raster_cache_insert: (skip)
+ * @cache: a #StIconRasterCache
+ * @key: what the icon was rendered from
+ * @pixbuf: the rendered icon
+ *
+ * Stores @pixbuf for later sessions, unless it's too large. The least
+ * recently used icons are dropped if the cache is full.
+ */
+void
+_st_icon_raster_cache_insert (StIconRasterCache     *cache,
+                              const StIconRasterKey *key,
+                              GdkPixbuf             *pixbuf)
+{
+  int width = gdk_pixbuf_get_width (pixbuf);
+  int height = gdk_pixbuf_get_height (pixbuf);
+  int n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  RasterEntry *entry;
+
+  if (width > MAX_ICON_SIZE || height > MAX_ICON_SIZE ||
+      gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 ||
+      (n_channels != 3 && n_channels != 4))
+    return;
+
+  g_mutex_lock (&cache->lock);
+
+  if (!g_hash_table_contains (cache->entries, key))
+    {
+      /* Pixbufs aren't changed once they are loaded, so the pixels
+       * are premultiplied when they are written out */
+      entry = raster_entry_new (key, width, height, get_now ());
+      entry->pixbuf = g_object_ref (pixbuf);
+
+      raster_cache_add (cache, entry);
+      raster_cache_queue_save (cache);
+    }
+
+  g_mutex_unlock (&cache->lock);
+}
@@ -0,0 +1,59 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-icon-raster-cache.h: Persistent cache of rendered icons
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cogl/cogl.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/* Upper bound for the size of the cache file */
+#define ST_ICON_RASTER_CACHE_MAX_BYTES (32 * 1024 * 1024)
+
+typedef struct _StIconRasterCache StIconRasterCache;
+
+/* What an icon was rendered from. @mtime is the modification time of
+ * @filename and @theme_mtime the one of the index.theme of its icon
+ * theme, if any, so that changed icons don't match anymore. */
+typedef struct
+{
+  const char *filename;
+  gint64 mtime;
+  gint64 theme_mtime;
+  int size;
+  int scale;
+  gboolean has_colors;
+  CoglColor colors[4]; /* foreground, warning, error, success */
+} StIconRasterKey;
+
+StIconRasterCache *_st_icon_raster_cache_new    (const char              *path);
+StIconRasterCache *_st_icon_raster_cache_ref    (StIconRasterCache       *cache);
+void               _st_icon_raster_cache_unref  (StIconRasterCache       *cache);
+
+GBytes            *_st_icon_raster_cache_lookup (StIconRasterCache       *cache,
+                                                 const StIconRasterKey   *key,
+                                                 int                     *width,
+                                                 int                     *height,
+                                                 int                     *rowstride);
+
+void               _st_icon_raster_cache_insert (StIconRasterCache       *cache,
+                                                 const StIconRasterKey   *key,
+                                                 GdkPixbuf               *pixbuf);
+
+G_END_DECLS
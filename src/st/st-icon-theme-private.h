@@ -0,0 +1,47 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-icon-theme-private.h: Private StIconInfo methods
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "st-icon-theme.h"
+
+G_BEGIN_DECLS
+
+/* Modification time of the index.theme of the theme the icon was
+ * found in, or 0 if it isn't from a theme */
+gint64 _st_icon_info_get_theme_mtime (StIconInfo *icon_info);
+
+/* Like the _with_priority() variants, with the time the icon was
+ * requested at for the decode statistics, see
+ * _st_decode_scheduler_run_queued() */
+void _st_icon_info_load_icon_async_queued     (StIconInfo          *icon_info,
+                                               int                  io_priority,
+                                               gint64               queue_time,
+                                               GCancellable        *cancellable,
+                                               GAsyncReadyCallback  callback,
+                                               gpointer             user_data);
+
+void _st_icon_info_load_symbolic_async_queued (StIconInfo          *icon_info,
+                                               StIconColors        *colors,
+                                               int                  io_priority,
+                                               gint64               queue_time,
+                                               GCancellable        *cancellable,
+                                               GAsyncReadyCallback  callback,
+                                               gpointer             user_data);
+
+G_END_DECLS
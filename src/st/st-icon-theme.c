@@ -28,7 +28,9 @@
 #include <glib/gi18n-lib.h>
 
 #include "st-icon-theme.h"
+#include "st-icon-theme-private.h"
 #include "st-icon-cache.h"
+#include "st-decode-scheduler.h"
 #include "st-settings.h"
 
 #define DEFAULT_ICON_THEME "Adwaita"
@@ -75,7 +77,7 @@ typedef enum
   ICON_SUFFIX_SYMBOLIC_PNG = 1 << 4
 } IconSuffix;
 
-#define INFO_CACHE_LRU_SIZE 32
+#define DEFAULT_INFO_CACHE_LRU_SIZE 32
 #if 0
 #define DEBUG_CACHE(args) g_print args
 #else
@@ -87,7 +89,11 @@ struct _StIconTheme
   GObject parent_instance;
 
   GHashTable *info_cache;
-  GList *info_cache_lru;
+  GQueue info_cache_lru; /* StIconInfo *, most recently used first */
+  guint info_cache_lru_size;
+  guint info_cache_hits;
+  guint info_cache_misses;
+  guint info_cache_evictions;
 
   char *current_theme;
   char **search_path;
@@ -135,6 +141,8 @@ struct _StIconInfo
    */
   IconInfoKey key;
   StIconTheme *in_cache;
+  GList lru_link; /* in in_cache->info_cache_lru if in_lru */
+  gboolean in_lru;
 
   char *filename;
   GFile *icon_file;
@@ -175,6 +183,8 @@ struct _StIconInfo
 
   int symbolic_width;
   int symbolic_height;
+
+  gint64 theme_mtime;
 };
 
 typedef struct
@@ -183,6 +193,7 @@ typedef struct
   char *display_name;
   char *comment;
   char *example;
+  gint64 mtime; /* of index.theme */
 
   /* In search order */
   GList *dirs;
@@ -451,6 +462,8 @@ st_icon_theme_init (StIconTheme *icon_theme)
 
   icon_theme->info_cache = g_hash_table_new_full (icon_info_key_hash, icon_info_key_equal, NULL,
                                                   (GDestroyNotify)icon_info_uncached);
+  g_queue_init (&icon_theme->info_cache_lru);
+  icon_theme->info_cache_lru_size = DEFAULT_INFO_CACHE_LRU_SIZE;
 
   xdg_data_dirs = g_get_system_data_dirs ();
   for (i = 0; xdg_data_dirs[i]; i++) ;
@@ -555,7 +568,7 @@ st_icon_theme_finalize (GObject *object)
   icon_theme = ST_ICON_THEME (object);
 
   g_hash_table_destroy (icon_theme->info_cache);
-  g_assert (icon_theme->info_cache_lru == NULL);
+  g_assert (icon_theme->info_cache_lru.length == 0);
 
   g_clear_handle_id (&icon_theme->theme_changed_idle, g_source_remove);
 
@@ -776,6 +789,7 @@ insert_theme (StIconTheme *icon_theme,
   GError *error = NULL;
   IconThemeDirMtime *dir_mtime;
   GStatBuf stat_buf;
+  gint64 theme_mtime = 0;
 
   for (l = icon_theme->themes; l != NULL; l = l->next)
     {
@@ -821,6 +835,10 @@ insert_theme (StIconTheme *icon_theme,
               g_error_free (error);
               error = NULL;
             }
+          else if (g_stat (path, &stat_buf) == 0)
+            {
+              theme_mtime = stat_buf.st_mtime;
+            }
         }
       g_free (path);
     }
@@ -841,6 +859,7 @@ insert_theme (StIconTheme *icon_theme,
   if (theme_file == NULL)
     return;
 
+  theme->mtime = theme_mtime;
   theme->display_name =
     g_key_file_get_locale_string (theme_file, "Icon Theme", "Name", NULL, NULL);
   if (!theme->display_name)
@@ -1101,34 +1120,46 @@ ensure_valid_themes (StIconTheme *icon_theme)
   icon_theme->loading_themes = FALSE;
 }
 
-/* The LRU cache is a short list of IconInfos that are kept
+/* The LRU cache is a queue of IconInfos that are kept
  * alive even though their IconInfo would otherwise have
- * been freed, so that we can avoid reloading these
+ * been freed, so that we can avoid looking these up
  * constantly.
  * We put infos on the lru list when nothing otherwise
  * references the info. So, when we get a cache hit
  * we remove it from the list, and when the proxy
  * pixmap is released we put it on the list.
+ * The texture cache keeps the rendered icons, so infos
+ * on the list drop their pixbufs, and the list costs
+ * little more than the lookups even when it is sized
+ * for all apps.
  */
 static void
-ensure_lru_cache_space (StIconTheme *icon_theme)
+drop_from_lru_cache (StIconTheme *icon_theme,
+                     StIconInfo  *icon_info)
 {
-  GList *l;
+  g_queue_unlink (&icon_theme->info_cache_lru, &icon_info->lru_link);
+  icon_info->in_lru = FALSE;
+  g_object_unref (icon_info);
+}
 
-  /* Remove last item if LRU full */
-  l = g_list_nth (icon_theme->info_cache_lru, INFO_CACHE_LRU_SIZE - 1);
-  if (l)
+static void
+ensure_lru_cache_space (StIconTheme *icon_theme,
+                        guint        n_free)
+{
+  /* Remove the least recently used items while the LRU is full */
+  while (icon_theme->info_cache_lru.length > 0 &&
+         icon_theme->info_cache_lru.length + n_free > icon_theme->info_cache_lru_size)
     {
-      StIconInfo *icon_info = l->data;
+      StIconInfo *icon_info = icon_theme->info_cache_lru.tail->data;
 
       DEBUG_CACHE (("removing (due to out of space) %p (%s %d 0x%x) from LRU cache (cache size %d)\n",
                     icon_info,
                     g_strjoinv (",", icon_info->key.icon_names),
                     icon_info->key.size, icon_info->key.flags,
-                    g_list_length (icon_theme->info_cache_lru)));
+                    icon_theme->info_cache_lru.length));
 
-      icon_theme->info_cache_lru = g_list_delete_link (icon_theme->info_cache_lru, l);
-      g_object_unref (icon_info);
+      icon_theme->info_cache_evictions++;
+      drop_from_lru_cache (icon_theme, icon_info);
     }
 }
 
@@ -1140,28 +1171,61 @@ add_to_lru_cache (StIconTheme *icon_theme,
                 icon_info,
                 g_strjoinv (",", icon_info->key.icon_names),
                 icon_info->key.size, icon_info->key.flags,
-                g_list_length (icon_theme->info_cache_lru)));
+                icon_theme->info_cache_lru.length));
 
-  g_assert (g_list_find (icon_theme->info_cache_lru, icon_info) == NULL);
+  g_assert (!icon_info->in_lru);
+
+  if (icon_theme->info_cache_lru_size == 0)
+    return;
 
-  ensure_lru_cache_space (icon_theme);
+  ensure_lru_cache_space (icon_theme, 1);
   /* prepend new info to LRU */
-  icon_theme->info_cache_lru = g_list_prepend (icon_theme->info_cache_lru,
-                                         g_object_ref (icon_info));
+  icon_info->lru_link.data = g_object_ref (icon_info);
+  icon_info->in_lru = TRUE;
+  g_queue_push_head_link (&icon_theme->info_cache_lru, &icon_info->lru_link);
+}
+
+static void symbolic_pixbuf_cache_free (SymbolicPixbufCache *cache);
+
+/* Drops the pixbufs that no proxy pixbuf uses anymore */
+static void
+icon_info_drop_pixbufs (StIconInfo *icon_info)
+{
+  SymbolicPixbufCache **link = &icon_info->symbolic_pixbuf_cache;
+
+  if (icon_info->proxy_pixbuf == NULL)
+    {
+      g_clear_object (&icon_info->pixbuf);
+      icon_info->emblems_applied = FALSE;
+    }
+
+  while (*link != NULL)
+    {
+      SymbolicPixbufCache *symbolic_cache = *link;
+
+      if (symbolic_cache->proxy_pixbuf != NULL)
+        {
+          link = &symbolic_cache->next;
+          continue;
+        }
+
+      *link = symbolic_cache->next;
+      symbolic_cache->next = NULL;
+      symbolic_pixbuf_cache_free (symbolic_cache);
+    }
 }
 
 static void
 ensure_in_lru_cache (StIconTheme *icon_theme,
                      StIconInfo  *icon_info)
 {
-  GList *l;
+  icon_info_drop_pixbufs (icon_info);
 
-  l = g_list_find (icon_theme->info_cache_lru, icon_info);
-  if (l)
+  if (icon_info->in_lru)
     {
       /* Move to front of LRU if already in it */
-      icon_theme->info_cache_lru = g_list_remove_link (icon_theme->info_cache_lru, l);
-      icon_theme->info_cache_lru = g_list_concat (l, icon_theme->info_cache_lru);
+      g_queue_unlink (&icon_theme->info_cache_lru, &icon_info->lru_link);
+      g_queue_push_head_link (&icon_theme->info_cache_lru, &icon_info->lru_link);
     }
   else
     add_to_lru_cache (icon_theme, icon_info);
@@ -1171,16 +1235,15 @@ static void
 remove_from_lru_cache (StIconTheme *icon_theme,
                        StIconInfo  *icon_info)
 {
-  if (g_list_find (icon_theme->info_cache_lru, icon_info))
+  if (icon_info->in_lru)
     {
       DEBUG_CACHE (("removing %p (%s %d 0x%x) from LRU cache (cache size %d)\n",
                     icon_info,
                     g_strjoinv (",", icon_info->key.icon_names),
                     icon_info->key.size, icon_info->key.flags,
-                    g_list_length (icon_theme->info_cache_lru)));
+                    icon_theme->info_cache_lru.length));
 
-      icon_theme->info_cache_lru = g_list_remove (icon_theme->info_cache_lru, icon_info);
-      g_object_unref (icon_info);
+      drop_from_lru_cache (icon_theme, icon_info);
     }
 }
 
@@ -1274,6 +1337,8 @@ real_choose_icon (StIconTheme       *icon_theme,
   icon_info = g_hash_table_lookup (icon_theme->info_cache, &key);
   if (icon_info != NULL)
     {
+      icon_theme->info_cache_hits++;
+
       DEBUG_CACHE (("cache hit %p (%s %d 0x%x) (cache size %d)\n",
                     icon_info,
                     g_strjoinv (",", icon_info->key.icon_names),
@@ -1286,6 +1351,8 @@ real_choose_icon (StIconTheme       *icon_theme,
       return icon_info;
     }
 
+  icon_theme->info_cache_misses++;
+
   if (flags & ST_ICON_LOOKUP_NO_SVG)
     allow_svg = FALSE;
   else if (flags & ST_ICON_LOOKUP_FORCE_SVG)
@@ -2162,6 +2229,52 @@ st_icon_theme_rescan_if_needed (StIconTheme *icon_theme)
   return retval;
 }
 
+/**
+ * st_icon_theme_set_info_cache_size:
+ * @icon_theme: a #StIconTheme
+ * @size: the number of lookups to keep
+ *
+ * Sets how many results of icon lookups are kept around after they
+ * were last used, so that looking the same icon up again is cheap.
+ * This should be at least the number of icons that are shown at the
+ * same time, such as those of the application grid. The default is 32.
+ */
+void
+st_icon_theme_set_info_cache_size (StIconTheme *icon_theme,
+                                   guint        size)
+{
+  g_return_if_fail (ST_IS_ICON_THEME (icon_theme));
+
+  icon_theme->info_cache_lru_size = size;
+  ensure_lru_cache_space (icon_theme, 0);
+}
+
+/**
+ * st_icon_theme_get_info_cache_stats:
+ * @icon_theme: a #StIconTheme
+ * @hits: (out) (optional): number of lookups that were cached
+ * @misses: (out) (optional): number of lookups that searched the theme
+ * @evictions: (out) (optional): number of unused lookups that were
+ *   dropped to stay within the cache size
+ *
+ * Gets statistics about the cached icon lookups.
+ */
+void
+st_icon_theme_get_info_cache_stats (StIconTheme *icon_theme,
+                                    guint       *hits,
+                                    guint       *misses,
+                                    guint       *evictions)
+{
+  g_return_if_fail (ST_IS_ICON_THEME (icon_theme));
+
+  if (hits)
+    *hits = icon_theme->info_cache_hits;
+  if (misses)
+    *misses = icon_theme->info_cache_misses;
+  if (evictions)
+    *evictions = icon_theme->info_cache_evictions;
+}
+
 static void
 theme_destroy (IconTheme *theme)
 {
@@ -2437,6 +2550,7 @@ theme_lookup_icon (IconTheme  *theme,
       icon_info = icon_info_new (min_dir->type, min_dir->size, min_dir->scale);
       icon_info->min_size = min_dir->min_size;
       icon_info->max_size = min_dir->max_size;
+      icon_info->theme_mtime = theme->mtime;
 
       suffix = theme_dir_get_icon_suffix (min_dir, icon_name, &has_icon_file);
       suffix = best_suffix (suffix, allow_svg);
@@ -2818,6 +2932,7 @@ icon_info_dup (StIconInfo *icon_info)
 
   dup->filename = g_strdup (icon_info->filename);
   dup->is_svg = icon_info->is_svg;
+  dup->theme_mtime = icon_info->theme_mtime;
 
   if (icon_info->icon_file)
     dup->icon_file = g_object_ref (icon_info->icon_file);
@@ -2951,6 +3066,12 @@ st_icon_info_get_filename (StIconInfo *icon_info)
   return icon_info->filename;
 }
 
+gint64
+_st_icon_info_get_theme_mtime (StIconInfo *icon_info)
+{
+  return icon_info->theme_mtime;
+}
+
 /**
  * st_icon_info_is_symbolic:
  * @icon_info: a #StIconInfo
@@ -3509,6 +3630,42 @@ st_icon_info_load_icon_async (StIconInfo          *icon_info,
                               GCancellable        *cancellable,
                               GAsyncReadyCallback  callback,
                               gpointer             user_data)
+{
+  st_icon_info_load_icon_async_with_priority (icon_info, G_PRIORITY_DEFAULT,
+                                              cancellable, callback, user_data);
+}
+
+/**
+ * st_icon_info_load_icon_async_with_priority: (finish-func st_icon_info_load_icon_finish)
+ * @icon_info: a #StIconInfo
+ * @io_priority: the priority of the request, such as %G_PRIORITY_DEFAULT
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore
+ * @callback: (scope async) (closure user_data): a #GAsyncReadyCallback to call when the
+ *     request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like st_icon_info_load_icon_async(), but icons are decoded by order of
+ * @io_priority, since only a few threads decode all of them.
+ */
+void
+st_icon_info_load_icon_async_with_priority (StIconInfo          *icon_info,
+                                            int                  io_priority,
+                                            GCancellable        *cancellable,
+                                            GAsyncReadyCallback  callback,
+                                            gpointer             user_data)
+{
+  _st_icon_info_load_icon_async_queued (icon_info, io_priority,
+                                        g_get_monotonic_time (),
+                                        cancellable, callback, user_data);
+}
+
+void
+_st_icon_info_load_icon_async_queued (StIconInfo          *icon_info,
+                                      int                  io_priority,
+                                      gint64               queue_time,
+                                      GCancellable        *cancellable,
+                                      GAsyncReadyCallback  callback,
+                                      gpointer             user_data)
 {
   GTask *task;
   GdkPixbuf *pixbuf;
@@ -3516,6 +3673,7 @@ st_icon_info_load_icon_async (StIconInfo          *icon_info,
   GError *error = NULL;
 
   task = g_task_new (icon_info, cancellable, callback, user_data);
+  g_task_set_priority (task, io_priority);
 
   if (icon_info_get_pixbuf_ready (icon_info))
     {
@@ -3530,7 +3688,7 @@ st_icon_info_load_icon_async (StIconInfo          *icon_info,
     {
       dup = icon_info_dup (icon_info);
       g_task_set_task_data (task, dup, g_object_unref);
-      g_task_run_in_thread (task, load_icon_thread);
+      _st_decode_scheduler_run_queued (task, load_icon_thread, queue_time);
       g_object_unref (task);
     }
 }
@@ -4055,6 +4213,49 @@ st_icon_info_load_symbolic_async (StIconInfo          *icon_info,
                                   GCancellable        *cancellable,
                                   GAsyncReadyCallback  callback,
                                   gpointer             user_data)
+{
+  st_icon_info_load_symbolic_async_with_priority (icon_info, colors,
+                                                  G_PRIORITY_DEFAULT,
+                                                  cancellable,
+                                                  callback, user_data);
+}
+
+/**
+ * st_icon_info_load_symbolic_async_with_priority: (finish-func st_icon_info_load_symbolic_finish)
+ * @icon_info: a #StIconInfo
+ * @colors: an #StIconColors representing the foreground, error and
+ *     success colors of the icon
+ * @io_priority: the priority of the request, such as %G_PRIORITY_DEFAULT
+ * @cancellable: (allow-none): optional #GCancellable object,
+ *     %NULL to ignore
+ * @callback: (scope async) (closure user_data): a #GAsyncReadyCallback to call when the
+ *     request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like st_icon_info_load_symbolic_async(), but icons are decoded by
+ * order of @io_priority.
+ */
+void
+st_icon_info_load_symbolic_async_with_priority (StIconInfo          *icon_info,
+                                                StIconColors        *colors,
+                                                int                  io_priority,
+                                                GCancellable        *cancellable,
+                                                GAsyncReadyCallback  callback,
+                                                gpointer             user_data)
+{
+  _st_icon_info_load_symbolic_async_queued (icon_info, colors, io_priority,
+                                            g_get_monotonic_time (),
+                                            cancellable, callback, user_data);
+}
+
+void
+_st_icon_info_load_symbolic_async_queued (StIconInfo          *icon_info,
+                                          StIconColors        *colors,
+                                          int                  io_priority,
+                                          gint64               queue_time,
+                                          GCancellable        *cancellable,
+                                          GAsyncReadyCallback  callback,
+                                          gpointer             user_data)
 {
   GTask *task;
   AsyncSymbolicData *data;
@@ -4065,6 +4266,7 @@ st_icon_info_load_symbolic_async (StIconInfo          *icon_info,
   g_return_if_fail (colors != NULL);
 
   task = g_task_new (icon_info, cancellable, callback, user_data);
+  g_task_set_priority (task, io_priority);
 
   data = g_new0 (AsyncSymbolicData, 1);
   g_task_set_task_data (task, data, (GDestroyNotify) async_symbolic_data_free);
@@ -4073,7 +4275,10 @@ st_icon_info_load_symbolic_async (StIconInfo          *icon_info,
 
   if (!data->is_symbolic)
     {
-      st_icon_info_load_icon_async (icon_info, cancellable, async_load_no_symbolic_cb, g_object_ref (task));
+      _st_icon_info_load_icon_async_queued (icon_info, io_priority,
+                                            queue_time, cancellable,
+                                            async_load_no_symbolic_cb,
+                                            g_object_ref (task));
     }
   else
     {
@@ -4087,7 +4292,8 @@ st_icon_info_load_symbolic_async (StIconInfo          *icon_info,
         {
           data->dup = icon_info_dup (icon_info);
           data->colors = st_icon_colors_ref (colors);
-          g_task_run_in_thread (task, load_symbolic_icon_thread);
+          _st_decode_scheduler_run_queued (task, load_symbolic_icon_thread,
+                                           queue_time);
         }
     }
   g_object_unref (task);
@@ -168,6 +168,14 @@ GList * st_icon_theme_list_contexts (StIconTheme *icon_theme);
 
 gboolean st_icon_theme_rescan_if_needed (StIconTheme *icon_theme);
 
+void st_icon_theme_set_info_cache_size (StIconTheme *icon_theme,
+                                        guint        size);
+
+void st_icon_theme_get_info_cache_stats (StIconTheme *icon_theme,
+                                         guint       *hits,
+                                         guint       *misses,
+                                         guint       *evictions);
+
 StIconInfo * st_icon_info_new_for_pixbuf (StIconTheme *icon_theme,
                                           GdkPixbuf   *pixbuf);
 
@@ -187,6 +195,12 @@ void st_icon_info_load_icon_async (StIconInfo          *icon_info,
                                    GAsyncReadyCallback  callback,
                                    gpointer             user_data);
 
+void st_icon_info_load_icon_async_with_priority (StIconInfo          *icon_info,
+                                                 int                  io_priority,
+                                                 GCancellable        *cancellable,
+                                                 GAsyncReadyCallback  callback,
+                                                 gpointer             user_data);
+
 GdkPixbuf * st_icon_info_load_icon_finish (StIconInfo    *icon_info,
                                            GAsyncResult  *res,
                                            GError       **error);
@@ -202,6 +216,13 @@ void st_icon_info_load_symbolic_async (StIconInfo           *icon_info,
                                        GAsyncReadyCallback   callback,
                                        gpointer              user_data);
 
+void st_icon_info_load_symbolic_async_with_priority (StIconInfo           *icon_info,
+                                                     StIconColors         *colors,
+                                                     int                   io_priority,
+                                                     GCancellable         *cancellable,
+                                                     GAsyncReadyCallback   callback,
+                                                     gpointer              user_data);
+
 GdkPixbuf * st_icon_info_load_symbolic_finish (StIconInfo    *icon_info,
                                                GAsyncResult  *res,
                                                gboolean      *was_symbolic,
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "st-image-content.h"
+#include "st-icon-colors.h"
 
 G_BEGIN_DECLS
 
@@ -27,4 +28,10 @@ void st_image_content_set_is_symbolic (StImageContent *content,
 
 gboolean st_image_content_get_is_symbolic (StImageContent *content);
 
+void st_image_content_set_texture (StImageContent *content,
+                                   CoglTexture    *texture);
+
+ClutterContent *_st_image_content_new_recolored (StImageContent *mask,
+                                                 StIconColors   *colors);
+
 G_END_DECLS
@@ -19,7 +19,9 @@
  */
 
 #include "st-image-content-private.h"
+#include "st-decode-scheduler.h"
 #include "st-private.h"
+#include "st-texture-atlas.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
@@ -32,6 +34,12 @@ struct _StImageContent
   int width;
   int height;
   gboolean is_symbolic;
+
+  /* Set for symbolic icons that are recolored when painted. The mask
+   * content is the one the texture cache holds on to. */
+  StImageContent *mask;
+  StIconColors *colors;
+  CoglPipeline *recolor_pipeline;
 };
 
 enum
@@ -127,6 +135,9 @@ st_image_content_finalize (GObject *gobject)
   StImageContent *content = ST_IMAGE_CONTENT (gobject);
 
   g_clear_object (&content->texture);
+  g_clear_object (&content->mask);
+  g_clear_pointer (&content->colors, st_icon_colors_unref);
+  g_clear_object (&content->recolor_pipeline);
 
   G_OBJECT_CLASS (st_image_content_parent_class)->finalize (gobject);
 }
@@ -200,6 +211,128 @@ pixbuf_from_image (StImageContent *image)
                                    (GdkPixbufDestroyNotify)g_free, NULL);
 }
 
+static CoglPipelineFilter
+get_pipeline_filter (ClutterScalingFilter filter)
+{
+  switch (filter)
+    {
+    case CLUTTER_SCALING_FILTER_NEAREST:
+      return COGL_PIPELINE_FILTER_NEAREST;
+    case CLUTTER_SCALING_FILTER_TRILINEAR:
+      return COGL_PIPELINE_FILTER_LINEAR_MIPMAP_LINEAR;
+    case CLUTTER_SCALING_FILTER_LINEAR:
+    default:
+      return COGL_PIPELINE_FILTER_LINEAR;
+    }
+}
+
+/* Mipmaps are generated for a whole atlas page, where the padding
+ * around an image only keeps its neighbours out at full size, so
+ * images on a page aren't drawn with mipmaps */
+static void
+get_scaling_filters (StImageContent       *image_content,
+                     ClutterActor         *actor,
+                     ClutterScalingFilter *min_filter,
+                     ClutterScalingFilter *mag_filter)
+{
+  clutter_actor_get_content_scaling_filters (actor, min_filter, mag_filter);
+
+  if (!COGL_IS_SUB_TEXTURE (image_content->texture))
+    return;
+
+  if (*min_filter == CLUTTER_SCALING_FILTER_TRILINEAR)
+    *min_filter = CLUTTER_SCALING_FILTER_LINEAR;
+  if (*mag_filter == CLUTTER_SCALING_FILTER_TRILINEAR)
+    *mag_filter = CLUTTER_SCALING_FILTER_LINEAR;
+}
+
+static void
+premultiply_color (const CoglColor *color,
+                   float            alpha,
+                   float           *value)
+{
+  value[0] = color->red / 255. * alpha;
+  value[1] = color->green / 255. * alpha;
+  value[2] = color->blue / 255. * alpha;
+  value[3] = alpha;
+}
+
+/* The red, green and blue channels of the mask are the coverage of the
+ * success, warning and error parts of the icon, and what is left of the
+ * alpha channel is the coverage of the foreground. Like when icons were
+ * recolored on the CPU, the alpha of the foreground color applies to
+ * the whole icon. */
+static CoglPipeline *
+create_recolor_pipeline (StImageContent *image_content,
+                         ClutterActor   *actor)
+{
+  static CoglPipelineKey recolor_pipeline_key = "st-image-content-recolor";
+  ClutterContext *context = clutter_actor_get_context (actor);
+  ClutterBackend *backend = clutter_context_get_backend (context);
+  CoglContext *cogl_context = clutter_backend_get_cogl_context (backend);
+  CoglPipeline *template;
+  CoglPipeline *pipeline;
+
+  template = cogl_context_get_named_pipeline (cogl_context, &recolor_pipeline_key);
+
+  if (G_UNLIKELY (template == NULL))
+    {
+      CoglSnippet *snippet;
+
+      snippet = cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT,
+                                  "uniform vec4 st_icon_colors[4];\n",
+                                  "vec4 mask = cogl_color_out;\n"
+                                  "float fg = max (mask.a - mask.r - mask.g - mask.b, 0.0);\n"
+                                  "cogl_color_out = st_icon_colors[0] * fg +\n"
+                                  "                 st_icon_colors[1] * mask.r +\n"
+                                  "                 st_icon_colors[2] * mask.g +\n"
+                                  "                 st_icon_colors[3] * mask.b;\n");
+
+      template = cogl_pipeline_new (cogl_context);
+      cogl_pipeline_set_layer_null_texture (template, 0);
+      cogl_pipeline_add_snippet (template, snippet);
+      g_object_unref (snippet);
+
+      cogl_context_set_named_pipeline (cogl_context,
+                                       &recolor_pipeline_key,
+                                       template);
+    }
+
+  pipeline = cogl_pipeline_copy (template);
+  cogl_pipeline_set_layer_texture (pipeline, 0, image_content->texture);
+
+  return pipeline;
+}
+
+/* Filters and opacity are the actor's, and may change between paints */
+static void
+update_recolor_pipeline (StImageContent *image_content,
+                         ClutterActor   *actor)
+{
+  CoglPipeline *pipeline = image_content->recolor_pipeline;
+  StIconColors *colors = image_content->colors;
+  ClutterScalingFilter min_filter, mag_filter;
+  float values[4 * 4];
+  float alpha;
+
+  get_scaling_filters (image_content, actor, &min_filter, &mag_filter);
+  cogl_pipeline_set_layer_filters (pipeline, 0,
+                                   get_pipeline_filter (min_filter),
+                                   get_pipeline_filter (mag_filter));
+
+  alpha = colors->foreground.alpha / 255. *
+          clutter_actor_get_paint_opacity (actor) / 255.;
+
+  premultiply_color (&colors->foreground, alpha, &values[0]);
+  premultiply_color (&colors->success, alpha, &values[4]);
+  premultiply_color (&colors->warning, alpha, &values[8]);
+  premultiply_color (&colors->error, alpha, &values[12]);
+
+  cogl_pipeline_set_uniform_float (pipeline,
+                                   cogl_pipeline_get_uniform_location (pipeline, "st_icon_colors"),
+                                   4, 4, values);
+}
+
 static void
 st_image_content_paint_content (ClutterContent      *content,
                                 ClutterActor        *actor,
@@ -212,17 +345,72 @@ st_image_content_paint_content (ClutterContent      *content,
   if (image_content->texture == NULL)
     return;
 
-  node = clutter_actor_create_texture_paint_node (actor, image_content->texture);
+  _st_texture_atlas_count_draw (image_content->texture);
+
+  if (image_content->colors != NULL)
+    {
+      ClutterActorBox box;
+
+      if (image_content->recolor_pipeline == NULL)
+        image_content->recolor_pipeline = create_recolor_pipeline (image_content, actor);
+
+      update_recolor_pipeline (image_content, actor);
+      clutter_actor_get_content_box (actor, &box);
+
+      node = clutter_pipeline_node_new (image_content->recolor_pipeline);
+      clutter_paint_node_set_static_name (node, "Recolored Image Content");
+      clutter_paint_node_add_rectangle (node, &box);
+      clutter_paint_node_add_child (root, node);
+      clutter_paint_node_unref (node);
+      return;
+    }
+
+  if (COGL_IS_SUB_TEXTURE (image_content->texture))
+    {
+      ClutterScalingFilter min_filter, mag_filter;
+      ClutterActorBox box;
+      CoglColor color;
+      float opacity;
+
+      get_scaling_filters (image_content, actor, &min_filter, &mag_filter);
+
+      opacity = clutter_actor_get_paint_opacity (actor) / 255.;
+      cogl_color_init_from_4f (&color, opacity, opacity, opacity, opacity);
+      clutter_actor_get_content_box (actor, &box);
+
+      node = clutter_texture_node_new (image_content->texture, &color,
+                                       min_filter, mag_filter);
+      clutter_paint_node_add_rectangle (node, &box);
+    }
+  else
+    {
+      node = clutter_actor_create_texture_paint_node (actor, image_content->texture);
+    }
+
   clutter_paint_node_set_static_name (node, "Image Content");
   clutter_paint_node_add_child (root, node);
   clutter_paint_node_unref (node);
 }
 
+/* A recolored icon is what actors display, while the texture cache
+ * holds on to the mask, so the mask is told when it might have stopped
+ * being displayed */
+static void
+st_image_content_detached (ClutterContent *content,
+                           ClutterActor   *actor)
+{
+  StImageContent *image_content = ST_IMAGE_CONTENT (content);
+
+  if (image_content->mask != NULL)
+    g_signal_emit_by_name (image_content->mask, "detached", actor);
+}
+
 static void
 clutter_content_interface_init (ClutterContentInterface *iface)
 {
   iface->get_preferred_size = st_image_content_get_preferred_size;
   iface->paint_content = st_image_content_paint_content;
+  iface->detached = st_image_content_detached;
 }
 
 static guint
@@ -316,8 +504,9 @@ st_image_load_async (GLoadableIcon       *icon,
   g_autoptr (GTask) task = NULL;
 
   task = g_task_new (icon, cancellable, callback, user_data);
+  g_task_set_priority (task, ST_DECODE_PRIORITY_BACKGROUND);
   g_task_set_task_data (task, GINT_TO_POINTER (size), NULL);
-  g_task_run_in_thread (task, load_image_thread);
+  _st_decode_scheduler_run (task, load_image_thread);
 }
 
 static GInputStream *
@@ -346,6 +535,39 @@ g_loadable_icon_interface_init (GLoadableIconIface *iface)
   iface->load_finish = st_image_load_finish;
 }
 
+/*
+ * _st_image_content_new_recolored:
+ * @mask: a symbolic icon rendered as a color mask
+ * @colors: the colors to paint it with
+ *
+ * Creates a content that shares the texture of @mask, and paints it
+ * with @colors. The returned content keeps a reference on @mask.
+ *
+ * Returns: (transfer full): a new #StImageContent
+ */
+ClutterContent *
+_st_image_content_new_recolored (StImageContent *mask,
+                                 StIconColors   *colors)
+{
+  StImageContent *content;
+
+  g_return_val_if_fail (ST_IS_IMAGE_CONTENT (mask), NULL);
+  g_return_val_if_fail (colors != NULL, NULL);
+
+  content = g_object_new (ST_TYPE_IMAGE_CONTENT,
+                          "preferred-width", mask->width,
+                          "preferred-height", mask->height,
+                          NULL);
+
+  if (mask->texture)
+    content->texture = g_object_ref (mask->texture);
+  content->is_symbolic = mask->is_symbolic;
+  content->mask = g_object_ref (mask);
+  content->colors = st_icon_colors_ref (colors);
+
+  return CLUTTER_CONTENT (content);
+}
+
 /**
  * st_image_content_new_with_preferred_size:
  * @width: The preferred width to be used when drawing the content
@@ -581,6 +803,34 @@ st_image_content_set_bytes (StImageContent   *content,
   return TRUE;
 }
 
+/* Uses @texture as is, which may be a sub-texture of an atlas */
+void
+st_image_content_set_texture (StImageContent *content,
+                              CoglTexture    *texture)
+{
+  int old_width = 0;
+  int old_height = 0;
+
+  g_return_if_fail (ST_IS_IMAGE_CONTENT (content));
+  g_return_if_fail (texture != NULL);
+
+  if (content->texture != NULL)
+    {
+      old_width = cogl_texture_get_width (content->texture);
+      old_height = cogl_texture_get_height (content->texture);
+
+      g_object_unref (content->texture);
+    }
+
+  content->texture = g_object_ref (texture);
+
+  clutter_content_invalidate (CLUTTER_CONTENT (content));
+
+  if (old_width != cogl_texture_get_width (texture) ||
+      old_height != cogl_texture_get_height (texture))
+    clutter_content_invalidate_size (CLUTTER_CONTENT (content));
+}
+
 /**
  * st_image_content_get_texture:
  * @content: a #StcontentContent
@@ -22,6 +22,17 @@
 #include <math.h>
 #include <string.h>
 
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define HAVE_BLUR_AVX2 1
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 #include <clutter/clutter-pango.h>
 
 #include "st-private.h"
@@ -241,11 +252,27 @@ _st_create_texture_pipeline (CoglTexture *src_texture)
  * Shadows
  *****/
 
-static gdouble *
+/* Kernel weights are fixed point numbers with this many fractional bits.
+ * With 24 bits, truncating each weighted pixel gives the same result as
+ * truncating it in double precision. */
+#define KERNEL_SHIFT 24
+
+/* Number of pixels the vector versions of accumulate() handle per
+ * iteration */
+#define BLOCK_SIZE 16
+
+typedef void (* AccumulateFunc) (guint32      *acc,
+                                 const guchar *src,
+                                 guint32       weight,
+                                 gint          n_values);
+
+static guint32 *
 calculate_gaussian_kernel (gdouble   sigma,
                            guint     n_values)
 {
-  gdouble *ret, sum;
+  g_autofree gdouble *values = NULL;
+  guint32 *ret;
+  gdouble sum;
   gdouble exp_divisor;
   int half, i;
 
@@ -253,7 +280,8 @@ calculate_gaussian_kernel (gdouble   sigma,
 
   half = n_values / 2;
 
-  ret = g_malloc (n_values * sizeof (gdouble));
+  values = g_malloc (n_values * sizeof (gdouble));
+  ret = g_malloc (n_values * sizeof (guint32));
   sum = 0.0;
 
   exp_divisor = 2 * sigma * sigma;
@@ -261,17 +289,213 @@ calculate_gaussian_kernel (gdouble   sigma,
   /* n_values of 1D Gauss function */
   for (i = 0; i < (int)n_values; i++)
     {
-      ret[i] = exp (-(i - half) * (i - half) / exp_divisor);
-      sum += ret[i];
+      values[i] = exp (-(i - half) * (i - half) / exp_divisor);
+      sum += values[i];
     }
 
   /* normalize */
   for (i = 0; i < (int)n_values; i++)
-    ret[i] /= sum;
+    ret[i] = (guint32) ((values[i] / sum) * (1 << KERNEL_SHIFT) + 0.5);
 
   return ret;
 }
 
+/* Adds the @n_values pixels at @src, multiplied by @weight, to @acc.
+ *
+ * Each weighted pixel is truncated before it is added. That makes
+ * shadows less opaque than an exact Gaussian blur would, by up to a
+ * quarter for large blur radii, but it is how shadows were always
+ * blurred, and the shadows of the theme are tuned for it.
+ */
+static void
+accumulate_scalar (guint32      *acc,
+                   const guchar *src,
+                   guint32       weight,
+                   gint          n_values)
+{
+  gint x;
+
+  for (x = 0; x < n_values; x++)
+    acc[x] += (src[x] * weight) >> KERNEL_SHIFT;
+}
+
+#ifdef __SSE2__
+/* SSE2 has no 32-bit multiplication that keeps the low halves, so
+ * multiply the even and odd lanes separately */
+static inline __m128i
+multiply_and_shift_sse2 (__m128i values,
+                         __m128i weight)
+{
+  __m128i even, odd;
+
+  even = _mm_mul_epu32 (values, weight);
+  odd = _mm_mul_epu32 (_mm_srli_epi64 (values, 32), weight);
+
+  return _mm_srli_epi32 (_mm_or_si128 (even, _mm_slli_epi64 (odd, 32)),
+                         KERNEL_SHIFT);
+}
+
+static void
+accumulate_sse2 (guint32      *acc,
+                 const guchar *src,
+                 guint32       weight,
+                 gint          n_values)
+{
+  __m128i zero = _mm_setzero_si128 ();
+  __m128i weights = _mm_set1_epi32 (weight);
+  gint x, i;
+
+  for (x = 0; x + BLOCK_SIZE <= n_values; x += BLOCK_SIZE)
+    {
+      __m128i bytes = _mm_loadu_si128 ((const __m128i *) (src + x));
+      __m128i low = _mm_unpacklo_epi8 (bytes, zero);
+      __m128i high = _mm_unpackhi_epi8 (bytes, zero);
+      __m128i values[4] = {
+        _mm_unpacklo_epi16 (low, zero),
+        _mm_unpackhi_epi16 (low, zero),
+        _mm_unpacklo_epi16 (high, zero),
+        _mm_unpackhi_epi16 (high, zero),
+      };
+
+      for (i = 0; i < 4; i++)
+        {
+          __m128i *sum = (__m128i *) (acc + x + 4 * i);
+
+          _mm_storeu_si128 (sum,
+                            _mm_add_epi32 (_mm_loadu_si128 (sum),
+                                           multiply_and_shift_sse2 (values[i],
+                                                                    weights)));
+        }
+    }
+
+  accumulate_scalar (acc + x, src + x, weight, n_values - x);
+}
+#endif
+
+#ifdef HAVE_BLUR_AVX2
+__attribute__ ((target ("avx2")))
+static void
+accumulate_avx2 (guint32      *acc,
+                 const guchar *src,
+                 guint32       weight,
+                 gint          n_values)
+{
+  __m256i weights = _mm256_set1_epi32 (weight);
+  gint x, i;
+
+  for (x = 0; x + BLOCK_SIZE <= n_values; x += BLOCK_SIZE)
+    {
+      for (i = 0; i < BLOCK_SIZE; i += 8)
+        {
+          __m128i bytes = _mm_loadl_epi64 ((const __m128i *) (src + x + i));
+          __m256i values = _mm256_cvtepu8_epi32 (bytes);
+          __m256i *sum = (__m256i *) (acc + x + i);
+
+          values = _mm256_srli_epi32 (_mm256_mullo_epi32 (values, weights),
+                                      KERNEL_SHIFT);
+          _mm256_storeu_si256 (sum,
+                               _mm256_add_epi32 (_mm256_loadu_si256 (sum),
+                                                 values));
+        }
+    }
+
+  accumulate_scalar (acc + x, src + x, weight, n_values - x);
+}
+#endif
+
+#ifdef __ARM_NEON
+static void
+accumulate_neon (guint32      *acc,
+                 const guchar *src,
+                 guint32       weight,
+                 gint          n_values)
+{
+  gint x, i;
+
+  for (x = 0; x + BLOCK_SIZE <= n_values; x += BLOCK_SIZE)
+    {
+      uint8x16_t bytes = vld1q_u8 (src + x);
+      uint16x8_t low = vmovl_u8 (vget_low_u8 (bytes));
+      uint16x8_t high = vmovl_u8 (vget_high_u8 (bytes));
+      uint32x4_t values[4] = {
+        vmovl_u16 (vget_low_u16 (low)),
+        vmovl_u16 (vget_high_u16 (low)),
+        vmovl_u16 (vget_low_u16 (high)),
+        vmovl_u16 (vget_high_u16 (high)),
+      };
+
+      for (i = 0; i < 4; i++)
+        {
+          uint32x4_t sum = vld1q_u32 (acc + x + 4 * i);
+
+          sum = vsraq_n_u32 (sum, vmulq_n_u32 (values[i], weight), KERNEL_SHIFT);
+          vst1q_u32 (acc + x + 4 * i, sum);
+        }
+    }
+
+  accumulate_scalar (acc + x, src + x, weight, n_values - x);
+}
+#endif
+
+typedef struct
+{
+  const char *name;
+  AccumulateFunc accumulate;
+} BlurImplementation;
+
+static const BlurImplementation *
+get_blur_implementation (void)
+{
+  static const BlurImplementation *implementation = NULL;
+
+  if (g_once_init_enter (&implementation))
+    {
+      static const BlurImplementation scalar = { "scalar", accumulate_scalar };
+#ifdef __SSE2__
+      static const BlurImplementation sse2 = { "sse2", accumulate_sse2 };
+#endif
+#ifdef HAVE_BLUR_AVX2
+      static const BlurImplementation avx2 = { "avx2", accumulate_avx2 };
+#endif
+#ifdef __ARM_NEON
+      static const BlurImplementation neon = { "neon", accumulate_neon };
+#endif
+      const BlurImplementation *best = &scalar;
+
+#ifdef __SSE2__
+      best = &sse2;
+#endif
+#ifdef HAVE_BLUR_AVX2
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        best = &avx2;
+#endif
+#ifdef __ARM_NEON
+      best = &neon;
+#endif
+
+      if (g_strcmp0 (g_getenv ("ST_BLUR_IMPLEMENTATION"), "scalar") == 0)
+        best = &scalar;
+
+      g_once_init_leave (&implementation, best);
+    }
+
+  return implementation;
+}
+
+/**
+ * _st_get_blur_implementation_name:
+ *
+ * Returns: the name of the code path used to blur shadows on this
+ *   machine, such as "avx2". Setting the ST_BLUR_IMPLEMENTATION
+ *   environment variable to "scalar" selects the portable one.
+ */
+const char *
+_st_get_blur_implementation_name (void)
+{
+  return get_blur_implementation ()->name;
+}
+
 static guchar *
 blur_pixels (guchar  *pixels_in,
              gint     width_in,
@@ -301,10 +525,13 @@ blur_pixels (guchar  *pixels_in,
     }
   else
     {
-      gdouble *kernel;
-      guchar  *line;
+      AccumulateFunc accumulate = get_blur_implementation ()->accumulate;
+      guint32 *kernel;
+      guint32 *acc;
+      guchar  *tmp;
+      gsize    tmp_stride;
       gint     n_values, half;
-      gint     x_in, y_in, x_out, y_out, i;
+      gint     x, y_in, y_out, i;
 
       n_values = (gint) 5 * sigma;
       half = n_values / 2;
@@ -314,74 +541,89 @@ blur_pixels (guchar  *pixels_in,
       *rowstride_out = (*width_out + 3) & ~3;
 
       pixels_out = g_malloc0 (*rowstride_out * *height_out);
-      line       = g_malloc0 (*rowstride_out);
 
-      kernel = calculate_gaussian_kernel (sigma, n_values);
+      /* The rows of the result of the vertical pass have 'half' pixels
+       * of zero padding on both sides, so the horizontal pass doesn't
+       * need to clamp. Since the weighted pixels are truncated, no sum
+       * exceeds 255. */
+      tmp_stride = *width_out + 2 * half;
+      tmp = g_malloc0 (tmp_stride * *height_out);
+      acc = g_new (guint32, *width_out);
 
-      /* vertical blur */
-      for (x_in = 0; x_in < width_in; x_in++)
-        for (y_out = 0; y_out < *height_out; y_out++)
-          {
-            guchar *pixel_in, *pixel_out;
-            gint i0, i1;
-
-            y_in = y_out - half;
-
-            /* We read from the source at 'y = y_in + i - half'; clamp the
-             * full i range [0, n_values) so that y is in [0, height_in).
-             */
-            i0 = MAX (half - y_in, 0);
-            i1 = MIN (height_in + half - y_in, n_values);
-
-            pixel_in  =  pixels_in + (y_in + i0 - half) * rowstride_in + x_in;
-            pixel_out =  pixels_out + y_out * *rowstride_out + (x_in + half);
+      kernel = calculate_gaussian_kernel (sigma, n_values);
 
-            for (i = i0; i < i1; i++)
-              {
-                *pixel_out += *pixel_in * kernel[i];
-                pixel_in += rowstride_in;
-              }
-          }
+      /* vertical blur, a whole row at a time so that memory is accessed
+       * sequentially */
+      for (y_out = 0; y_out < *height_out; y_out++)
+        {
+          guchar *row_out;
+          gint i0, i1;
+
+          y_in = y_out - half;
+
+          /* We read from the source at 'y = y_in + i - half'; clamp the
+           * full i range [0, n_values) so that y is in [0, height_in).
+           */
+          i0 = MAX (half - y_in, 0);
+          i1 = MIN (height_in + half - y_in, n_values);
+
+          memset (acc, 0, width_in * sizeof (guint32));
+          for (i = i0; i < i1; i++)
+            accumulate (acc,
+                        pixels_in + (y_in + i - half) * rowstride_in,
+                        kernel[i],
+                        width_in);
+
+          /* skip the padding, then 'half' pixels to center the input */
+          row_out = tmp + y_out * tmp_stride + 2 * half;
+          for (x = 0; x < width_in; x++)
+            row_out[x] = acc[x];
+        }
 
       /* horizontal blur */
       for (y_out = 0; y_out < *height_out; y_out++)
         {
-          memcpy (line, pixels_out + y_out * *rowstride_out, *rowstride_out);
-
-          for (x_out = 0; x_out < *width_out; x_out++)
-            {
-              gint i0, i1;
-              guchar *pixel_out, *pixel_in;
-
-              /* We read from the source at 'x = x_out + i - half'; clamp the
-               * full i range [0, n_values) so that x is in [0, width_out).
-               */
-              i0 = MAX (half - x_out, 0);
-              i1 = MIN (*width_out + half - x_out, n_values);
-
-              pixel_in  = line + x_out + i0 - half;
-              pixel_out = pixels_out + *rowstride_out * y_out + x_out;
-
-              *pixel_out = 0;
-              for (i = i0; i < i1; i++)
-                {
-                  *pixel_out += *pixel_in * kernel[i];
-                  pixel_in++;
-                }
-            }
+          const guchar *row_in = tmp + y_out * tmp_stride;
+          guchar *row_out = pixels_out + y_out * *rowstride_out;
+
+          /* We read from the source at 'x = x_out + i - half', which is
+           * 'x_out + i' in the padded row.
+           */
+          memset (acc, 0, *width_out * sizeof (guint32));
+          for (i = 0; i < n_values; i++)
+            accumulate (acc, row_in + i, kernel[i], *width_out);
+
+          for (x = 0; x < *width_out; x++)
+            row_out[x] = acc[x];
         }
+
       g_free (kernel);
-      g_free (line);
+      g_free (acc);
+      g_free (tmp);
     }
 
   return pixels_out;
 }
 
-CoglPipeline *
-_st_create_shadow_pipeline (StShadow            *shadow_spec,
-                            ClutterPaintContext *paint_context,
-                            CoglTexture         *src_texture,
-                            float                resource_scale)
+/**
+ * _st_create_shadow_texture:
+ * @shadow_spec: the definition of the shadow
+ * @paint_context: the current paint context
+ * @src_texture: the texture to create the shadow for
+ * @resource_scale: the resource scale of @src_texture
+ *
+ * Blurs the silhouette of @src_texture, that is its alpha channel with
+ * every non-transparent pixel made opaque, into a new texture that is
+ * larger than @src_texture by the blur radius on each side. Only the
+ * blur radius of @shadow_spec is used.
+ *
+ * Returns: (transfer full) (nullable): the blurred texture
+ */
+CoglTexture *
+_st_create_shadow_texture (StShadow            *shadow_spec,
+                           ClutterPaintContext *paint_context,
+                           CoglTexture         *src_texture,
+                           float                resource_scale)
 {
   g_autoptr (ClutterPaintNode) texture_node = NULL;
   g_autoptr (ClutterPaintNode) blur_node = NULL;
@@ -391,7 +633,6 @@ _st_create_shadow_pipeline (StShadow            *shadow_spec,
   ClutterPaintContext *nested_paint_context;
   ClutterColorState *color_state;
   CoglFramebuffer *fb;
-  CoglPipeline *pipeline;
   CoglTexture *texture;
   float sampling_radius;
   float radius;
@@ -401,7 +642,6 @@ _st_create_shadow_pipeline (StShadow            *shadow_spec,
 
   static CoglPipelineKey texture_pipeline_key =
     "st-create-shadow-pipeline-saturate-alpha";
-  static CoglPipeline *shadow_pipeline_template = NULL;
 
   g_return_val_if_fail (shadow_spec != NULL, NULL);
   g_return_val_if_fail (src_texture != NULL, NULL);
@@ -485,8 +725,26 @@ _st_create_shadow_pipeline (StShadow            *shadow_spec,
   clutter_paint_context_pop_color_state (nested_paint_context);
   clutter_paint_context_destroy (nested_paint_context);
 
+  return texture;
+}
+
+/**
+ * _st_create_shadow_pipeline_for_texture:
+ * @shadow_texture: a texture created by _st_create_shadow_texture()
+ *
+ * Returns: (transfer full): a pipeline painting @shadow_texture with
+ *   the color passed to _st_paint_shadow_with_opacity()
+ */
+CoglPipeline *
+_st_create_shadow_pipeline_for_texture (CoglTexture *shadow_texture)
+{
+  static CoglPipeline *shadow_pipeline_template = NULL;
+  CoglPipeline *pipeline;
+
   if (G_UNLIKELY (shadow_pipeline_template == NULL))
     {
+      CoglContext *cogl_context = cogl_texture_get_context (shadow_texture);
+
       shadow_pipeline_template = cogl_pipeline_new (cogl_context);
 
       /* We set up the pipeline to blend the shadow texture with the combine
@@ -498,13 +756,27 @@ _st_create_shadow_pipeline (StShadow            *shadow_spec,
     }
 
   pipeline = cogl_pipeline_copy (shadow_pipeline_template);
-  cogl_pipeline_set_layer_texture (pipeline, 0, texture);
-
-  g_clear_object (&texture);
+  cogl_pipeline_set_layer_texture (pipeline, 0, shadow_texture);
 
   return pipeline;
 }
 
+CoglPipeline *
+_st_create_shadow_pipeline (StShadow            *shadow_spec,
+                            ClutterPaintContext *paint_context,
+                            CoglTexture         *src_texture,
+                            float                resource_scale)
+{
+  g_autoptr (CoglTexture) texture = NULL;
+
+  texture = _st_create_shadow_texture (shadow_spec, paint_context,
+                                       src_texture, resource_scale);
+  if (texture == NULL)
+    return NULL;
+
+  return _st_create_shadow_pipeline_for_texture (texture);
+}
+
 CoglPipeline *
 _st_create_shadow_pipeline_from_actor (StShadow            *shadow_spec,
                                        ClutterActor        *actor,
@@ -57,6 +57,11 @@ void _st_set_text_from_style (ClutterText *text,
 CoglPipeline * _st_create_texture_pipeline (CoglTexture *src_texture);
 
 /* Helper for widgets which need to draw additional shadows */
+CoglTexture *  _st_create_shadow_texture (StShadow            *shadow_spec,
+                                          ClutterPaintContext *paint_context,
+                                          CoglTexture         *src_texture,
+                                          float                resource_scale);
+CoglPipeline * _st_create_shadow_pipeline_for_texture (CoglTexture *shadow_texture);
 CoglPipeline * _st_create_shadow_pipeline (StShadow            *shadow_spec,
                                            ClutterPaintContext *paint_context,
                                            CoglTexture         *src_texture,
@@ -67,6 +72,8 @@ CoglPipeline * _st_create_shadow_pipeline_from_actor (StShadow            *shado
 cairo_pattern_t *_st_create_shadow_cairo_pattern (StShadow        *shadow_spec,
                                                   cairo_pattern_t *src_pattern);
 
+const char *_st_get_blur_implementation_name (void);
+
 void _st_paint_shadow_with_opacity (StShadow         *shadow_spec,
                                     ClutterPaintNode *node,
                                     CoglPipeline     *shadow_pipeline,
@@ -0,0 +1,668 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-texture-atlas.c: Shared textures for small images
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Rounded corners and icons are small, and a panel or a menu paints
+ * dozens of them. As separate textures, each one starts a new batch in
+ * the Cogl journal. Cogl compares the GL textures behind sub-textures
+ * when batching, so images that are packed into the same atlas page
+ * can be drawn together.
+ *
+ * Pages are filled with shelves: rows as high as the first image put
+ * on them, on which images of similar height are placed left to right.
+ * Each image is surrounded by a copy of its edge pixels, so bilinear
+ * filtering doesn't pick up its neighbours. That's not enough for the
+ * smaller mipmap levels, so images on a page are never drawn with
+ * mipmaps.
+ *
+ * Callers own the sub-textures; the atlas notices when one is
+ * finalized. The space of an image that goes away is reused by later
+ * images of the same or a smaller width on that shelf, a shelf whose
+ * images are all gone is reused with any height up to its own, empty
+ * shelves at the bottom of a page are given back to the page, and a
+ * page without images is freed unless it's the last one.
+ *
+ * When all pages are full, the atlas asks its owner to drop the images
+ * it only keeps around for later, starting with the emptiest page, see
+ * _st_texture_atlas_set_evict_func(). Only images that nothing draws
+ * anymore are dropped, so a page that is in use stays full, and new
+ * images get textures of their own until something is freed.
+ *
+ * Whether atlasing pays off shows in the number of texture switches
+ * between the images St draws, see _st_texture_atlas_count_draw().
+ */
+
+#include <string.h>
+
+#include "st-texture-atlas.h"
+
+/* Edge pixels copied around each image */
+#define PADDING 1
+
+typedef struct
+{
+  int x;
+  int width;
+} AtlasSpan;
+
+typedef struct
+{
+  int y;
+  int height;
+  int x; /* where the next image goes */
+  guint n_images;
+  GArray *free_spans; /* AtlasSpan left of x, sorted by x */
+} AtlasShelf;
+
+typedef struct
+{
+  StTextureAtlas *atlas;
+  CoglTexture *texture;
+  GArray *shelves; /* AtlasShelf, from top to bottom */
+  int height; /* used by shelves */
+  gsize used_area; /* taken by images, including padding */
+  GQueue images; /* AtlasImage */
+} AtlasPage;
+
+typedef struct
+{
+  AtlasPage *page;
+  guint shelf;
+  int x;
+  int width;
+  CoglTexture *texture; /* not owned */
+  GList link;
+} AtlasImage;
+
+struct _StTextureAtlas
+{
+  GQueue pages; /* AtlasPage */
+  guint n_images;
+  guint n_evictions;
+
+  StTextureAtlasEvictFunc evict_func;
+  gpointer evict_data;
+};
+
+/* What was drawn last, only compared against and never dereferenced */
+static gconstpointer last_drawn_texture;
+static guint n_textured_draws;
+static guint n_texture_switches;
+
+StTextureAtlas *
+_st_texture_atlas_new (void)
+{
+  StTextureAtlas *atlas = g_new0 (StTextureAtlas, 1);
+
+  g_queue_init (&atlas->pages);
+
+  return atlas;
+}
+
+static void atlas_image_finalized (AtlasImage *image,
+                                   GObject    *texture);
+
+static void
+atlas_page_free (AtlasPage *page)
+{
+  AtlasImage *image;
+
+  while ((image = g_queue_pop_head (&page->images)) != NULL)
+    {
+      g_object_weak_unref (G_OBJECT (image->texture),
+                           (GWeakNotify) atlas_image_finalized,
+                           image);
+      g_free (image);
+    }
+
+  g_object_unref (page->texture);
+  g_array_unref (page->shelves);
+  g_free (page);
+}
+
+void
+_st_texture_atlas_free (StTextureAtlas *atlas)
+{
+  g_queue_free_full (&atlas->pages, (GDestroyNotify) atlas_page_free);
+  g_free (atlas);
+}
+
+static void
+atlas_shelf_clear (AtlasShelf *shelf)
+{
+  g_clear_pointer (&shelf->free_spans, g_array_unref);
+}
+
+static AtlasPage *
+atlas_page_new (StTextureAtlas *atlas,
+                CoglContext    *cogl_context)
+{
+  AtlasPage *page = g_new0 (AtlasPage, 1);
+
+  page->atlas = atlas;
+  page->texture = cogl_texture_2d_new_with_size (cogl_context,
+                                                 ST_TEXTURE_ATLAS_PAGE_SIZE,
+                                                 ST_TEXTURE_ATLAS_PAGE_SIZE);
+  page->shelves = g_array_new (FALSE, FALSE, sizeof (AtlasShelf));
+  g_array_set_clear_func (page->shelves, (GDestroyNotify) atlas_shelf_clear);
+  g_queue_init (&page->images);
+
+  return page;
+}
+
+/* Takes width pixels from the first free span of @shelf they fit in,
+ * or from its end */
+static gboolean
+atlas_shelf_reserve (AtlasShelf *shelf,
+                     int         width,
+                     int        *x_out)
+{
+  guint i;
+
+  for (i = 0; i < shelf->free_spans->len; i++)
+    {
+      AtlasSpan *span = &g_array_index (shelf->free_spans, AtlasSpan, i);
+
+      if (span->width < width)
+        continue;
+
+      *x_out = span->x;
+
+      span->x += width;
+      span->width -= width;
+      if (span->width == 0)
+        g_array_remove_index (shelf->free_spans, i);
+
+      return TRUE;
+    }
+
+  if (shelf->x + width > ST_TEXTURE_ATLAS_PAGE_SIZE)
+    return FALSE;
+
+  *x_out = shelf->x;
+  shelf->x += width;
+
+  return TRUE;
+}
+
+static gboolean
+atlas_shelf_has_room (AtlasShelf *shelf,
+                      int         width)
+{
+  guint i;
+
+  if (shelf->x + width <= ST_TEXTURE_ATLAS_PAGE_SIZE)
+    return TRUE;
+
+  for (i = 0; i < shelf->free_spans->len; i++)
+    {
+      if (g_array_index (shelf->free_spans, AtlasSpan, i).width >= width)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Gives the span back to @shelf, merging it with the free spans next
+ * to it */
+static void
+atlas_shelf_release (AtlasShelf *shelf,
+                     int         x,
+                     int         width)
+{
+  AtlasSpan *prev = NULL, *next = NULL;
+  guint i;
+
+  if (x + width == shelf->x)
+    {
+      shelf->x = x;
+
+      /* The free span before the image may now end the shelf too */
+      if (shelf->free_spans->len > 0)
+        {
+          AtlasSpan *last = &g_array_index (shelf->free_spans, AtlasSpan,
+                                            shelf->free_spans->len - 1);
+
+          if (last->x + last->width == shelf->x)
+            {
+              shelf->x = last->x;
+              g_array_set_size (shelf->free_spans, shelf->free_spans->len - 1);
+            }
+        }
+
+      return;
+    }
+
+  for (i = 0; i < shelf->free_spans->len; i++)
+    {
+      if (g_array_index (shelf->free_spans, AtlasSpan, i).x > x)
+        break;
+    }
+
+  if (i > 0)
+    prev = &g_array_index (shelf->free_spans, AtlasSpan, i - 1);
+  if (i < shelf->free_spans->len)
+    next = &g_array_index (shelf->free_spans, AtlasSpan, i);
+
+  if (prev != NULL && prev->x + prev->width == x)
+    {
+      prev->width += width;
+
+      if (next != NULL && x + width == next->x)
+        {
+          prev->width += next->width;
+          g_array_remove_index (shelf->free_spans, i);
+        }
+    }
+  else if (next != NULL && x + width == next->x)
+    {
+      next->x = x;
+      next->width += width;
+    }
+  else
+    {
+      AtlasSpan span = { x, width };
+
+      g_array_insert_val (shelf->free_spans, i, span);
+    }
+}
+
+/* Finds room for a width x height rectangle on @page, preferring the
+ * lowest shelf it fits on so that tall shelves aren't filled with
+ * small images */
+static gboolean
+atlas_page_reserve (AtlasPage *page,
+                    int        width,
+                    int        height,
+                    guint     *shelf_out,
+                    int       *x_out,
+                    int       *y_out)
+{
+  AtlasShelf *shelf;
+  int best = -1;
+  guint i;
+
+  for (i = 0; i < page->shelves->len; i++)
+    {
+      shelf = &g_array_index (page->shelves, AtlasShelf, i);
+
+      if (shelf->height < height || !atlas_shelf_has_room (shelf, width))
+        continue;
+
+      /* Only put an image on a much taller shelf if it's empty */
+      if (shelf->n_images > 0 && shelf->height > height + height / 2)
+        continue;
+
+      if (best < 0 ||
+          shelf->height < g_array_index (page->shelves, AtlasShelf, best).height)
+        best = i;
+    }
+
+  if (best < 0)
+    {
+      AtlasShelf new_shelf = { 0, };
+
+      if (page->height + height > ST_TEXTURE_ATLAS_PAGE_SIZE)
+        return FALSE;
+
+      new_shelf.y = page->height;
+      new_shelf.height = height;
+      new_shelf.free_spans = g_array_new (FALSE, FALSE, sizeof (AtlasSpan));
+      g_array_append_val (page->shelves, new_shelf);
+      page->height += height;
+
+      best = page->shelves->len - 1;
+    }
+
+  shelf = &g_array_index (page->shelves, AtlasShelf, best);
+
+  if (!atlas_shelf_reserve (shelf, width, x_out))
+    g_assert_not_reached ();
+
+  *shelf_out = best;
+  *y_out = shelf->y;
+
+  shelf->n_images++;
+  page->used_area += (gsize) width * shelf->height;
+
+  return TRUE;
+}
+
+static void
+atlas_page_release (AtlasPage *page,
+                    guint      shelf_index,
+                    int        x,
+                    int        width)
+{
+  AtlasShelf *shelf = &g_array_index (page->shelves, AtlasShelf, shelf_index);
+
+  page->used_area -= (gsize) width * shelf->height;
+
+  shelf->n_images--;
+  if (shelf->n_images > 0)
+    {
+      atlas_shelf_release (shelf, x, width);
+      return;
+    }
+
+  shelf->x = 0;
+  g_array_set_size (shelf->free_spans, 0);
+
+  /* Give empty shelves at the bottom back to the page, so they can be
+   * opened again with a different height */
+  while (page->shelves->len > 0)
+    {
+      shelf = &g_array_index (page->shelves, AtlasShelf, page->shelves->len - 1);
+      if (shelf->n_images > 0)
+        break;
+
+      page->height = shelf->y;
+      g_array_set_size (page->shelves, page->shelves->len - 1);
+    }
+}
+
+static void
+atlas_image_finalized (AtlasImage *image,
+                       GObject    *texture)
+{
+  AtlasPage *page = image->page;
+  StTextureAtlas *atlas = page->atlas;
+
+  g_queue_unlink (&page->images, &image->link);
+  atlas_page_release (page, image->shelf, image->x, image->width);
+  atlas->n_images--;
+  g_free (image);
+
+  if (page->images.length == 0 && atlas->pages.length > 1)
+    {
+      g_queue_remove (&atlas->pages, page);
+      atlas_page_free (page);
+    }
+}
+
+static gboolean
+atlas_page_upload (AtlasPage       *page,
+                   int              x,
+                   int              y,
+                   int              width,
+                   int              height,
+                   CoglPixelFormat  format,
+                   int              rowstride,
+                   const guint8    *data)
+{
+  g_autofree guint8 *padded = NULL;
+  int bpp = cogl_pixel_format_get_bytes_per_pixel (format, 0);
+  int padded_width = width + 2 * PADDING;
+  int padded_height = height + 2 * PADDING;
+  int padded_rowstride = padded_width * bpp;
+  int row;
+
+  padded = g_malloc (padded_height * padded_rowstride);
+
+  for (row = 0; row < padded_height; row++)
+    {
+      const guint8 *src = data + CLAMP (row - PADDING, 0, height - 1) * rowstride;
+      guint8 *dst = padded + row * padded_rowstride;
+      int i;
+
+      for (i = 0; i < PADDING; i++)
+        {
+          memcpy (dst + i * bpp, src, bpp);
+          memcpy (dst + (PADDING + width + i) * bpp, src + (width - 1) * bpp, bpp);
+        }
+
+      memcpy (dst + PADDING * bpp, src, width * bpp);
+    }
+
+  return cogl_texture_set_region (page->texture,
+                                  0, 0,
+                                  x, y,
+                                  padded_width, padded_height,
+                                  padded_width, padded_height,
+                                  format,
+                                  padded_rowstride,
+                                  padded);
+}
+
+static AtlasPage *
+atlas_reserve (StTextureAtlas *atlas,
+               CoglContext    *cogl_context,
+               int             width,
+               int             height,
+               guint          *shelf,
+               int            *x,
+               int            *y)
+{
+  AtlasPage *page;
+  GList *l;
+
+  for (l = atlas->pages.head; l; l = l->next)
+    {
+      if (atlas_page_reserve (l->data, width, height, shelf, x, y))
+        return l->data;
+    }
+
+  if (atlas->pages.length >= ST_TEXTURE_ATLAS_MAX_PAGES)
+    return NULL;
+
+  page = atlas_page_new (atlas, cogl_context);
+  g_queue_push_tail (&atlas->pages, page);
+
+  if (!atlas_page_reserve (page, width, height, shelf, x, y))
+    g_assert_not_reached ();
+
+  return page;
+}
+
+/* The page with the least area in use that wasn't evicted from yet */
+static CoglTexture *
+atlas_find_eviction_victim (StTextureAtlas *atlas,
+                            GPtrArray      *evicted)
+{
+  AtlasPage *victim = NULL;
+  GList *l;
+
+  for (l = atlas->pages.head; l; l = l->next)
+    {
+      AtlasPage *page = l->data;
+
+      if (g_ptr_array_find (evicted, page->texture, NULL))
+        continue;
+
+      if (victim == NULL || page->used_area < victim->used_area)
+        victim = page;
+    }
+
+  return victim != NULL ? victim->texture : NULL;
+}
+
+/**
+ * _st_texture_atlas_add: (skip)
+ * @atlas: a #StTextureAtlas
+ * @cogl_context: a #CoglContext
+ * @width: width of the image
+ * @height: height of the image
+ * @format: format of @data
+ * @rowstride: rowstride of @data
+ * @data: the pixels of the image
+ *
+ * Copies the image into one of the pages of @atlas. If they are all
+ * full, the evict function is asked to free up a page first.
+ *
+ * Returns: (transfer full) (nullable): a texture for the image, or %NULL
+ *   if it is too large or the atlas is full
+ */
+CoglTexture *
+_st_texture_atlas_add (StTextureAtlas  *atlas,
+                       CoglContext     *cogl_context,
+                       int              width,
+                       int              height,
+                       CoglPixelFormat  format,
+                       int              rowstride,
+                       const guint8    *data)
+{
+  AtlasPage *page;
+  AtlasImage *image;
+  CoglTexture *texture;
+  guint shelf;
+  int x, y;
+
+  if (width <= 0 || height <= 0 ||
+      width > ST_TEXTURE_ATLAS_MAX_IMAGE_SIZE ||
+      height > ST_TEXTURE_ATLAS_MAX_IMAGE_SIZE)
+    return NULL;
+
+  page = atlas_reserve (atlas, cogl_context,
+                        width + 2 * PADDING, height + 2 * PADDING,
+                        &shelf, &x, &y);
+
+  if (page == NULL && atlas->evict_func != NULL)
+    {
+      g_autoptr (GPtrArray) evicted = NULL;
+      CoglTexture *victim;
+
+      /* Pages may be freed while evicting, so only their textures are
+       * held on to */
+      evicted = g_ptr_array_new_with_free_func (g_object_unref);
+
+      while (page == NULL &&
+             (victim = atlas_find_eviction_victim (atlas, evicted)) != NULL)
+        {
+          g_ptr_array_add (evicted, g_object_ref (victim));
+
+          atlas->n_evictions++;
+          atlas->evict_func (victim, atlas->evict_data);
+
+          page = atlas_reserve (atlas, cogl_context,
+                                width + 2 * PADDING, height + 2 * PADDING,
+                                &shelf, &x, &y);
+        }
+    }
+
+  if (page == NULL)
+    return NULL;
+
+  if (!atlas_page_upload (page, x, y, width, height, format, rowstride, data))
+    {
+      atlas_page_release (page, shelf, x, width + 2 * PADDING);
+      return NULL;
+    }
+
+  texture = cogl_sub_texture_new (cogl_context, page->texture,
+                                  x + PADDING, y + PADDING,
+                                  width, height);
+
+  image = g_new0 (AtlasImage, 1);
+  image->page = page;
+  image->shelf = shelf;
+  image->x = x;
+  image->width = width + 2 * PADDING;
+  image->texture = texture;
+  image->link.data = image;
+  g_queue_push_tail_link (&page->images, &image->link);
+  atlas->n_images++;
+
+  g_object_weak_ref (G_OBJECT (texture),
+                     (GWeakNotify) atlas_image_finalized,
+                     image);
+
+  return texture;
+}
+
+/**
+ * _st_texture_atlas_set_evict_func: (skip)
+ * @atlas: a #StTextureAtlas
+ * @func: (nullable): the function to call when the atlas is full
+ * @user_data: data to pass to @func
+ *
+ * Sets the function that drops the images on a page which are only
+ * kept for later. It's called with the texture of the page, which the
+ * textures of its images are sub-textures of.
+ */
+void
+_st_texture_atlas_set_evict_func (StTextureAtlas          *atlas,
+                                  StTextureAtlasEvictFunc  func,
+                                  gpointer                 user_data)
+{
+  atlas->evict_func = func;
+  atlas->evict_data = user_data;
+}
+
+/**
+ * _st_texture_atlas_count_draw: (skip)
+ * @texture: (nullable): the texture that is about to be drawn
+ *
+ * Counts a draw of @texture, and whether it uses a different GL
+ * texture than the previous draw. Cogl can't batch draws across such
+ * a switch, so fewer switches per draw mean fewer draw calls.
+ */
+void
+_st_texture_atlas_count_draw (CoglTexture *texture)
+{
+  gconstpointer drawn;
+
+  if (texture == NULL)
+    return;
+
+  drawn = texture;
+  if (COGL_IS_SUB_TEXTURE (texture))
+    drawn = cogl_sub_texture_get_parent (COGL_SUB_TEXTURE (texture));
+
+  n_textured_draws++;
+  if (drawn != last_drawn_texture)
+    n_texture_switches++;
+
+  last_drawn_texture = drawn;
+}
+
+/**
+ * _st_texture_atlas_get_draw_stats: (skip)
+ * @n_draws: (out) (optional): number of textured draws
+ * @n_switches: (out) (optional): number of draws that used a different
+ *   GL texture than the previous one
+ */
+void
+_st_texture_atlas_get_draw_stats (guint *n_draws,
+                                  guint *n_switches)
+{
+  if (n_draws)
+    *n_draws = n_textured_draws;
+  if (n_switches)
+    *n_switches = n_texture_switches;
+}
+
+/**
+ * _st_texture_atlas_get_stats: (skip)
+ * @atlas: a #StTextureAtlas
+ * @n_pages: (out) (optional): number of atlas pages
+ * @n_images: (out) (optional): number of images stored in the pages
+ * @n_evictions: (out) (optional): number of times a full page was
+ *   evicted from
+ */
+void
+_st_texture_atlas_get_stats (StTextureAtlas *atlas,
+                             guint          *n_pages,
+                             guint          *n_images,
+                             guint          *n_evictions)
+{
+  if (n_pages)
+    *n_pages = atlas->pages.length;
+  if (n_images)
+    *n_images = atlas->n_images;
+  if (n_evictions)
+    *n_evictions = atlas->n_evictions;
+}
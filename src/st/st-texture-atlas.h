@@ -0,0 +1,60 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-texture-atlas.h: Shared textures for small images
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cogl/cogl.h>
+
+G_BEGIN_DECLS
+
+/* Images larger than this, in device pixels, get a texture of their own */
+#define ST_TEXTURE_ATLAS_MAX_IMAGE_SIZE 64
+
+#define ST_TEXTURE_ATLAS_PAGE_SIZE 1024
+#define ST_TEXTURE_ATLAS_MAX_PAGES 4
+
+typedef struct _StTextureAtlas StTextureAtlas;
+
+typedef void (* StTextureAtlasEvictFunc) (CoglTexture *page_texture,
+                                          gpointer     user_data);
+
+StTextureAtlas *_st_texture_atlas_new       (void);
+void            _st_texture_atlas_free      (StTextureAtlas  *atlas);
+
+CoglTexture    *_st_texture_atlas_add       (StTextureAtlas  *atlas,
+                                             CoglContext     *cogl_context,
+                                             int              width,
+                                             int              height,
+                                             CoglPixelFormat  format,
+                                             int              rowstride,
+                                             const guint8    *data);
+
+void            _st_texture_atlas_set_evict_func (StTextureAtlas          *atlas,
+                                                  StTextureAtlasEvictFunc  func,
+                                                  gpointer                 user_data);
+
+void            _st_texture_atlas_get_stats (StTextureAtlas  *atlas,
+                                             guint           *n_pages,
+                                             guint           *n_images,
+                                             guint           *n_evictions);
+
+void            _st_texture_atlas_count_draw     (CoglTexture *texture);
+void            _st_texture_atlas_get_draw_stats (guint       *n_draws,
+                                                  guint       *n_switches);
+
+G_END_DECLS
@@ -0,0 +1,98 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-texture-cache-private.h: Private StTextureCache methods
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "st-texture-cache.h"
+
+G_BEGIN_DECLS
+
+/* Upper bound for the size of the cached box-shadow textures. Widgets
+ * hold their own reference, so an evicted texture is only freed once no
+ * widget uses it anymore. */
+#define ST_SHADOW_CACHE_MAX_BYTES (16 * 1024 * 1024)
+
+/* Budget for the textures of images and icons that are kept around
+ * after they stop being displayed */
+#define ST_TEXTURE_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+typedef enum
+{
+  ST_SHADOW_MASK_BACKGROUND    = 1 << 0,
+  ST_SHADOW_MASK_BORDER_TOP    = 1 << 1,
+  ST_SHADOW_MASK_BORDER_RIGHT  = 1 << 2,
+  ST_SHADOW_MASK_BORDER_BOTTOM = 1 << 3,
+  ST_SHADOW_MASK_BORDER_LEFT   = 1 << 4,
+} StShadowMaskFlags;
+
+/* Everything that determines the blurred silhouette of a box. The
+ * shadow's color, offset and spread are applied when painting, so two
+ * boxes with the same key can share a texture. The struct is hashed
+ * and compared bytewise, so it must be zeroed before it is filled in. */
+typedef struct
+{
+  float blur;
+  float resource_scale;
+
+  /* size of the silhouette, in logical pixels */
+  float width;
+  float height;
+
+  guint border_radius[4];
+  guint border_width[4];
+
+  StShadowMaskFlags flags;
+} StShadowCacheKey;
+
+CoglTexture *_st_texture_cache_create_texture (StTextureCache   *cache,
+                                               CoglContext      *cogl_context,
+                                               int               width,
+                                               int               height,
+                                               CoglPixelFormat   format,
+                                               int               rowstride,
+                                               const guint8     *data,
+                                               GError          **error);
+
+/* The texture of one rounded corner. The struct has no padding, so it
+ * can be hashed and compared bytewise. */
+typedef struct
+{
+  CoglColor      color;
+  CoglColor      border_color_1;
+  CoglColor      border_color_2;
+  guint          radius;
+  guint          border_width_1;
+  guint          border_width_2;
+  float          resource_scale;
+} StCornerSpec;
+
+CoglTexture *_st_texture_cache_lookup_corner (StTextureCache     *cache,
+                                              const StCornerSpec *corner);
+
+void         _st_texture_cache_insert_corner (StTextureCache     *cache,
+                                              const StCornerSpec *corner,
+                                              CoglTexture        *texture);
+
+CoglTexture *_st_texture_cache_lookup_shadow (StTextureCache         *cache,
+                                              const StShadowCacheKey *key);
+
+void         _st_texture_cache_insert_shadow (StTextureCache         *cache,
+                                              const StShadowCacheKey *key,
+                                              CoglTexture            *texture);
+
+G_END_DECLS
@@ -22,39 +22,111 @@
 #include "config.h"
 
 #include "st-image-content-private.h"
-#include "st-texture-cache.h"
+#include "st-texture-cache-private.h"
+#include "st-decode-scheduler.h"
 #include "st-private.h"
 #include "st-settings.h"
+#include "st-texture-atlas.h"
+#include "st-icon-raster-cache.h"
 #include "st-icon-theme.h"
+#include "st-icon-theme-private.h"
 #include <math.h>
 #include <string.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
-#define CACHE_PREFIX_ICON "icon:"
 #define CACHE_PREFIX_FILE "file:"
 #define CACHE_PREFIX_FILE_FOR_CAIRO "file-for-cairo:"
 
+/* Images decoded at the same time, so that a request with a higher
+ * priority doesn't wait behind a whole grid of icons */
+#define MAX_RUNNING_LOADS 4
+
 typedef struct _StTextureCache
 {
   GObject parent;
 
   StIconTheme *icon_theme;
 
-  /* Things that were loaded with a cache policy != NONE */
-  GHashTable *keyed_cache; /* char * -> StImageContent* */
+  /* Things that were loaded with a cache policy != NONE. Entries that
+   * nothing else references are evicted least recently used first once
+   * they take more than ST_TEXTURE_CACHE_MAX_BYTES, when something is
+   * added or an image stops being displayed. */
+  GHashTable *keyed_cache; /* char * -> KeyedCacheEntry * */
+  GHashTable *icon_cache; /* IconCacheKey * -> KeyedCacheEntry * */
+  GQueue keyed_lru; /* KeyedCacheEntry *, most recently used first */
+  gsize keyed_cache_bytes;
+  guint keyed_cache_evictions;
+  guint keyed_cache_trim_id;
   GHashTable *keyed_surface_cache; /* char * -> cairo_surface_t* */
 
   GHashTable *used_scales; /* Set: double */
 
   /* Presently this is used to de-duplicate requests for GIcons and async URIs. */
   GHashTable *outstanding_requests; /* char * -> AsyncTextureLoadData * */
+  GHashTable *outstanding_icon_requests; /* IconCacheKey * -> AsyncTextureLoadData * */
+
+  /* Requests that wait for one of the running loads to finish, by
+   * increasing priority value */
+  GQueue pending_loads; /* AsyncTextureLoadData * */
+  GQueue running_loads; /* AsyncTextureLoadData * */
+  guint last_prefetch_id;
 
   /* File monitors to evict cache data on changes */
   GHashTable *file_monitors; /* char * -> GFileMonitor * */
 
-  GCancellable *cancellable;
+  /* Small images that are drawn together often */
+  StTextureAtlas *atlas;
+
+  /* Rendered icons, kept across sessions */
+  StIconRasterCache *raster_cache;
+
+  /* Rounded corner textures, only evicted to make room in the atlas */
+  GHashTable *corner_cache; /* StCornerSpec * -> CoglTexture * */
+
+  /* Blurred box silhouettes, shared between all widgets with the same
+   * box-shadow geometry */
+  GHashTable *shadow_cache; /* StShadowCacheKey * -> ShadowCacheEntry * */
+  GQueue shadow_lru; /* ShadowCacheEntry *, most recently used first */
+  gsize shadow_cache_bytes;
+  guint shadow_cache_hits;
+  guint shadow_cache_misses;
 } StTextureCache;
 
+/* What a loaded GIcon is cached by. Lookups use a key on the stack
+ * that doesn't hold a reference to the icon; keys stored in the tables
+ * are copies made with icon_cache_key_copy(). */
+typedef struct
+{
+  GIcon *icon;
+  guint hash;
+  int size;
+  int scale;
+  StIconStyle style;
+  gboolean has_colors;
+  CoglColor colors[4]; /* foreground, warning, error, success */
+} IconCacheKey;
+
+typedef struct
+{
+  StTextureCache *cache;
+  GHashTable *table; /* keyed_cache or icon_cache */
+  gpointer key;
+  GDestroyNotify free_key;
+  GObject *object; /* StImageContent or CoglTexture */
+  gsize n_bytes;
+  gulong detached_id;
+  GList link;
+} KeyedCacheEntry;
+
+typedef struct
+{
+  StShadowCacheKey key;
+  CoglTexture *texture;
+  gsize n_bytes;
+  GList link;
+} ShadowCacheEntry;
+
 static void st_texture_cache_dispose (GObject *object);
 static void st_texture_cache_finalize (GObject *object);
 
@@ -69,6 +141,9 @@ enum
 static guint signals[LAST_SIGNAL] = { 0, };
 G_DEFINE_FINAL_TYPE (StTextureCache, st_texture_cache, G_TYPE_OBJECT);
 
+/* The colors a symbolic icon actor is painted with */
+static GQuark icon_colors_quark;
+
 /* We want to preserve the aspect ratio by default, also the default
  * pipeline for an empty texture is full opacity white, which we
  * definitely don't want.  Skip that by setting 0 opacity.
@@ -87,9 +162,19 @@ static void
 set_content_from_image (ClutterActor   *actor,
                         ClutterContent *image)
 {
+  g_autoptr (ClutterContent) content = NULL;
+  StIconColors *colors;
+
   g_assert (image && ST_IS_IMAGE_CONTENT (image));
 
-  clutter_actor_set_content (actor, image);
+  colors = g_object_get_qdata (G_OBJECT (actor), icon_colors_quark);
+
+  if (colors && st_image_content_get_is_symbolic (ST_IMAGE_CONTENT (image)))
+    content = _st_image_content_new_recolored (ST_IMAGE_CONTENT (image), colors);
+  else
+    content = g_object_ref (image);
+
+  clutter_actor_set_content (actor, content);
   clutter_actor_set_opacity (actor, 255);
 }
 
@@ -101,6 +186,8 @@ st_texture_cache_class_init (StTextureCacheClass *klass)
   gobject_class->dispose = st_texture_cache_dispose;
   gobject_class->finalize = st_texture_cache_finalize;
 
+  icon_colors_quark = g_quark_from_static_string ("st-texture-cache-icon-colors");
+
   /**
    * StTextureCache::icon-theme-changed:
    * @self: a #StTextureCache
@@ -131,26 +218,11 @@ st_texture_cache_class_init (StTextureCacheClass *klass)
                   G_TYPE_NONE, 1, G_TYPE_FILE);
 }
 
-/* Evicts all cached textures for named icons */
+/* Evicts all cached textures for icons */
 static void
 st_texture_cache_evict_icons (StTextureCache *cache)
 {
-  GHashTableIter iter;
-  gpointer key;
-  gpointer value;
-
-  g_hash_table_iter_init (&iter, cache->keyed_cache);
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      const char *cache_key = key;
-
-      /* This is too conservative - it takes out all cached textures
-       * for GIcons even when they aren't named icons, but it's not
-       * worth the complexity of parsing the key and calling
-       * g_icon_new_for_string(); icon theme changes aren't normal */
-      if (g_str_has_prefix (cache_key, CACHE_PREFIX_ICON))
-        g_hash_table_iter_remove (&iter);
-    }
+  g_hash_table_remove_all (cache->icon_cache);
 }
 
 static void
@@ -161,9 +233,150 @@ on_icon_theme_changed (StIconTheme    *icon_theme,
   g_signal_emit (self, signals[ICON_THEME_CHANGED], 0);
 }
 
+static guint
+corner_spec_hash (gconstpointer data)
+{
+  const guint32 *words = data;
+  guint32 hash = 5381;
+  gsize i;
+
+  G_STATIC_ASSERT (sizeof (StCornerSpec) == 3 * sizeof (CoglColor) +
+                                            3 * sizeof (guint) +
+                                            sizeof (float));
+  G_STATIC_ASSERT (sizeof (StCornerSpec) % sizeof (guint32) == 0);
+
+  for (i = 0; i < sizeof (StCornerSpec) / sizeof (guint32); i++)
+    hash = hash * 33 + words[i];
+
+  return hash;
+}
+
+static gboolean
+corner_spec_equal (gconstpointer a,
+                   gconstpointer b)
+{
+  return memcmp (a, b, sizeof (StCornerSpec)) == 0;
+}
+
+static guint
+shadow_cache_key_hash (gconstpointer data)
+{
+  const guint32 *words = data;
+  guint32 hash = 5381;
+  gsize i;
+
+  G_STATIC_ASSERT (sizeof (StShadowCacheKey) % sizeof (guint32) == 0);
+
+  for (i = 0; i < sizeof (StShadowCacheKey) / sizeof (guint32); i++)
+    hash = hash * 33 + words[i];
+
+  return hash;
+}
+
+static gboolean
+shadow_cache_key_equal (gconstpointer a,
+                        gconstpointer b)
+{
+  return memcmp (a, b, sizeof (StShadowCacheKey)) == 0;
+}
+
+static void
+icon_cache_key_init (IconCacheKey *key,
+                     GIcon        *icon,
+                     int           size,
+                     int           scale,
+                     StIconStyle   style,
+                     StIconColors *colors)
+{
+  memset (key, 0, sizeof (IconCacheKey));
+
+  key->icon = icon;
+  key->size = size;
+  key->scale = scale;
+  key->style = style;
+  key->hash = g_icon_hash (icon) ^ (size << 16) ^ (scale << 8) ^ style;
+
+  if (colors)
+    {
+      key->has_colors = TRUE;
+      key->colors[0] = colors->foreground;
+      key->colors[1] = colors->warning;
+      key->colors[2] = colors->error;
+      key->colors[3] = colors->success;
+      key->hash ^= ((guint) colors->foreground.red << 24 |
+                    colors->foreground.green << 16 |
+                    colors->foreground.blue << 8 |
+                    colors->foreground.alpha);
+    }
+}
+
+static IconCacheKey *
+icon_cache_key_copy (const IconCacheKey *key)
+{
+  IconCacheKey *copy = g_memdup2 (key, sizeof (IconCacheKey));
+
+  g_object_ref (copy->icon);
+
+  return copy;
+}
+
+static void
+icon_cache_key_free (IconCacheKey *key)
+{
+  g_object_unref (key->icon);
+  g_free (key);
+}
+
+static guint
+icon_cache_key_hash (gconstpointer data)
+{
+  const IconCacheKey *key = data;
+
+  return key->hash;
+}
+
+static gboolean
+icon_cache_key_equal (gconstpointer a,
+                      gconstpointer b)
+{
+  const IconCacheKey *key_a = a;
+  const IconCacheKey *key_b = b;
+
+  return key_a->hash == key_b->hash &&
+         key_a->size == key_b->size &&
+         key_a->scale == key_b->scale &&
+         key_a->style == key_b->style &&
+         key_a->has_colors == key_b->has_colors &&
+         memcmp (key_a->colors, key_b->colors, sizeof (key_a->colors)) == 0 &&
+         g_icon_equal (key_a->icon, key_b->icon);
+}
+
+static void
+keyed_cache_entry_free (KeyedCacheEntry *entry)
+{
+  StTextureCache *cache = entry->cache;
+
+  g_queue_unlink (&cache->keyed_lru, &entry->link);
+  cache->keyed_cache_bytes -= entry->n_bytes;
+
+  g_clear_signal_handler (&entry->detached_id, entry->object);
+  g_object_unref (entry->object);
+  entry->free_key (entry->key);
+  g_free (entry);
+}
+
+static void
+shadow_cache_entry_free (ShadowCacheEntry *entry)
+{
+  g_object_unref (entry->texture);
+  g_free (entry);
+}
+
 static void
 st_texture_cache_init (StTextureCache *self)
 {
+  g_autofree char *raster_cache_path = NULL;
+
   self->icon_theme = st_icon_theme_new ();
   st_icon_theme_add_resource_path (self->icon_theme,
                                    "/org/gnome/shell/icons");
@@ -171,7 +384,13 @@ st_texture_cache_init (StTextureCache *self)
                     G_CALLBACK (on_icon_theme_changed), self);
 
   self->keyed_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                             g_free, g_object_unref);
+                                             NULL,
+                                             (GDestroyNotify) keyed_cache_entry_free);
+  self->icon_cache = g_hash_table_new_full (icon_cache_key_hash,
+                                            icon_cache_key_equal,
+                                            NULL,
+                                            (GDestroyNotify) keyed_cache_entry_free);
+  g_queue_init (&self->keyed_lru);
   self->keyed_surface_cache = g_hash_table_new_full (g_str_hash,
                                                      g_str_equal,
                                                      g_free,
@@ -180,27 +399,67 @@ st_texture_cache_init (StTextureCache *self)
                                              g_free, NULL);
   self->outstanding_requests = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                       g_free, NULL);
+  self->outstanding_icon_requests = g_hash_table_new_full (icon_cache_key_hash,
+                                                           icon_cache_key_equal,
+                                                           (GDestroyNotify) icon_cache_key_free,
+                                                           NULL);
   self->file_monitors = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
                                                g_object_unref, g_object_unref);
-
-  self->cancellable = g_cancellable_new ();
+  self->atlas = _st_texture_atlas_new ();
+  _st_texture_atlas_set_evict_func (self->atlas, evict_atlas_page, self);
+  raster_cache_path = g_build_filename (g_get_user_cache_dir (),
+                                        "gnome-shell",
+                                        "icon-raster-cache",
+                                        NULL);
+  self->raster_cache = _st_icon_raster_cache_new (raster_cache_path);
+  self->corner_cache = g_hash_table_new_full (corner_spec_hash,
+                                              corner_spec_equal,
+                                              g_free, g_object_unref);
+  self->shadow_cache = g_hash_table_new_full (shadow_cache_key_hash,
+                                              shadow_cache_key_equal,
+                                              NULL,
+                                              (GDestroyNotify) shadow_cache_entry_free);
+  g_queue_init (&self->shadow_lru);
 }
 
 static void
 st_texture_cache_dispose (GObject *object)
 {
   StTextureCache *self = (StTextureCache*)object;
+  GList *l;
+
+  for (l = self->running_loads.head; l; l = l->next)
+    {
+      AsyncTextureLoadData *data = l->data;
+
+      g_cancellable_cancel (data->cancellable);
+    }
+
+  while (self->pending_loads.head != NULL)
+    {
+      AsyncTextureLoadData *data = self->pending_loads.head->data;
 
-  g_cancellable_cancel (self->cancellable);
+      g_queue_unlink (&self->pending_loads, &data->link);
+      texture_load_data_free (data);
+    }
 
   g_clear_object (&self->icon_theme);
-  g_clear_object (&self->cancellable);
 
+  g_clear_handle_id (&self->keyed_cache_trim_id, g_source_remove);
   g_clear_pointer (&self->keyed_cache, g_hash_table_destroy);
+  g_clear_pointer (&self->icon_cache, g_hash_table_destroy);
+  self->keyed_cache_bytes = 0;
   g_clear_pointer (&self->keyed_surface_cache, g_hash_table_destroy);
   g_clear_pointer (&self->used_scales, g_hash_table_destroy);
   g_clear_pointer (&self->outstanding_requests, g_hash_table_destroy);
+  g_clear_pointer (&self->outstanding_icon_requests, g_hash_table_destroy);
   g_clear_pointer (&self->file_monitors, g_hash_table_destroy);
+  g_clear_pointer (&self->corner_cache, g_hash_table_destroy);
+  g_clear_pointer (&self->shadow_cache, g_hash_table_destroy);
+  g_queue_init (&self->shadow_lru);
+  self->shadow_cache_bytes = 0;
+  g_clear_pointer (&self->atlas, _st_texture_atlas_free);
+  g_clear_pointer (&self->raster_cache, _st_icon_raster_cache_unref);
 
   G_OBJECT_CLASS (st_texture_cache_parent_class)->dispose (object);
 }
@@ -282,7 +541,25 @@ typedef struct {
 typedef struct {
   StTextureCache *cache;
   StTextureCachePolicy policy;
-  char *key;
+  char *key; /* for files */
+  IconCacheKey *icon_key; /* for icons */
+
+  /* Set for icons that are rendered from a file, once the raster
+   * cache was looked up */
+  gboolean raster_lookup_done;
+  gboolean has_raster_key;
+  StIconRasterKey raster_key;
+
+  int priority;
+  /* When the request was first queued, 0 once a decode was counted */
+  gint64 queue_time;
+  gboolean queued; /* in pending_loads, through link */
+  gboolean running; /* in running_loads, through link */
+  GList link;
+  /* Cancelled when nothing waits for the image anymore */
+  GCancellable *cancellable;
+  /* The st_texture_cache_prefetch_gicons() calls that asked for the icon */
+  GArray *prefetch_ids; /* guint */
 
   guint width;
   guint height;
@@ -310,8 +587,10 @@ texture_load_data_free (gpointer p)
   else if (data->file)
     g_object_unref (data->file);
 
-  if (data->key)
-    g_free (data->key);
+  g_free (data->key);
+  g_clear_pointer (&data->icon_key, icon_cache_key_free);
+  g_clear_object (&data->cancellable);
+  g_clear_pointer (&data->prefetch_ids, g_array_unref);
 
   if (data->actors)
     g_slist_free_full (data->actors, (GDestroyNotify) g_object_unref);
@@ -487,21 +766,29 @@ load_pixbuf_async_finish (StTextureCache *cache, GAsyncResult *result, GError **
   return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+/* @atlas may be NULL for images that might be drawn repeated, which
+ * sub-textures don't support in hardware */
 static ClutterContent *
-pixbuf_to_st_content_image (GdkPixbuf   *pixbuf,
-                            CoglContext *context,
-                            int          width,
-                            int          height,
-                            int          paint_scale,
-                            float        resource_scale)
+pixels_to_st_content_image (const guint8    *pixels,
+                            int              pixels_width,
+                            int              pixels_height,
+                            int              rowstride,
+                            CoglPixelFormat  format,
+                            CoglContext     *context,
+                            StTextureAtlas  *atlas,
+                            int              width,
+                            int              height,
+                            int              paint_scale,
+                            float            resource_scale)
 {
   ClutterContent *image;
+  g_autoptr(CoglTexture) texture = NULL;
   g_autoptr(GError) error = NULL;
 
   float native_width, native_height;
 
-  native_width = ceilf (gdk_pixbuf_get_width (pixbuf) / resource_scale);
-  native_height = ceilf (gdk_pixbuf_get_height (pixbuf) / resource_scale);
+  native_width = ceilf (pixels_width / resource_scale);
+  native_height = ceilf (pixels_height / resource_scale);
 
   if (width < 0 && height < 0)
     {
@@ -524,16 +811,24 @@ pixbuf_to_st_content_image (GdkPixbuf   *pixbuf,
       height *= paint_scale;
     }
 
+  if (atlas != NULL)
+    texture = _st_texture_atlas_add (atlas, context,
+                                     pixels_width, pixels_height,
+                                     format, rowstride, pixels);
+
   image = st_image_content_new_with_preferred_size (width, height);
-  st_image_content_set_data (ST_IMAGE_CONTENT (image),
-                             context,
-                             gdk_pixbuf_get_pixels (pixbuf),
-                             gdk_pixbuf_get_has_alpha (pixbuf) ?
-                               COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888,
-                             gdk_pixbuf_get_width (pixbuf),
-                             gdk_pixbuf_get_height (pixbuf),
-                             gdk_pixbuf_get_rowstride (pixbuf),
-                             &error);
+
+  if (texture != NULL)
+    st_image_content_set_texture (ST_IMAGE_CONTENT (image), texture);
+  else
+    st_image_content_set_data (ST_IMAGE_CONTENT (image),
+                               context,
+                               pixels,
+                               format,
+                               pixels_width,
+                               pixels_height,
+                               rowstride,
+                               &error);
 
   if (error)
     {
@@ -544,6 +839,30 @@ pixbuf_to_st_content_image (GdkPixbuf   *pixbuf,
   return image;
 }
 
+static ClutterContent *
+pixbuf_to_st_content_image (GdkPixbuf      *pixbuf,
+                            CoglContext    *context,
+                            StTextureAtlas *atlas,
+                            int             width,
+                            int             height,
+                            int             paint_scale,
+                            float           resource_scale)
+{
+  CoglPixelFormat format;
+
+  format = gdk_pixbuf_get_has_alpha (pixbuf) ?
+             COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888;
+
+  return pixels_to_st_content_image (gdk_pixbuf_get_pixels (pixbuf),
+                                     gdk_pixbuf_get_width (pixbuf),
+                                     gdk_pixbuf_get_height (pixbuf),
+                                     gdk_pixbuf_get_rowstride (pixbuf),
+                                     format,
+                                     context, atlas,
+                                     width, height,
+                                     paint_scale, resource_scale);
+}
+
 static void
 util_cairo_surface_paint_pixbuf (cairo_surface_t *surface,
                                  const GdkPixbuf *pixbuf)
@@ -680,53 +999,245 @@ pixbuf_to_cairo_surface (GdkPixbuf *pixbuf)
   return surface;
 }
 
+static CoglTexture *
+keyed_cache_object_get_texture (GObject *object)
+{
+  if (ST_IS_IMAGE_CONTENT (object))
+    return st_image_content_get_texture (ST_IMAGE_CONTENT (object));
+  else
+    return COGL_TEXTURE (object);
+}
+
+static gsize
+keyed_cache_object_size (GObject *object)
+{
+  CoglTexture *texture = keyed_cache_object_get_texture (object);
+
+  if (texture == NULL)
+    return 0;
+
+  return (gsize) cogl_texture_get_width (texture) *
+         cogl_texture_get_height (texture) * 4;
+}
+
+static gboolean
+keyed_cache_entry_is_unused (KeyedCacheEntry *entry)
+{
+  return G_OBJECT (entry->object)->ref_count == 1;
+}
+
+/* Drops the least recently used entries that only the cache holds on
+ * to, until those that are left take at most ST_TEXTURE_CACHE_MAX_BYTES.
+ * Entries that are still displayed neither count nor get evicted, since
+ * evicting them wouldn't free anything. */
 static void
-finish_texture_load (AsyncTextureLoadData *data,
-                     GdkPixbuf            *pixbuf)
+keyed_cache_trim (StTextureCache *cache)
+{
+  gsize unused_bytes = 0;
+  GList *l;
+
+  g_clear_handle_id (&cache->keyed_cache_trim_id, g_source_remove);
+
+  for (l = cache->keyed_lru.head; l; l = l->next)
+    {
+      KeyedCacheEntry *entry = l->data;
+
+      if (keyed_cache_entry_is_unused (entry))
+        unused_bytes += entry->n_bytes;
+    }
+
+  l = cache->keyed_lru.tail;
+
+  while (unused_bytes > ST_TEXTURE_CACHE_MAX_BYTES && l != NULL)
+    {
+      KeyedCacheEntry *entry = l->data;
+
+      l = l->prev;
+
+      if (!keyed_cache_entry_is_unused (entry))
+        continue;
+
+      unused_bytes -= entry->n_bytes;
+      cache->keyed_cache_evictions++;
+      g_hash_table_remove (entry->table, entry->key);
+    }
+}
+
+static gboolean
+keyed_cache_trim_idle (gpointer data)
+{
+  StTextureCache *cache = data;
+
+  cache->keyed_cache_trim_id = 0;
+  keyed_cache_trim (cache);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Trims once the main loop is idle, so that loading many images only
+ * walks the cache once, and images that stop being displayed have
+ * been unreferenced by then */
+static void
+keyed_cache_queue_trim (StTextureCache *cache)
+{
+  if (cache->keyed_cache_trim_id != 0)
+    return;
+
+  cache->keyed_cache_trim_id = g_idle_add_full (G_PRIORITY_LOW,
+                                                keyed_cache_trim_idle,
+                                                cache, NULL);
+  g_source_set_name_by_id (cache->keyed_cache_trim_id,
+                           "[gnome-shell] keyed_cache_trim_idle");
+}
+
+static void
+on_cached_content_detached (ClutterContent  *content,
+                            ClutterActor    *actor,
+                            KeyedCacheEntry *entry)
+{
+  keyed_cache_queue_trim (entry->cache);
+}
+
+static gboolean
+texture_is_on_atlas_page (CoglTexture *texture,
+                          CoglTexture *page_texture)
+{
+  return texture != NULL &&
+         COGL_IS_SUB_TEXTURE (texture) &&
+         cogl_sub_texture_get_parent (COGL_SUB_TEXTURE (texture)) == page_texture;
+}
+
+/* Drops the images on an atlas page that nothing but the cache holds
+ * on to, so that their space can be reused */
+static void
+evict_atlas_page (CoglTexture *page_texture,
+                  gpointer     user_data)
+{
+  StTextureCache *cache = user_data;
+  GHashTableIter iter;
+  CoglTexture *texture;
+  GList *l = cache->keyed_lru.tail;
+
+  while (l != NULL)
+    {
+      KeyedCacheEntry *entry = l->data;
+
+      l = l->prev;
+
+      if (!keyed_cache_entry_is_unused (entry) ||
+          !texture_is_on_atlas_page (keyed_cache_object_get_texture (entry->object),
+                                     page_texture))
+        continue;
+
+      cache->keyed_cache_evictions++;
+      g_hash_table_remove (entry->table, entry->key);
+    }
+
+  g_hash_table_iter_init (&iter, cache->corner_cache);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &texture))
+    {
+      if (G_OBJECT (texture)->ref_count == 1 &&
+          texture_is_on_atlas_page (texture, page_texture))
+        g_hash_table_iter_remove (&iter);
+    }
+}
+
+static gpointer
+keyed_cache_lookup (StTextureCache *cache,
+                    GHashTable     *table,
+                    gconstpointer   key)
+{
+  KeyedCacheEntry *entry;
+
+  entry = g_hash_table_lookup (table, key);
+  if (entry == NULL)
+    return NULL;
+
+  g_queue_unlink (&cache->keyed_lru, &entry->link);
+  g_queue_push_head_link (&cache->keyed_lru, &entry->link);
+
+  return entry->object;
+}
+
+/* Takes ownership of @key and of a reference to @object */
+static void
+keyed_cache_insert (StTextureCache *cache,
+                    GHashTable     *table,
+                    gpointer        key,
+                    GDestroyNotify  free_key,
+                    gpointer        object)
+{
+  KeyedCacheEntry *entry;
+
+  entry = g_new0 (KeyedCacheEntry, 1);
+  entry->cache = cache;
+  entry->table = table;
+  entry->key = key;
+  entry->free_key = free_key;
+  entry->object = object;
+  entry->n_bytes = keyed_cache_object_size (object);
+  entry->link.data = entry;
+
+  if (CLUTTER_IS_CONTENT (object))
+    entry->detached_id = g_signal_connect (object, "detached",
+                                           G_CALLBACK (on_cached_content_detached),
+                                           entry);
+
+  g_hash_table_replace (table, entry->key, entry);
+  g_queue_push_head_link (&cache->keyed_lru, &entry->link);
+  cache->keyed_cache_bytes += entry->n_bytes;
+
+  keyed_cache_queue_trim (cache);
+}
+
+static void start_pending_loads (StTextureCache *cache);
+
+static void
+finish_texture_load_with_image (AsyncTextureLoadData *data,
+                                ClutterContent       *image)
 {
-  g_autoptr(ClutterContent) image = NULL;
   GSList *iter;
   StTextureCache *cache;
 
   cache = data->cache;
 
-  g_hash_table_remove (cache->outstanding_requests, data->key);
+  if (data->running)
+    g_queue_unlink (&cache->running_loads, &data->link);
+
+  /* A cancelled prefetch may have been replaced by a new request */
+  if (data->icon_key)
+    {
+      if (g_hash_table_lookup (cache->outstanding_icon_requests, data->icon_key) == data)
+        g_hash_table_remove (cache->outstanding_icon_requests, data->icon_key);
+    }
+  else
+    {
+      g_hash_table_remove (cache->outstanding_requests, data->key);
+    }
 
-  if (pixbuf == NULL)
+  if (image == NULL)
     goto out;
 
   if (data->policy != ST_TEXTURE_CACHE_POLICY_NONE)
     {
-      gpointer orig_key = NULL, value = NULL;
+      ClutterContent *cached;
 
-      if (!g_hash_table_lookup_extended (cache->keyed_cache, data->key,
-                                         &orig_key, &value))
-        {
-          image = pixbuf_to_st_content_image (pixbuf,
-                                              data->cogl_context,
-                                              data->width, data->height,
-                                              data->paint_scale,
-                                              data->resource_scale);
-          if (!image)
-            goto out;
-
-          g_hash_table_insert (cache->keyed_cache, g_strdup (data->key),
-                               g_object_ref (image));
-        }
+      if (data->icon_key)
+        cached = keyed_cache_lookup (cache, cache->icon_cache, data->icon_key);
       else
-        {
-          image = g_object_ref (value);
-        }
-    }
-  else
-    {
-      image = pixbuf_to_st_content_image (pixbuf,
-                                          data->cogl_context,
-                                          data->width, data->height,
-                                          data->paint_scale,
-                                          data->resource_scale);
-      if (!image)
-        goto out;
+        cached = keyed_cache_lookup (cache, cache->keyed_cache, data->key);
+
+      if (cached != NULL)
+        image = cached;
+      else if (data->icon_key)
+        keyed_cache_insert (cache, cache->icon_cache,
+                            icon_cache_key_copy (data->icon_key),
+                            (GDestroyNotify) icon_cache_key_free,
+                            g_object_ref (image));
+      else
+        keyed_cache_insert (cache, cache->keyed_cache,
+                            g_strdup (data->key), g_free,
+                            g_object_ref (image));
     }
 
   if (data->icon_info)
@@ -741,6 +1252,32 @@ finish_texture_load (AsyncTextureLoadData *data,
 
 out:
   texture_load_data_free (data);
+
+  start_pending_loads (cache);
+}
+
+static void
+finish_texture_load (AsyncTextureLoadData *data,
+                     GdkPixbuf            *pixbuf)
+{
+  g_autoptr(ClutterContent) image = NULL;
+
+  if (pixbuf != NULL)
+    {
+      if (data->has_raster_key)
+        _st_icon_raster_cache_insert (data->cache->raster_cache,
+                                      &data->raster_key,
+                                      pixbuf);
+
+      image = pixbuf_to_st_content_image (pixbuf,
+                                          data->cogl_context,
+                                          data->cache->atlas,
+                                          data->width, data->height,
+                                          data->paint_scale,
+                                          data->resource_scale);
+    }
+
+  finish_texture_load_with_image (data, image);
 }
 
 static void
@@ -776,36 +1313,234 @@ on_pixbuf_loaded (GObject      *source,
   g_clear_object (&pixbuf);
 }
 
+typedef struct
+{
+  StIconRasterCache *raster_cache;
+  char *filename;
+  StIconRasterKey key;
+  gboolean has_key;
+
+  GBytes *pixels;
+  int width;
+  int height;
+  int rowstride;
+} RasterLookup;
+
 static void
-load_texture_async (StTextureCache       *cache,
-                    AsyncTextureLoadData *data)
+raster_lookup_free (RasterLookup *lookup)
 {
-  if (data->file)
-    {
-      GTask *task = g_task_new (cache, NULL, on_pixbuf_loaded, data);
-      g_task_set_task_data (task, data, NULL);
-      g_task_run_in_thread (task, load_pixbuf_thread);
-      g_object_unref (task);
-    }
-  else if (data->icon_info)
+  _st_icon_raster_cache_unref (lookup->raster_cache);
+  g_free (lookup->filename);
+  g_clear_pointer (&lookup->pixels, g_bytes_unref);
+  g_free (lookup);
+}
+
+/* Looks up an icon rendered in an earlier session. This runs in a
+ * decode thread, since the icon file needs to be stat'ed for the key. */
+static void
+raster_lookup_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+  RasterLookup *lookup = task_data;
+  GStatBuf stat_buf;
+
+  /* Icons from resources have a path, but no file */
+  if (g_stat (lookup->filename, &stat_buf) == 0)
     {
-      StIconColors *colors = data->colors;
-      if (colors)
-        {
-          st_icon_info_load_symbolic_async (data->icon_info,
-                                            data->colors,
-                                            cache->cancellable,
-                                            on_symbolic_icon_loaded, data);
-        }
-      else
-        {
-          st_icon_info_load_icon_async (data->icon_info,
-                                        cache->cancellable,
-                                        on_icon_loaded, data);
-        }
+      lookup->key.filename = lookup->filename;
+      lookup->key.mtime = stat_buf.st_mtime;
+      lookup->has_key = TRUE;
+
+      lookup->pixels = _st_icon_raster_cache_lookup (lookup->raster_cache,
+                                                     &lookup->key,
+                                                     &lookup->width,
+                                                     &lookup->height,
+                                                     &lookup->rowstride);
     }
-  else
-    g_assert_not_reached ();
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void start_texture_load (StTextureCache       *cache,
+                                AsyncTextureLoadData *data);
+
+/* The cached pixels are premultiplied already, so they are uploaded
+ * from the mapped cache file without conversion. Icons that aren't
+ * cached are loaded from their file as usual. */
+static void
+on_raster_lookup_done (GObject      *source,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+  AsyncTextureLoadData *data = user_data;
+  RasterLookup *lookup = g_task_get_task_data (G_TASK (result));
+  g_autoptr(ClutterContent) image = NULL;
+
+  if (!g_task_propagate_boolean (G_TASK (result), NULL))
+    {
+      finish_texture_load (data, NULL);
+      return;
+    }
+
+  data->raster_lookup_done = TRUE;
+
+  if (lookup->has_key)
+    {
+      data->raster_key = lookup->key;
+      data->raster_key.filename = st_icon_info_get_filename (data->icon_info);
+      data->has_raster_key = TRUE;
+    }
+
+  if (lookup->pixels != NULL)
+    image = pixels_to_st_content_image (g_bytes_get_data (lookup->pixels, NULL),
+                                        lookup->width, lookup->height,
+                                        lookup->rowstride,
+                                        COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                        data->cogl_context,
+                                        data->cache->atlas,
+                                        data->width, data->height,
+                                        data->paint_scale,
+                                        data->resource_scale);
+
+  if (image != NULL)
+    finish_texture_load_with_image (data, image);
+  else
+    start_texture_load (data->cache, data);
+}
+
+static void
+start_raster_lookup (StTextureCache       *cache,
+                     AsyncTextureLoadData *data)
+{
+  RasterLookup *lookup;
+  GTask *task;
+
+  lookup = g_new0 (RasterLookup, 1);
+  lookup->raster_cache = _st_icon_raster_cache_ref (cache->raster_cache);
+  lookup->filename = g_strdup (st_icon_info_get_filename (data->icon_info));
+  lookup->key.theme_mtime = _st_icon_info_get_theme_mtime (data->icon_info);
+  lookup->key.size = data->icon_key->size;
+  lookup->key.scale = data->icon_key->scale;
+  lookup->key.has_colors = data->icon_key->has_colors;
+  memcpy (lookup->key.colors, data->icon_key->colors, sizeof (lookup->key.colors));
+
+  task = g_task_new (cache, data->cancellable, on_raster_lookup_done, data);
+  g_task_set_priority (task, data->priority);
+  g_task_set_task_data (task, lookup, (GDestroyNotify) raster_lookup_free);
+  _st_decode_scheduler_run_queued (task, raster_lookup_thread, data->queue_time);
+  data->queue_time = 0;
+  g_object_unref (task);
+}
+
+static void
+start_texture_load (StTextureCache       *cache,
+                    AsyncTextureLoadData *data)
+{
+  if (data->file)
+    {
+      GTask *task = g_task_new (cache, data->cancellable, on_pixbuf_loaded, data);
+      g_task_set_priority (task, data->priority);
+      g_task_set_task_data (task, data, NULL);
+      _st_decode_scheduler_run_queued (task, load_pixbuf_thread, data->queue_time);
+      g_object_unref (task);
+    }
+  else if (data->icon_info && !data->raster_lookup_done &&
+           st_icon_info_get_filename (data->icon_info) != NULL)
+    {
+      start_raster_lookup (cache, data);
+    }
+  else if (data->icon_info)
+    {
+      StIconColors *colors = data->colors;
+      if (colors)
+        {
+          _st_icon_info_load_symbolic_async_queued (data->icon_info,
+                                                    data->colors,
+                                                    data->priority,
+                                                    data->queue_time,
+                                                    data->cancellable,
+                                                    on_symbolic_icon_loaded,
+                                                    data);
+        }
+      else
+        {
+          _st_icon_info_load_icon_async_queued (data->icon_info,
+                                                data->priority,
+                                                data->queue_time,
+                                                data->cancellable,
+                                                on_icon_loaded, data);
+        }
+    }
+  else
+    g_assert_not_reached ();
+}
+
+/* Requests with the same priority are started in the order they were
+ * made */
+static void
+queue_texture_load (StTextureCache       *cache,
+                    AsyncTextureLoadData *data)
+{
+  GList *l;
+
+  for (l = cache->pending_loads.tail; l; l = l->prev)
+    {
+      AsyncTextureLoadData *pending = l->data;
+
+      if (pending->priority <= data->priority)
+        break;
+    }
+
+  data->link.data = data;
+  data->queued = TRUE;
+
+  if (l != NULL)
+    g_queue_insert_after_link (&cache->pending_loads, l, &data->link);
+  else
+    g_queue_push_head_link (&cache->pending_loads, &data->link);
+}
+
+static void
+start_pending_loads (StTextureCache *cache)
+{
+  while (cache->running_loads.length < MAX_RUNNING_LOADS &&
+         cache->pending_loads.head != NULL)
+    {
+      AsyncTextureLoadData *data = cache->pending_loads.head->data;
+
+      g_queue_unlink (&cache->pending_loads, &data->link);
+      data->queued = FALSE;
+      data->running = TRUE;
+      data->cancellable = g_cancellable_new ();
+      g_queue_push_tail_link (&cache->running_loads, &data->link);
+
+      start_texture_load (cache, data);
+    }
+}
+
+/* Moves a request that didn't start yet ahead if @priority is higher */
+static void
+raise_load_priority (StTextureCache       *cache,
+                     AsyncTextureLoadData *data,
+                     int                   priority)
+{
+  if (!data->queued || data->priority <= priority)
+    return;
+
+  g_queue_unlink (&cache->pending_loads, &data->link);
+  data->priority = priority;
+  queue_texture_load (cache, data);
+}
+
+static void
+load_texture_async (StTextureCache       *cache,
+                    AsyncTextureLoadData *data)
+{
+  data->queue_time = g_get_monotonic_time ();
+  queue_texture_load (cache, data);
+  start_pending_loads (cache);
 }
 
 /**
@@ -834,16 +1569,15 @@ st_texture_cache_load (StTextureCache       *cache,
 {
   CoglTexture *texture;
 
-  texture = g_hash_table_lookup (cache->keyed_cache, key);
-  if (!texture)
-    {
-      texture = load (cache, key, data, error);
-      if (texture && policy == ST_TEXTURE_CACHE_POLICY_FOREVER)
-        g_hash_table_insert (cache->keyed_cache, g_strdup (key), texture);
-    }
+  texture = keyed_cache_lookup (cache, cache->keyed_cache, key);
+  if (texture)
+    return g_object_ref (texture);
 
+  texture = load (cache, key, data, error);
   if (texture && policy == ST_TEXTURE_CACHE_POLICY_FOREVER)
-    g_object_ref (texture);
+    keyed_cache_insert (cache, cache->keyed_cache,
+                        g_strdup (key), g_free,
+                        g_object_ref (texture));
 
   return texture;
 }
@@ -851,7 +1585,10 @@ st_texture_cache_load (StTextureCache       *cache,
 /**
  * ensure_request:
  * @cache: A #StTextureCache
+ * @keyed_cache: The table the loaded image is cached in
+ * @outstanding_requests: The table of pending requests for @keyed_cache
  * @key: A cache key
+ * @copy_key: Function to copy @key for @outstanding_requests
  * @policy: Cache policy
  * @request: (out): If no request is outstanding, one will be created and returned here
  * @texture: A texture to be added to the request
@@ -864,7 +1601,10 @@ st_texture_cache_load (StTextureCache       *cache,
  */
 static gboolean
 ensure_request (StTextureCache        *cache,
-                const char            *key,
+                GHashTable            *keyed_cache,
+                GHashTable            *outstanding_requests,
+                gconstpointer          key,
+                GBoxedCopyFunc         copy_key,
                 StTextureCachePolicy   policy,
                 AsyncTextureLoadData **request,
                 ClutterActor          *actor)
@@ -873,7 +1613,7 @@ ensure_request (StTextureCache        *cache,
   AsyncTextureLoadData *pending;
   gboolean had_pending;
 
-  image = g_hash_table_lookup (cache->keyed_cache, key);
+  image = keyed_cache_lookup (cache, keyed_cache, key);
 
   if (image != NULL)
     {
@@ -882,7 +1622,7 @@ ensure_request (StTextureCache        *cache,
       return TRUE;
     }
 
-  pending = g_hash_table_lookup (cache->outstanding_requests, key);
+  pending = g_hash_table_lookup (outstanding_requests, key);
   had_pending = pending != NULL;
 
   if (pending == NULL)
@@ -890,10 +1630,13 @@ ensure_request (StTextureCache        *cache,
       /* Not cached and no pending request, create it */
       *request = g_new0 (AsyncTextureLoadData, 1);
       if (policy != ST_TEXTURE_CACHE_POLICY_NONE)
-        g_hash_table_insert (cache->outstanding_requests, g_strdup (key), *request);
+        g_hash_table_insert (outstanding_requests, copy_key (key), *request);
     }
   else
-   *request = pending;
+    {
+      *request = pending;
+      raise_load_priority (cache, pending, G_PRIORITY_DEFAULT);
+    }
 
   /* Regardless of whether there was a pending request, prepend our texture here. */
   (*request)->actors = g_slist_prepend ((*request)->actors, g_object_ref (actor));
@@ -901,6 +1644,108 @@ ensure_request (StTextureCache        *cache,
   return had_pending;
 }
 
+static void
+get_icon_lookup_params (StThemeNode        *theme_node,
+                        StIconColors      **colors,
+                        StIconStyle        *icon_style,
+                        StIconLookupFlags  *lookup_flags)
+{
+  *colors = NULL;
+  *icon_style = ST_ICON_STYLE_REQUESTED;
+
+  if (theme_node)
+    {
+      *colors = st_theme_node_get_icon_colors (theme_node);
+      *icon_style = st_theme_node_get_icon_style (theme_node);
+    }
+
+  *lookup_flags = 0;
+
+  if (*icon_style == ST_ICON_STYLE_REGULAR)
+    *lookup_flags |= ST_ICON_LOOKUP_FORCE_REGULAR;
+  else if (*icon_style == ST_ICON_STYLE_SYMBOLIC)
+    *lookup_flags |= ST_ICON_LOOKUP_FORCE_SYMBOLIC;
+
+  if (clutter_get_default_text_direction () == CLUTTER_TEXT_DIRECTION_RTL)
+    *lookup_flags |= ST_ICON_LOOKUP_DIR_RTL;
+  else
+    *lookup_flags |= ST_ICON_LOOKUP_DIR_LTR;
+}
+
+/* Symbolic icons are rendered once with these colors, which puts the
+ * success, warning and error parts in the red, green and blue channels
+ * like in .symbolic.png files, and recolored when they are painted.
+ * That way a color change doesn't render them again, and there is a
+ * single texture for all the colors an icon is shown with. */
+static StIconColors *
+get_symbolic_mask_colors (void)
+{
+  static StIconColors *mask_colors = NULL;
+
+  if (G_UNLIKELY (mask_colors == NULL))
+    {
+      mask_colors = st_icon_colors_new ();
+      cogl_color_init_from_4f (&mask_colors->foreground, 0., 0., 0., 1.);
+      cogl_color_init_from_4f (&mask_colors->success, 1., 0., 0., 1.);
+      cogl_color_init_from_4f (&mask_colors->warning, 0., 1., 0., 1.);
+      cogl_color_init_from_4f (&mask_colors->error, 0., 0., 1., 1.);
+    }
+
+  return mask_colors;
+}
+
+/* Returns the colors to render @icon with for @colors. Emblems would be
+ * recolored along with the icon, so emblemed icons are rendered with
+ * their colors. */
+static StIconColors *
+get_load_colors (GIcon        *icon,
+                 StIconColors *colors)
+{
+  if (colors == NULL || G_IS_EMBLEMED_ICON (icon))
+    return colors;
+
+  return get_symbolic_mask_colors ();
+}
+
+/* Fills in a new request and starts loading it. Returns %FALSE if
+ * there is no such icon, in which case the caller frees @request. */
+static gboolean
+start_icon_request (StTextureCache       *cache,
+                    AsyncTextureLoadData *request,
+                    const IconCacheKey   *key,
+                    StIconColors         *colors,
+                    StIconLookupFlags     lookup_flags,
+                    int                   paint_scale,
+                    float                 resource_scale,
+                    CoglContext          *cogl_context,
+                    int                   priority)
+{
+  StIconInfo *info;
+
+  /* Do theme lookups in the main thread to avoid thread-unsafety */
+  info = st_icon_theme_lookup_by_gicon_for_scale (cache->icon_theme,
+                                                  key->icon,
+                                                  key->size, key->scale,
+                                                  lookup_flags);
+  if (info == NULL)
+    return FALSE;
+
+  request->cache = cache;
+  request->icon_key = icon_cache_key_copy (key);
+  request->policy = ST_TEXTURE_CACHE_POLICY_FOREVER;
+  request->colors = colors ? st_icon_colors_ref (colors) : NULL;
+  request->icon_info = info;
+  request->width = request->height = key->size;
+  request->paint_scale = paint_scale;
+  request->resource_scale = resource_scale;
+  request->cogl_context = cogl_context;
+  request->priority = priority;
+
+  load_texture_async (cache, request);
+
+  return TRUE;
+}
+
 /**
  * st_texture_cache_load_gicon:
  * @cache: A #StTextureCache
@@ -928,13 +1773,11 @@ st_texture_cache_load_gicon (StTextureCache    *cache,
   AsyncTextureLoadData *request;
   ClutterActor *actor;
   gint scale;
-  char *gicon_string;
-  g_autofree char *key = NULL;
+  IconCacheKey key;
   float actor_size;
-  StIconTheme *theme;
-  StTextureCachePolicy policy;
-  StIconColors *colors = NULL;
-  StIconStyle icon_style = ST_ICON_STYLE_REQUESTED;
+  StIconColors *colors;
+  StIconColors *load_colors;
+  StIconStyle icon_style;
   StIconLookupFlags lookup_flags;
 
   actor_size = size * paint_scale;
@@ -958,89 +1801,226 @@ st_texture_cache_load_gicon (StTextureCache    *cache,
                            NULL);
     }
 
-  if (theme_node)
-    {
-      colors = st_theme_node_get_icon_colors (theme_node);
-      icon_style = st_theme_node_get_icon_style (theme_node);
-    }
-
-  /* Do theme lookups in the main thread to avoid thread-unsafety */
-  theme = cache->icon_theme;
-
-  lookup_flags = 0;
-
-  if (icon_style == ST_ICON_STYLE_REGULAR)
-    lookup_flags |= ST_ICON_LOOKUP_FORCE_REGULAR;
-  else if (icon_style == ST_ICON_STYLE_SYMBOLIC)
-    lookup_flags |= ST_ICON_LOOKUP_FORCE_SYMBOLIC;
-
-  if (clutter_get_default_text_direction () == CLUTTER_TEXT_DIRECTION_RTL)
-    lookup_flags |= ST_ICON_LOOKUP_DIR_RTL;
-  else
-    lookup_flags |= ST_ICON_LOOKUP_DIR_LTR;
+  get_icon_lookup_params (theme_node, &colors, &icon_style, &lookup_flags);
+  load_colors = get_load_colors (icon, colors);
 
   scale = ceilf (paint_scale * resource_scale);
 
-  gicon_string = g_icon_to_string (icon);
-  /* A return value of NULL indicates that the icon can not be serialized,
-   * so don't have a unique identifier for it as a cache key, and thus can't
-   * be cached. If it is cacheable, we hardcode a policy of FOREVER here for
-   * now; we should actually blow this away on icon theme changes probably */
-  policy = gicon_string != NULL ? ST_TEXTURE_CACHE_POLICY_FOREVER
-                                : ST_TEXTURE_CACHE_POLICY_NONE;
-  if (colors)
-    {
-      /* This raises some doubts about the practice of using string keys */
-      key = g_strdup_printf (CACHE_PREFIX_ICON "%s,size=%d,scale=%d,style=%d,colors=%2x%2x%2x%2x,%2x%2x%2x%2x,%2x%2x%2x%2x,%2x%2x%2x%2x",
-                             gicon_string, size, scale, icon_style,
-                             colors->foreground.red, colors->foreground.blue, colors->foreground.green, colors->foreground.alpha,
-                             colors->warning.red, colors->warning.blue, colors->warning.green, colors->warning.alpha,
-                             colors->error.red, colors->error.blue, colors->error.green, colors->error.alpha,
-                             colors->success.red, colors->success.blue, colors->success.green, colors->success.alpha);
-    }
-  else
-    {
-      key = g_strdup_printf (CACHE_PREFIX_ICON "%s,size=%d,scale=%d,style=%d",
-                             gicon_string, size, scale, icon_style);
-    }
-  g_free (gicon_string);
+  icon_cache_key_init (&key, icon, size, scale, icon_style, load_colors);
 
   actor = create_invisible_actor ();
   clutter_actor_set_content_gravity  (actor, CLUTTER_CONTENT_GRAVITY_RESIZE_ASPECT);
   clutter_actor_set_size (actor, actor_size, actor_size);
-  if (!ensure_request (cache, key, policy, &request, actor))
+
+  if (load_colors != colors)
+    g_object_set_qdata_full (G_OBJECT (actor), icon_colors_quark,
+                             st_icon_colors_ref (colors),
+                             (GDestroyNotify) st_icon_colors_unref);
+  if (!ensure_request (cache, cache->icon_cache, cache->outstanding_icon_requests,
+                       &key, (GBoxedCopyFunc) icon_cache_key_copy,
+                       ST_TEXTURE_CACHE_POLICY_FOREVER, &request, actor))
     {
       /* Else, make a new request */
-      StIconInfo *info;
       ClutterContext *context = clutter_actor_get_context (actor);
       ClutterBackend *clutter_backend = clutter_context_get_backend (context);
 
-      info = st_icon_theme_lookup_by_gicon_for_scale (theme, icon,
-                                                      size, scale,
-                                                      lookup_flags);
-      if (info == NULL)
+      if (!start_icon_request (cache, request, &key, load_colors, lookup_flags,
+                               paint_scale, resource_scale,
+                               clutter_backend_get_cogl_context (clutter_backend),
+                               G_PRIORITY_DEFAULT))
         {
-          g_hash_table_remove (cache->outstanding_requests, key);
+          g_hash_table_remove (cache->outstanding_icon_requests, &key);
           texture_load_data_free (request);
           g_object_unref (actor);
           return NULL;
         }
+    }
 
-      request->cache = cache;
-      /* Transfer ownership of key */
-      request->key = g_steal_pointer (&key);
-      request->policy = policy;
-      request->colors = colors ? st_icon_colors_ref (colors) : NULL;
-      request->icon_info = info;
-      request->width = request->height = size;
-      request->paint_scale = paint_scale;
-      request->resource_scale = resource_scale;
-      request->cogl_context = clutter_backend_get_cogl_context (clutter_backend);
+  return actor;
+}
 
-      load_texture_async (cache, request);
+static void
+add_prefetch_id (AsyncTextureLoadData *data,
+                 guint                 prefetch_id)
+{
+  if (data->prefetch_ids == NULL)
+    data->prefetch_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  g_array_append_val (data->prefetch_ids, prefetch_id);
+}
+
+/* Returns %TRUE if nothing waits for @data anymore without @prefetch_id */
+static gboolean
+remove_prefetch_id (AsyncTextureLoadData *data,
+                    guint                 prefetch_id)
+{
+  guint i;
+
+  if (data->prefetch_ids == NULL)
+    return FALSE;
+
+  for (i = 0; i < data->prefetch_ids->len; i++)
+    {
+      if (g_array_index (data->prefetch_ids, guint, i) != prefetch_id)
+        continue;
+
+      g_array_remove_index_fast (data->prefetch_ids, i);
+
+      return data->prefetch_ids->len == 0 && data->actors == NULL;
     }
 
-  return actor;
+  return FALSE;
+}
+
+/**
+ * st_texture_cache_prefetch_gicons:
+ * @cache: A #StTextureCache
+ * @actor: an actor on the stage the icons will be shown on
+ * @theme_node: (nullable): The #StThemeNode to use for colors, or %NULL
+ *                            if the icons must not be recolored
+ * @icons: (array length=n_icons): the icons to load
+ * @n_icons: the number of icons
+ * @size: Size of themed
+ * @paint_scale: Scale factor of display
+ * @resource_scale: Resource scale factor
+ * @priority: the priority of the loads, such as %G_PRIORITY_HIGH for
+ *   icons that are about to be shown
+ *
+ * Loads @icons into the cache, so that icons later created with
+ * st_texture_cache_load_gicon() and the same parameters are shown
+ * right away. Icons that are cached or already being loaded are not
+ * loaded again, but their load is moved ahead if @priority is higher.
+ *
+ * Only a few images are decoded at the same time; icons loaded with
+ * st_texture_cache_load_gicon() have %G_PRIORITY_DEFAULT.
+ *
+ * Returns: an ID to pass to st_texture_cache_cancel_prefetch() when
+ *   the icons aren't needed anymore
+ */
+guint
+st_texture_cache_prefetch_gicons (StTextureCache  *cache,
+                                  ClutterActor    *actor,
+                                  StThemeNode     *theme_node,
+                                  GIcon          **icons,
+                                  int              n_icons,
+                                  int              size,
+                                  int              paint_scale,
+                                  float            resource_scale,
+                                  int              priority)
+{
+  ClutterContext *context;
+  CoglContext *cogl_context;
+  StIconColors *colors;
+  StIconColors *load_colors;
+  StIconStyle icon_style;
+  StIconLookupFlags lookup_flags;
+  guint prefetch_id;
+  int scale;
+  int i;
+
+  g_return_val_if_fail (ST_IS_TEXTURE_CACHE (cache), 0);
+  g_return_val_if_fail (CLUTTER_IS_ACTOR (actor), 0);
+
+  prefetch_id = ++cache->last_prefetch_id;
+  if (prefetch_id == 0)
+    prefetch_id = ++cache->last_prefetch_id;
+
+  context = clutter_actor_get_context (actor);
+  cogl_context = clutter_backend_get_cogl_context (clutter_context_get_backend (context));
+
+  get_icon_lookup_params (theme_node, &colors, &icon_style, &lookup_flags);
+  scale = ceilf (paint_scale * resource_scale);
+
+  for (i = 0; i < n_icons; i++)
+    {
+      AsyncTextureLoadData *request;
+      IconCacheKey key;
+
+      if (ST_IS_IMAGE_CONTENT (icons[i]))
+        continue;
+
+      load_colors = get_load_colors (icons[i], colors);
+      icon_cache_key_init (&key, icons[i], size, scale, icon_style, load_colors);
+
+      if (keyed_cache_lookup (cache, cache->icon_cache, &key) != NULL)
+        continue;
+
+      request = g_hash_table_lookup (cache->outstanding_icon_requests, &key);
+      if (request != NULL)
+        {
+          add_prefetch_id (request, prefetch_id);
+          raise_load_priority (cache, request, priority);
+          continue;
+        }
+
+      request = g_new0 (AsyncTextureLoadData, 1);
+      add_prefetch_id (request, prefetch_id);
+      g_hash_table_insert (cache->outstanding_icon_requests,
+                           icon_cache_key_copy (&key), request);
+
+      if (!start_icon_request (cache, request, &key, load_colors, lookup_flags,
+                               paint_scale, resource_scale,
+                               cogl_context, priority))
+        {
+          g_hash_table_remove (cache->outstanding_icon_requests, &key);
+          texture_load_data_free (request);
+        }
+    }
+
+  return prefetch_id;
+}
+
+/**
+ * st_texture_cache_cancel_prefetch:
+ * @cache: A #StTextureCache
+ * @prefetch_id: an ID returned by st_texture_cache_prefetch_gicons(),
+ *   or 0
+ *
+ * Drops the icons of a st_texture_cache_prefetch_gicons() call that
+ * no actor and no other prefetch waits for, for instance because the
+ * user scrolled away from them. Loads that already started are
+ * cancelled too, and what they decoded is discarded.
+ */
+void
+st_texture_cache_cancel_prefetch (StTextureCache *cache,
+                                  guint           prefetch_id)
+{
+  GList *l;
+
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  if (prefetch_id == 0)
+    return;
+
+  l = cache->pending_loads.head;
+  while (l != NULL)
+    {
+      AsyncTextureLoadData *data = l->data;
+
+      l = l->next;
+
+      if (!remove_prefetch_id (data, prefetch_id))
+        continue;
+
+      g_queue_unlink (&cache->pending_loads, &data->link);
+      g_hash_table_remove (cache->outstanding_icon_requests, data->icon_key);
+      texture_load_data_free (data);
+    }
+
+  /* Loads that wait for a decode thread are skipped. A later request
+   * for the same icon starts over rather than waiting for them. */
+  for (l = cache->running_loads.head; l; l = l->next)
+    {
+      AsyncTextureLoadData *data = l->data;
+
+      if (!remove_prefetch_id (data, prefetch_id))
+        continue;
+
+      if (g_hash_table_lookup (cache->outstanding_icon_requests, data->icon_key) == data)
+        g_hash_table_remove (cache->outstanding_icon_requests, data->icon_key);
+
+      g_cancellable_cancel (data->cancellable);
+    }
 }
 
 static void
@@ -1161,7 +2141,9 @@ st_texture_cache_load_file_async (StTextureCache *cache,
 
   actor = create_invisible_actor ();
 
-  if (ensure_request (cache, key, policy, &request, actor))
+  if (ensure_request (cache, cache->keyed_cache, cache->outstanding_requests,
+                      key, (GBoxedCopyFunc) g_strdup,
+                      policy, &request, actor))
     {
       /* If there's an outstanding request, we've just added ourselves to it */
       g_free (key);
@@ -1202,7 +2184,7 @@ st_texture_cache_load_file_sync_to_cogl_texture (StTextureCache *cache,
                                                  gfloat          resource_scale,
                                                  GError         **error)
 {
-  ClutterContent *image;
+  g_autoptr (ClutterContent) image = NULL;
   CoglTexture *texdata;
   GdkPixbuf *pixbuf;
   char *key;
@@ -1210,16 +2192,20 @@ st_texture_cache_load_file_sync_to_cogl_texture (StTextureCache *cache,
   key = g_strdup_printf (CACHE_PREFIX_FILE "%u%f", g_file_hash (file), resource_scale);
 
   texdata = NULL;
-  image = g_hash_table_lookup (cache->keyed_cache, key);
+  image = keyed_cache_lookup (cache, cache->keyed_cache, key);
 
-  if (image == NULL)
+  if (image != NULL)
+    {
+      g_object_ref (image);
+    }
+  else
     {
       pixbuf = impl_load_pixbuf_file (file, available_width, available_height,
                                       paint_scale, resource_scale, error);
       if (!pixbuf)
         goto out;
 
-      image = pixbuf_to_st_content_image (pixbuf, context,
+      image = pixbuf_to_st_content_image (pixbuf, context, NULL,
                                           available_height, available_width,
                                           paint_scale, resource_scale);
       g_object_unref (pixbuf);
@@ -1229,7 +2215,9 @@ st_texture_cache_load_file_sync_to_cogl_texture (StTextureCache *cache,
 
       if (policy == ST_TEXTURE_CACHE_POLICY_FOREVER)
         {
-          g_hash_table_insert (cache->keyed_cache, g_strdup (key), image);
+          keyed_cache_insert (cache, cache->keyed_cache,
+                              g_strdup (key), g_free,
+                              g_object_ref (image));
           hash_table_insert_scale (cache->used_scales, (double)resource_scale);
         }
     }
@@ -1397,3 +2385,328 @@ st_texture_cache_rescan_icon_theme (StTextureCache *cache)
 {
   return st_icon_theme_rescan_if_needed (cache->icon_theme);
 }
+
+/**
+ * st_texture_cache_set_icon_info_cache_size:
+ * @cache: A #StTextureCache
+ * @size: the number of icon lookups to keep
+ *
+ * Sets how many icon theme lookups are kept after they were last used,
+ * see st_icon_theme_set_info_cache_size().
+ */
+void
+st_texture_cache_set_icon_info_cache_size (StTextureCache *cache,
+                                           guint           size)
+{
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  st_icon_theme_set_info_cache_size (cache->icon_theme, size);
+}
+
+/**
+ * st_texture_cache_get_icon_info_cache_stats:
+ * @cache: A #StTextureCache
+ * @hits: (out) (optional): number of icon lookups that were cached
+ * @misses: (out) (optional): number of icon lookups that searched the theme
+ * @evictions: (out) (optional): number of unused lookups that were dropped
+ *
+ * Gets statistics about the icon theme lookups of @cache.
+ */
+void
+st_texture_cache_get_icon_info_cache_stats (StTextureCache *cache,
+                                            guint          *hits,
+                                            guint          *misses,
+                                            guint          *evictions)
+{
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  st_icon_theme_get_info_cache_stats (cache->icon_theme,
+                                      hits, misses, evictions);
+}
+
+/**
+ * _st_texture_cache_create_texture: (skip)
+ * @cache: A #StTextureCache
+ * @cogl_context: a #CoglContext
+ * @width: width of the image
+ * @height: height of the image
+ * @format: format of @data
+ * @rowstride: rowstride of @data
+ * @data: the pixels of the image
+ * @error: return location for a #GError, or %NULL
+ *
+ * Creates a texture for an image that is never drawn repeated, packing
+ * it into the atlas if it's small enough.
+ *
+ * Returns: (transfer full) (nullable): the new texture
+ */
+CoglTexture *
+_st_texture_cache_create_texture (StTextureCache   *cache,
+                                  CoglContext      *cogl_context,
+                                  int               width,
+                                  int               height,
+                                  CoglPixelFormat   format,
+                                  int               rowstride,
+                                  const guint8     *data,
+                                  GError          **error)
+{
+  CoglTexture *texture;
+
+  texture = _st_texture_atlas_add (cache->atlas, cogl_context,
+                                   width, height,
+                                   format, rowstride, data);
+  if (texture != NULL)
+    return texture;
+
+  return cogl_texture_2d_new_from_data (cogl_context,
+                                        width, height,
+                                        format, rowstride, data,
+                                        error);
+}
+
+/**
+ * _st_texture_cache_lookup_corner: (skip)
+ * @cache: A #StTextureCache
+ * @corner: the corner to look up
+ *
+ * Looks up a corner texture previously stored with
+ * _st_texture_cache_insert_corner().
+ *
+ * Returns: (transfer full) (nullable): the corner texture, or %NULL
+ */
+CoglTexture *
+_st_texture_cache_lookup_corner (StTextureCache     *cache,
+                                 const StCornerSpec *corner)
+{
+  CoglTexture *texture;
+
+  texture = g_hash_table_lookup (cache->corner_cache, corner);
+
+  return texture ? g_object_ref (texture) : NULL;
+}
+
+/**
+ * _st_texture_cache_insert_corner: (skip)
+ * @cache: A #StTextureCache
+ * @corner: the corner drawn in @texture
+ * @texture: the corner texture
+ *
+ * Stores @texture for all nodes with the same corner.
+ */
+void
+_st_texture_cache_insert_corner (StTextureCache     *cache,
+                                 const StCornerSpec *corner,
+                                 CoglTexture        *texture)
+{
+  g_hash_table_replace (cache->corner_cache,
+                        g_memdup2 (corner, sizeof (StCornerSpec)),
+                        g_object_ref (texture));
+}
+
+/* Drops the least recently used shadows until the cache is within
+ * ST_SHADOW_CACHE_MAX_BYTES again */
+static void
+shadow_cache_trim (StTextureCache *cache)
+{
+  while (cache->shadow_cache_bytes > ST_SHADOW_CACHE_MAX_BYTES &&
+         cache->shadow_lru.tail != NULL)
+    {
+      ShadowCacheEntry *entry = cache->shadow_lru.tail->data;
+
+      g_queue_unlink (&cache->shadow_lru, &entry->link);
+      cache->shadow_cache_bytes -= entry->n_bytes;
+      g_hash_table_remove (cache->shadow_cache, &entry->key);
+    }
+}
+
+/**
+ * _st_texture_cache_lookup_shadow: (skip)
+ * @cache: A #StTextureCache
+ * @key: the geometry of the shadow
+ *
+ * Looks up a blurred silhouette previously stored with
+ * _st_texture_cache_insert_shadow().
+ *
+ * Returns: (transfer full) (nullable): the shadow texture, or %NULL
+ */
+CoglTexture *
+_st_texture_cache_lookup_shadow (StTextureCache         *cache,
+                                 const StShadowCacheKey *key)
+{
+  ShadowCacheEntry *entry;
+
+  entry = g_hash_table_lookup (cache->shadow_cache, key);
+  if (entry == NULL)
+    {
+      cache->shadow_cache_misses++;
+      return NULL;
+    }
+
+  cache->shadow_cache_hits++;
+
+  g_queue_unlink (&cache->shadow_lru, &entry->link);
+  g_queue_push_head_link (&cache->shadow_lru, &entry->link);
+
+  return g_object_ref (entry->texture);
+}
+
+/**
+ * _st_texture_cache_insert_shadow: (skip)
+ * @cache: A #StTextureCache
+ * @key: the geometry of the shadow
+ * @texture: the blurred silhouette
+ *
+ * Stores @texture so that other boxes with the same shadow geometry can
+ * use it, evicting the least recently used shadows if needed.
+ */
+void
+_st_texture_cache_insert_shadow (StTextureCache         *cache,
+                                 const StShadowCacheKey *key,
+                                 CoglTexture            *texture)
+{
+  ShadowCacheEntry *entry;
+
+  entry = g_hash_table_lookup (cache->shadow_cache, key);
+  if (entry != NULL)
+    {
+      g_queue_unlink (&cache->shadow_lru, &entry->link);
+      cache->shadow_cache_bytes -= entry->n_bytes;
+      g_hash_table_remove (cache->shadow_cache, key);
+    }
+
+  entry = g_new0 (ShadowCacheEntry, 1);
+  entry->key = *key;
+  entry->texture = g_object_ref (texture);
+  entry->n_bytes = (gsize) cogl_texture_get_width (texture) *
+                   cogl_texture_get_height (texture) * 4;
+  entry->link.data = entry;
+
+  g_hash_table_insert (cache->shadow_cache, &entry->key, entry);
+  g_queue_push_head_link (&cache->shadow_lru, &entry->link);
+  cache->shadow_cache_bytes += entry->n_bytes;
+
+  shadow_cache_trim (cache);
+}
+
+/**
+ * st_texture_cache_get_atlas_stats:
+ * @cache: A #StTextureCache
+ * @n_pages: (out) (optional): number of shared atlas textures
+ * @n_images: (out) (optional): number of images packed into them
+ * @n_evictions: (out) (optional): number of times unused images were
+ *   dropped to make room on a full page
+ *
+ * Gets statistics about the small images that share textures, so that
+ * they can be drawn in a single batch.
+ */
+void
+st_texture_cache_get_atlas_stats (StTextureCache *cache,
+                                  guint          *n_pages,
+                                  guint          *n_images,
+                                  guint          *n_evictions)
+{
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  _st_texture_atlas_get_stats (cache->atlas, n_pages, n_images, n_evictions);
+}
+
+/**
+ * st_texture_cache_get_texture_draw_stats:
+ * @cache: A #StTextureCache
+ * @n_draws: (out) (optional): number of textures drawn by St
+ * @n_switches: (out) (optional): number of those draws that used a
+ *   different GL texture than the draw before
+ *
+ * Gets statistics about the textures St draws. Draws that use the
+ * same GL texture as the previous one, such as images on the same
+ * atlas page, can be batched into one draw call.
+ */
+void
+st_texture_cache_get_texture_draw_stats (StTextureCache *cache,
+                                         guint          *n_draws,
+                                         guint          *n_switches)
+{
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  _st_texture_atlas_get_draw_stats (n_draws, n_switches);
+}
+
+/**
+ * st_texture_cache_get_shadow_cache_stats:
+ * @cache: A #StTextureCache
+ * @hits: (out) (optional): number of box shadows that reused a cached
+ *   texture
+ * @misses: (out) (optional): number of box shadows that had to be blurred
+ * @n_bytes: (out) (optional): approximate size of the cached textures
+ *
+ * Gets statistics about the sharing of blurred box-shadow textures
+ * between widgets.
+ */
+void
+st_texture_cache_get_shadow_cache_stats (StTextureCache *cache,
+                                         guint          *hits,
+                                         guint          *misses,
+                                         gsize          *n_bytes)
+{
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  if (hits)
+    *hits = cache->shadow_cache_hits;
+  if (misses)
+    *misses = cache->shadow_cache_misses;
+  if (n_bytes)
+    *n_bytes = cache->shadow_cache_bytes;
+}
+
+/**
+ * st_texture_cache_get_cache_stats:
+ * @cache: A #StTextureCache
+ * @n_entries: (out) (optional): number of cached images and icons
+ * @n_bytes: (out) (optional): approximate size of their textures
+ * @n_evictions: (out) (optional): number of unused entries that were
+ *   freed to stay within the budget
+ *
+ * Gets statistics about the cached images and icons.
+ */
+void
+st_texture_cache_get_cache_stats (StTextureCache *cache,
+                                  guint          *n_entries,
+                                  gsize          *n_bytes,
+                                  guint          *n_evictions)
+{
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  if (n_entries)
+    *n_entries = g_hash_table_size (cache->keyed_cache) +
+                 g_hash_table_size (cache->icon_cache);
+  if (n_bytes)
+    *n_bytes = cache->keyed_cache_bytes;
+  if (n_evictions)
+    *n_evictions = cache->keyed_cache_evictions;
+}
+
+/**
+ * st_texture_cache_get_decode_stats:
+ * @cache: A #StTextureCache
+ * @lane: the group of decodes
+ * @n_decoded: (out) (optional): number of images decoded
+ * @n_cancelled: (out) (optional): number of decodes that were cancelled
+ *   before they started
+ * @latency_histogram: (out caller-allocates) (array fixed-size=6) (optional):
+ *   how many decodes waited for a thread less than 1, 4, 16, 64 and
+ *   256 milliseconds, and longer
+ *
+ * Gets statistics about the images and icons decoded in worker threads.
+ */
+void
+st_texture_cache_get_decode_stats (StTextureCache *cache,
+                                   StDecodeLane    lane,
+                                   guint          *n_decoded,
+                                   guint          *n_cancelled,
+                                   guint          *latency_histogram)
+{
+  g_return_if_fail (ST_IS_TEXTURE_CACHE (cache));
+
+  _st_decode_scheduler_get_stats (lane, n_decoded, n_cancelled,
+                                  latency_histogram);
+}
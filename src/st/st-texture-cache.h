@@ -42,6 +42,23 @@ typedef enum {
   ST_TEXTURE_CACHE_POLICY_FOREVER
 } StTextureCachePolicy;
 
+/**
+ * StDecodeLane:
+ * @ST_DECODE_LANE_VISIBLE: images that are shown on screen
+ * @ST_DECODE_LANE_PREFETCH: images that are loaded ahead of time
+ * @ST_DECODE_LANE_BACKGROUND: other images
+ *
+ * The groups of image decodes that
+ * st_texture_cache_get_decode_stats() reports on.
+ */
+typedef enum {
+  ST_DECODE_LANE_VISIBLE,
+  ST_DECODE_LANE_PREFETCH,
+  ST_DECODE_LANE_BACKGROUND
+} StDecodeLane;
+
+#define ST_DECODE_N_LATENCY_BUCKETS 6
+
 StTextureCache* st_texture_cache_get_default (void);
 
 ClutterActor *st_texture_cache_load_gicon (StTextureCache *cache,
@@ -89,4 +106,50 @@ CoglTexture * st_texture_cache_load (StTextureCache       *cache,
                                      void                 *data,
                                      GError              **error);
 
+guint st_texture_cache_prefetch_gicons (StTextureCache  *cache,
+                                        ClutterActor    *actor,
+                                        StThemeNode     *theme_node,
+                                        GIcon          **icons,
+                                        int              n_icons,
+                                        int              size,
+                                        int              paint_scale,
+                                        float            resource_scale,
+                                        int              priority);
+
+void st_texture_cache_cancel_prefetch (StTextureCache *cache,
+                                       guint           prefetch_id);
+
 gboolean st_texture_cache_rescan_icon_theme (StTextureCache *cache);
+
+void st_texture_cache_set_icon_info_cache_size (StTextureCache *cache,
+                                                guint           size);
+
+void st_texture_cache_get_icon_info_cache_stats (StTextureCache *cache,
+                                                 guint          *hits,
+                                                 guint          *misses,
+                                                 guint          *evictions);
+
+void st_texture_cache_get_atlas_stats (StTextureCache *cache,
+                                       guint          *n_pages,
+                                       guint          *n_images,
+                                       guint          *n_evictions);
+
+void st_texture_cache_get_texture_draw_stats (StTextureCache *cache,
+                                              guint          *n_draws,
+                                              guint          *n_switches);
+
+void st_texture_cache_get_shadow_cache_stats (StTextureCache *cache,
+                                              guint          *hits,
+                                              guint          *misses,
+                                              gsize          *n_bytes);
+
+void st_texture_cache_get_cache_stats (StTextureCache *cache,
+                                       guint          *n_entries,
+                                       gsize          *n_bytes,
+                                       guint          *n_evictions);
+
+void st_texture_cache_get_decode_stats (StTextureCache *cache,
+                                        StDecodeLane    lane,
+                                        guint          *n_decoded,
+                                        guint          *n_cancelled,
+                                        guint          *latency_histogram);
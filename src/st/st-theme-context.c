@@ -40,6 +40,11 @@
 
 #define ACCENT_FG_COLOR     "#ffffff"
 
+#define DEFAULT_MAX_INTERNED_NODES 2048
+
+/* Upper bound of interned nodes looked at for eviction per interned node */
+#define MAX_EVICTION_SCAN 16
+
 struct _StThemeContext {
   GObject parent;
 
@@ -48,12 +53,22 @@ struct _StThemeContext {
   PangoFontDescription *font;
   CoglColor accent_color;
   CoglColor accent_fg_color;
+  guint accent_generation;
 
   StThemeNode *root_node;
   StTheme *theme;
 
-  /* set of StThemeNode */
+  /* StThemeNode => GList link in nodes_lru */
   GHashTable *nodes;
+  /* interned StThemeNodes, most recently used first */
+  GQueue nodes_lru;
+  guint max_interned_nodes;
+  guint n_evicted_nodes;
+
+  /* set of StMatchedProperties, only cleared when the stylesheets change */
+  GHashTable *matched_properties;
+  guint matched_properties_hits;
+  guint matched_properties_misses;
 
   gulong stylesheets_changed_id;
 
@@ -64,6 +79,7 @@ enum
 {
   PROP_0,
   PROP_SCALE_FACTOR,
+  PROP_MAX_INTERNED_NODES,
 
   N_PROPS
 };
@@ -89,6 +105,9 @@ static void update_accent_colors (StThemeContext *context);
 static void on_icon_theme_changed (StTextureCache *cache,
                                    StThemeContext *context);
 static void st_theme_context_changed (StThemeContext *context);
+static void trim_interned_nodes (StThemeContext *context);
+static void on_custom_stylesheets_changed (StTheme        *theme,
+                                           StThemeContext *context);
 
 static void st_theme_context_set_property (GObject      *object,
                                            guint         prop_id,
@@ -120,8 +139,11 @@ st_theme_context_finalize (GObject *object)
 
   g_clear_signal_handler (&context->stylesheets_changed_id, context->theme);
 
+  g_queue_clear (&context->nodes_lru);
   if (context->nodes)
     g_hash_table_unref (context->nodes);
+  if (context->matched_properties)
+    g_hash_table_unref (context->matched_properties);
   if (context->root_node)
     g_object_unref (context->root_node);
   if (context->theme)
@@ -151,6 +173,19 @@ st_theme_context_class_init (StThemeContextClass *klass)
                       0, G_MAXINT, 1,
                       ST_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY);
 
+  /**
+   * StThemeContext:max-interned-nodes:
+   *
+   * The number of interned theme nodes above which nodes that are no
+   * longer in use are evicted, least recently used first. Nodes that are
+   * still referenced are never evicted, so this is a soft limit. 0 means
+   * no limit.
+   */
+  props[PROP_MAX_INTERNED_NODES] =
+    g_param_spec_uint ("max-interned-nodes", NULL, NULL,
+                       0, G_MAXUINT, DEFAULT_MAX_INTERNED_NODES,
+                       ST_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY);
+
   g_object_class_install_properties (object_class, N_PROPS, props);
 
   /**
@@ -190,6 +225,13 @@ st_theme_context_init (StThemeContext *context)
   context->nodes = g_hash_table_new_full ((GHashFunc) st_theme_node_hash,
                                           (GEqualFunc) st_theme_node_equal,
                                           g_object_unref, NULL);
+  g_queue_init (&context->nodes_lru);
+  context->max_interned_nodes = DEFAULT_MAX_INTERNED_NODES;
+  context->matched_properties =
+    g_hash_table_new_full (_st_matched_properties_hash,
+                           _st_matched_properties_equal,
+                           (GDestroyNotify) _st_matched_properties_unref,
+                           NULL);
   context->scale_factor = 1;
 
   update_accent_colors (context);
@@ -208,6 +250,9 @@ st_theme_context_set_property (GObject      *object,
     case PROP_SCALE_FACTOR:
       st_theme_context_set_scale_factor (context, g_value_get_int (value));
       break;
+    case PROP_MAX_INTERNED_NODES:
+      st_theme_context_set_max_interned_nodes (context, g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -227,6 +272,9 @@ st_theme_context_get_property (GObject    *object,
     case PROP_SCALE_FACTOR:
       g_value_set_int (value, context->scale_factor);
       break;
+    case PROP_MAX_INTERNED_NODES:
+      g_value_set_uint (value, context->max_interned_nodes);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -246,8 +294,13 @@ get_interface_font_description (void)
 static void
 update_accent_colors (StThemeContext *context)
 {
+  /* Shared by all contexts, so a generation never means two things.
+   * The first one is 1, as 0 marks terms without a cached color. */
+  static guint accent_generation = 0;
   StSettings *settings = st_settings_get ();
   StSystemAccentColor accent_color;
+  CoglColor old_accent_color = context->accent_color;
+  CoglColor old_accent_fg_color = context->accent_fg_color;
 
   g_object_get (settings, "accent-color", &accent_color, NULL);
 
@@ -295,9 +348,51 @@ update_accent_colors (StThemeContext *context)
 
   cogl_color_from_string (&context->accent_fg_color, ACCENT_FG_COLOR);
 
+  /* Colors computed from the accent are cached on the terms until
+   * this changes */
+  if (context->accent_generation == 0 ||
+      !cogl_color_equal (&old_accent_color, &context->accent_color) ||
+      !cogl_color_equal (&old_accent_fg_color, &context->accent_fg_color))
+    context->accent_generation = ++accent_generation;
+
   st_theme_context_changed (context);
 }
 
+static void
+trim_interned_nodes (StThemeContext *context)
+{
+  int n_scanned = 0;
+
+  if (context->max_interned_nodes == 0)
+    return;
+
+  while (g_hash_table_size (context->nodes) > context->max_interned_nodes &&
+         n_scanned++ < MAX_EVICTION_SCAN)
+    {
+      GList *link = g_queue_pop_tail_link (&context->nodes_lru);
+      StThemeNode *node = link->data;
+
+      /* Nodes that are still used by a widget, a transition or as
+       * the parent of another node get another chance */
+      if (G_OBJECT (node)->ref_count > 1)
+        {
+          g_queue_push_head_link (&context->nodes_lru, link);
+          continue;
+        }
+
+      g_list_free_1 (link);
+      g_hash_table_remove (context->nodes, node);
+      context->n_evicted_nodes++;
+    }
+
+  /* The matched properties are shared between nodes, and nodes that
+   * still use an entry keep it alive, so simply start over when the
+   * cache grows much bigger than the set of nodes it serves.
+   */
+  if (g_hash_table_size (context->matched_properties) > 2 * context->max_interned_nodes)
+    g_hash_table_remove_all (context->matched_properties);
+}
+
 static void
 on_stage_destroy (ClutterStage *stage)
 {
@@ -312,6 +407,7 @@ st_theme_context_changed (StThemeContext *context)
 {
   StThemeNode *old_root = context->root_node;
   context->root_node = NULL;
+  g_queue_clear (&context->nodes_lru);
   g_hash_table_remove_all (context->nodes);
 
   g_signal_emit (context, signals[CHANGED], 0);
@@ -320,6 +416,14 @@ st_theme_context_changed (StThemeContext *context)
     g_object_unref (old_root);
 }
 
+static void
+on_custom_stylesheets_changed (StTheme        *theme,
+                               StThemeContext *context)
+{
+  g_hash_table_remove_all (context->matched_properties);
+  st_theme_context_changed (context);
+}
+
 static void
 on_font_name_changed (StSettings     *settings,
                       GParamSpec     *pspect,
@@ -411,14 +515,15 @@ st_theme_context_set_theme (StThemeContext          *context,
         g_clear_signal_handler (&context->stylesheets_changed_id, context->theme);
 
       g_set_object (&context->theme, theme);
+      g_hash_table_remove_all (context->matched_properties);
 
       if (context->theme)
         {
           context->stylesheets_changed_id =
-            g_signal_connect_swapped (context->theme,
-                                      "custom-stylesheets-changed",
-                                      G_CALLBACK (st_theme_context_changed),
-                                      context);
+            g_signal_connect (context->theme,
+                              "custom-stylesheets-changed",
+                              G_CALLBACK (on_custom_stylesheets_changed),
+                              context);
         }
 
       st_theme_context_changed (context);
@@ -484,6 +589,12 @@ st_theme_context_get_font (StThemeContext *context)
   return context->font;
 }
 
+guint
+_st_theme_context_get_accent_generation (StThemeContext *context)
+{
+  return context->accent_generation;
+}
+
 /**
  * st_theme_context_get_accent_color:
  * @context: a #StThemeContext
@@ -540,16 +651,142 @@ StThemeNode *
 st_theme_context_intern_node (StThemeContext *context,
                               StThemeNode    *node)
 {
-  StThemeNode *mine = g_hash_table_lookup (context->nodes, node);
+  StThemeNode *mine;
+  GList *link;
 
   /* this might be node or not - it doesn't actually matter */
-  if (mine != NULL)
-    return mine;
+  if (g_hash_table_lookup_extended (context->nodes, node,
+                                    (gpointer *) &mine, (gpointer *) &link))
+    {
+      g_queue_unlink (&context->nodes_lru, link);
+      g_queue_push_head_link (&context->nodes_lru, link);
+      return mine;
+    }
+
+  g_queue_push_head (&context->nodes_lru, node);
+  g_hash_table_insert (context->nodes, g_object_ref (node),
+                       g_queue_peek_head_link (&context->nodes_lru));
+
+  trim_interned_nodes (context);
 
-  g_hash_table_add (context->nodes, g_object_ref (node));
   return node;
 }
 
+/**
+ * st_theme_context_set_max_interned_nodes:
+ * @context: a #StThemeContext
+ * @max_nodes: the new limit, or 0 for no limit
+ *
+ * Sets the number of interned nodes above which nodes no longer in
+ * use are evicted. See #StThemeContext:max-interned-nodes.
+ */
+void
+st_theme_context_set_max_interned_nodes (StThemeContext *context,
+                                         guint           max_nodes)
+{
+  g_return_if_fail (ST_IS_THEME_CONTEXT (context));
+
+  if (context->max_interned_nodes == max_nodes)
+    return;
+
+  context->max_interned_nodes = max_nodes;
+  trim_interned_nodes (context);
+
+  g_object_notify_by_pspec (G_OBJECT (context), props[PROP_MAX_INTERNED_NODES]);
+}
+
+/**
+ * st_theme_context_get_max_interned_nodes:
+ * @context: a #StThemeContext
+ *
+ * Gets the limit set by st_theme_context_set_max_interned_nodes().
+ *
+ * Returns: the maximum number of interned nodes, or 0 for no limit
+ */
+guint
+st_theme_context_get_max_interned_nodes (StThemeContext *context)
+{
+  g_return_val_if_fail (ST_IS_THEME_CONTEXT (context), 0);
+
+  return context->max_interned_nodes;
+}
+
+/**
+ * st_theme_context_get_node_cache_stats:
+ * @context: a #StThemeContext
+ * @n_nodes: (out) (optional): number of currently interned nodes
+ * @n_evicted: (out) (optional): number of nodes evicted so far
+ *
+ * Gets statistics about the table of interned nodes, see
+ * st_theme_context_intern_node().
+ */
+void
+st_theme_context_get_node_cache_stats (StThemeContext *context,
+                                       guint          *n_nodes,
+                                       guint          *n_evicted)
+{
+  g_return_if_fail (ST_IS_THEME_CONTEXT (context));
+
+  if (n_nodes)
+    *n_nodes = g_hash_table_size (context->nodes);
+  if (n_evicted)
+    *n_evicted = context->n_evicted_nodes;
+}
+
+/**
+ * st_theme_context_get_style_cache_stats:
+ * @context: a #StThemeContext
+ * @hits: (out) (optional): number of nodes that reused an existing cascade
+ *   result
+ * @misses: (out) (optional): number of nodes that had to be matched against
+ *   the theme
+ *
+ * Gets statistics about the sharing of style information between theme
+ * nodes with identical matching inputs.
+ */
+void
+st_theme_context_get_style_cache_stats (StThemeContext *context,
+                                        guint          *hits,
+                                        guint          *misses)
+{
+  g_return_if_fail (ST_IS_THEME_CONTEXT (context));
+
+  if (hits)
+    *hits = context->matched_properties_hits;
+  if (misses)
+    *misses = context->matched_properties_misses;
+}
+
+StMatchedProperties *
+_st_theme_context_lookup_matched_properties (StThemeContext      *context,
+                                             StMatchedProperties *key)
+{
+  StMatchedProperties *matched;
+
+  /* We only get notified of stylesheet changes for our own theme */
+  if (key->theme != context->theme)
+    return NULL;
+
+  matched = g_hash_table_lookup (context->matched_properties, key);
+  if (matched != NULL)
+    context->matched_properties_hits++;
+  else
+    context->matched_properties_misses++;
+
+  return matched;
+}
+
+void
+_st_theme_context_add_matched_properties (StThemeContext      *context,
+                                          StMatchedProperties *matched)
+{
+  if (matched->theme != context->theme)
+    return;
+
+  g_hash_table_add (context->matched_properties,
+                    _st_matched_properties_ref (matched));
+}
+
 /**
  * st_theme_context_get_scale_factor:
  * @context: a #StThemeContext
@@ -61,10 +61,22 @@ StThemeNode *               st_theme_context_get_root_node    (StThemeContext
 StThemeNode *               st_theme_context_intern_node      (StThemeContext             *context,
                                                                StThemeNode                *node);
 
+void  st_theme_context_set_max_interned_nodes (StThemeContext *context,
+                                               guint           max_nodes);
+guint st_theme_context_get_max_interned_nodes (StThemeContext *context);
+
+void st_theme_context_get_node_cache_stats (StThemeContext *context,
+                                            guint          *n_nodes,
+                                            guint          *n_evicted);
+
 int st_theme_context_get_scale_factor (StThemeContext *context);
 void st_theme_context_set_scale_factor (StThemeContext *context,
                                         int             factor);
 
 double st_theme_context_get_resolution (StThemeContext *context);
 
+void st_theme_context_get_style_cache_stats (StThemeContext *context,
+                                             guint          *hits,
+                                             guint          *misses);
+
 G_END_DECLS
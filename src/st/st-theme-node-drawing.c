@@ -28,34 +28,22 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "st-shadow.h"
 #include "st-private.h"
 #include "st-theme-private.h"
 #include "st-theme-context.h"
-#include "st-texture-cache.h"
+#include "st-texture-atlas.h"
+#include "st-texture-cache-private.h"
 #include "st-theme-node-private.h"
+#include "st-theme-node-sdf-generated.h"
 
 /****
  * Rounded corners
  ****/
 
-typedef struct {
-  /*
-   * The context here is not really part of the corner
-   * definition per se, but is used for the drawing part.
-  */
-  CoglContext   *cogl_context;
-  CoglColor      color;
-  CoglColor      border_color_1;
-  CoglColor      border_color_2;
-  guint          radius;
-  guint          border_width_1;
-  guint          border_width_2;
-  float          resource_scale;
-} StCornerSpec;
-
 typedef enum {
   ST_PAINT_BORDERS_MODE_COLOR,
   ST_PAINT_BORDERS_MODE_SILHOUETTE
@@ -78,7 +66,8 @@ elliptical_arc (cairo_t *cr,
 }
 
 static CoglTexture *
-create_corner_pipeline (StCornerSpec *corner)
+create_corner_texture (CoglContext        *cogl_context,
+                       const StCornerSpec *corner)
 {
   GError *error = NULL;
   CoglTexture *texture;
@@ -183,11 +172,12 @@ create_corner_pipeline (StCornerSpec *corner)
 
   cairo_surface_destroy (surface);
 
-  texture = cogl_texture_2d_new_from_data (corner->cogl_context, size, size,
-                                           COGL_PIXEL_FORMAT_CAIRO_ARGB32_COMPAT,
-                                           rowstride,
-                                           data,
-                                           &error);
+  texture = _st_texture_cache_create_texture (st_texture_cache_get_default (),
+                                              cogl_context, size, size,
+                                              COGL_PIXEL_FORMAT_CAIRO_ARGB32_COMPAT,
+                                              rowstride,
+                                              data,
+                                              &error);
 
   if (error)
     {
@@ -200,28 +190,6 @@ create_corner_pipeline (StCornerSpec *corner)
   return texture;
 }
 
-static char *
-corner_to_string (StCornerSpec *corner)
-{
-  return g_strdup_printf ("st-theme-node-corner:%02x%02x%02x%02x,%02x%02x%02x%02x,%02x%02x%02x%02x,%u,%u,%u,%.4f",
-                          corner->color.red, corner->color.blue, corner->color.green, corner->color.alpha,
-                          corner->border_color_1.red, corner->border_color_1.green, corner->border_color_1.blue, corner->border_color_1.alpha,
-                          corner->border_color_2.red, corner->border_color_2.green, corner->border_color_2.blue, corner->border_color_2.alpha,
-                          corner->radius,
-                          corner->border_width_1,
-                          corner->border_width_2,
-                          corner->resource_scale);
-}
-
-static CoglTexture *
-load_corner (StTextureCache  *cache,
-             const char      *key,
-             void            *datap,
-             GError         **error)
-{
-  return create_corner_pipeline ((StCornerSpec *) datap);
-}
-
 /* To match the CSS specification, we want the border to look like it was
  * drawn over the background. But actually drawing the border over the
  * background will produce slightly bad antialiasing at the edges, so
@@ -292,37 +260,37 @@ st_theme_node_reduce_border_radius (StThemeNode  *node,
   scale = 1.0;
 
   /* top */
-  sum = node->border_radius[ST_CORNER_TOPLEFT]
-    + node->border_radius[ST_CORNER_TOPRIGHT];
+  sum = node->style->border_radius[ST_CORNER_TOPLEFT]
+    + node->style->border_radius[ST_CORNER_TOPRIGHT];
 
   if (sum > 0)
     scale = MIN (width / sum, scale);
 
   /* right */
-  sum = node->border_radius[ST_CORNER_TOPRIGHT]
-    + node->border_radius[ST_CORNER_BOTTOMRIGHT];
+  sum = node->style->border_radius[ST_CORNER_TOPRIGHT]
+    + node->style->border_radius[ST_CORNER_BOTTOMRIGHT];
 
   if (sum > 0)
     scale = MIN (height / sum, scale);
 
   /* bottom */
-  sum = node->border_radius[ST_CORNER_BOTTOMLEFT]
-    + node->border_radius[ST_CORNER_BOTTOMRIGHT];
+  sum = node->style->border_radius[ST_CORNER_BOTTOMLEFT]
+    + node->style->border_radius[ST_CORNER_BOTTOMRIGHT];
 
   if (sum > 0)
     scale = MIN (width / sum, scale);
 
   /* left */
-  sum = node->border_radius[ST_CORNER_BOTTOMLEFT]
-    + node->border_radius[ST_CORNER_TOPLEFT];
+  sum = node->style->border_radius[ST_CORNER_BOTTOMLEFT]
+    + node->style->border_radius[ST_CORNER_TOPLEFT];
 
   if (sum > 0)
     scale = MIN (height / sum, scale);
 
-  corners[ST_CORNER_TOPLEFT]     = node->border_radius[ST_CORNER_TOPLEFT]     * scale;
-  corners[ST_CORNER_TOPRIGHT]    = node->border_radius[ST_CORNER_TOPRIGHT]    * scale;
-  corners[ST_CORNER_BOTTOMLEFT]  = node->border_radius[ST_CORNER_BOTTOMLEFT]  * scale;
-  corners[ST_CORNER_BOTTOMRIGHT] = node->border_radius[ST_CORNER_BOTTOMRIGHT] * scale;
+  corners[ST_CORNER_TOPLEFT]     = node->style->border_radius[ST_CORNER_TOPLEFT]     * scale;
+  corners[ST_CORNER_TOPRIGHT]    = node->style->border_radius[ST_CORNER_TOPRIGHT]    * scale;
+  corners[ST_CORNER_BOTTOMLEFT]  = node->style->border_radius[ST_CORNER_BOTTOMLEFT]  * scale;
+  corners[ST_CORNER_BOTTOMRIGHT] = node->style->border_radius[ST_CORNER_BOTTOMRIGHT] * scale;
 }
 
 static void
@@ -335,27 +303,27 @@ st_theme_node_get_corner_border_widths (StThemeNode *node,
     {
       case ST_CORNER_TOPLEFT:
         if (border_width_1)
-            *border_width_1 = node->border_width[ST_SIDE_TOP];
+            *border_width_1 = node->style->border_width[ST_SIDE_TOP];
         if (border_width_2)
-            *border_width_2 = node->border_width[ST_SIDE_LEFT];
+            *border_width_2 = node->style->border_width[ST_SIDE_LEFT];
         break;
       case ST_CORNER_TOPRIGHT:
         if (border_width_1)
-            *border_width_1 = node->border_width[ST_SIDE_TOP];
+            *border_width_1 = node->style->border_width[ST_SIDE_TOP];
         if (border_width_2)
-            *border_width_2 = node->border_width[ST_SIDE_RIGHT];
+            *border_width_2 = node->style->border_width[ST_SIDE_RIGHT];
         break;
       case ST_CORNER_BOTTOMRIGHT:
         if (border_width_1)
-            *border_width_1 = node->border_width[ST_SIDE_BOTTOM];
+            *border_width_1 = node->style->border_width[ST_SIDE_BOTTOM];
         if (border_width_2)
-            *border_width_2 = node->border_width[ST_SIDE_RIGHT];
+            *border_width_2 = node->style->border_width[ST_SIDE_RIGHT];
         break;
       case ST_CORNER_BOTTOMLEFT:
         if (border_width_1)
-            *border_width_1 = node->border_width[ST_SIDE_BOTTOM];
+            *border_width_1 = node->style->border_width[ST_SIDE_BOTTOM];
         if (border_width_2)
-            *border_width_2 = node->border_width[ST_SIDE_LEFT];
+            *border_width_2 = node->style->border_width[ST_SIDE_LEFT];
         break;
       default:
         g_assert_not_reached();
@@ -373,7 +341,6 @@ st_theme_node_lookup_corner (StThemeNode    *node,
 {
   CoglTexture *texture = NULL;
   CoglPipeline *pipeline = NULL;
-  char *key;
   StTextureCache *cache;
   StCornerSpec corner;
   guint radius[4];
@@ -386,9 +353,8 @@ st_theme_node_lookup_corner (StThemeNode    *node,
     return NULL;
 
   corner.radius = radius[corner_id];
-  corner.color = node->background_color;
+  corner.color = node->style->background_color;
   corner.resource_scale = resource_scale;
-  corner.cogl_context = cogl_context;
   st_theme_node_get_corner_border_widths (node, corner_id,
                                           &corner.border_width_1,
                                           &corner.border_width_2);
@@ -396,20 +362,20 @@ st_theme_node_lookup_corner (StThemeNode    *node,
   switch (corner_id)
     {
       case ST_CORNER_TOPLEFT:
-        over (&node->border_color[ST_SIDE_TOP], &corner.color, &corner.border_color_1);
-        over (&node->border_color[ST_SIDE_LEFT], &corner.color, &corner.border_color_2);
+        over (&node->style->border_color[ST_SIDE_TOP], &corner.color, &corner.border_color_1);
+        over (&node->style->border_color[ST_SIDE_LEFT], &corner.color, &corner.border_color_2);
         break;
       case ST_CORNER_TOPRIGHT:
-        over (&node->border_color[ST_SIDE_TOP], &corner.color, &corner.border_color_1);
-        over (&node->border_color[ST_SIDE_RIGHT], &corner.color, &corner.border_color_2);
+        over (&node->style->border_color[ST_SIDE_TOP], &corner.color, &corner.border_color_1);
+        over (&node->style->border_color[ST_SIDE_RIGHT], &corner.color, &corner.border_color_2);
         break;
       case ST_CORNER_BOTTOMRIGHT:
-        over (&node->border_color[ST_SIDE_BOTTOM], &corner.color, &corner.border_color_1);
-        over (&node->border_color[ST_SIDE_RIGHT], &corner.color, &corner.border_color_2);
+        over (&node->style->border_color[ST_SIDE_BOTTOM], &corner.color, &corner.border_color_1);
+        over (&node->style->border_color[ST_SIDE_RIGHT], &corner.color, &corner.border_color_2);
         break;
       case ST_CORNER_BOTTOMLEFT:
-        over (&node->border_color[ST_SIDE_BOTTOM], &corner.color, &corner.border_color_1);
-        over (&node->border_color[ST_SIDE_LEFT], &corner.color, &corner.border_color_2);
+        over (&node->style->border_color[ST_SIDE_BOTTOM], &corner.color, &corner.border_color_1);
+        over (&node->style->border_color[ST_SIDE_LEFT], &corner.color, &corner.border_color_2);
         break;
       default:
         g_assert_not_reached();
@@ -426,8 +392,13 @@ st_theme_node_lookup_corner (StThemeNode    *node,
         corner.color = (CoglColor) {0, 0, 0, 255};
     }
 
-  key = corner_to_string (&corner);
-  texture = st_texture_cache_load (cache, key, ST_TEXTURE_CACHE_POLICY_FOREVER, load_corner, &corner, NULL);
+  texture = _st_texture_cache_lookup_corner (cache, &corner);
+  if (texture == NULL)
+    {
+      texture = create_corner_texture (cogl_context, &corner);
+      if (texture)
+        _st_texture_cache_insert_corner (cache, &corner, texture);
+    }
 
   if (texture)
     {
@@ -435,8 +406,6 @@ st_theme_node_lookup_corner (StThemeNode    *node,
       g_object_unref (texture);
     }
 
-  g_free (key);
-
   return pipeline;
 }
 
@@ -452,7 +421,7 @@ get_background_scale (StThemeNode *node,
   *scale_w = -1.0;
   *scale_h = -1.0;
 
-  switch (node->background_size)
+  switch (node->style->background_size)
     {
       case ST_BACKGROUND_SIZE_AUTO:
         *scale_w = 1.0f;
@@ -466,14 +435,14 @@ get_background_scale (StThemeNode *node,
                         painting_area_height / background_image_height);
         break;
       case ST_BACKGROUND_SIZE_FIXED:
-        if (node->background_size_w > -1)
+        if (node->style->background_size_w > -1)
           {
-            *scale_w = node->background_size_w / background_image_width;
-            if (node->background_size_h > -1)
-              *scale_h = node->background_size_h / background_image_height;
+            *scale_w = node->style->background_size_w / background_image_width;
+            if (node->style->background_size_h > -1)
+              *scale_h = node->style->background_size_h / background_image_height;
           }
-        else if (node->background_size_h > -1)
-          *scale_w = node->background_size_h / background_image_height;
+        else if (node->style->background_size_h > -1)
+          *scale_w = node->style->background_size_h / background_image_height;
         break;
       default:
         g_assert_not_reached();
@@ -493,10 +462,10 @@ get_background_coordinates (StThemeNode *node,
                             gdouble     *y)
 {
   /* honor the specified position if any */
-  if (node->background_position_set)
+  if (node->style->background_position_set)
     {
-      *x = node->background_position_x;
-      *y = node->background_position_y;
+      *x = node->style->background_position_x;
+      *y = node->style->background_position_y;
     }
   else
     {
@@ -544,7 +513,7 @@ get_background_position (StThemeNode             *self,
                               background_image_width, background_image_height,
                               &x1, &y1);
 
-  if (self->background_repeat)
+  if (self->style->background_repeat)
     {
       gdouble width = allocation->x2 - allocation->x1 + x1;
       gdouble height = allocation->y2 - allocation->y1 + y1;
@@ -583,22 +552,22 @@ get_arbitrary_border_color (StThemeNode   *node,
 static gboolean
 st_theme_node_has_visible_outline (StThemeNode *node)
 {
-  if (node->background_color.alpha > 0)
+  if (node->style->background_color.alpha > 0)
     return TRUE;
 
-  if (node->background_gradient_end.alpha > 0)
+  if (node->style->background_gradient_end.alpha > 0)
     return TRUE;
 
-  if (node->border_radius[ST_CORNER_TOPLEFT] > 0 ||
-      node->border_radius[ST_CORNER_TOPRIGHT] > 0 ||
-      node->border_radius[ST_CORNER_BOTTOMLEFT] > 0 ||
-      node->border_radius[ST_CORNER_BOTTOMRIGHT] > 0)
+  if (node->style->border_radius[ST_CORNER_TOPLEFT] > 0 ||
+      node->style->border_radius[ST_CORNER_TOPRIGHT] > 0 ||
+      node->style->border_radius[ST_CORNER_BOTTOMLEFT] > 0 ||
+      node->style->border_radius[ST_CORNER_BOTTOMRIGHT] > 0)
     return TRUE;
 
-  if (node->border_width[ST_SIDE_TOP] > 0 ||
-      node->border_width[ST_SIDE_LEFT] > 0 ||
-      node->border_width[ST_SIDE_RIGHT] > 0 ||
-      node->border_width[ST_SIDE_BOTTOM] > 0)
+  if (node->style->border_width[ST_SIDE_TOP] > 0 ||
+      node->style->border_width[ST_SIDE_LEFT] > 0 ||
+      node->style->border_width[ST_SIDE_RIGHT] > 0 ||
+      node->style->border_width[ST_SIDE_BOTTOM] > 0)
     return TRUE;
 
   return FALSE;
@@ -611,12 +580,12 @@ create_cairo_pattern_of_background_gradient (StThemeNode *node,
 {
   cairo_pattern_t *pattern;
 
-  g_return_val_if_fail (node->background_gradient_type != ST_GRADIENT_NONE,
+  g_return_val_if_fail (node->style->background_gradient_type != ST_GRADIENT_NONE,
                         NULL);
 
-  if (node->background_gradient_type == ST_GRADIENT_VERTICAL)
+  if (node->style->background_gradient_type == ST_GRADIENT_VERTICAL)
     pattern = cairo_pattern_create_linear (0, 0, 0, height);
-  else if (node->background_gradient_type == ST_GRADIENT_HORIZONTAL)
+  else if (node->style->background_gradient_type == ST_GRADIENT_HORIZONTAL)
     pattern = cairo_pattern_create_linear (0, 0, width, 0);
   else
     {
@@ -628,15 +597,15 @@ create_cairo_pattern_of_background_gradient (StThemeNode *node,
     }
 
   cairo_pattern_add_color_stop_rgba (pattern, 0,
-                                     node->background_color.red / 255.,
-                                     node->background_color.green / 255.,
-                                     node->background_color.blue / 255.,
-                                     node->background_color.alpha / 255.);
+                                     node->style->background_color.red / 255.,
+                                     node->style->background_color.green / 255.,
+                                     node->style->background_color.blue / 255.,
+                                     node->style->background_color.alpha / 255.);
   cairo_pattern_add_color_stop_rgba (pattern, 1,
-                                     node->background_gradient_end.red / 255.,
-                                     node->background_gradient_end.green / 255.,
-                                     node->background_gradient_end.blue / 255.,
-                                     node->background_gradient_end.alpha / 255.);
+                                     node->style->background_gradient_end.red / 255.,
+                                     node->style->background_gradient_end.green / 255.,
+                                     node->style->background_gradient_end.blue / 255.,
+                                     node->style->background_gradient_end.alpha / 255.);
   return pattern;
 }
 
@@ -707,7 +676,7 @@ create_cairo_pattern_of_background_image (StThemeNode *node,
                               &x, &y);
   cairo_matrix_translate (&matrix, -x, -y);
 
-  if (node->background_repeat)
+  if (node->style->background_repeat)
     cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
 
   /* If it's opaque, fills up the entire allocated
@@ -715,7 +684,7 @@ create_cairo_pattern_of_background_image (StThemeNode *node,
    */
   if (content != CAIRO_CONTENT_COLOR_ALPHA)
     {
-      if (node->background_repeat ||
+      if (node->style->background_repeat ||
           (x >= 0 &&
            y >= 0 &&
            background_image_width - x >= width &&
@@ -1066,17 +1035,21 @@ paint_inset_box_shadow_to_cairo_context (StThemeNode     *node,
 /* In order for borders to be smoothly blended with non-solid backgrounds,
  * we need to use cairo.  This function is a slow fallback path for those
  * cases (gradients, background images, etc).
+ *
+ * Only cairo is used, and only properties of @node that have already
+ * been computed are read, so this can run in a thread unless the node's
+ * background image needs to be loaded.
  */
-static CoglTexture *
-st_theme_node_prerender_background (StThemeNode *node,
-                                    CoglContext *ctx,
-                                    float        actor_width,
-                                    float        actor_height,
-                                    float        resource_scale)
+static guchar *
+st_theme_node_prerender_background_data (StThemeNode *node,
+                                         float        actor_width,
+                                         float        actor_height,
+                                         float        resource_scale,
+                                         int         *texture_width_out,
+                                         int         *texture_height_out,
+                                         guint       *rowstride_out)
 {
-  GError *error = NULL;
   StBorderImage *border_image;
-  CoglTexture *texture;
   guint radius[4];
   int i;
   cairo_t *cr;
@@ -1156,7 +1129,7 @@ st_theme_node_prerender_background (StThemeNode *node,
   /* Note we don't support translucent background images on top
    * of gradients. It's strictly either/or.
    */
-  if (node->background_gradient_type != ST_GRADIENT_NONE)
+  if (node->style->background_gradient_type != ST_GRADIENT_NONE)
     {
       pattern = create_cairo_pattern_of_background_gradient (node, width, height);
       draw_solid_background = FALSE;
@@ -1166,8 +1139,8 @@ st_theme_node_prerender_background (StThemeNode *node,
        * what's actually under the gradient and not whatever is
        * left over from filling the border, etc.
        */
-      if (node->background_color.alpha < 255 ||
-          node->background_gradient_end.alpha < 255)
+      if (node->style->background_color.alpha < 255 ||
+          node->style->background_gradient_end.alpha < 255)
         background_is_translucent = TRUE;
       else
         background_is_translucent = FALSE;
@@ -1352,10 +1325,10 @@ st_theme_node_prerender_background (StThemeNode *node,
       cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
 
       cairo_set_source_rgba (cr,
-                             node->background_color.red / 255.,
-                             node->background_color.green / 255.,
-                             node->background_color.blue / 255.,
-                             node->background_color.alpha / 255.);
+                             node->style->background_color.red / 255.,
+                             node->style->background_color.green / 255.,
+                             node->style->background_color.blue / 255.,
+                             node->style->background_color.alpha / 255.);
       cairo_fill_preserve (cr);
       cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
     }
@@ -1401,6 +1374,26 @@ st_theme_node_prerender_background (StThemeNode *node,
   if (interior_path != NULL)
     cairo_path_destroy (interior_path);
 
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+
+  *texture_width_out = texture_width;
+  *texture_height_out = texture_height;
+  *rowstride_out = rowstride;
+
+  return data;
+}
+
+static CoglTexture *
+st_theme_node_upload_background (CoglContext  *ctx,
+                                 int           texture_width,
+                                 int           texture_height,
+                                 guint         rowstride,
+                                 const guchar *data)
+{
+  GError *error = NULL;
+  CoglTexture *texture;
+
   texture = cogl_texture_2d_new_from_data (ctx,
                                            texture_width,
                                            texture_height,
@@ -1415,13 +1408,324 @@ st_theme_node_prerender_background (StThemeNode *node,
       g_error_free (error);
     }
 
-  cairo_destroy (cr);
-  cairo_surface_destroy (surface);
+  return texture;
+}
+
+static CoglTexture *
+st_theme_node_prerender_background (StThemeNode *node,
+                                    CoglContext *ctx,
+                                    float        actor_width,
+                                    float        actor_height,
+                                    float        resource_scale)
+{
+  CoglTexture *texture;
+  int texture_width;
+  int texture_height;
+  guint rowstride;
+  guchar *data;
+
+  data = st_theme_node_prerender_background_data (node,
+                                                  actor_width, actor_height,
+                                                  resource_scale,
+                                                  &texture_width,
+                                                  &texture_height,
+                                                  &rowstride);
+  texture = st_theme_node_upload_background (ctx,
+                                             texture_width, texture_height,
+                                             rowstride, data);
   g_free (data);
 
   return texture;
 }
 
+/* A background being prerendered in a thread for a paint state. The
+ * thread only reads the node, whose lazily computed properties are
+ * all computed on the main thread before it starts. */
+struct _StThemeNodePrerender
+{
+  /* NULL once the paint state doesn't wait for it anymore */
+  StThemeNodePaintState *state;
+  GCancellable *cancellable;
+
+  StThemeNode *node;
+  float width;
+  float height;
+  float resource_scale;
+  /* How the result is painted, see StThemeNodePaintState */
+  gboolean sliced;
+  float slices[4];
+
+  gboolean done;
+  guchar *data;
+  int texture_width;
+  int texture_height;
+  guint rowstride;
+};
+
+static void
+st_theme_node_prerender_clear (StThemeNodePrerender *prerender)
+{
+  g_clear_object (&prerender->cancellable);
+  g_clear_object (&prerender->node);
+  g_clear_pointer (&prerender->data, g_free);
+}
+
+static StThemeNodePrerender *
+st_theme_node_prerender_ref (StThemeNodePrerender *prerender)
+{
+  return g_atomic_rc_box_acquire (prerender);
+}
+
+static void
+st_theme_node_prerender_unref (StThemeNodePrerender *prerender)
+{
+  g_atomic_rc_box_release_full (prerender,
+                                (GDestroyNotify) st_theme_node_prerender_clear);
+}
+
+static void
+st_theme_node_paint_state_drop_prerender (StThemeNodePaintState *state)
+{
+  StThemeNodePrerender *prerender = g_steal_pointer (&state->pending_prerender);
+
+  if (prerender == NULL)
+    return;
+
+  prerender->state = NULL;
+  g_cancellable_cancel (prerender->cancellable);
+  st_theme_node_prerender_unref (prerender);
+}
+
+/* Whether a background is being prerendered in a thread for @state and
+ * isn't done yet, for tests */
+gboolean
+_st_theme_node_paint_state_is_prerendering (StThemeNodePaintState *state)
+{
+  return state->pending_prerender != NULL && !state->pending_prerender->done;
+}
+
+static void
+prerender_background_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  StThemeNodePrerender *prerender = task_data;
+  int texture_width, texture_height;
+  guint rowstride;
+  guchar *data;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  data = st_theme_node_prerender_background_data (prerender->node,
+                                                  prerender->width,
+                                                  prerender->height,
+                                                  prerender->resource_scale,
+                                                  &texture_width,
+                                                  &texture_height,
+                                                  &rowstride);
+
+  prerender->texture_width = texture_width;
+  prerender->texture_height = texture_height;
+  prerender->rowstride = rowstride;
+
+  g_task_return_pointer (task, data, g_free);
+}
+
+static void
+on_background_prerendered (GObject      *source,
+                           GAsyncResult *result,
+                           gpointer      user_data)
+{
+  StThemeNodePrerender *prerender = user_data;
+  guchar *data;
+
+  data = g_task_propagate_pointer (G_TASK (result), NULL);
+
+  if (prerender->state != NULL)
+    {
+      prerender->data = data;
+      prerender->done = TRUE;
+
+      /* The texture is uploaded when the actor is painted next */
+      clutter_actor_queue_redraw (prerender->state->redraw_actor);
+    }
+  else
+    {
+      g_free (data);
+    }
+
+  st_theme_node_prerender_unref (prerender);
+}
+
+static void
+st_theme_node_prerender_background_async (StThemeNodePaintState *state,
+                                          StThemeNode           *node,
+                                          float                  width,
+                                          float                  height,
+                                          float                  resource_scale,
+                                          gboolean               sliced,
+                                          const float            slices[4])
+{
+  g_autoptr (GTask) task = NULL;
+  StThemeNodePrerender *prerender;
+
+  /* Compute everything the thread is going to look at */
+  _st_theme_node_ensure_background (node);
+  _st_theme_node_ensure_geometry (node);
+  st_theme_node_get_border_image (node);
+  st_theme_node_get_box_shadow (node);
+  st_theme_node_get_background_image_shadow (node);
+
+  prerender = g_atomic_rc_box_new0 (StThemeNodePrerender);
+  prerender->state = state;
+  prerender->cancellable = g_cancellable_new ();
+  prerender->node = g_object_ref (node);
+  prerender->width = width;
+  prerender->height = height;
+  prerender->resource_scale = resource_scale;
+  prerender->sliced = sliced;
+  memcpy (prerender->slices, slices, sizeof (prerender->slices));
+
+  state->pending_prerender = prerender;
+
+  task = g_task_new (NULL, prerender->cancellable,
+                     on_background_prerendered,
+                     st_theme_node_prerender_ref (prerender));
+  g_task_set_source_tag (task, st_theme_node_prerender_background_async);
+  /* The reference held by the callback keeps the data alive for the
+   * thread, and makes sure the node is only released on this thread */
+  g_task_set_task_data (task, prerender, NULL);
+  g_task_run_in_thread (task, prerender_background_thread);
+}
+
+/* Apart from its edges, which contain the borders, the rounded corners
+ * and an inset box-shadow, a background looks the same everywhere along
+ * the axes its gradient (if any) doesn't run along. It can then be
+ * prerendered with a one pixel wide center that is stretched to fill
+ * the allocation, so resizing doesn't require rendering it again.
+ *
+ * Returns %FALSE if the background can't be sliced, or if slicing
+ * doesn't make the prerendered texture any smaller.
+ */
+static gboolean
+st_theme_node_get_background_slices (StThemeNode *node,
+                                     float        width,
+                                     float        height,
+                                     float        resource_scale,
+                                     float        slices[4],
+                                     float       *slice_width,
+                                     float       *slice_height)
+{
+  StShadow *box_shadow_spec;
+  gboolean stretch_x, stretch_y;
+  int side_id;
+
+  if (node->style->background_gradient_type == ST_GRADIENT_RADIAL ||
+      st_theme_node_get_background_image (node) != NULL ||
+      st_theme_node_get_background_image_shadow (node) != NULL)
+    return FALSE;
+
+  /* Stretching only gives the same result as rendering at full size
+   * if the far edges move by whole pixels */
+  if (resource_scale != floorf (resource_scale) ||
+      width != floorf (width) ||
+      height != floorf (height))
+    return FALSE;
+
+  /* The outset box-shadow of a sliced background is created from the
+   * silhouette of the node, which only matches the prerendered
+   * background if that is visible everywhere */
+  box_shadow_spec = st_theme_node_get_box_shadow (node);
+  if (box_shadow_spec && !box_shadow_spec->inset &&
+      (node->style->background_color.alpha == 0 ||
+       (node->style->background_gradient_type != ST_GRADIENT_NONE &&
+        node->style->background_gradient_end.alpha == 0)))
+    return FALSE;
+
+  slices[ST_SIDE_TOP] = MAX (node->style->border_radius[ST_CORNER_TOPLEFT],
+                             node->style->border_radius[ST_CORNER_TOPRIGHT]);
+  slices[ST_SIDE_RIGHT] = MAX (node->style->border_radius[ST_CORNER_TOPRIGHT],
+                               node->style->border_radius[ST_CORNER_BOTTOMRIGHT]);
+  slices[ST_SIDE_BOTTOM] = MAX (node->style->border_radius[ST_CORNER_BOTTOMLEFT],
+                                node->style->border_radius[ST_CORNER_BOTTOMRIGHT]);
+  slices[ST_SIDE_LEFT] = MAX (node->style->border_radius[ST_CORNER_TOPLEFT],
+                              node->style->border_radius[ST_CORNER_BOTTOMLEFT]);
+
+  for (side_id = 0; side_id < 4; side_id++)
+    slices[side_id] = MAX (slices[side_id], node->style->border_width[side_id]);
+
+  if (box_shadow_spec && box_shadow_spec->inset)
+    {
+      /* The blur kernel reaches about 1.25 times the blur radius */
+      float extent = box_shadow_spec->spread + ceilf (2 * box_shadow_spec->blur);
+
+      slices[ST_SIDE_TOP] += extent + fabs (box_shadow_spec->yoffset);
+      slices[ST_SIDE_RIGHT] += extent + fabs (box_shadow_spec->xoffset);
+      slices[ST_SIDE_BOTTOM] += extent + fabs (box_shadow_spec->yoffset);
+      slices[ST_SIDE_LEFT] += extent + fabs (box_shadow_spec->xoffset);
+    }
+
+  /* Keep antialiased edges out of the stretched center */
+  for (side_id = 0; side_id < 4; side_id++)
+    slices[side_id] = ceilf (slices[side_id]) + 1;
+
+  stretch_x = node->style->background_gradient_type != ST_GRADIENT_HORIZONTAL &&
+              slices[ST_SIDE_LEFT] + slices[ST_SIDE_RIGHT] + 1 < width;
+  stretch_y = node->style->background_gradient_type != ST_GRADIENT_VERTICAL &&
+              slices[ST_SIDE_TOP] + slices[ST_SIDE_BOTTOM] + 1 < height;
+
+  if (stretch_x)
+    {
+      *slice_width = slices[ST_SIDE_LEFT] + slices[ST_SIDE_RIGHT] + 1;
+    }
+  else
+    {
+      *slice_width = width;
+      slices[ST_SIDE_LEFT] = slices[ST_SIDE_RIGHT] = 0;
+    }
+
+  if (stretch_y)
+    {
+      *slice_height = slices[ST_SIDE_TOP] + slices[ST_SIDE_BOTTOM] + 1;
+    }
+  else
+    {
+      *slice_height = height;
+      slices[ST_SIDE_TOP] = slices[ST_SIDE_BOTTOM] = 0;
+    }
+
+  return stretch_x || stretch_y;
+}
+
+/* Replaces the prerendered background of @state, taking ownership of
+ * @texture. @slices is only used if @sliced is set. */
+static void
+st_theme_node_paint_state_set_prerendered (StThemeNodePaintState *state,
+                                           CoglTexture           *texture,
+                                           gboolean               sliced,
+                                           const float            slices[4],
+                                           float                  width,
+                                           float                  height)
+{
+  g_clear_object (&state->prerendered_texture);
+  g_clear_object (&state->prerendered_pipeline);
+
+  state->prerendered_texture = texture;
+  if (texture)
+    state->prerendered_pipeline = _st_create_texture_pipeline (texture);
+
+  state->prerendered_sliced = sliced;
+  state->prerendered_width = width;
+  state->prerendered_height = height;
+  if (sliced)
+    memcpy (state->prerendered_slices, slices, sizeof (state->prerendered_slices));
+}
+
+/* While a background is prerendered in a thread, the previous
+ * prerendered background of @state, if any, is kept and stretched to
+ * the allocation, see st_theme_node_finish_prerender() */
 static void
 st_theme_node_maybe_prerender_background (StThemeNodePaintState *state,
                                           StThemeNode           *node,
@@ -1437,22 +1741,24 @@ st_theme_node_maybe_prerender_background (StThemeNodePaintState *state,
   StShadow *box_shadow_spec;
   StCorner corner_id;
 
+  st_theme_node_paint_state_drop_prerender (state);
+
   box_shadow_spec = st_theme_node_get_box_shadow (node);
 
   has_inset_box_shadow = box_shadow_spec && box_shadow_spec->inset;
 
-  if (node->border_width[ST_SIDE_TOP] > 0 ||
-      node->border_width[ST_SIDE_LEFT] > 0 ||
-      node->border_width[ST_SIDE_RIGHT] > 0 ||
-      node->border_width[ST_SIDE_BOTTOM] > 0)
+  if (node->style->border_width[ST_SIDE_TOP] > 0 ||
+      node->style->border_width[ST_SIDE_LEFT] > 0 ||
+      node->style->border_width[ST_SIDE_RIGHT] > 0 ||
+      node->style->border_width[ST_SIDE_BOTTOM] > 0)
     has_border = TRUE;
   else
     has_border = FALSE;
 
-  if (node->border_radius[ST_CORNER_TOPLEFT] > 0 ||
-      node->border_radius[ST_CORNER_TOPRIGHT] > 0 ||
-      node->border_radius[ST_CORNER_BOTTOMLEFT] > 0 ||
-      node->border_radius[ST_CORNER_BOTTOMRIGHT] > 0)
+  if (node->style->border_radius[ST_CORNER_TOPLEFT] > 0 ||
+      node->style->border_radius[ST_CORNER_TOPRIGHT] > 0 ||
+      node->style->border_radius[ST_CORNER_BOTTOMLEFT] > 0 ||
+      node->style->border_radius[ST_CORNER_BOTTOMRIGHT] > 0)
     has_border_radius = TRUE;
   else
     has_border_radius = FALSE;
@@ -1507,19 +1813,47 @@ st_theme_node_maybe_prerender_background (StThemeNodePaintState *state,
    * background image won't overlap with the node borders,
    * then we could use cogl for that case.
    */
-  if ((node->background_gradient_type != ST_GRADIENT_NONE)
-      || (has_inset_box_shadow && (has_border || node->background_color.alpha > 0))
+  if ((node->style->background_gradient_type != ST_GRADIENT_NONE)
+      || (has_inset_box_shadow && (has_border || node->style->background_color.alpha > 0))
       || (st_theme_node_get_background_image (node) && (has_border || has_border_radius))
       || has_large_corners)
     {
-      state->prerendered_texture = st_theme_node_prerender_background (node, cogl_context,
-                                                                       width, height,
-                                                                       resource_scale);
+      float prerendered_width = width;
+      float prerendered_height = height;
+      float slices[4] = { 0, };
+      gboolean sliced;
+
+      sliced = st_theme_node_get_background_slices (node, width, height,
+                                                    resource_scale,
+                                                    slices,
+                                                    &prerendered_width,
+                                                    &prerendered_height);
+
+      /* Background images are loaded through the texture cache, which
+       * can only be used from the main thread */
+      if (state->redraw_actor != NULL &&
+          st_theme_node_get_background_image (node) == NULL)
+        {
+          st_theme_node_prerender_background_async (state, node,
+                                                    prerendered_width,
+                                                    prerendered_height,
+                                                    resource_scale,
+                                                    sliced, slices);
+          return;
+        }
 
-      if (state->prerendered_texture)
-        state->prerendered_pipeline = _st_create_texture_pipeline (state->prerendered_texture);
-      else
-        state->prerendered_pipeline = NULL;
+      st_theme_node_paint_state_set_prerendered (state,
+                                                 st_theme_node_prerender_background (node, cogl_context,
+                                                                                     prerendered_width,
+                                                                                     prerendered_height,
+                                                                                     resource_scale),
+                                                 sliced, slices,
+                                                 prerendered_width,
+                                                 prerendered_height);
+    }
+  else
+    {
+      st_theme_node_paint_state_set_prerendered (state, NULL, FALSE, NULL, 0, 0);
     }
 }
 
@@ -1601,7 +1935,7 @@ st_theme_node_load_background_image (StThemeNode         *node,
 
       node->background_pipeline = _st_create_texture_pipeline (node->background_texture);
 
-      if (node->background_repeat)
+      if (node->style->background_repeat)
         cogl_pipeline_set_layer_wrap_mode (node->background_pipeline, 0,
                                            COGL_PIPELINE_WRAP_MODE_REPEAT);
 
@@ -1644,11 +1978,268 @@ st_theme_node_invalidate_resources_for_file (StThemeNode *node,
   return changed;
 }
 
+/****
+ * Analytic rendering
+ ****/
+
+/* Drawing the background, borders and box-shadow with a shader that
+ * evaluates the distance to the rounded box avoids rasterizing
+ * anything with cairo, and doesn't depend on the size of the box. It
+ * is used instead of textures when the ST_SDF_RENDERING environment
+ * variable is set to 1, for nodes that don't need gradients, images,
+ * inset shadows or borders of different colors.
+ */
+static int sdf_rendering = -1;
+
+static gboolean
+st_theme_node_sdf_rendering_enabled (void)
+{
+  if (G_UNLIKELY (sdf_rendering < 0))
+    sdf_rendering = g_strcmp0 (g_getenv ("ST_SDF_RENDERING"), "1") == 0;
+
+  return sdf_rendering;
+}
+
+/* Overrides ST_SDF_RENDERING for nodes painted from now on, so that
+ * tests can compare both paths */
+void
+_st_theme_node_set_sdf_rendering (gboolean enabled)
+{
+  sdf_rendering = enabled != FALSE;
+}
+
+static gboolean
+st_theme_node_can_use_sdf (StThemeNode *node)
+{
+  StShadow *box_shadow_spec;
+  CoglColor *border_color = NULL;
+  int side_id;
+
+  if (!st_theme_node_sdf_rendering_enabled ())
+    return FALSE;
+
+  if (node->style->background_gradient_type != ST_GRADIENT_NONE ||
+      st_theme_node_get_background_image (node) != NULL ||
+      st_theme_node_get_background_image_shadow (node) != NULL ||
+      st_theme_node_get_border_image (node) != NULL)
+    return FALSE;
+
+  box_shadow_spec = st_theme_node_get_box_shadow (node);
+  if (box_shadow_spec && box_shadow_spec->inset)
+    return FALSE;
+
+  for (side_id = 0; side_id < 4; side_id++)
+    {
+      if (node->style->border_width[side_id] == 0)
+        continue;
+
+      if (border_color != NULL &&
+          !cogl_color_equal (border_color, &node->style->border_color[side_id]))
+        return FALSE;
+
+      border_color = &node->style->border_color[side_id];
+    }
+
+  return TRUE;
+}
+
+static void
+set_uniform_color (CoglPipeline    *pipeline,
+                   const char      *name,
+                   const CoglColor *color)
+{
+  float alpha = color->alpha / 255.;
+  float value[4] = {
+    color->red / 255. * alpha,
+    color->green / 255. * alpha,
+    color->blue / 255. * alpha,
+    alpha,
+  };
+
+  cogl_pipeline_set_uniform_float (pipeline,
+                                   cogl_pipeline_get_uniform_location (pipeline, name),
+                                   4, 1, value);
+}
+
+static CoglPipeline *
+st_theme_node_create_sdf_pipeline (StThemeNode *node,
+                                   CoglContext *cogl_context,
+                                   float        resource_scale)
+{
+  static CoglPipelineKey sdf_pipeline_key = "st-theme-node-sdf";
+  CoglPipeline *template;
+  CoglPipeline *pipeline;
+  StShadow *box_shadow_spec;
+  CoglColor border_color = { 0, };
+  CoglColor shadow_color = { 0, };
+  float radius[4], border_width[4], shadow_geometry[4] = { 0, };
+  int i;
+
+  template = cogl_context_get_named_pipeline (cogl_context, &sdf_pipeline_key);
+
+  if (G_UNLIKELY (template == NULL))
+    {
+      CoglSnippet *snippet;
+
+      snippet = cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT,
+                                  st_theme_node_sdf_glsl,
+                                  "cogl_color_out = st_rounded_box (cogl_tex_coord_in[0].xy,\n"
+                                  "                                 cogl_tex_coord_in[1].xy);\n"
+                                  "cogl_color_out *= cogl_color_in.a;");
+
+      /* The layers are only there for their texture coordinates */
+      template = cogl_pipeline_new (cogl_context);
+      cogl_pipeline_set_layer_null_texture (template, 0);
+      cogl_pipeline_set_layer_null_texture (template, 1);
+      cogl_pipeline_add_snippet (template, snippet);
+      g_object_unref (snippet);
+
+      cogl_context_set_named_pipeline (cogl_context,
+                                       &sdf_pipeline_key,
+                                       template);
+    }
+
+  pipeline = cogl_pipeline_copy (template);
+
+  for (i = 0; i < 4; i++)
+    {
+      radius[i] = node->style->border_radius[i];
+      border_width[i] = node->style->border_width[i];
+
+      if (node->style->border_width[i] > 0)
+        border_color = node->style->border_color[i];
+    }
+
+  box_shadow_spec = st_theme_node_get_box_shadow (node);
+  if (box_shadow_spec)
+    {
+      shadow_color = box_shadow_spec->color;
+      shadow_geometry[0] = box_shadow_spec->xoffset;
+      shadow_geometry[1] = box_shadow_spec->yoffset;
+      shadow_geometry[2] = box_shadow_spec->spread;
+      shadow_geometry[3] = box_shadow_spec->blur / 2.;
+    }
+
+  cogl_pipeline_set_uniform_float (pipeline,
+                                   cogl_pipeline_get_uniform_location (pipeline, "st_radius"),
+                                   4, 1, radius);
+  cogl_pipeline_set_uniform_float (pipeline,
+                                   cogl_pipeline_get_uniform_location (pipeline, "st_border_width"),
+                                   4, 1, border_width);
+  cogl_pipeline_set_uniform_float (pipeline,
+                                   cogl_pipeline_get_uniform_location (pipeline, "st_shadow_geometry"),
+                                   4, 1, shadow_geometry);
+  cogl_pipeline_set_uniform_1f (pipeline,
+                                cogl_pipeline_get_uniform_location (pipeline, "st_pixel_size"),
+                                1.0 / resource_scale);
+
+  set_uniform_color (pipeline, "st_background_color", &node->style->background_color);
+  set_uniform_color (pipeline, "st_border_color", &border_color);
+  set_uniform_color (pipeline, "st_shadow_color", &shadow_color);
+
+  return pipeline;
+}
+
+static void
+st_theme_node_paint_sdf (StThemeNodePaintState *state,
+                         ClutterPaintNode      *root,
+                         const ClutterActorBox *box,
+                         guint8                 paint_opacity)
+{
+  g_autoptr (ClutterPaintNode) pipeline_node = NULL;
+  ClutterActorBox paint_box;
+  float width, height;
+  float coords[8];
+  CoglColor color;
+
+  width = box->x2 - box->x1;
+  height = box->y2 - box->y1;
+
+  st_theme_node_get_paint_box (state->node, box, &paint_box);
+
+  /* Position in the box for layer 0, size of the box for layer 1 */
+  coords[0] = paint_box.x1 - box->x1;
+  coords[1] = paint_box.y1 - box->y1;
+  coords[2] = paint_box.x2 - box->x1;
+  coords[3] = paint_box.y2 - box->y1;
+  coords[4] = coords[6] = width;
+  coords[5] = coords[7] = height;
+
+  cogl_color_init_from_4f (&color,
+                           paint_opacity / 255.0, paint_opacity / 255.0,
+                           paint_opacity / 255.0, paint_opacity / 255.0);
+  cogl_pipeline_set_color (state->sdf_pipeline, &color);
+
+  pipeline_node = clutter_pipeline_node_new (state->sdf_pipeline);
+  clutter_paint_node_set_static_name (pipeline_node, "StThemeNode (sdf)");
+  clutter_paint_node_add_child (root, pipeline_node);
+  count_pipeline_draw (state->sdf_pipeline);
+  clutter_paint_node_add_multitexture_rectangle (pipeline_node, &paint_box,
+                                                 coords, G_N_ELEMENTS (coords));
+}
+
 static void st_theme_node_compute_maximum_borders (StThemeNodePaintState *state);
 static void st_theme_node_prerender_shadow (StThemeNodePaintState *state,
                                             CoglContext           *cogl_context,
                                             ClutterPaintContext   *paint_context);
 
+/* Creates the outset box-shadow from the prerendered background, or
+ * from the silhouette of the node if there's no usable one */
+static void
+st_theme_node_render_box_shadow (StThemeNodePaintState *state,
+                                 CoglContext           *cogl_context,
+                                 ClutterPaintContext   *paint_context)
+{
+  StShadow *box_shadow_spec = st_theme_node_get_box_shadow (state->node);
+
+  if (state->prerendered_texture != NULL && !state->prerendered_sliced)
+    state->box_shadow_pipeline = _st_create_shadow_pipeline (box_shadow_spec,
+                                                             paint_context,
+                                                             state->prerendered_texture,
+                                                             state->resource_scale);
+  else
+    st_theme_node_prerender_shadow (state, cogl_context, paint_context);
+}
+
+/* Uploads the background prerendered in a thread in place of the one
+ * painted meanwhile, and creates the box-shadow that goes with it */
+static void
+st_theme_node_finish_prerender (StThemeNodePaintState *state,
+                                CoglContext           *cogl_context,
+                                ClutterPaintContext   *paint_context)
+{
+  StThemeNodePrerender *prerender = state->pending_prerender;
+  StThemeNode *node = state->node;
+  CoglTexture *texture = NULL;
+  StShadow *box_shadow_spec;
+
+  if (prerender->data != NULL)
+    texture = st_theme_node_upload_background (cogl_context,
+                                               prerender->texture_width,
+                                               prerender->texture_height,
+                                               prerender->rowstride,
+                                               prerender->data);
+
+  st_theme_node_paint_state_set_prerendered (state, texture,
+                                             prerender->sliced,
+                                             prerender->slices,
+                                             prerender->width,
+                                             prerender->height);
+
+  st_theme_node_paint_state_drop_prerender (state);
+
+  /* The box-shadow of a sliced background doesn't depend on it, any
+   * other one was created from the previous background */
+  box_shadow_spec = st_theme_node_get_box_shadow (node);
+  if (box_shadow_spec && !box_shadow_spec->inset &&
+      node->border_slices_texture == NULL &&
+      (state->box_shadow_pipeline == NULL || !state->prerendered_sliced))
+    {
+      g_clear_object (&state->box_shadow_pipeline);
+      st_theme_node_render_box_shadow (state, cogl_context, paint_context);
+    }
+}
+
 static void
 st_theme_node_render_resources (StThemeNodePaintState *state,
                                 StThemeNode           *node,
@@ -1677,6 +2268,14 @@ st_theme_node_render_resources (StThemeNodePaintState *state,
   _st_theme_node_ensure_background (node);
   _st_theme_node_ensure_geometry (node);
 
+  if (st_theme_node_can_use_sdf (node))
+    {
+      state->sdf_pipeline = st_theme_node_create_sdf_pipeline (node,
+                                                               cogl_context,
+                                                               resource_scale);
+      return;
+    }
+
   box_shadow_spec = st_theme_node_get_box_shadow (node);
   has_inset_box_shadow = box_shadow_spec && box_shadow_spec->inset;
 
@@ -1692,13 +2291,8 @@ st_theme_node_render_resources (StThemeNodePaintState *state,
                                                                  paint_context,
                                                                  node->border_slices_texture,
                                                                  state->resource_scale);
-      else if (state->prerendered_texture != NULL)
-        state->box_shadow_pipeline = _st_create_shadow_pipeline (box_shadow_spec,
-                                                                 paint_context,
-                                                                 state->prerendered_texture,
-                                                                 state->resource_scale);
-      else
-        st_theme_node_prerender_shadow (state, cogl_context, paint_context);
+      else if (state->pending_prerender == NULL)
+        st_theme_node_render_box_shadow (state, cogl_context, paint_context);
     }
 
   /* If we don't have cached textures yet, check whether we can cache
@@ -1706,6 +2300,7 @@ st_theme_node_render_resources (StThemeNodePaintState *state,
   if (!node->cached_textures)
     {
       if (state->prerendered_pipeline == NULL &&
+          state->pending_prerender == NULL &&
           width >= node->box_shadow_min_width &&
           height >= node->box_shadow_min_height)
         {
@@ -1725,40 +2320,70 @@ st_theme_node_update_resources (StThemeNodePaintState *state,
                                 float                  resource_scale)
 {
   gboolean had_box_shadow = FALSE;
-  StShadow *box_shadow_spec;
+  float slices[4], slice_width, slice_height;
 
   g_return_if_fail (width > 0 && height > 0);
 
-  /* Free handles we can't reuse */
-  g_clear_object (&state->prerendered_texture);
-
-  if (state->prerendered_pipeline != NULL)
+  /* Nothing drawn analytically depends on the size */
+  if (state->sdf_pipeline != NULL &&
+      fabsf (state->resource_scale - resource_scale) < FLT_EPSILON)
     {
-      g_clear_object (&state->prerendered_pipeline);
+      state->alloc_width = width;
+      state->alloc_height = height;
+      return;
+    }
 
-      if (node->border_slices_texture == NULL &&
-          state->box_shadow_pipeline != NULL)
-        {
-          g_clear_object (&state->box_shadow_pipeline);
-          had_box_shadow = TRUE;
-        }
+  /* A sliced background can be stretched to any size that results in
+   * the same slices */
+  if (state->prerendered_sliced &&
+      fabsf (state->resource_scale - resource_scale) < FLT_EPSILON &&
+      st_theme_node_get_background_slices (node, width, height,
+                                           resource_scale, slices,
+                                           &slice_width, &slice_height) &&
+      slice_width == state->prerendered_width &&
+      slice_height == state->prerendered_height &&
+      memcmp (slices, state->prerendered_slices, sizeof (slices)) == 0)
+    {
+      state->alloc_width = width;
+      state->alloc_height = height;
+      return;
     }
 
+  /* Until the background being prerendered for an earlier size is done,
+   * keep stretching the current one rather than starting over on every
+   * frame of a resize. st_theme_node_paint() calls this again once it
+   * is done, as the allocation is only updated below. */
+  if (state->pending_prerender != NULL)
+    return;
+
+  /* The box-shadow of a sliced background doesn't depend on it */
+  if (state->prerendered_pipeline != NULL &&
+      node->border_slices_texture == NULL &&
+      state->box_shadow_pipeline != NULL &&
+      !state->prerendered_sliced)
+    had_box_shadow = TRUE;
+
   st_theme_node_paint_state_set_node (state, node);
   state->alloc_width = width;
   state->alloc_height = height;
   state->resource_scale = resource_scale;
 
-  box_shadow_spec = st_theme_node_get_box_shadow (node);
-
   st_theme_node_maybe_prerender_background (state, node, cogl_context,
                                             width, height, resource_scale);
 
-  if (had_box_shadow)
-    state->box_shadow_pipeline = _st_create_shadow_pipeline (box_shadow_spec,
-                                                             paint_context,
-                                                             state->prerendered_texture,
-                                                             state->resource_scale);
+  /* A background prerendered in a thread brings its own box-shadow */
+  if (had_box_shadow && state->pending_prerender == NULL)
+    {
+      g_clear_object (&state->box_shadow_pipeline);
+      st_theme_node_render_box_shadow (state, cogl_context, paint_context);
+    }
+}
+
+static void
+count_pipeline_draw (CoglPipeline *pipeline)
+{
+  if (cogl_pipeline_get_n_layers (pipeline) > 0)
+    _st_texture_atlas_count_draw (cogl_pipeline_get_layer_texture (pipeline, 0));
 }
 
 static void
@@ -1778,6 +2403,7 @@ paint_pipeline_with_opacity (ClutterPaintNode *node,
 
   pipeline_node = clutter_pipeline_node_new (pipeline);
   clutter_paint_node_add_child (node, pipeline_node);
+  count_pipeline_draw (pipeline);
 
   if (coords)
     clutter_paint_node_add_texture_rectangle (pipeline_node, box,
@@ -1840,7 +2466,7 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
       gboolean skip_corner_1, skip_corner_2;
       float rects[16];
 
-      over (&border_color, &node->background_color, &effective_border);
+      over (&border_color, &node->style->background_color, &effective_border);
       alpha = paint_opacity * effective_border.alpha / 255;
 
       if (alpha > 0)
@@ -1904,8 +2530,8 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
     }
 
   corners_are_transparent = mode == ST_PAINT_BORDERS_MODE_COLOR &&
-                            node->background_color.alpha == 0 &&
-                            node->border_color[0].alpha == 0;
+                            node->style->background_color.alpha == 0 &&
+                            node->style->border_color[0].alpha == 0;
 
   cogl_color_init_from_4f (&pipeline_color,
                            paint_opacity / 255.0, paint_opacity / 255.0,
@@ -1927,6 +2553,7 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
           clutter_paint_node_set_static_name (corners_node,
                                               "StThemeNode (CSS border corners)");
           clutter_paint_node_add_child (root, corners_node);
+          count_pipeline_draw (state->corner_pipeline[corner_id]);
 
           switch (corner_id)
             {
@@ -1983,16 +2610,16 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
   /* background color */
   alpha = mode == ST_PAINT_BORDERS_MODE_SILHOUETTE ?
           255 :
-          paint_opacity * node->background_color.alpha / 255;
+          paint_opacity * node->style->background_color.alpha / 255;
   if (alpha > 0)
     {
       g_autoptr (ClutterPaintNode) background_color_node = NULL;
       CoglColor color;
 
       cogl_color_init_from_4f (&color,
-                               node->background_color.red / 255.0f,
-                               node->background_color.green / 255.0f,
-                               node->background_color.blue / 255.0f,
+                               node->style->background_color.red / 255.0f,
+                               node->style->background_color.green / 255.0f,
+                               node->style->background_color.blue / 255.0f,
                                alpha / 255.0f);
 
       background_color_node = clutter_color_node_new (&color);
@@ -2195,17 +2822,17 @@ st_theme_node_paint_sliced_shadow (StThemeNodePaintState *state,
 
   /* Compute input regions parameters */
   s_top = shadow_blur_radius + box_shadow_spec->blur +
-    MAX (node->border_radius[ST_CORNER_TOPLEFT],
-         node->border_radius[ST_CORNER_TOPRIGHT]);
+    MAX (node->style->border_radius[ST_CORNER_TOPLEFT],
+         node->style->border_radius[ST_CORNER_TOPRIGHT]);
   s_bottom = shadow_blur_radius + box_shadow_spec->blur +
-    MAX (node->border_radius[ST_CORNER_BOTTOMLEFT],
-         node->border_radius[ST_CORNER_BOTTOMRIGHT]);
+    MAX (node->style->border_radius[ST_CORNER_BOTTOMLEFT],
+         node->style->border_radius[ST_CORNER_BOTTOMRIGHT]);
   s_left = shadow_blur_radius + box_shadow_spec->blur +
-    MAX (node->border_radius[ST_CORNER_TOPLEFT],
-         node->border_radius[ST_CORNER_BOTTOMLEFT]);
+    MAX (node->style->border_radius[ST_CORNER_TOPLEFT],
+         node->style->border_radius[ST_CORNER_BOTTOMLEFT]);
   s_right = shadow_blur_radius + box_shadow_spec->blur +
-    MAX (node->border_radius[ST_CORNER_TOPRIGHT],
-         node->border_radius[ST_CORNER_BOTTOMRIGHT]);
+    MAX (node->style->border_radius[ST_CORNER_TOPRIGHT],
+         node->style->border_radius[ST_CORNER_BOTTOMRIGHT]);
 
   /* Compute output regions parameters */
   xoffset = box->x1 + box_shadow_spec->xoffset - shadow_blur_radius - box_shadow_spec->spread;
@@ -2390,6 +3017,7 @@ st_theme_node_paint_sliced_shadow (StThemeNodePaintState *state,
   clutter_paint_node_set_static_name (pipeline_node,
                                       "StThemeNode (CSS box-shadow)");
   clutter_paint_node_add_child (root, pipeline_node);
+  count_pipeline_draw (state->box_shadow_pipeline);
   clutter_paint_node_add_texture_rectangles (pipeline_node,
                                              rectangles,
                                              idx / 8);
@@ -2502,18 +3130,67 @@ st_theme_node_paint_sliced_shadow (StThemeNodePaintState *state,
 #endif
 }
 
+/* The silhouette painted by st_theme_node_paint_borders() in
+ * ST_PAINT_BORDERS_MODE_SILHOUETTE only depends on the geometry of the
+ * box and on which of its parts are visible at all, because the blur
+ * makes every non-transparent pixel opaque */
+static void
+st_theme_node_get_shadow_cache_key (StThemeNodePaintState *state,
+                                    StShadowCacheKey      *key)
+{
+  StThemeNode *node = state->node;
+  int side_id;
+
+  memset (key, 0, sizeof (StShadowCacheKey));
+
+  key->blur = st_theme_node_get_box_shadow (node)->blur;
+  key->resource_scale = state->resource_scale;
+  key->width = state->box_shadow_width;
+  key->height = state->box_shadow_height;
+
+  st_theme_node_reduce_border_radius (node,
+                                      state->box_shadow_width,
+                                      state->box_shadow_height,
+                                      key->border_radius);
+
+  for (side_id = 0; side_id < 4; side_id++)
+    {
+      key->border_width[side_id] = node->style->border_width[side_id];
+
+      if (node->style->border_color[side_id].alpha > 0)
+        key->flags |= ST_SHADOW_MASK_BORDER_TOP << side_id;
+    }
+
+  if (node->style->background_color.alpha > 0)
+    key->flags |= ST_SHADOW_MASK_BACKGROUND;
+}
+
 static void
 st_theme_node_prerender_shadow (StThemeNodePaintState *state,
                                 CoglContext           *ctx,
                                 ClutterPaintContext   *paint_context)
 {
   StThemeNode *node = state->node;
+  StTextureCache *texture_cache = st_texture_cache_get_default ();
+  StShadowCacheKey key;
   int fb_width, fb_height;
   CoglTexture *buffer;
+  CoglTexture *shadow_texture;
   CoglOffscreen *offscreen = NULL;
   CoglFramebuffer *framebuffer;
   GError *error = NULL;
 
+  /* Identical boxes, e.g. the items of all popup menus, share a shadow */
+  st_theme_node_get_shadow_cache_key (state, &key);
+  shadow_texture = _st_texture_cache_lookup_shadow (texture_cache, &key);
+  if (shadow_texture != NULL)
+    {
+      state->box_shadow_pipeline =
+        _st_create_shadow_pipeline_for_texture (shadow_texture);
+      g_object_unref (shadow_texture);
+      return;
+    }
+
   /* Render offscreen */
   fb_width = ceilf (state->box_shadow_width * state->resource_scale);
   fb_height = ceilf (state->box_shadow_height * state->resource_scale);
@@ -2557,9 +3234,16 @@ st_theme_node_prerender_shadow (StThemeNodePaintState *state,
       clutter_paint_node_paint (root_node, nested_paint_context);
       clutter_paint_context_destroy (nested_paint_context);
 
-      state->box_shadow_pipeline = _st_create_shadow_pipeline (st_theme_node_get_box_shadow (node),
-                                                               paint_context,
-                                                               buffer, state->resource_scale);
+      shadow_texture = _st_create_shadow_texture (st_theme_node_get_box_shadow (node),
+                                                  paint_context,
+                                                  buffer, state->resource_scale);
+      if (shadow_texture != NULL)
+        {
+          _st_texture_cache_insert_shadow (texture_cache, &key, shadow_texture);
+          state->box_shadow_pipeline =
+            _st_create_shadow_pipeline_for_texture (shadow_texture);
+          g_object_unref (shadow_texture);
+        }
     }
 
   g_clear_error (&error);
@@ -2574,14 +3258,14 @@ st_theme_node_compute_maximum_borders (StThemeNodePaintState *state)
   StThemeNode * node = state->node;
 
   /* Compute maximum borders sizes */
-  max_borders[ST_SIDE_TOP] = MAX (node->border_radius[ST_CORNER_TOPLEFT],
-                                  node->border_radius[ST_CORNER_TOPRIGHT]);
-  max_borders[ST_SIDE_BOTTOM] = MAX (node->border_radius[ST_CORNER_BOTTOMLEFT],
-                                     node->border_radius[ST_CORNER_BOTTOMRIGHT]);
-  max_borders[ST_SIDE_LEFT] = MAX (node->border_radius[ST_CORNER_TOPLEFT],
-                                   node->border_radius[ST_CORNER_BOTTOMLEFT]);
-  max_borders[ST_SIDE_RIGHT] = MAX (node->border_radius[ST_CORNER_TOPRIGHT],
-                                    node->border_radius[ST_CORNER_BOTTOMRIGHT]);
+  max_borders[ST_SIDE_TOP] = MAX (node->style->border_radius[ST_CORNER_TOPLEFT],
+                                  node->style->border_radius[ST_CORNER_TOPRIGHT]);
+  max_borders[ST_SIDE_BOTTOM] = MAX (node->style->border_radius[ST_CORNER_BOTTOMLEFT],
+                                     node->style->border_radius[ST_CORNER_BOTTOMRIGHT]);
+  max_borders[ST_SIDE_LEFT] = MAX (node->style->border_radius[ST_CORNER_TOPLEFT],
+                                   node->style->border_radius[ST_CORNER_BOTTOMLEFT]);
+  max_borders[ST_SIDE_RIGHT] = MAX (node->style->border_radius[ST_CORNER_TOPRIGHT],
+                                    node->style->border_radius[ST_CORNER_BOTTOMRIGHT]);
 
   center_radius = (node->box_shadow->blur > 0) ? (2 * node->box_shadow->blur + 1) : 1;
 
@@ -2697,6 +3381,94 @@ st_theme_node_paint_sliced_border_image (StThemeNode      *node,
     clutter_paint_node_set_static_name (pipeline_node,
                                         "StThemeNode (CSS border image)");
     clutter_paint_node_add_child (root, pipeline_node);
+    count_pipeline_draw (pipeline);
+    clutter_paint_node_add_texture_rectangles (pipeline_node, rectangles, 9);
+  }
+}
+
+static void
+st_theme_node_paint_sliced_background (StThemeNodePaintState *state,
+                                       ClutterPaintNode      *root,
+                                       const ClutterActorBox *box,
+                                       guint8                 paint_opacity)
+{
+  g_autoptr (ClutterPaintNode) pipeline_node = NULL;
+  float left, right, top, bottom;
+  float ex, ey, tx1, ty1, tx2, ty2;
+  CoglColor color;
+
+  left = state->prerendered_slices[ST_SIDE_LEFT];
+  right = state->prerendered_slices[ST_SIDE_RIGHT];
+  top = state->prerendered_slices[ST_SIDE_TOP];
+  bottom = state->prerendered_slices[ST_SIDE_BOTTOM];
+
+  ex = box->x2 - right;
+  ey = box->y2 - bottom;
+
+  tx1 = left / state->prerendered_width;
+  tx2 = (state->prerendered_width - right) / state->prerendered_width;
+  ty1 = top / state->prerendered_height;
+  ty2 = (state->prerendered_height - bottom) / state->prerendered_height;
+
+  cogl_color_init_from_4f (&color,
+                           paint_opacity / 255.0, paint_opacity / 255.0,
+                           paint_opacity / 255.0, paint_opacity / 255.0);
+  cogl_pipeline_set_color (state->prerendered_pipeline, &color);
+
+  {
+    float rectangles[] =
+    {
+      /* top left corner */
+      box->x1, box->y1, box->x1 + left, box->y1 + top,
+      0.0, 0.0,
+      tx1, ty1,
+
+      /* top middle */
+      box->x1 + left, box->y1, ex, box->y1 + top,
+      tx1, 0.0,
+      tx2, ty1,
+
+      /* top right */
+      ex, box->y1, box->x2, box->y1 + top,
+      tx2, 0.0,
+      1.0, ty1,
+
+      /* mid left */
+      box->x1, box->y1 + top, box->x1 + left, ey,
+      0.0, ty1,
+      tx1, ty2,
+
+      /* center */
+      box->x1 + left, box->y1 + top, ex, ey,
+      tx1, ty1,
+      tx2, ty2,
+
+      /* mid right */
+      ex, box->y1 + top, box->x2, ey,
+      tx2, ty1,
+      1.0, ty2,
+
+      /* bottom left */
+      box->x1, ey, box->x1 + left, box->y2,
+      0.0, ty2,
+      tx1, 1.0,
+
+      /* bottom center */
+      box->x1 + left, ey, ex, box->y2,
+      tx1, ty2,
+      tx2, 1.0,
+
+      /* bottom right */
+      ex, ey, box->x2, box->y2,
+      tx2, ty2,
+      1.0, 1.0
+    };
+
+    pipeline_node = clutter_pipeline_node_new (state->prerendered_pipeline);
+    clutter_paint_node_set_static_name (pipeline_node,
+                                        "StThemeNode (sliced background)");
+    clutter_paint_node_add_child (root, pipeline_node);
+    count_pipeline_draw (state->prerendered_pipeline);
     clutter_paint_node_add_texture_rectangles (pipeline_node, rectangles, 9);
   }
 }
@@ -2724,7 +3496,7 @@ st_theme_node_paint_outline (StThemeNode           *node,
     return;
 
   st_theme_node_get_outline_color (node, &outline_color);
-  over (&outline_color, &node->background_color, &effective_outline);
+  over (&outline_color, &node->style->background_color, &effective_outline);
 
   alpha = paint_opacity * outline_color.alpha / 255;
 
@@ -2836,6 +3608,12 @@ st_theme_node_paint (StThemeNode           *node,
   if (width <= 0 || height <= 0 || resource_scale <= 0.0f)
     return;
 
+  /* Done first, so that a size change that happened meanwhile is
+   * handled below */
+  if (state->node == node &&
+      state->pending_prerender != NULL && state->pending_prerender->done)
+    st_theme_node_finish_prerender (state, cogl_context, paint_context);
+
   /* Check whether we need to recreate the textures of the paint
    * state, either because :
    *  1) the theme node associated to the paint state has changed
@@ -2866,6 +3644,13 @@ st_theme_node_paint (StThemeNode           *node,
                                       width, height, resource_scale);
     }
 
+  if (state->sdf_pipeline != NULL)
+    {
+      st_theme_node_paint_sdf (state, root, &allocation, paint_opacity);
+      st_theme_node_paint_outline (node, root, box, paint_opacity);
+      return;
+    }
+
   /* Rough notes about the relationship of borders and backgrounds in CSS3;
    * see http://www.w3.org/TR/css3-background/ for more accurate details.
    *
@@ -2919,11 +3704,17 @@ st_theme_node_paint (StThemeNode           *node,
                                                   &allocation,
                                                   &paint_box);
 
-          paint_pipeline_with_opacity (root,
-                                       state->prerendered_pipeline,
-                                       &paint_box,
-                                       NULL,
-                                       paint_opacity);
+          if (state->prerendered_sliced)
+            st_theme_node_paint_sliced_background (state,
+                                                   root,
+                                                   &paint_box,
+                                                   paint_opacity);
+          else
+            paint_pipeline_with_opacity (root,
+                                         state->prerendered_pipeline,
+                                         &paint_box,
+                                         NULL,
+                                         paint_opacity);
         }
 
       if (node->border_slices_pipeline != NULL)
@@ -2952,7 +3743,7 @@ st_theme_node_paint (StThemeNode           *node,
       get_background_position (node, &allocation, resource_scale,
                                &background_box, &texture_coords);
 
-      if (has_visible_outline || node->background_repeat)
+      if (has_visible_outline || node->style->background_repeat)
         {
           g_autoptr (ClutterPaintNode) clip_node = NULL;
 
@@ -2995,11 +3786,15 @@ static void
 st_theme_node_paint_state_node_free_internal (StThemeNodePaintState *state,
                                               gboolean               unref_node)
 {
+  ClutterActor *redraw_actor = state->redraw_actor;
   int corner_id;
 
+  st_theme_node_paint_state_drop_prerender (state);
+
   g_clear_object (&state->prerendered_texture);
   g_clear_object (&state->prerendered_pipeline);
   g_clear_object (&state->box_shadow_pipeline);
+  g_clear_object (&state->sdf_pipeline);
 
   for (corner_id = 0; corner_id < 4; corner_id++)
     g_clear_object (&state->corner_pipeline[corner_id]);
@@ -3008,6 +3803,7 @@ st_theme_node_paint_state_node_free_internal (StThemeNodePaintState *state,
     st_theme_node_paint_state_set_node (state, NULL);
 
   st_theme_node_paint_state_init (state);
+  state->redraw_actor = redraw_actor;
 }
 
 static void
@@ -3049,6 +3845,10 @@ st_theme_node_paint_state_init (StThemeNodePaintState *state)
   state->box_shadow_pipeline = NULL;
   state->prerendered_texture = NULL;
   state->prerendered_pipeline = NULL;
+  state->sdf_pipeline = NULL;
+  state->prerendered_sliced = FALSE;
+  state->pending_prerender = NULL;
+  state->redraw_actor = NULL;
 
   for (corner_id = 0; corner_id < 4; corner_id++)
     state->corner_pipeline[corner_id] = NULL;
@@ -3079,9 +3879,43 @@ st_theme_node_paint_state_copy (StThemeNodePaintState *state,
     state->prerendered_texture = g_object_ref (other->prerendered_texture);
   if (other->prerendered_pipeline)
     state->prerendered_pipeline = g_object_ref (other->prerendered_pipeline);
+  if (other->sdf_pipeline)
+    state->sdf_pipeline = g_object_ref (other->sdf_pipeline);
+  state->prerendered_sliced = other->prerendered_sliced;
+  state->prerendered_width = other->prerendered_width;
+  state->prerendered_height = other->prerendered_height;
+  memcpy (state->prerendered_slices, other->prerendered_slices,
+          sizeof (state->prerendered_slices));
   for (corner_id = 0; corner_id < 4; corner_id++)
     if (other->corner_pipeline[corner_id])
       state->corner_pipeline[corner_id] = g_object_ref (other->corner_pipeline[corner_id]);
+
+  /* A background still being prerendered for @other is not shared */
+  if (other->pending_prerender != NULL)
+    st_theme_node_paint_state_invalidate (state);
+}
+
+/**
+ * st_theme_node_paint_state_set_redraw_actor:
+ * @state: a #StThemeNodePaintState
+ * @actor: (nullable): the actor painted with @state
+ *
+ * Lets st_theme_node_paint() prerender the background of @state in a
+ * thread, painting a simpler version of it, or the previous one
+ * stretched to the new size, until that is done. @actor is redrawn
+ * once the prerendered background can be used.
+ */
+void
+st_theme_node_paint_state_set_redraw_actor (StThemeNodePaintState *state,
+                                            ClutterActor          *actor)
+{
+  state->redraw_actor = actor;
+
+  if (actor == NULL && state->pending_prerender != NULL)
+    {
+      st_theme_node_paint_state_drop_prerender (state);
+      st_theme_node_paint_state_invalidate (state);
+    }
 }
 
 void
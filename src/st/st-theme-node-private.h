@@ -27,15 +27,44 @@
 
 G_BEGIN_DECLS
 
-struct _StThemeNode {
-  GObject parent;
+typedef struct _StMatchedProperties StMatchedProperties;
 
-  StThemeContext *context;
-  StThemeNode *parent_node;
+/* The result of matching the theme against a node. Nodes that have the
+ * same matching inputs (the parent's match, theme, element type, id,
+ * classes, pseudo-classes and inline style) share the same instance,
+ * see _st_theme_context_lookup_matched_properties().
+ */
+struct _StMatchedProperties {
+  StMatchedProperties *parent;
   StTheme *theme;
+  GType element_type;
+  char *element_id;
+  GStrv element_classes;
+  GStrv pseudo_classes;
+  char *inline_style;
 
-  PangoFontDescription *font_desc;
+  CRDeclaration **properties;
+  int n_properties;
+
+  /* GQuark of a property name => index of its last declaration */
+  GHashTable *property_index;
+  /* For each declaration, the index of the previous declaration of
+   * the same property, or -1 */
+  int *previous_declaration;
+
+  /* We hold onto these separately so we can destroy them on finalize */
+  CRDeclaration *inline_properties;
+};
 
+typedef struct _StThemeNodeStyle StThemeNodeStyle;
+
+/* The geometry and background of a node, computed together in one pass
+ * over its declarations. Styles are immutable once computed and nodes
+ * with the same values share one instance, see
+ * ensure_geometry_and_background(). The fields before @background_image
+ * are compared bytewise, so keep them 4 bytes wide.
+ */
+struct _StThemeNodeStyle {
   CoglColor background_color;
   /* If gradient is set, then background_color is the gradient start */
   StGradientType background_gradient_type;
@@ -48,7 +77,6 @@ struct _StThemeNode {
   gint background_size_w;
   gint background_size_h;
 
-  CoglColor foreground_color;
   CoglColor border_color[4];
   CoglColor outline_color;
 
@@ -65,9 +93,27 @@ struct _StThemeNode {
   int max_width;
   int max_height;
 
-  int transition_duration;
+  gboolean background_position_set;
+  gboolean background_repeat;
 
   GFile *background_image;
+};
+
+struct _StThemeNode {
+  GObject parent;
+
+  StThemeContext *context;
+  StThemeNode *parent_node;
+  StTheme *theme;
+
+  PangoFontDescription *font_desc;
+
+  StThemeNodeStyle *style;
+
+  CoglColor foreground_color;
+
+  int transition_duration;
+
   StBorderImage *border_image;
   StShadow *box_shadow;
   StShadow *background_image_shadow;
@@ -80,18 +126,14 @@ struct _StThemeNode {
   GStrv pseudo_classes;
   char *inline_style;
 
+  /* Owned by matched_properties */
   CRDeclaration **properties;
   int n_properties;
 
-  /* We hold onto these separately so we can destroy them on finalize */
-  CRDeclaration *inline_properties;
-
-  guint background_position_set : 1;
-  guint background_repeat : 1;
+  StMatchedProperties *matched_properties;
 
   guint properties_computed : 1;
-  guint geometry_computed : 1;
-  guint background_computed : 1;
+  guint style_computed : 1;
   guint foreground_computed : 1;
   guint border_image_computed : 1;
   guint box_shadow_computed : 1;
@@ -117,9 +159,30 @@ struct _StThemeNode {
   int cached_scale_factor;
 };
 
+StMatchedProperties *_st_matched_properties_ref   (StMatchedProperties *matched);
+void                 _st_matched_properties_unref (StMatchedProperties *matched);
+guint                _st_matched_properties_hash  (gconstpointer        key);
+gboolean             _st_matched_properties_equal (gconstpointer        a,
+                                                   gconstpointer        b);
+
+StMatchedProperties *_st_theme_context_lookup_matched_properties (StThemeContext      *context,
+                                                                  StMatchedProperties *key);
+void                 _st_theme_context_add_matched_properties    (StThemeContext      *context,
+                                                                  StMatchedProperties *matched);
+
+/* Changes whenever the accent colors of @context do, see CRTerm.cached_color */
+guint _st_theme_context_get_accent_generation (StThemeContext *context);
+
+gboolean _st_theme_node_descendants_need_restyle (StThemeNode *old_node,
+                                                  StThemeNode *new_node);
+
 void _st_theme_node_ensure_background (StThemeNode *node);
 void _st_theme_node_ensure_geometry (StThemeNode *node);
 void _st_theme_node_apply_margins (StThemeNode *node,
                                    ClutterActor *actor);
 
+void _st_theme_node_set_sdf_rendering (gboolean enabled);
+
+gboolean _st_theme_node_paint_state_is_prerendering (StThemeNodePaintState *state);
+
 G_END_DECLS
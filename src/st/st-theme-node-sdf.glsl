@@ -0,0 +1,177 @@
+/*
+ * st-theme-node-sdf.glsl: Analytic rounded boxes for StThemeNode
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The texture coordinates of layer 0 are the position in the box and
+ * those of layer 1 the size of the box, both in logical pixels, so that
+ * the uniforms only depend on the style and boxes of any size can be
+ * drawn in a single batch. Colors are premultiplied. */
+
+uniform vec4 st_radius;          /* top-left, top-right, bottom-right, bottom-left */
+uniform vec4 st_border_width;    /* top, right, bottom, left */
+uniform vec4 st_background_color;
+uniform vec4 st_border_color;
+uniform vec4 st_shadow_color;    /* transparent if there's no box-shadow */
+uniform vec4 st_shadow_geometry; /* x offset, y offset, spread, sigma */
+uniform float st_pixel_size;     /* size of a device pixel, in logical pixels */
+
+/* p is relative to the center of the box */
+float
+st_corner_radius (vec2 p,
+                  vec4 radius)
+{
+  if (p.x < 0.0)
+    return p.y < 0.0 ? radius.x : radius.w;
+  else
+    return p.y < 0.0 ? radius.y : radius.z;
+}
+
+float
+st_rounded_box_distance (vec2  p,
+                         vec2  half_size,
+                         float radius)
+{
+  vec2 q = abs (p) - half_size + radius;
+
+  return min (max (q.x, q.y), 0.0) + length (max (q, 0.0)) - radius;
+}
+
+float
+st_coverage (float distance)
+{
+  return clamp (0.5 - distance / st_pixel_size, 0.0, 1.0);
+}
+
+/* The box-shadow is the box convolved with a Gaussian. Along x that
+ * has a closed form using erf(), along y it is integrated numerically;
+ * see Evan Wallace, "Fast Rounded Rectangle Shadows". */
+vec2
+st_erf (vec2 x)
+{
+  vec2 s = sign (x);
+  vec2 a = abs (x);
+
+  x = 1.0 + (0.278393 + (0.230389 + 0.078108 * (a * a)) * a) * a;
+  x *= x;
+
+  return s - s / (x * x);
+}
+
+float
+st_gaussian (float x,
+             float sigma)
+{
+  return exp (-(x * x) / (2.0 * sigma * sigma)) / (2.5066283 * sigma);
+}
+
+float
+st_shadow_row (float x,
+               float y,
+               float sigma,
+               float radius,
+               vec2  half_size)
+{
+  float delta = min (half_size.y - radius - abs (y), 0.0);
+  float curved = half_size.x - radius + sqrt (max (0.0, radius * radius - delta * delta));
+  vec2 integral = 0.5 + 0.5 * st_erf ((x + vec2 (-curved, curved)) * (0.7071068 / sigma));
+
+  return integral.y - integral.x;
+}
+
+float
+st_shadow_alpha (vec2  p,
+                 vec2  half_size,
+                 float radius,
+                 float sigma)
+{
+  float start = clamp (-3.0 * sigma, p.y - half_size.y, p.y + half_size.y);
+  float end = clamp (3.0 * sigma, p.y - half_size.y, p.y + half_size.y);
+  float dy = (end - start) / 4.0;
+  float y = start + dy * 0.5;
+  float value = 0.0;
+
+  for (int i = 0; i < 4; i++)
+    {
+      value += st_shadow_row (p.x, p.y - y, sigma, radius, half_size) *
+               st_gaussian (y, sigma) * dy;
+      y += dy;
+    }
+
+  return value;
+}
+
+vec4
+st_rounded_box (vec2 position,
+                vec2 size)
+{
+  vec2 half_size = 0.5 * size;
+  vec2 p = position - half_size;
+  vec4 radius = st_radius;
+  vec4 color;
+  float outer, inner;
+
+  /* Shrink radii that don't fit, like st_theme_node_reduce_border_radius() */
+  radius *= min (1.0, min (min (size.x / max (radius.x + radius.y, 0.001),
+                                size.x / max (radius.w + radius.z, 0.001)),
+                           min (size.y / max (radius.x + radius.w, 0.001),
+                                size.y / max (radius.y + radius.z, 0.001))));
+
+  outer = st_coverage (st_rounded_box_distance (p, half_size,
+                                                st_corner_radius (p, radius)));
+
+  /* The inner corners are circles rather than ellipses when the
+   * adjacent borders have different widths */
+  {
+    vec2 inner_min = st_border_width.wx;
+    vec2 inner_max = size - st_border_width.yz;
+    vec2 inner_half = max (0.5 * (inner_max - inner_min), 0.0);
+    vec2 pi = position - 0.5 * (inner_min + inner_max);
+    vec4 inner_radius = max (radius - vec4 (max (st_border_width.x, st_border_width.w),
+                                            max (st_border_width.x, st_border_width.y),
+                                            max (st_border_width.z, st_border_width.y),
+                                            max (st_border_width.z, st_border_width.w)),
+                             0.0);
+
+    inner = st_coverage (st_rounded_box_distance (pi, inner_half,
+                                                  st_corner_radius (pi, inner_radius)));
+    inner *= step (inner_min.x, inner_max.x) * step (inner_min.y, inner_max.y);
+    inner = min (inner, outer);
+  }
+
+  color = st_background_color * inner + st_border_color * (outer - inner);
+
+  if (st_shadow_color.a > 0.0)
+    {
+      vec2 shadow_half = max (half_size + st_shadow_geometry.z, 0.0);
+      vec2 ps = p - st_shadow_geometry.xy;
+      float shadow_radius = st_corner_radius (ps, radius);
+      float sigma = st_shadow_geometry.w;
+      float alpha;
+
+      if (shadow_radius > 0.0)
+        shadow_radius = clamp (shadow_radius + st_shadow_geometry.z,
+                               0.0, min (shadow_half.x, shadow_half.y));
+
+      if (sigma < 0.25 * st_pixel_size)
+        alpha = st_coverage (st_rounded_box_distance (ps, shadow_half, shadow_radius));
+      else
+        alpha = st_shadow_alpha (ps, shadow_half, shadow_radius, sigma);
+
+      color += st_shadow_color * alpha * (1.0 - color.a);
+    }
+
+  return color;
+}
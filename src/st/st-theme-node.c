@@ -40,11 +40,61 @@ static const CoglColor DEFAULT_SUCCESS_COLOR = { 0x4e, 0x9a, 0x06, 0xff };
 static const CoglColor DEFAULT_WARNING_COLOR = { 0xf5, 0x79, 0x3e, 0xff };
 static const CoglColor DEFAULT_ERROR_COLOR = { 0xcc, 0x00, 0x00, 0xff };
 
+static GQuark color_quark;
+static GQuark icon_style_quark;
+static GQuark text_decoration_quark;
+static GQuark text_align_quark;
+static GQuark font_feature_settings_quark;
+static GQuark border_image_quark;
+
+/* Prefixes of the properties St computes from the node's own
+ * declarations only, see do_geometry_property() and
+ * do_background_property() */
+static const char * const non_inherited_property_prefixes[] = {
+  "background",
+  "border",
+  "margin",
+  "outline",
+  "padding",
+};
+
+/* Other properties St never looks up on the parent of a node */
+static const char * const non_inherited_property_names[] = {
+  "width",
+  "height",
+  "min-width",
+  "min-height",
+  "max-width",
+  "max-height",
+  "-st-natural-width",
+  "-st-natural-height",
+  "box-shadow",
+  "-st-background-image-shadow",
+  "letter-spacing",
+  "text-decoration",
+  "transition-duration",
+};
+
+/* Set of the GQuarks of non_inherited_property_names */
+static GHashTable *non_inherited_properties;
+
+/* Used by nodes until their style is computed */
+static StThemeNodeStyle default_style;
+
+/* Set of the computed styles, so nodes with the same values share one */
+static GHashTable *computed_styles;
+
+static guint    style_hash  (gconstpointer key);
+static gboolean style_equal (gconstpointer a,
+                             gconstpointer b);
+static void     style_clear (gpointer      data);
+
 G_DEFINE_TYPE (StThemeNode, st_theme_node, G_TYPE_OBJECT)
 
 static void
 st_theme_node_init (StThemeNode *node)
 {
+  node->style = &default_style;
   node->transition_duration = -1;
 
   st_theme_node_paint_state_init (&node->cached_state);
@@ -54,27 +104,35 @@ static void
 st_theme_node_class_init (StThemeNodeClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  guint i;
 
   object_class->dispose = st_theme_node_dispose;
   object_class->finalize = st_theme_node_finalize;
+
+  color_quark = g_quark_from_static_string ("color");
+  icon_style_quark = g_quark_from_static_string ("-st-icon-style");
+  text_decoration_quark = g_quark_from_static_string ("text-decoration");
+  text_align_quark = g_quark_from_static_string ("text-align");
+  font_feature_settings_quark = g_quark_from_static_string ("font-feature-settings");
+  border_image_quark = g_quark_from_static_string ("border-image");
+
+  non_inherited_properties = g_hash_table_new (NULL, NULL);
+  for (i = 0; i < G_N_ELEMENTS (non_inherited_property_names); i++)
+    {
+      GQuark property = g_quark_from_static_string (non_inherited_property_names[i]);
+      g_hash_table_add (non_inherited_properties, GUINT_TO_POINTER (property));
+    }
+
+  computed_styles = g_hash_table_new (style_hash, style_equal);
 }
 
 static void
 maybe_free_properties (StThemeNode *node)
 {
-  if (node->properties)
-    {
-      g_free (node->properties);
-      node->properties = NULL;
-      node->n_properties = 0;
-    }
+  node->properties = NULL;
+  node->n_properties = 0;
 
-  if (node->inline_properties)
-    {
-      /* This destroys the list, not just the head of the list */
-      cr_declaration_destroy (node->inline_properties);
-      node->inline_properties = NULL;
-    }
+  g_clear_pointer (&node->matched_properties, _st_matched_properties_unref);
 }
 
 static void
@@ -125,7 +183,8 @@ st_theme_node_finalize (GObject *object)
   g_clear_pointer (&node->background_image_shadow, st_shadow_unref);
   g_clear_pointer (&node->text_shadow, st_shadow_unref);
 
-  g_clear_object (&node->background_image);
+  if (node->style != &default_style)
+    g_rc_box_release_full (node->style, style_clear);
 
   g_clear_object (&node->background_texture);
   g_clear_object (&node->background_pipeline);
@@ -443,36 +502,372 @@ st_theme_node_hash (StThemeNode *node)
   return hash;
 }
 
+static gboolean
+strv_equal0 (GStrv a,
+             GStrv b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+
+  return g_strv_equal ((const char * const *) a, (const char * const *) b);
+}
+
+static void
+matched_properties_clear (StMatchedProperties *matched)
+{
+  g_clear_pointer (&matched->parent, _st_matched_properties_unref);
+  g_clear_object (&matched->theme);
+
+  g_free (matched->element_id);
+  g_strfreev (matched->element_classes);
+  g_strfreev (matched->pseudo_classes);
+  g_free (matched->inline_style);
+
+  g_free (matched->properties);
+  g_clear_pointer (&matched->property_index, g_hash_table_unref);
+  g_free (matched->previous_declaration);
+
+  /* This destroys the list, not just the head of the list */
+  if (matched->inline_properties)
+    cr_declaration_destroy (matched->inline_properties);
+}
+
+StMatchedProperties *
+_st_matched_properties_ref (StMatchedProperties *matched)
+{
+  return g_rc_box_acquire (matched);
+}
+
+void
+_st_matched_properties_unref (StMatchedProperties *matched)
+{
+  g_rc_box_release_full (matched, (GDestroyNotify) matched_properties_clear);
+}
+
+guint
+_st_matched_properties_hash (gconstpointer key)
+{
+  const StMatchedProperties *matched = key;
+  guint hash;
+
+  hash = GPOINTER_TO_UINT (matched->parent);
+
+  hash = hash * 33 + GPOINTER_TO_UINT (matched->theme);
+  hash = hash * 33 + ((guint) matched->element_type);
+
+  if (matched->element_id != NULL)
+    hash = hash * 33 + g_str_hash (matched->element_id);
+
+  if (matched->inline_style != NULL)
+    hash = hash * 33 + g_str_hash (matched->inline_style);
+
+  if (matched->element_classes != NULL)
+    {
+      gchar **it;
+
+      for (it = matched->element_classes; *it != NULL; it++)
+        hash = hash * 33 + g_str_hash (*it) + 1;
+    }
+
+  if (matched->pseudo_classes != NULL)
+    {
+      gchar **it;
+
+      for (it = matched->pseudo_classes; *it != NULL; it++)
+        hash = hash * 33 + g_str_hash (*it) + 1;
+    }
+
+  return hash;
+}
+
+gboolean
+_st_matched_properties_equal (gconstpointer a,
+                              gconstpointer b)
+{
+  const StMatchedProperties *matched_a = a;
+  const StMatchedProperties *matched_b = b;
+
+  return matched_a->parent == matched_b->parent &&
+         matched_a->theme == matched_b->theme &&
+         matched_a->element_type == matched_b->element_type &&
+         g_strcmp0 (matched_a->element_id, matched_b->element_id) == 0 &&
+         g_strcmp0 (matched_a->inline_style, matched_b->inline_style) == 0 &&
+         strv_equal0 (matched_a->element_classes, matched_b->element_classes) &&
+         strv_equal0 (matched_a->pseudo_classes, matched_b->pseudo_classes);
+}
+
+static StMatchedProperties *
+matched_properties_new (StThemeNode         *node,
+                        StMatchedProperties *key)
+{
+  StMatchedProperties *matched;
+  GPtrArray *properties = NULL;
+
+  matched = g_rc_box_new0 (StMatchedProperties);
+
+  if (key->parent)
+    matched->parent = _st_matched_properties_ref (key->parent);
+  g_set_object (&matched->theme, key->theme);
+  matched->element_type = key->element_type;
+  matched->element_id = g_strdup (key->element_id);
+  matched->element_classes = g_strdupv (key->element_classes);
+  matched->pseudo_classes = g_strdupv (key->pseudo_classes);
+  matched->inline_style = g_strdup (key->inline_style);
+
+  if (node->theme)
+    properties = _st_theme_get_matched_properties (node->theme, node);
+
+  if (node->inline_style && *node->inline_style != '\0')
+    {
+      CRDeclaration *cur_decl;
+
+      if (!properties)
+        properties = g_ptr_array_new ();
+
+      matched->inline_properties = _st_theme_parse_declaration_list (node->theme,
+                                                                     node->inline_style);
+      for (cur_decl = matched->inline_properties; cur_decl; cur_decl = cur_decl->next)
+        g_ptr_array_add (properties, cur_decl);
+    }
+
+  if (properties)
+    {
+      matched->n_properties = properties->len;
+      matched->properties = (CRDeclaration **)g_ptr_array_free (properties, FALSE);
+    }
+
+  if (matched->n_properties > 0)
+    {
+      int i;
+
+      matched->property_index = g_hash_table_new (NULL, NULL);
+      matched->previous_declaration = g_new (int, matched->n_properties);
+
+      for (i = 0; i < matched->n_properties; i++)
+        {
+          gpointer key = GUINT_TO_POINTER (matched->properties[i]->property_quark);
+          gpointer last;
+
+          if (g_hash_table_lookup_extended (matched->property_index, key, NULL, &last))
+            matched->previous_declaration[i] = GPOINTER_TO_INT (last);
+          else
+            matched->previous_declaration[i] = -1;
+
+          g_hash_table_insert (matched->property_index, key, GINT_TO_POINTER (i));
+        }
+    }
+
+  return matched;
+}
+
 static void
 ensure_properties (StThemeNode *node)
 {
   if (!node->properties_computed)
     {
-      GPtrArray *properties = NULL;
+      StMatchedProperties key = { 0, };
+      StMatchedProperties *matched;
 
       node->properties_computed = TRUE;
 
-      if (node->theme)
-        properties = _st_theme_get_matched_properties (node->theme, node);
-
-      if (node->inline_style && *node->inline_style != '\0')
+      /* Matching only depends on the node's own inputs and those of its
+       * ancestors, which the parent's match stands in for; this lets
+       * nodes share the cascade result even across theme context changes
+       * that recreate the whole node tree.
+       */
+      if (node->parent_node)
         {
-          CRDeclaration *cur_decl;
+          ensure_properties (node->parent_node);
+          key.parent = node->parent_node->matched_properties;
+        }
 
-          if (!properties)
-            properties = g_ptr_array_new ();
+      key.theme = node->theme;
+      key.element_type = node->element_type;
+      key.element_id = node->element_id;
+      key.element_classes = node->element_classes;
+      key.pseudo_classes = node->pseudo_classes;
+      key.inline_style = node->inline_style;
 
-          node->inline_properties = _st_theme_parse_declaration_list (node->inline_style);
-          for (cur_decl = node->inline_properties; cur_decl; cur_decl = cur_decl->next)
-            g_ptr_array_add (properties, cur_decl);
+      matched = _st_theme_context_lookup_matched_properties (node->context, &key);
+      if (matched != NULL)
+        {
+          node->matched_properties = _st_matched_properties_ref (matched);
         }
-
-      if (properties)
+      else
         {
-          node->n_properties = properties->len;
-          node->properties = (CRDeclaration **)g_ptr_array_free (properties, FALSE);
+          node->matched_properties = matched_properties_new (node, &key);
+          _st_theme_context_add_matched_properties (node->context,
+                                                    node->matched_properties);
         }
+
+      node->properties = node->matched_properties->properties;
+      node->n_properties = node->matched_properties->n_properties;
+    }
+}
+
+/* Declarations of a single property are iterated from highest to lowest
+ * priority with:
+ *
+ *   for (i = last_declaration (node, property); i >= 0;
+ *        i = previous_declaration (node, i))
+ *
+ * ensure_properties() must have been called on @node.
+ */
+static inline int
+last_declaration (StThemeNode *node,
+                  GQuark       property)
+{
+  gpointer last;
+
+  if (node->n_properties == 0 ||
+      !g_hash_table_lookup_extended (node->matched_properties->property_index,
+                                     GUINT_TO_POINTER (property),
+                                     NULL, &last))
+    return -1;
+
+  return GPOINTER_TO_INT (last);
+}
+
+static inline int
+previous_declaration (StThemeNode *node,
+                      int          i)
+{
+  return node->matched_properties->previous_declaration[i];
+}
+
+static gboolean
+changed_strings_match (GStrv      old_strings,
+                       GStrv      new_strings,
+                       StTheme   *theme,
+                       gboolean (*matches) (StTheme    *theme,
+                                            const char *string))
+{
+  char **it;
+
+  for (it = old_strings; it && *it; it++)
+    {
+      if ((new_strings == NULL ||
+           !g_strv_contains ((const char * const *) new_strings, *it)) &&
+          matches (theme, *it))
+        return TRUE;
+    }
+
+  for (it = new_strings; it && *it; it++)
+    {
+      if ((old_strings == NULL ||
+           !g_strv_contains ((const char * const *) old_strings, *it)) &&
+          matches (theme, *it))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Whether descendants can see the value of @decl. Besides the CSS
+ * inherited properties (color, font, text-align, ...) this includes
+ * any property St doesn't know to be uninherited, since widgets and
+ * extensions can look up arbitrary properties with inheritance, such
+ * as StEntry's caret-color. */
+static gboolean
+declaration_may_be_inherited (CRDeclaration *decl)
+{
+  const char *property_name = decl->property->stryng->str;
+  guint i;
+
+  if (g_hash_table_contains (non_inherited_properties,
+                             GUINT_TO_POINTER (decl->property_quark)))
+    return FALSE;
+
+  for (i = 0; i < G_N_ELEMENTS (non_inherited_property_prefixes); i++)
+    {
+      if (g_str_has_prefix (property_name, non_inherited_property_prefixes[i]))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static int
+next_inherited_declaration (StThemeNode *node,
+                            int          i,
+                            gboolean     all_inherited)
+{
+  while (i < node->n_properties && !all_inherited &&
+         !declaration_may_be_inherited (node->properties[i]))
+    i++;
+
+  return i;
+}
+
+/**
+ * _st_theme_node_descendants_need_restyle:
+ * @old_node: the previous theme node of a widget
+ * @new_node: the new theme node of the same widget
+ *
+ * Checks whether the style of the descendants of a widget can be
+ * affected by its theme node changing from @old_node to @new_node:
+ * either because a class or pseudo-class that changed is used in the
+ * ancestor part of a selector, or because a property the descendants
+ * can inherit changed.
+ *
+ * Returns: %FALSE if the descendants can keep their theme nodes
+ */
+gboolean
+_st_theme_node_descendants_need_restyle (StThemeNode *old_node,
+                                         StThemeNode *new_node)
+{
+  gboolean all_inherited;
+  int i, j;
+
+  if (old_node == new_node)
+    return FALSE;
+
+  if (old_node->parent_node != new_node->parent_node ||
+      old_node->context != new_node->context ||
+      old_node->theme != new_node->theme ||
+      old_node->element_type != new_node->element_type ||
+      old_node->cached_scale_factor != new_node->cached_scale_factor ||
+      g_strcmp0 (old_node->element_id, new_node->element_id) != 0)
+    return TRUE;
+
+  if (new_node->theme != NULL &&
+      (changed_strings_match (old_node->element_classes,
+                              new_node->element_classes,
+                              new_node->theme,
+                              _st_theme_is_ancestor_class) ||
+       changed_strings_match (old_node->pseudo_classes,
+                              new_node->pseudo_classes,
+                              new_node->theme,
+                              _st_theme_is_ancestor_pseudo_class)))
+    return TRUE;
+
+  ensure_properties (old_node);
+  ensure_properties (new_node);
+
+  /* With 'inherit' values around, any property can be inherited */
+  all_inherited = _st_theme_uses_inherit (new_node->theme);
+
+  i = next_inherited_declaration (old_node, 0, all_inherited);
+  j = next_inherited_declaration (new_node, 0, all_inherited);
+
+  while (i < old_node->n_properties && j < new_node->n_properties)
+    {
+      CRDeclaration *old_decl = old_node->properties[i];
+      CRDeclaration *new_decl = new_node->properties[j];
+
+      /* Inline declarations are parsed for each set of matched
+       * properties, so compare them through the inline style */
+      if (old_decl != new_decl &&
+          !(old_decl->parent_statement == NULL &&
+            new_decl->parent_statement == NULL &&
+            g_strcmp0 (old_node->inline_style, new_node->inline_style) == 0))
+        return TRUE;
+
+      i = next_inherited_declaration (old_node, i + 1, all_inherited);
+      j = next_inherited_declaration (new_node, j + 1, all_inherited);
     }
+
+  return i < old_node->n_properties || j < new_node->n_properties;
 }
 
 typedef enum {
@@ -801,6 +1196,42 @@ get_color_from_darken_term (StThemeNode *node,
   return VALUE_FOUND;
 }
 
+static GetFromTermResult
+get_color_from_function_term (StThemeNode *node,
+                              CRTerm      *term,
+                              CoglColor   *color)
+{
+  const char *name;
+
+  if (!term->content.str ||
+      !term->content.str->stryng ||
+      !term->content.str->stryng->str)
+    return VALUE_NOT_FOUND;
+
+  name = term->content.str->stryng->str;
+
+  /* rgba () colors - a CSS3 addition, are not supported by libcroco,
+   * but they are parsed as a "function", so we can emulate the
+   * functionality.
+   */
+  if (strcmp (name, "rgba") == 0)
+    return get_color_from_rgba_term (term, color);
+  /* St-specific extension: st-transparentize() */
+  else if (strcmp (name, "st-transparentize") == 0)
+    return get_color_from_transparentize_term (node, term, color);
+  /* St-specific extension: st-mix() */
+  else if (strcmp (name, "st-mix") == 0)
+    return get_color_from_mix_term (node, term, color);
+  /* St-specific extension: st-lighten() */
+  else if (strcmp (name, "st-lighten") == 0)
+    return get_color_from_lighten_term (node, term, color);
+  /* St-specific extension: st-darken() */
+  else if (strcmp (name, "st-darken") == 0)
+    return get_color_from_darken_term (node, term, color);
+
+  return VALUE_NOT_FOUND;
+}
+
 static GetFromTermResult
 get_color_from_term (StThemeNode  *node,
                      CRTerm       *term,
@@ -833,53 +1264,36 @@ get_color_from_term (StThemeNode  *node,
       st_theme_context_get_accent_color (node->context, NULL, color);
       return VALUE_FOUND;
     }
-  /* rgba () colors - a CSS3 addition, are not supported by libcroco,
-   * but they are parsed as a "function", so we can emulate the
-   * functionality.
+  /* rgba () and the St-specific color functions; see
+   * get_color_from_function_term()
    */
-  else if (term->type == TERM_FUNCTION &&
-           term->content.str &&
-           term->content.str->stryng &&
-           term->content.str->stryng->str &&
-           strcmp (term->content.str->stryng->str, "rgba") == 0)
+  else if (term->type == TERM_FUNCTION)
     {
-      return get_color_from_rgba_term (term, color);
-    }
-  /* St-specific extension: st-transparentize() */
-  else if (term->type == TERM_FUNCTION &&
-           term->content.str &&
-           term->content.str->stryng &&
-           term->content.str->stryng->str &&
-           strcmp (term->content.str->stryng->str, "st-transparentize") == 0)
-    {
-      return get_color_from_transparentize_term (node, term, color);
-    }
-  /* St-specific extension: st-mix() */
-  else if (term->type == TERM_FUNCTION &&
-           term->content.str &&
-           term->content.str->stryng &&
-           term->content.str->stryng->str &&
-           strcmp (term->content.str->stryng->str, "st-mix") == 0)
-    {
-      return get_color_from_mix_term (node, term, color);
-    }
-  /* St-specific extension: st-lighten() */
-  else if (term->type == TERM_FUNCTION &&
-           term->content.str &&
-           term->content.str->stryng &&
-           term->content.str->stryng->str &&
-           strcmp (term->content.str->stryng->str, "st-lighten") == 0)
-    {
-      return get_color_from_lighten_term (node, term, color);
-    }
-  /* St-specific extension: st-darken() */
-  else if (term->type == TERM_FUNCTION &&
-           term->content.str &&
-           term->content.str->stryng &&
-           term->content.str->stryng->str &&
-           strcmp (term->content.str->stryng->str, "st-darken") == 0)
-    {
-      return get_color_from_darken_term (node, term, color);
+      guint generation = _st_theme_context_get_accent_generation (node->context);
+      GetFromTermResult result;
+
+      /* The result only depends on the accent colors, so it's cached on
+       * the term itself, which lives as long as the stylesheet does */
+      if (term->cached_color_generation == generation)
+        {
+          color->red   = term->cached_color >> 24;
+          color->green = term->cached_color >> 16;
+          color->blue  = term->cached_color >> 8;
+          color->alpha = term->cached_color;
+          return VALUE_FOUND;
+        }
+
+      result = get_color_from_function_term (node, term, color);
+      if (result == VALUE_FOUND)
+        {
+          term->cached_color = ((guint32) color->red << 24 |
+                                (guint32) color->green << 16 |
+                                (guint32) color->blue << 8 |
+                                (guint32) color->alpha);
+          term->cached_color_generation = generation;
+        }
+
+      return result;
     }
 
   status = cr_rgb_set_from_term (&rgb, term);
@@ -897,6 +1311,40 @@ get_color_from_term (StThemeNode  *node,
   return VALUE_FOUND;
 }
 
+static gboolean
+lookup_color (StThemeNode *node,
+              GQuark       property,
+              gboolean     inherit,
+              CoglColor   *color)
+{
+  int i;
+
+  ensure_properties (node);
+
+  for (i = last_declaration (node, property); i >= 0; i = previous_declaration (node, i))
+    {
+      CRDeclaration *decl = node->properties[i];
+      GetFromTermResult result = get_color_from_term (node, decl->value, color);
+
+      if (result == VALUE_FOUND)
+        {
+          return TRUE;
+        }
+      else if (result == VALUE_INHERIT)
+        {
+          if (node->parent_node)
+            return lookup_color (node->parent_node, property, inherit, color);
+          else
+            break;
+        }
+    }
+
+  if (inherit && node->parent_node)
+    return lookup_color (node->parent_node, property, inherit, color);
+
+  return FALSE;
+}
+
 /**
  * st_theme_node_lookup_color:
  * @node: a #StThemeNode
@@ -926,39 +1374,10 @@ st_theme_node_lookup_color (StThemeNode  *node,
                             gboolean      inherit,
                             CoglColor    *color)
 {
-
-  int i;
-
   g_return_val_if_fail (ST_IS_THEME_NODE(node), FALSE);
   g_return_val_if_fail (property_name != NULL, FALSE);
 
-  ensure_properties (node);
-
-  for (i = node->n_properties - 1; i >= 0; i--)
-    {
-      CRDeclaration *decl = node->properties[i];
-
-      if (strcmp (decl->property->stryng->str, property_name) == 0)
-        {
-          GetFromTermResult result = get_color_from_term (node, decl->value, color);
-          if (result == VALUE_FOUND)
-            {
-              return TRUE;
-            }
-          else if (result == VALUE_INHERIT)
-            {
-              if (node->parent_node)
-                return st_theme_node_lookup_color (node->parent_node, property_name, inherit, color);
-              else
-                break;
-            }
-        }
-    }
-
-  if (inherit && node->parent_node)
-    return st_theme_node_lookup_color (node->parent_node, property_name, inherit, color);
-
-  return FALSE;
+  return lookup_color (node, g_quark_try_string (property_name), inherit, color);
 }
 
 /**
@@ -992,6 +1411,36 @@ st_theme_node_get_color (StThemeNode  *node,
     }
 }
 
+static gboolean
+lookup_double (StThemeNode *node,
+               GQuark       property,
+               gboolean     inherit,
+               double      *value)
+{
+  gboolean result = FALSE;
+  int i;
+
+  ensure_properties (node);
+
+  for (i = last_declaration (node, property); i >= 0; i = previous_declaration (node, i))
+    {
+      CRDeclaration *decl = node->properties[i];
+      CRTerm *term = decl->value;
+
+      if (term->type != TERM_NUMBER || term->content.num->type != NUM_GENERIC)
+        continue;
+
+      *value = term->content.num->val;
+      result = TRUE;
+      break;
+    }
+
+  if (!result && inherit && node->parent_node)
+    result = lookup_double (node->parent_node, property, inherit, value);
+
+  return result;
+}
+
 /**
  * st_theme_node_lookup_double:
  * @node: a #StThemeNode
@@ -1019,33 +1468,46 @@ st_theme_node_lookup_double (StThemeNode *node,
                              gboolean     inherit,
                              double      *value)
 {
-  gboolean result = FALSE;
-  int i;
-
   g_return_val_if_fail (ST_IS_THEME_NODE(node), FALSE);
   g_return_val_if_fail (property_name != NULL, FALSE);
 
+  return lookup_double (node, g_quark_try_string (property_name), inherit, value);
+}
+
+static gboolean
+lookup_time (StThemeNode *node,
+             GQuark       property,
+             gboolean     inherit,
+             double      *value)
+{
+  gboolean result = FALSE;
+  int i;
+
   ensure_properties (node);
 
-  for (i = node->n_properties - 1; i >= 0; i--)
+  for (i = last_declaration (node, property); i >= 0; i = previous_declaration (node, i))
     {
       CRDeclaration *decl = node->properties[i];
+      CRTerm *term = decl->value;
+      int factor = 1;
 
-      if (strcmp (decl->property->stryng->str, property_name) == 0)
-        {
-          CRTerm *term = decl->value;
+      if (term->type != TERM_NUMBER)
+        continue;
 
-          if (term->type != TERM_NUMBER || term->content.num->type != NUM_GENERIC)
-            continue;
+      if (term->content.num->type != NUM_TIME_S &&
+          term->content.num->type != NUM_TIME_MS)
+        continue;
 
-          *value = term->content.num->val;
-          result = TRUE;
-          break;
-        }
+      if (term->content.num->type == NUM_TIME_S)
+        factor = 1000;
+
+      *value = factor * term->content.num->val;
+      result = TRUE;
+      break;
     }
 
   if (!result && inherit && node->parent_node)
-    result = st_theme_node_lookup_double (node->parent_node, property_name, inherit, value);
+    result = lookup_time (node->parent_node, property, inherit, value);
 
   return result;
 }
@@ -1075,43 +1537,10 @@ st_theme_node_lookup_time (StThemeNode *node,
                            gboolean     inherit,
                            double      *value)
 {
-  gboolean result = FALSE;
-  int i;
-
   g_return_val_if_fail (ST_IS_THEME_NODE(node), FALSE);
   g_return_val_if_fail (property_name != NULL, FALSE);
 
-  ensure_properties (node);
-
-  for (i = node->n_properties - 1; i >= 0; i--)
-    {
-      CRDeclaration *decl = node->properties[i];
-
-      if (strcmp (decl->property->stryng->str, property_name) == 0)
-        {
-          CRTerm *term = decl->value;
-          int factor = 1;
-
-          if (term->type != TERM_NUMBER)
-            continue;
-
-          if (term->content.num->type != NUM_TIME_S &&
-              term->content.num->type != NUM_TIME_MS)
-            continue;
-
-          if (term->content.num->type == NUM_TIME_S)
-            factor = 1000;
-
-          *value = factor * term->content.num->val;
-          result = TRUE;
-          break;
-        }
-    }
-
-  if (!result && inherit && node->parent_node)
-    result = st_theme_node_lookup_time (node->parent_node, property_name, inherit, value);
-
-  return result;
+  return lookup_time (node, g_quark_try_string (property_name), inherit, value);
 }
 
 /**
@@ -1144,6 +1573,44 @@ st_theme_node_get_double (StThemeNode *node,
     }
 }
 
+static gboolean
+lookup_url (StThemeNode  *node,
+            GQuark        property,
+            gboolean      inherit,
+            GFile       **file)
+{
+  gboolean result = FALSE;
+  int i;
+
+  ensure_properties (node);
+
+  for (i = last_declaration (node, property); i >= 0; i = previous_declaration (node, i))
+    {
+      CRDeclaration *decl = node->properties[i];
+      CRTerm *term = decl->value;
+      CRStyleSheet *base_stylesheet;
+
+      if (term->type != TERM_URI && term->type != TERM_STRING)
+        continue;
+
+      if (decl->parent_statement != NULL)
+        base_stylesheet = decl->parent_statement->parent_sheet;
+      else
+        base_stylesheet = NULL;
+
+      *file = _st_theme_resolve_url (node->theme,
+                                     base_stylesheet,
+                                     decl->value->content.str->stryng->str);
+      result = TRUE;
+      break;
+    }
+
+  if (!result && inherit && node->parent_node)
+    result = lookup_url (node->parent_node, property, inherit, file);
+
+  return result;
+}
+
 /**
  * st_theme_node_lookup_url:
  * @node: a #StThemeNode
@@ -1170,43 +1637,10 @@ st_theme_node_lookup_url (StThemeNode  *node,
                           gboolean      inherit,
                           GFile       **file)
 {
-  gboolean result = FALSE;
-  int i;
-
   g_return_val_if_fail (ST_IS_THEME_NODE(node), FALSE);
   g_return_val_if_fail (property_name != NULL, FALSE);
 
-  ensure_properties (node);
-
-  for (i = node->n_properties - 1; i >= 0; i--)
-    {
-      CRDeclaration *decl = node->properties[i];
-
-      if (strcmp (decl->property->stryng->str, property_name) == 0)
-        {
-          CRTerm *term = decl->value;
-          CRStyleSheet *base_stylesheet;
-
-          if (term->type != TERM_URI && term->type != TERM_STRING)
-            continue;
-
-          if (decl->parent_statement != NULL)
-            base_stylesheet = decl->parent_statement->parent_sheet;
-          else
-            base_stylesheet = NULL;
-
-          *file = _st_theme_resolve_url (node->theme,
-                                         base_stylesheet,
-                                         decl->value->content.str->stryng->str);
-          result = TRUE;
-          break;
-        }
-    }
-
-  if (!result && inherit && node->parent_node)
-    result = st_theme_node_lookup_url (node->parent_node, property_name, inherit, file);
-
-  return result;
+  return lookup_url (node, g_quark_try_string (property_name), inherit, file);
 }
 
 /**
@@ -1418,28 +1852,46 @@ get_length_from_term_int (StThemeNode *node,
 
 static GetFromTermResult
 get_length_internal (StThemeNode *node,
-                     const char  *property_name,
+                     GQuark       property,
                      gdouble     *length)
 {
   int i;
 
   ensure_properties (node);
 
-  for (i = node->n_properties - 1; i >= 0; i--)
+  for (i = last_declaration (node, property); i >= 0; i = previous_declaration (node, i))
     {
       CRDeclaration *decl = node->properties[i];
+      GetFromTermResult result = get_length_from_term (node, decl->value, FALSE, length);
 
-      if (strcmp (decl->property->stryng->str, property_name) == 0)
-        {
-          GetFromTermResult result = get_length_from_term (node, decl->value, FALSE, length);
-          if (result != VALUE_NOT_FOUND)
-            return result;
-        }
+      if (result != VALUE_NOT_FOUND)
+        return result;
     }
 
   return VALUE_NOT_FOUND;
 }
 
+static gboolean
+lookup_length (StThemeNode *node,
+               GQuark       property,
+               gboolean     inherit,
+               gdouble     *length)
+{
+  GetFromTermResult result;
+
+  result = get_length_internal (node, property, length);
+
+  if (result == VALUE_FOUND)
+    return TRUE;
+  else if (result == VALUE_INHERIT)
+    inherit = TRUE;
+
+  if (inherit && node->parent_node)
+    return lookup_length (node->parent_node, property, inherit, length);
+
+  return FALSE;
+}
+
 /**
  * st_theme_node_lookup_length:
  * @node: a #StThemeNode
@@ -1470,22 +1922,10 @@ st_theme_node_lookup_length (StThemeNode *node,
                              gboolean     inherit,
                              gdouble     *length)
 {
-  GetFromTermResult result;
-
   g_return_val_if_fail (ST_IS_THEME_NODE(node), FALSE);
   g_return_val_if_fail (property_name != NULL, FALSE);
 
-  result = get_length_internal (node, property_name, length);
-
-  if (result == VALUE_FOUND)
-    return TRUE;
-  else if (result == VALUE_INHERIT)
-    inherit = TRUE;
-
-  if (inherit && node->parent_node)
-    return st_theme_node_lookup_length (node->parent_node, property_name, inherit, length);
-
-  return FALSE;
+  return lookup_length (node, g_quark_try_string (property_name), inherit, length);
 }
 
 /**
@@ -1533,13 +1973,13 @@ do_border_radius_term (StThemeNode *node,
     return;
 
   if (topleft)
-    node->border_radius[ST_CORNER_TOPLEFT] = value;
+    node->style->border_radius[ST_CORNER_TOPLEFT] = value;
   if (topright)
-    node->border_radius[ST_CORNER_TOPRIGHT] = value;
+    node->style->border_radius[ST_CORNER_TOPRIGHT] = value;
   if (bottomright)
-    node->border_radius[ST_CORNER_BOTTOMRIGHT] = value;
+    node->style->border_radius[ST_CORNER_BOTTOMRIGHT] = value;
   if (bottomleft)
-    node->border_radius[ST_CORNER_BOTTOMLEFT] = value;
+    node->style->border_radius[ST_CORNER_BOTTOMLEFT] = value;
 }
 
 static void
@@ -1721,17 +2161,17 @@ do_border_property (StThemeNode   *node,
       for (j = 0; j < 4; j++)
         {
           if (color_set)
-            node->border_color[j] = color;
+            node->style->border_color[j] = color;
           if (width_set)
-            node->border_width[j] = width;
+            node->style->border_width[j] = width;
         }
     }
   else
     {
       if (color_set)
-        node->border_color[side] = color;
+        node->style->border_color[side] = color;
       if (width_set)
-        node->border_width[side] = width;
+        node->style->border_width[side] = width;
     }
 }
 
@@ -1822,9 +2262,9 @@ do_outline_property (StThemeNode   *node,
     }
 
   if (color_set)
-    node->outline_color = color;
+    node->style->outline_color = color;
   if (width_set)
-    node->outline_width = width;
+    node->style->outline_width = width;
 }
 
 static void
@@ -1841,13 +2281,13 @@ do_padding_property_term (StThemeNode *node,
     return;
 
   if (left)
-    node->padding[ST_SIDE_LEFT] = value;
+    node->style->padding[ST_SIDE_LEFT] = value;
   if (right)
-    node->padding[ST_SIDE_RIGHT] = value;
+    node->style->padding[ST_SIDE_RIGHT] = value;
   if (top)
-    node->padding[ST_SIDE_TOP] = value;
+    node->style->padding[ST_SIDE_TOP] = value;
   if (bottom)
-    node->padding[ST_SIDE_BOTTOM] = value;
+    node->style->padding[ST_SIDE_BOTTOM] = value;
 }
 
 static void
@@ -1923,13 +2363,13 @@ do_margin_property_term (StThemeNode *node,
     return;
 
   if (left)
-    node->margin[ST_SIDE_LEFT] = value;
+    node->style->margin[ST_SIDE_LEFT] = value;
   if (right)
-    node->margin[ST_SIDE_RIGHT] = value;
+    node->style->margin[ST_SIDE_RIGHT] = value;
   if (top)
-    node->margin[ST_SIDE_TOP] = value;
+    node->style->margin[ST_SIDE_TOP] = value;
   if (bottom)
-    node->margin[ST_SIDE_BOTTOM] = value;
+    node->style->margin[ST_SIDE_BOTTOM] = value;
 }
 
 static void
@@ -2005,105 +2445,104 @@ do_size_property (StThemeNode   *node,
     get_length_from_term_int (node, term, FALSE, node_value);
 }
 
-void
-_st_theme_node_ensure_geometry (StThemeNode *node)
+static void
+init_geometry (StThemeNode *node)
 {
-  int i, j;
-  int width, height;
-
-  if (node->geometry_computed)
-    return;
-
-  node->geometry_computed = TRUE;
-
-  ensure_properties (node);
+  int j;
 
   for (j = 0; j < 4; j++)
     {
-      node->border_width[j] = 0;
-      node->border_color[j] = TRANSPARENT_COLOR;
+      node->style->border_width[j] = 0;
+      node->style->border_color[j] = TRANSPARENT_COLOR;
     }
 
-  node->outline_width = 0;
-  node->outline_color = TRANSPARENT_COLOR;
+  node->style->outline_width = 0;
+  node->style->outline_color = TRANSPARENT_COLOR;
 
-  width = -1;
-  height = -1;
-  node->width = -1;
-  node->height = -1;
-  node->min_width = -1;
-  node->min_height = -1;
-  node->max_width = -1;
-  node->max_height = -1;
+  node->style->width = -1;
+  node->style->height = -1;
+  node->style->min_width = -1;
+  node->style->min_height = -1;
+  node->style->max_width = -1;
+  node->style->max_height = -1;
+}
 
-  for (i = 0; i < node->n_properties; i++)
-    {
-      CRDeclaration *decl = node->properties[i];
-      const char *property_name = decl->property->stryng->str;
-
-      if (g_str_has_prefix (property_name, "border"))
-        do_border_property (node, decl);
-      else if (g_str_has_prefix (property_name, "outline"))
-        do_outline_property (node, decl);
-      else if (g_str_has_prefix (property_name, "padding"))
-        do_padding_property (node, decl);
-      else if (g_str_has_prefix (property_name, "margin"))
-        do_margin_property (node, decl);
-      else if (strcmp (property_name, "width") == 0)
-        do_size_property (node, decl, &width);
-      else if (strcmp (property_name, "height") == 0)
-        do_size_property (node, decl, &height);
-      else if (strcmp (property_name, "-st-natural-width") == 0)
-        do_size_property (node, decl, &node->width);
-      else if (strcmp (property_name, "-st-natural-height") == 0)
-        do_size_property (node, decl, &node->height);
-      else if (strcmp (property_name, "min-width") == 0)
-        do_size_property (node, decl, &node->min_width);
-      else if (strcmp (property_name, "min-height") == 0)
-        do_size_property (node, decl, &node->min_height);
-      else if (strcmp (property_name, "max-width") == 0)
-        do_size_property (node, decl, &node->max_width);
-      else if (strcmp (property_name, "max-height") == 0)
-        do_size_property (node, decl, &node->max_height);
-    }
+static void
+do_geometry_property (StThemeNode   *node,
+                      CRDeclaration *decl,
+                      int           *width,
+                      int           *height)
+{
+  const char *property_name = decl->property->stryng->str;
+
+  if (g_str_has_prefix (property_name, "border"))
+    do_border_property (node, decl);
+  else if (g_str_has_prefix (property_name, "outline"))
+    do_outline_property (node, decl);
+  else if (g_str_has_prefix (property_name, "padding"))
+    do_padding_property (node, decl);
+  else if (g_str_has_prefix (property_name, "margin"))
+    do_margin_property (node, decl);
+  else if (strcmp (property_name, "width") == 0)
+    do_size_property (node, decl, width);
+  else if (strcmp (property_name, "height") == 0)
+    do_size_property (node, decl, height);
+  else if (strcmp (property_name, "-st-natural-width") == 0)
+    do_size_property (node, decl, &node->style->width);
+  else if (strcmp (property_name, "-st-natural-height") == 0)
+    do_size_property (node, decl, &node->style->height);
+  else if (strcmp (property_name, "min-width") == 0)
+    do_size_property (node, decl, &node->style->min_width);
+  else if (strcmp (property_name, "min-height") == 0)
+    do_size_property (node, decl, &node->style->min_height);
+  else if (strcmp (property_name, "max-width") == 0)
+    do_size_property (node, decl, &node->style->max_width);
+  else if (strcmp (property_name, "max-height") == 0)
+    do_size_property (node, decl, &node->style->max_height);
+}
 
+static void
+finish_geometry (StThemeNode *node,
+                 int          width,
+                 int          height)
+{
   /*
    * Setting width sets max-width, min-width and -st-natural-width,
    * unless one of them is set individually.
    * Setting min-width sets natural width too, so that the minimum
    * width reported by get_preferred_width() is always not greater
    * than the natural width.
-   * The natural width in node->width is actually a lower bound, the
+   * The natural width in node->style->width is actually a lower bound, the
    * actor is allowed to request something greater than that, but
    * not greater than max-width.
-   * We don't need to clamp node->width to be less than max_width,
+   * We don't need to clamp node->style->width to be less than max_width,
    * that's done by adjust_preferred_width.
    */
   if (width != -1)
     {
-      if (node->width == -1)
-        node->width = width;
-      if (node->min_width == -1)
-        node->min_width = width;
-      if (node->max_width == -1)
-        node->max_width = width;
+      if (node->style->width == -1)
+        node->style->width = width;
+      if (node->style->min_width == -1)
+        node->style->min_width = width;
+      if (node->style->max_width == -1)
+        node->style->max_width = width;
     }
 
-  if (node->width < node->min_width)
-    node->width = node->min_width;
+  if (node->style->width < node->style->min_width)
+    node->style->width = node->style->min_width;
 
   if (height != -1)
     {
-      if (node->height == -1)
-        node->height = height;
-      if (node->min_height == -1)
-        node->min_height = height;
-      if (node->max_height == -1)
-        node->max_height = height;
+      if (node->style->height == -1)
+        node->style->height = height;
+      if (node->style->min_height == -1)
+        node->style->min_height = height;
+      if (node->style->max_height == -1)
+        node->style->max_height = height;
     }
 
-  if (node->height < node->min_height)
-    node->height = node->min_height;
+  if (node->style->height < node->style->min_height)
+    node->style->height = node->style->min_height;
 }
 
 /**
@@ -2124,7 +2563,7 @@ st_theme_node_get_border_width (StThemeNode *node,
 
   _st_theme_node_ensure_geometry (node);
 
-  return node->border_width[side];
+  return node->style->border_width[side];
 }
 
 /**
@@ -2145,7 +2584,7 @@ st_theme_node_get_border_radius (StThemeNode *node,
 
   _st_theme_node_ensure_geometry (node);
 
-  return node->border_radius[corner];
+  return node->style->border_radius[corner];
 }
 
 /**
@@ -2163,7 +2602,7 @@ st_theme_node_get_outline_width (StThemeNode  *node)
 
   _st_theme_node_ensure_geometry (node);
 
-  return node->outline_width;
+  return node->style->outline_width;
 }
 
 /**
@@ -2181,7 +2620,7 @@ st_theme_node_get_outline_color (StThemeNode *node,
 
   _st_theme_node_ensure_geometry (node);
 
-  *color = node->outline_color;
+  *color = node->style->outline_color;
 }
 
 /**
@@ -2198,7 +2637,7 @@ st_theme_node_get_width (StThemeNode *node)
   g_return_val_if_fail (ST_IS_THEME_NODE (node), -1);
 
   _st_theme_node_ensure_geometry (node);
-  return node->width;
+  return node->style->width;
 }
 
 /**
@@ -2215,7 +2654,7 @@ st_theme_node_get_height (StThemeNode *node)
   g_return_val_if_fail (ST_IS_THEME_NODE (node), -1);
 
   _st_theme_node_ensure_geometry (node);
-  return node->height;
+  return node->style->height;
 }
 
 /**
@@ -2232,7 +2671,7 @@ st_theme_node_get_min_width (StThemeNode *node)
   g_return_val_if_fail (ST_IS_THEME_NODE (node), -1);
 
   _st_theme_node_ensure_geometry (node);
-  return node->min_width;
+  return node->style->min_width;
 }
 
 /**
@@ -2249,7 +2688,7 @@ st_theme_node_get_min_height (StThemeNode *node)
   g_return_val_if_fail (ST_IS_THEME_NODE (node), -1);
 
   _st_theme_node_ensure_geometry (node);
-  return node->min_height;
+  return node->style->min_height;
 }
 
 /**
@@ -2266,7 +2705,7 @@ st_theme_node_get_max_width (StThemeNode *node)
   g_return_val_if_fail (ST_IS_THEME_NODE (node), -1);
 
   _st_theme_node_ensure_geometry (node);
-  return node->max_width;
+  return node->style->max_width;
 }
 
 /**
@@ -2283,238 +2722,350 @@ st_theme_node_get_max_height (StThemeNode *node)
   g_return_val_if_fail (ST_IS_THEME_NODE (node), -1);
 
   _st_theme_node_ensure_geometry (node);
-  return node->max_height;
+  return node->style->max_height;
 }
 
-void
-_st_theme_node_ensure_background (StThemeNode *node)
+static void
+init_background (StThemeNode *node)
 {
-  int i;
-
-  if (node->background_computed)
-    return;
+  node->style->background_repeat = FALSE;
+  node->style->background_color = TRANSPARENT_COLOR;
+  node->style->background_gradient_type = ST_GRADIENT_NONE;
+  node->style->background_position_set = FALSE;
+  node->style->background_size = ST_BACKGROUND_SIZE_AUTO;
+}
 
-  node->background_repeat = FALSE;
-  node->background_computed = TRUE;
-  node->background_color = TRANSPARENT_COLOR;
-  node->background_gradient_type = ST_GRADIENT_NONE;
-  node->background_position_set = FALSE;
-  node->background_size = ST_BACKGROUND_SIZE_AUTO;
+static void
+do_background_property (StThemeNode   *node,
+                        CRDeclaration *decl)
+{
+  const char *property_name = decl->property->stryng->str;
 
-  ensure_properties (node);
+  if (g_str_has_prefix (property_name, "background"))
+    property_name += 10;
+  else
+    return;
 
-  for (i = 0; i < node->n_properties; i++)
+  if (strcmp (property_name, "") == 0)
     {
-      CRDeclaration *decl = node->properties[i];
-      const char *property_name = decl->property->stryng->str;
+      /* We're very liberal here ... if we recognize any term in the expression we take it, and
+       * we ignore the rest. The actual specification is:
+       *
+       * background: [<'background-color'> || <'background-image'> || <'background-repeat'> || <'background-attachment'> || <'background-position'>] | inherit
+       */
 
-      if (g_str_has_prefix (property_name, "background"))
-        property_name += 10;
-      else
-        continue;
+      CRTerm *term;
+      /* background: property sets all terms to specified or default values */
+      node->style->background_color = TRANSPARENT_COLOR;
+      g_clear_object (&node->style->background_image);
+      node->style->background_position_set = FALSE;
+      node->style->background_size = ST_BACKGROUND_SIZE_AUTO;
 
-      if (strcmp (property_name, "") == 0)
+      for (term = decl->value; term; term = term->next)
         {
-          /* We're very liberal here ... if we recognize any term in the expression we take it, and
-           * we ignore the rest. The actual specification is:
-           *
-           * background: [<'background-color'> || <'background-image'> || <'background-repeat'> || <'background-attachment'> || <'background-position'>] | inherit
-           */
-
-          CRTerm *term;
-          /* background: property sets all terms to specified or default values */
-          node->background_color = TRANSPARENT_COLOR;
-          g_clear_object (&node->background_image);
-          node->background_position_set = FALSE;
-          node->background_size = ST_BACKGROUND_SIZE_AUTO;
-
-          for (term = decl->value; term; term = term->next)
+          GetFromTermResult result = get_color_from_term (node, term, &node->style->background_color);
+          if (result == VALUE_FOUND)
             {
-              GetFromTermResult result = get_color_from_term (node, term, &node->background_color);
-              if (result == VALUE_FOUND)
-                {
-                  /* color stored in node->background_color */
-                }
-              else if (result == VALUE_INHERIT)
-                {
-                  if (node->parent_node)
-                    {
-                      st_theme_node_get_background_color (node->parent_node, &node->background_color);
-                      node->background_image = g_object_ref (st_theme_node_get_background_image (node->parent_node));
-                    }
-                }
-              else if (term_is_none (term))
+              /* color stored in node->style->background_color */
+            }
+          else if (result == VALUE_INHERIT)
+            {
+              if (node->parent_node)
                 {
-                  /* leave node->background_color as transparent */
+                  st_theme_node_get_background_color (node->parent_node, &node->style->background_color);
+                  node->style->background_image = g_object_ref (st_theme_node_get_background_image (node->parent_node));
                 }
-              else if (term->type == TERM_URI)
-                {
-                  CRStyleSheet *base_stylesheet;
-                  GFile *file;
+            }
+          else if (term_is_none (term))
+            {
+              /* leave node->style->background_color as transparent */
+            }
+          else if (term->type == TERM_URI)
+            {
+              CRStyleSheet *base_stylesheet;
+              GFile *file;
 
-                  if (decl->parent_statement != NULL)
-                    base_stylesheet = decl->parent_statement->parent_sheet;
-                  else
-                    base_stylesheet = NULL;
+              if (decl->parent_statement != NULL)
+                base_stylesheet = decl->parent_statement->parent_sheet;
+              else
+                base_stylesheet = NULL;
 
-                  file = _st_theme_resolve_url (node->theme,
-                                                base_stylesheet,
-                                                term->content.str->stryng->str);
+              file = _st_theme_resolve_url (node->theme,
+                                            base_stylesheet,
+                                            term->content.str->stryng->str);
 
-                  node->background_image = file;
-                }
+              node->style->background_image = file;
             }
         }
-      else if (strcmp (property_name, "-position") == 0)
+    }
+  else if (strcmp (property_name, "-position") == 0)
+    {
+      GetFromTermResult result = get_length_from_term_int (node, decl->value, FALSE, &node->style->background_position_x);
+      if (result == VALUE_NOT_FOUND)
         {
-          GetFromTermResult result = get_length_from_term_int (node, decl->value, FALSE, &node->background_position_x);
-          if (result == VALUE_NOT_FOUND)
-            {
-              node->background_position_set = FALSE;
-              continue;
-            }
-          else
-            node->background_position_set = TRUE;
+          node->style->background_position_set = FALSE;
+          return;
+        }
+      else
+        node->style->background_position_set = TRUE;
 
-          result = get_length_from_term_int (node, decl->value->next, FALSE, &node->background_position_y);
+      result = get_length_from_term_int (node, decl->value->next, FALSE, &node->style->background_position_y);
 
-          if (result == VALUE_NOT_FOUND)
-            {
-              node->background_position_set = FALSE;
-              continue;
-            }
-          else
-            node->background_position_set = TRUE;
+      if (result == VALUE_NOT_FOUND)
+        {
+          node->style->background_position_set = FALSE;
+          return;
         }
-      else if (strcmp (property_name, "-repeat") == 0)
+      else
+        node->style->background_position_set = TRUE;
+    }
+  else if (strcmp (property_name, "-repeat") == 0)
+    {
+      if (decl->value->type == TERM_IDENT)
         {
-          if (decl->value->type == TERM_IDENT)
-            {
-              if (strcmp (decl->value->content.str->stryng->str, "repeat") == 0)
-                node->background_repeat = TRUE;
-            }
+          if (strcmp (decl->value->content.str->stryng->str, "repeat") == 0)
+            node->style->background_repeat = TRUE;
         }
-      else if (strcmp (property_name, "-size") == 0)
+    }
+  else if (strcmp (property_name, "-size") == 0)
+    {
+      if (decl->value->type == TERM_IDENT)
         {
-          if (decl->value->type == TERM_IDENT)
+          if (strcmp (decl->value->content.str->stryng->str, "contain") == 0)
+            node->style->background_size = ST_BACKGROUND_SIZE_CONTAIN;
+          else if (strcmp (decl->value->content.str->stryng->str, "cover") == 0)
+            node->style->background_size = ST_BACKGROUND_SIZE_COVER;
+          else if ((strcmp (decl->value->content.str->stryng->str, "auto") == 0) && (decl->value->next) && (decl->value->next->type == TERM_NUMBER))
             {
-              if (strcmp (decl->value->content.str->stryng->str, "contain") == 0)
-                node->background_size = ST_BACKGROUND_SIZE_CONTAIN;
-              else if (strcmp (decl->value->content.str->stryng->str, "cover") == 0)
-                node->background_size = ST_BACKGROUND_SIZE_COVER;
-              else if ((strcmp (decl->value->content.str->stryng->str, "auto") == 0) && (decl->value->next) && (decl->value->next->type == TERM_NUMBER))
-                {
-                  GetFromTermResult result = get_length_from_term_int (node, decl->value->next, FALSE, &node->background_size_h);
+              GetFromTermResult result = get_length_from_term_int (node, decl->value->next, FALSE, &node->style->background_size_h);
 
-                  node->background_size_w = -1;
-                  node->background_size = (result == VALUE_FOUND) ? ST_BACKGROUND_SIZE_FIXED : ST_BACKGROUND_SIZE_AUTO;
-                }
-              else
-                node->background_size = ST_BACKGROUND_SIZE_AUTO;
+              node->style->background_size_w = -1;
+              node->style->background_size = (result == VALUE_FOUND) ? ST_BACKGROUND_SIZE_FIXED : ST_BACKGROUND_SIZE_AUTO;
             }
-          else if (decl->value->type == TERM_NUMBER)
-            {
-              GetFromTermResult result = get_length_from_term_int (node, decl->value, FALSE, &node->background_size_w);
-              if (result == VALUE_NOT_FOUND)
-                continue;
+          else
+            node->style->background_size = ST_BACKGROUND_SIZE_AUTO;
+        }
+      else if (decl->value->type == TERM_NUMBER)
+        {
+          GetFromTermResult result = get_length_from_term_int (node, decl->value, FALSE, &node->style->background_size_w);
+          if (result == VALUE_NOT_FOUND)
+            return;
 
-              node->background_size = ST_BACKGROUND_SIZE_FIXED;
+          node->style->background_size = ST_BACKGROUND_SIZE_FIXED;
 
-              if ((decl->value->next) && (decl->value->next->type == TERM_NUMBER))
-                {
-                  result = get_length_from_term_int (node, decl->value->next, FALSE, &node->background_size_h);
+          if ((decl->value->next) && (decl->value->next->type == TERM_NUMBER))
+            {
+              result = get_length_from_term_int (node, decl->value->next, FALSE, &node->style->background_size_h);
 
-                  if (result == VALUE_FOUND)
-                    continue;
-                }
-              node->background_size_h = -1;
+              if (result == VALUE_FOUND)
+                return;
             }
-          else
-            node->background_size = ST_BACKGROUND_SIZE_AUTO;
+          node->style->background_size_h = -1;
+        }
+      else
+        node->style->background_size = ST_BACKGROUND_SIZE_AUTO;
+    }
+  else if (strcmp (property_name, "-color") == 0)
+    {
+      GetFromTermResult result;
+
+      if (decl->value == NULL || decl->value->next != NULL)
+        return;
+
+      result = get_color_from_term (node, decl->value, &node->style->background_color);
+      if (result == VALUE_FOUND)
+        {
+          /* color stored in node->style->background_color */
         }
-      else if (strcmp (property_name, "-color") == 0)
+      else if (result == VALUE_INHERIT)
         {
-          GetFromTermResult result;
+          if (node->parent_node)
+            st_theme_node_get_background_color (node->parent_node, &node->style->background_color);
+        }
+    }
+  else if (strcmp (property_name, "-image") == 0)
+    {
+      if (decl->value == NULL || decl->value->next != NULL)
+        return;
 
-          if (decl->value == NULL || decl->value->next != NULL)
-            continue;
+      if (decl->value->type == TERM_URI)
+        {
+          CRStyleSheet *base_stylesheet;
 
-          result = get_color_from_term (node, decl->value, &node->background_color);
-          if (result == VALUE_FOUND)
-            {
-              /* color stored in node->background_color */
-            }
-          else if (result == VALUE_INHERIT)
-            {
-              if (node->parent_node)
-                st_theme_node_get_background_color (node->parent_node, &node->background_color);
-            }
+          if (decl->parent_statement != NULL)
+            base_stylesheet = decl->parent_statement->parent_sheet;
+          else
+            base_stylesheet = NULL;
+
+          g_clear_object (&node->style->background_image);
+          node->style->background_image = _st_theme_resolve_url (node->theme,
+                                                          base_stylesheet,
+                                                          decl->value->content.str->stryng->str);
         }
-      else if (strcmp (property_name, "-image") == 0)
+      else if (term_is_inherit (decl->value))
         {
-          if (decl->value == NULL || decl->value->next != NULL)
-            continue;
+          g_clear_object (&node->style->background_image);
+          node->style->background_image = g_object_ref (st_theme_node_get_background_image (node->parent_node));
+        }
+      else if (term_is_none (decl->value))
+        {
+          g_clear_object (&node->style->background_image);
+        }
+    }
+  else if (strcmp (property_name, "-gradient-direction") == 0)
+    {
+      CRTerm *term = decl->value;
+      if (strcmp (term->content.str->stryng->str, "vertical") == 0)
+        {
+          node->style->background_gradient_type = ST_GRADIENT_VERTICAL;
+        }
+      else if (strcmp (term->content.str->stryng->str, "horizontal") == 0)
+        {
+          node->style->background_gradient_type = ST_GRADIENT_HORIZONTAL;
+        }
+      else if (strcmp (term->content.str->stryng->str, "radial") == 0)
+        {
+          node->style->background_gradient_type = ST_GRADIENT_RADIAL;
+        }
+      else if (strcmp (term->content.str->stryng->str, "none") == 0)
+        {
+          node->style->background_gradient_type = ST_GRADIENT_NONE;
+        }
+      else
+        {
+          g_warning ("Unrecognized background-gradient-direction \"%s\"",
+                     term->content.str->stryng->str);
+        }
+    }
+  else if (strcmp (property_name, "-gradient-start") == 0)
+    {
+      get_color_from_term (node, decl->value, &node->style->background_color);
+    }
+  else if (strcmp (property_name, "-gradient-end") == 0)
+    {
+      get_color_from_term (node, decl->value, &node->style->background_gradient_end);
+    }
+}
+
+/* Bytes of a StThemeNodeStyle before background_image */
+#define STYLE_VALUES_SIZE \
+  (G_STRUCT_OFFSET (StThemeNodeStyle, background_repeat) + sizeof (gboolean))
+
+static guint
+style_hash (gconstpointer key)
+{
+  const StThemeNodeStyle *style = key;
+  const guint8 *bytes = key;
+  guint hash = 5381;
+  gsize i;
+
+  for (i = 0; i < STYLE_VALUES_SIZE; i++)
+    hash = (hash << 5) + hash + bytes[i];
+
+  if (style->background_image != NULL)
+    hash ^= g_file_hash (style->background_image);
+
+  return hash;
+}
+
+static gboolean
+style_equal (gconstpointer a,
+             gconstpointer b)
+{
+  const StThemeNodeStyle *style_a = a;
+  const StThemeNodeStyle *style_b = b;
+
+  if (memcmp (style_a, style_b, STYLE_VALUES_SIZE) != 0)
+    return FALSE;
+
+  if (style_a->background_image == NULL || style_b->background_image == NULL)
+    return style_a->background_image == style_b->background_image;
+
+  return g_file_equal (style_a->background_image, style_b->background_image);
+}
+
+static void
+style_clear (gpointer data)
+{
+  StThemeNodeStyle *style = data;
+  gpointer interned;
+
+  /* A style that turned out to be a duplicate was never added */
+  if (g_hash_table_lookup_extended (computed_styles, style, &interned, NULL) &&
+      interned == style)
+    g_hash_table_remove (computed_styles, style);
+
+  g_clear_object (&style->background_image);
+}
+
+/* Geometry and background are needed for nearly every node that gets
+ * painted, so resolve both in a single pass over the declarations into
+ * a StThemeNodeStyle. Many nodes that differ in other ways (the items
+ * of a menu, the icons of a grid) end up with the same values, so the
+ * result is looked up in computed_styles and shared, leaving a single
+ * pointer in each node.
+ *
+ * The other computed values (foreground, shadows, border image, icon
+ * colors) stay out of the style: each depends on one or a few
+ * properties, which last_declaration() finds without a scan, and the
+ * foreground is inherited, so folding them in would make nodes that
+ * never need them pay for them.
+ */
+static void
+ensure_geometry_and_background (StThemeNode *node)
+{
+  StThemeNodeStyle *style, *interned;
+  int width = -1;
+  int height = -1;
+  int i;
+
+  if (node->style_computed)
+    return;
+
+  node->style_computed = TRUE;
+
+  ensure_properties (node);
+
+  style = g_rc_box_new0 (StThemeNodeStyle);
+  node->style = style;
+
+  init_geometry (node);
+  init_background (node);
+
+  for (i = 0; i < node->n_properties; i++)
+    {
+      CRDeclaration *decl = node->properties[i];
 
-          if (decl->value->type == TERM_URI)
-            {
-              CRStyleSheet *base_stylesheet;
+      do_geometry_property (node, decl, &width, &height);
+      do_background_property (node, decl);
+    }
 
-              if (decl->parent_statement != NULL)
-                base_stylesheet = decl->parent_statement->parent_sheet;
-              else
-                base_stylesheet = NULL;
+  finish_geometry (node, width, height);
 
-              g_clear_object (&node->background_image);
-              node->background_image = _st_theme_resolve_url (node->theme,
-                                                              base_stylesheet,
-                                                              decl->value->content.str->stryng->str);
-            }
-          else if (term_is_inherit (decl->value))
-            {
-              g_clear_object (&node->background_image);
-              node->background_image = g_object_ref (st_theme_node_get_background_image (node->parent_node));
-            }
-          else if (term_is_none (decl->value))
-            {
-              g_clear_object (&node->background_image);
-            }
-        }
-      else if (strcmp (property_name, "-gradient-direction") == 0)
-        {
-          CRTerm *term = decl->value;
-          if (strcmp (term->content.str->stryng->str, "vertical") == 0)
-            {
-              node->background_gradient_type = ST_GRADIENT_VERTICAL;
-            }
-          else if (strcmp (term->content.str->stryng->str, "horizontal") == 0)
-            {
-              node->background_gradient_type = ST_GRADIENT_HORIZONTAL;
-            }
-          else if (strcmp (term->content.str->stryng->str, "radial") == 0)
-            {
-              node->background_gradient_type = ST_GRADIENT_RADIAL;
-            }
-          else if (strcmp (term->content.str->stryng->str, "none") == 0)
-            {
-              node->background_gradient_type = ST_GRADIENT_NONE;
-            }
-          else
-            {
-              g_warning ("Unrecognized background-gradient-direction \"%s\"",
-                         term->content.str->stryng->str);
-            }
-        }
-      else if (strcmp (property_name, "-gradient-start") == 0)
-        {
-          get_color_from_term (node, decl->value, &node->background_color);
-        }
-      else if (strcmp (property_name, "-gradient-end") == 0)
-        {
-          get_color_from_term (node, decl->value, &node->background_gradient_end);
-        }
+  interned = g_hash_table_lookup (computed_styles, style);
+  if (interned != NULL)
+    {
+      node->style = g_rc_box_acquire (interned);
+      g_rc_box_release_full (style, style_clear);
+    }
+  else
+    {
+      g_hash_table_add (computed_styles, style);
     }
 }
 
+void
+_st_theme_node_ensure_geometry (StThemeNode *node)
+{
+  ensure_geometry_and_background (node);
+}
+
+void
+_st_theme_node_ensure_background (StThemeNode *node)
+{
+  ensure_geometry_and_background (node);
+}
+
 /**
  * st_theme_node_get_background_color:
  * @node: a #StThemeNode
@@ -2530,7 +3081,7 @@ st_theme_node_get_background_color (StThemeNode *node,
 
   _st_theme_node_ensure_background (node);
 
-  *color = node->background_color;
+  *color = node->style->background_color;
 }
 
 /**
@@ -2546,7 +3097,7 @@ st_theme_node_get_background_image (StThemeNode *node)
 
   _st_theme_node_ensure_background (node);
 
-  return node->background_image;
+  return node->style->background_image;
 }
 
 /**
@@ -2570,24 +3121,23 @@ st_theme_node_get_foreground_color (StThemeNode  *node,
 
       ensure_properties (node);
 
-      for (i = node->n_properties - 1; i >= 0; i--)
+      for (i = last_declaration (node, color_quark); i >= 0; i = previous_declaration (node, i))
         {
           CRDeclaration *decl = node->properties[i];
+          GetFromTermResult result = get_color_from_term (node, decl->value, &node->foreground_color);
 
-          if (strcmp (decl->property->stryng->str, "color") == 0)
-            {
-              GetFromTermResult result = get_color_from_term (node, decl->value, &node->foreground_color);
-              if (result == VALUE_FOUND)
-                goto out;
-              else if (result == VALUE_INHERIT)
-                break;
-            }
+          if (result == VALUE_FOUND)
+            goto out;
+          else if (result == VALUE_INHERIT)
+            break;
         }
 
       if (node->parent_node)
         st_theme_node_get_foreground_color (node->parent_node, &node->foreground_color);
       else
-        node->foreground_color = BLACK_COLOR; /* default to black */
+        {
+          node->foreground_color = BLACK_COLOR; /* default to black */
+        }
     }
 
  out:
@@ -2614,11 +3164,11 @@ st_theme_node_get_background_gradient (StThemeNode    *node,
 
   _st_theme_node_ensure_background (node);
 
-  *type = node->background_gradient_type;
+  *type = node->style->background_gradient_type;
   if (*type != ST_GRADIENT_NONE)
     {
-      *start = node->background_color;
-      *end = node->background_gradient_end;
+      *start = node->style->background_color;
+      *end = node->style->background_gradient_end;
     }
 }
 
@@ -2640,7 +3190,7 @@ st_theme_node_get_border_color (StThemeNode  *node,
 
   _st_theme_node_ensure_geometry (node);
 
-  *color = node->border_color[side];
+  *color = node->style->border_color[side];
 }
 
 /**
@@ -2662,7 +3212,7 @@ st_theme_node_get_padding (StThemeNode *node,
 
   _st_theme_node_ensure_geometry (node);
 
-  return node->padding[side];
+  return node->style->padding[side];
 }
 
 /**
@@ -2684,7 +3234,7 @@ st_theme_node_get_margin (StThemeNode *node,
 
   _st_theme_node_ensure_geometry (node);
 
-  return node->margin[side];
+  return node->style->margin[side];
 }
 
 /**
@@ -2737,29 +3287,25 @@ st_theme_node_get_icon_style (StThemeNode *node)
 
   ensure_properties (node);
 
-  for (i = node->n_properties - 1; i >= 0; i--)
+  for (i = last_declaration (node, icon_style_quark); i >= 0; i = previous_declaration (node, i))
     {
       CRDeclaration *decl = node->properties[i];
+      CRTerm *term;
 
-      if (strcmp (decl->property->stryng->str, "-st-icon-style") == 0)
+      for (term = decl->value; term; term = term->next)
         {
-          CRTerm *term;
-
-          for (term = decl->value; term; term = term->next)
-            {
-              if (term->type != TERM_IDENT)
-                goto next_decl;
-
-              if (strcmp (term->content.str->stryng->str, "requested") == 0)
-                return ST_ICON_STYLE_REQUESTED;
-              else if (strcmp (term->content.str->stryng->str, "regular") == 0)
-                return ST_ICON_STYLE_REGULAR;
-              else if (strcmp (term->content.str->stryng->str, "symbolic") == 0)
-                return ST_ICON_STYLE_SYMBOLIC;
-              else
-                g_warning ("Unknown -st-icon-style \"%s\"",
-                           term->content.str->stryng->str);
-            }
+          if (term->type != TERM_IDENT)
+            goto next_decl;
+
+          if (strcmp (term->content.str->stryng->str, "requested") == 0)
+            return ST_ICON_STYLE_REQUESTED;
+          else if (strcmp (term->content.str->stryng->str, "regular") == 0)
+            return ST_ICON_STYLE_REGULAR;
+          else if (strcmp (term->content.str->stryng->str, "symbolic") == 0)
+            return ST_ICON_STYLE_SYMBOLIC;
+          else
+            g_warning ("Unknown -st-icon-style \"%s\"",
+                       term->content.str->stryng->str);
         }
 
     next_decl:
@@ -2789,59 +3335,55 @@ st_theme_node_get_text_decoration (StThemeNode *node)
 
   ensure_properties (node);
 
-  for (i = node->n_properties - 1; i >= 0; i--)
+  for (i = last_declaration (node, text_decoration_quark); i >= 0; i = previous_declaration (node, i))
     {
       CRDeclaration *decl = node->properties[i];
+      CRTerm *term = decl->value;
+      StTextDecoration decoration = 0;
 
-      if (strcmp (decl->property->stryng->str, "text-decoration") == 0)
+      /* Specification is none | [ underline || overline || line-through || blink ] | inherit
+       *
+       * We're a bit more liberal, and for example treat 'underline none' as the same as
+       * none.
+       */
+      for (; term; term = term->next)
         {
-          CRTerm *term = decl->value;
-          StTextDecoration decoration = 0;
+          if (term->type != TERM_IDENT)
+            goto next_decl;
 
-          /* Specification is none | [ underline || overline || line-through || blink ] | inherit
-           *
-           * We're a bit more liberal, and for example treat 'underline none' as the same as
-           * none.
-           */
-          for (; term; term = term->next)
+          if (strcmp (term->content.str->stryng->str, "none") == 0)
             {
-              if (term->type != TERM_IDENT)
-                goto next_decl;
-
-              if (strcmp (term->content.str->stryng->str, "none") == 0)
-                {
-                  return 0;
-                }
-              else if (strcmp (term->content.str->stryng->str, "inherit") == 0)
-                {
-                  if (node->parent_node)
-                    return st_theme_node_get_text_decoration (node->parent_node);
-                }
-              else if (strcmp (term->content.str->stryng->str, "underline") == 0)
-                {
-                  decoration |= ST_TEXT_DECORATION_UNDERLINE;
-                }
-              else if (strcmp (term->content.str->stryng->str, "overline") == 0)
-                {
-                  decoration |= ST_TEXT_DECORATION_OVERLINE;
-                }
-              else if (strcmp (term->content.str->stryng->str, "line-through") == 0)
-                {
-                  decoration |= ST_TEXT_DECORATION_LINE_THROUGH;
-                }
-              else if (strcmp (term->content.str->stryng->str, "blink") == 0)
-                {
-                  decoration |= ST_TEXT_DECORATION_BLINK;
-                }
-              else
-                {
-                  goto next_decl;
-                }
+              return 0;
+            }
+          else if (strcmp (term->content.str->stryng->str, "inherit") == 0)
+            {
+              if (node->parent_node)
+                return st_theme_node_get_text_decoration (node->parent_node);
+            }
+          else if (strcmp (term->content.str->stryng->str, "underline") == 0)
+            {
+              decoration |= ST_TEXT_DECORATION_UNDERLINE;
+            }
+          else if (strcmp (term->content.str->stryng->str, "overline") == 0)
+            {
+              decoration |= ST_TEXT_DECORATION_OVERLINE;
+            }
+          else if (strcmp (term->content.str->stryng->str, "line-through") == 0)
+            {
+              decoration |= ST_TEXT_DECORATION_LINE_THROUGH;
+            }
+          else if (strcmp (term->content.str->stryng->str, "blink") == 0)
+            {
+              decoration |= ST_TEXT_DECORATION_BLINK;
+            }
+          else
+            {
+              goto next_decl;
             }
-
-          return decoration;
         }
 
+      return decoration;
+
     next_decl:
       ;
     }
@@ -2866,43 +3408,39 @@ st_theme_node_get_text_align(StThemeNode *node)
 
   ensure_properties(node);
 
-  for (i = node->n_properties - 1; i >= 0; i--)
+  for (i = last_declaration (node, text_align_quark); i >= 0; i = previous_declaration (node, i))
     {
       CRDeclaration *decl = node->properties[i];
+      CRTerm *term = decl->value;
 
-      if (strcmp(decl->property->stryng->str, "text-align") == 0)
-        {
-          CRTerm *term = decl->value;
-
-          if (term->type != TERM_IDENT || term->next)
-            continue;
+      if (term->type != TERM_IDENT || term->next)
+        continue;
 
-          if (strcmp(term->content.str->stryng->str, "inherit") == 0)
-            {
-              if (node->parent_node)
-                return st_theme_node_get_text_align(node->parent_node);
-              return ST_TEXT_ALIGN_LEFT;
-            }
-          else if (strcmp(term->content.str->stryng->str, "left") == 0)
-            {
-              return ST_TEXT_ALIGN_LEFT;
-            }
-          else if (strcmp(term->content.str->stryng->str, "right") == 0)
-            {
-              return ST_TEXT_ALIGN_RIGHT;
-            }
-          else if (strcmp(term->content.str->stryng->str, "center") == 0)
-            {
-              return ST_TEXT_ALIGN_CENTER;
-            }
-          else if (strcmp(term->content.str->stryng->str, "justify") == 0)
-            {
-              return ST_TEXT_ALIGN_JUSTIFY;
-            }
+      if (strcmp(term->content.str->stryng->str, "inherit") == 0)
+        {
+          if (node->parent_node)
+            return st_theme_node_get_text_align(node->parent_node);
+          return ST_TEXT_ALIGN_LEFT;
+        }
+      else if (strcmp(term->content.str->stryng->str, "left") == 0)
+        {
+          return ST_TEXT_ALIGN_LEFT;
+        }
+      else if (strcmp(term->content.str->stryng->str, "right") == 0)
+        {
+          return ST_TEXT_ALIGN_RIGHT;
+        }
+      else if (strcmp(term->content.str->stryng->str, "center") == 0)
+        {
+          return ST_TEXT_ALIGN_CENTER;
+        }
+      else if (strcmp(term->content.str->stryng->str, "justify") == 0)
+        {
+          return ST_TEXT_ALIGN_JUSTIFY;
         }
     }
-  if(node->parent_node)
-    return st_theme_node_get_text_align(node->parent_node);
+  if (node->parent_node)
+    return st_theme_node_get_text_align (node->parent_node);
 
   if (clutter_get_default_text_direction () == CLUTTER_TEXT_DIRECTION_RTL)
     return ST_TEXT_ALIGN_RIGHT;
@@ -3410,27 +3948,23 @@ st_theme_node_get_font_features (StThemeNode *node)
 
   ensure_properties (node);
 
-  for (i = node->n_properties - 1; i >= 0; i--)
+  for (i = last_declaration (node, font_feature_settings_quark); i >= 0; i = previous_declaration (node, i))
     {
       CRDeclaration *decl = node->properties[i];
+      CRTerm *term = decl->value;
 
-      if (strcmp (decl->property->stryng->str, "font-feature-settings") == 0)
+      if (!term->next && term->type == TERM_IDENT)
         {
-          CRTerm *term = decl->value;
-
-          if (!term->next && term->type == TERM_IDENT)
-            {
-              gchar *ident = term->content.str->stryng->str;
+          gchar *ident = term->content.str->stryng->str;
 
-              if (strcmp (ident, "inherit") == 0)
-                break;
-
-              if (strcmp (ident, "normal") == 0)
-                return NULL;
-            }
+          if (strcmp (ident, "inherit") == 0)
+            break;
 
-          return (gchar *)cr_term_to_string (term);
+          if (strcmp (ident, "normal") == 0)
+            return NULL;
         }
+
+      return (gchar *)cr_term_to_string (term);
     }
 
   return node->parent_node ? st_theme_node_get_font_features (node->parent_node) : NULL;
@@ -3460,115 +3994,111 @@ st_theme_node_get_border_image (StThemeNode *node)
 
   ensure_properties (node);
 
-  for (i = node->n_properties - 1; i >= 0; i--)
+  for (i = last_declaration (node, border_image_quark); i >= 0; i = previous_declaration (node, i))
     {
       CRDeclaration *decl = node->properties[i];
-
-      if (strcmp (decl->property->stryng->str, "border-image") == 0)
+      CRTerm *term = decl->value;
+      CRStyleSheet *base_stylesheet;
+      int borders[4];
+      int n_borders = 0;
+      int j;
+
+      const char *url;
+      int border_top;
+      int border_right;
+      int border_bottom;
+      int border_left;
+
+      GFile *file;
+
+      /* Support border-image: none; to suppress a previously specified border image */
+      if (term_is_none (term))
         {
-          CRTerm *term = decl->value;
-          CRStyleSheet *base_stylesheet;
-          int borders[4];
-          int n_borders = 0;
-          int j;
-
-          const char *url;
-          int border_top;
-          int border_right;
-          int border_bottom;
-          int border_left;
-
-          GFile *file;
-
-          /* Support border-image: none; to suppress a previously specified border image */
-          if (term_is_none (term))
-            {
-              if (term->next == NULL)
-                return NULL;
-              else
-                goto next_property;
-            }
-
-          /* First term must be the URL to the image */
-          if (term->type != TERM_URI)
+          if (term->next == NULL)
+            return NULL;
+          else
             goto next_property;
+        }
 
-          url = term->content.str->stryng->str;
+      /* First term must be the URL to the image */
+      if (term->type != TERM_URI)
+        goto next_property;
 
-          term = term->next;
+      url = term->content.str->stryng->str;
 
-          /* Followed by 0 to 4 numbers or percentages. *Not lengths*. The interpretation
-           * of a number is supposed to be pixels if the image is pixel based, otherwise CSS pixels.
-           */
-          for (j = 0; j < 4; j++)
-            {
-              if (term == NULL)
-                break;
+      term = term->next;
 
-              if (term->type != TERM_NUMBER)
-                goto next_property;
+      /* Followed by 0 to 4 numbers or percentages. *Not lengths*. The interpretation
+       * of a number is supposed to be pixels if the image is pixel based, otherwise CSS pixels.
+       */
+      for (j = 0; j < 4; j++)
+        {
+          if (term == NULL)
+            break;
 
-              if (term->content.num->type == NUM_GENERIC)
-                {
-                  borders[n_borders] = (int)(0.5 + term->content.num->val);
-                  n_borders++;
-                }
-              else if (term->content.num->type == NUM_PERCENTAGE)
-                {
-                  /* This would be easiest to support if we moved image handling into StBorderImage */
-                  g_warning ("Percentages not supported for border-image");
-                  goto next_property;
-                }
-              else
-                goto next_property;
+          if (term->type != TERM_NUMBER)
+            goto next_property;
 
-              term = term->next;
+          if (term->content.num->type == NUM_GENERIC)
+            {
+              borders[n_borders] = (int)(0.5 + term->content.num->val);
+              n_borders++;
             }
-
-          switch (n_borders)
+          else if (term->content.num->type == NUM_PERCENTAGE)
             {
-            case 0:
-              border_top = border_right = border_bottom = border_left = 0;
-              break;
-            case 1:
-              border_top = border_right = border_bottom = border_left = borders[0];
-              break;
-            case 2:
-              border_top = border_bottom = borders[0];
-              border_left = border_right = borders[1];
-              break;
-            case 3:
-              border_top = borders[0];
-              border_left = border_right = borders[1];
-              border_bottom = borders[2];
-              break;
-            case 4:
-            default:
-              border_top = borders[0];
-              border_right = borders[1];
-              border_bottom = borders[2];
-              border_left = borders[3];
-              break;
+              /* This would be easiest to support if we moved image handling into StBorderImage */
+              g_warning ("Percentages not supported for border-image");
+              goto next_property;
             }
-
-          if (decl->parent_statement != NULL)
-            base_stylesheet = decl->parent_statement->parent_sheet;
           else
-            base_stylesheet = NULL;
+            goto next_property;
 
-          file = _st_theme_resolve_url (node->theme, base_stylesheet, url);
+          term = term->next;
+        }
 
-          if (file == NULL)
-            goto next_property;
+      switch (n_borders)
+        {
+        case 0:
+          border_top = border_right = border_bottom = border_left = 0;
+          break;
+        case 1:
+          border_top = border_right = border_bottom = border_left = borders[0];
+          break;
+        case 2:
+          border_top = border_bottom = borders[0];
+          border_left = border_right = borders[1];
+          break;
+        case 3:
+          border_top = borders[0];
+          border_left = border_right = borders[1];
+          border_bottom = borders[2];
+          break;
+        case 4:
+        default:
+          border_top = borders[0];
+          border_right = borders[1];
+          border_bottom = borders[2];
+          border_left = borders[3];
+          break;
+        }
 
-          node->border_image = st_border_image_new (file,
-                                                    border_top, border_right, border_bottom, border_left,
-                                                    node->cached_scale_factor);
+      if (decl->parent_statement != NULL)
+        base_stylesheet = decl->parent_statement->parent_sheet;
+      else
+        base_stylesheet = NULL;
 
-          g_object_unref (file);
+      file = _st_theme_resolve_url (node->theme, base_stylesheet, url);
 
-          return node->border_image;
-        }
+      if (file == NULL)
+        goto next_property;
+
+      node->border_image = st_border_image_new (file,
+                                                border_top, border_right, border_bottom, border_left,
+                                                node->cached_scale_factor);
+
+      g_object_unref (file);
+
+      return node->border_image;
 
     next_property:
       ;
@@ -3749,6 +4279,68 @@ parse_shadow_property (StThemeNode       *node,
     return VALUE_NOT_FOUND;
 }
 
+static gboolean
+lookup_shadow (StThemeNode  *node,
+               GQuark        property,
+               gboolean      inherit,
+               StShadow    **shadow)
+{
+  CoglColor color = { 0., };
+  gdouble xoffset = 0.;
+  gdouble yoffset = 0.;
+  gdouble blur = 0.;
+  gdouble spread = 0.;
+  gboolean inset = FALSE;
+  gboolean is_none = FALSE;
+
+  int i;
+
+  ensure_properties (node);
+
+  for (i = last_declaration (node, property); i >= 0; i = previous_declaration (node, i))
+    {
+      CRDeclaration *decl = node->properties[i];
+      GetFromTermResult result = parse_shadow_property (node,
+                                                        decl,
+                                                        &color,
+                                                        &xoffset,
+                                                        &yoffset,
+                                                        &blur,
+                                                        &spread,
+                                                        &inset,
+                                                        &is_none);
+      if (result == VALUE_FOUND)
+        {
+          if (is_none)
+            return FALSE;
+
+          *shadow = st_shadow_new (&color,
+                                   xoffset, yoffset,
+                                   blur, spread,
+                                   inset);
+          return TRUE;
+        }
+      else if (result == VALUE_INHERIT)
+        {
+          if (node->parent_node)
+            return lookup_shadow (node->parent_node,
+                                  property,
+                                  inherit,
+                                  shadow);
+          else
+            break;
+        }
+    }
+
+    if (inherit && node->parent_node)
+      return lookup_shadow (node->parent_node,
+                            property,
+                            inherit,
+                            shadow);
+
+  return FALSE;
+}
+
 /**
  * st_theme_node_lookup_shadow:
  * @node: a #StThemeNode
@@ -3780,67 +4372,10 @@ st_theme_node_lookup_shadow (StThemeNode  *node,
                              gboolean      inherit,
                              StShadow    **shadow)
 {
-  CoglColor color = { 0., };
-  gdouble xoffset = 0.;
-  gdouble yoffset = 0.;
-  gdouble blur = 0.;
-  gdouble spread = 0.;
-  gboolean inset = FALSE;
-  gboolean is_none = FALSE;
-
-  int i;
-
   g_return_val_if_fail (ST_IS_THEME_NODE (node), FALSE);
   g_return_val_if_fail (property_name != NULL, FALSE);
 
-  ensure_properties (node);
-
-  for (i = node->n_properties - 1; i >= 0; i--)
-    {
-      CRDeclaration *decl = node->properties[i];
-
-      if (strcmp (decl->property->stryng->str, property_name) == 0)
-        {
-          GetFromTermResult result = parse_shadow_property (node,
-                                                            decl,
-                                                            &color,
-                                                            &xoffset,
-                                                            &yoffset,
-                                                            &blur,
-                                                            &spread,
-                                                            &inset,
-                                                            &is_none);
-          if (result == VALUE_FOUND)
-            {
-              if (is_none)
-                return FALSE;
-
-              *shadow = st_shadow_new (&color,
-                                       xoffset, yoffset,
-                                       blur, spread,
-                                       inset);
-              return TRUE;
-            }
-          else if (result == VALUE_INHERIT)
-            {
-              if (node->parent_node)
-                return st_theme_node_lookup_shadow (node->parent_node,
-                                                    property_name,
-                                                    inherit,
-                                                    shadow);
-              else
-                break;
-            }
-        }
-    }
-
-    if (inherit && node->parent_node)
-      return st_theme_node_lookup_shadow (node->parent_node,
-                                          property_name,
-                                          inherit,
-                                          shadow);
-
-  return FALSE;
+  return lookup_shadow (node, g_quark_try_string (property_name), inherit, shadow);
 }
 
 /**
@@ -4123,15 +4658,15 @@ st_theme_node_get_icon_colors (StThemeNode *node)
 static float
 get_width_inc (StThemeNode *node)
 {
-  return ((int)(0.5 + node->border_width[ST_SIDE_LEFT]) + node->padding[ST_SIDE_LEFT] +
-          (int)(0.5 + node->border_width[ST_SIDE_RIGHT]) + node->padding[ST_SIDE_RIGHT]);
+  return ((int)(0.5 + node->style->border_width[ST_SIDE_LEFT]) + node->style->padding[ST_SIDE_LEFT] +
+          (int)(0.5 + node->style->border_width[ST_SIDE_RIGHT]) + node->style->padding[ST_SIDE_RIGHT]);
 }
 
 static float
 get_height_inc (StThemeNode *node)
 {
-  return ((int)(0.5 + node->border_width[ST_SIDE_TOP]) + node->padding[ST_SIDE_TOP] +
-          (int)(0.5 + node->border_width[ST_SIDE_BOTTOM]) + node->padding[ST_SIDE_BOTTOM]);
+  return ((int)(0.5 + node->style->border_width[ST_SIDE_TOP]) + node->style->padding[ST_SIDE_TOP] +
+          (int)(0.5 + node->style->border_width[ST_SIDE_BOTTOM]) + node->style->padding[ST_SIDE_BOTTOM]);
 }
 
 /**
@@ -4186,17 +4721,17 @@ st_theme_node_adjust_preferred_width (StThemeNode  *node,
 
   if (min_width_p)
     {
-      if (node->min_width != -1)
-        *min_width_p = node->min_width;
+      if (node->style->min_width != -1)
+        *min_width_p = node->style->min_width;
       *min_width_p += width_inc;
     }
 
   if (natural_width_p)
     {
-      if (node->width != -1)
-        *natural_width_p = MAX (*natural_width_p, node->width);
-      if (node->max_width != -1)
-        *natural_width_p = MIN (*natural_width_p, node->max_width);
+      if (node->style->width != -1)
+        *natural_width_p = MAX (*natural_width_p, node->style->width);
+      if (node->style->max_width != -1)
+        *natural_width_p = MIN (*natural_width_p, node->style->max_width);
       *natural_width_p += width_inc;
     }
 }
@@ -4253,16 +4788,16 @@ st_theme_node_adjust_preferred_height (StThemeNode  *node,
 
   if (min_height_p)
     {
-      if (node->min_height != -1)
-        *min_height_p = node->min_height;
+      if (node->style->min_height != -1)
+        *min_height_p = node->style->min_height;
       *min_height_p += height_inc;
     }
   if (natural_height_p)
     {
-      if (node->height != -1)
-        *natural_height_p = MAX (*natural_height_p, node->height);
-      if (node->max_height != -1)
-        *natural_height_p = MIN (*natural_height_p, node->max_height);
+      if (node->style->height != -1)
+        *natural_height_p = MAX (*natural_height_p, node->style->height);
+      if (node->style->max_height != -1)
+        *natural_height_p = MIN (*natural_height_p, node->style->max_height);
       *natural_height_p += height_inc;
     }
 }
@@ -4293,10 +4828,10 @@ st_theme_node_get_content_box (StThemeNode           *node,
   avail_width = allocation->x2 - allocation->x1;
   avail_height = allocation->y2 - allocation->y1;
 
-  noncontent_left = node->border_width[ST_SIDE_LEFT] + node->padding[ST_SIDE_LEFT];
-  noncontent_top = node->border_width[ST_SIDE_TOP] + node->padding[ST_SIDE_TOP];
-  noncontent_right = node->border_width[ST_SIDE_RIGHT] + node->padding[ST_SIDE_RIGHT];
-  noncontent_bottom = node->border_width[ST_SIDE_BOTTOM] + node->padding[ST_SIDE_BOTTOM];
+  noncontent_left = node->style->border_width[ST_SIDE_LEFT] + node->style->padding[ST_SIDE_LEFT];
+  noncontent_top = node->style->border_width[ST_SIDE_TOP] + node->style->padding[ST_SIDE_TOP];
+  noncontent_right = node->style->border_width[ST_SIDE_RIGHT] + node->style->padding[ST_SIDE_RIGHT];
+  noncontent_bottom = node->style->border_width[ST_SIDE_BOTTOM] + node->style->padding[ST_SIDE_BOTTOM];
 
   content_box->x1 = (int)(0.5 + noncontent_left);
   content_box->y1 = (int)(0.5 + noncontent_top);
@@ -4426,19 +4961,22 @@ st_theme_node_geometry_equal (StThemeNode *node,
   _st_theme_node_ensure_geometry (node);
   _st_theme_node_ensure_geometry (other);
 
+  if (node->style == other->style)
+    return TRUE;
+
   for (side = ST_SIDE_TOP; side <= ST_SIDE_LEFT; side++)
     {
-      if (node->border_width[side] != other->border_width[side])
+      if (node->style->border_width[side] != other->style->border_width[side])
         return FALSE;
-      if (node->padding[side] != other->padding[side])
+      if (node->style->padding[side] != other->style->padding[side])
         return FALSE;
     }
 
-  if (node->width != other->width || node->height != other->height)
+  if (node->style->width != other->style->width || node->style->height != other->style->height)
     return FALSE;
-  if (node->min_width != other->min_width || node->min_height != other->min_height)
+  if (node->style->min_width != other->style->min_width || node->style->min_height != other->style->min_height)
     return FALSE;
-  if (node->max_width != other->max_width || node->max_height != other->max_height)
+  if (node->style->max_width != other->style->max_width || node->style->max_height != other->style->max_height)
     return FALSE;
 
   return TRUE;
@@ -4474,19 +5012,19 @@ st_theme_node_paint_equal (StThemeNode *node,
   _st_theme_node_ensure_background (node);
   _st_theme_node_ensure_background (other);
 
-  if (!cogl_color_equal (&node->background_color, &other->background_color))
+  if (!cogl_color_equal (&node->style->background_color, &other->style->background_color))
     return FALSE;
 
-  if (node->background_gradient_type != other->background_gradient_type)
+  if (node->style->background_gradient_type != other->style->background_gradient_type)
     return FALSE;
 
-  if (node->background_gradient_type != ST_GRADIENT_NONE &&
-      !cogl_color_equal (&node->background_gradient_end, &other->background_gradient_end))
+  if (node->style->background_gradient_type != ST_GRADIENT_NONE &&
+      !cogl_color_equal (&node->style->background_gradient_end, &other->style->background_gradient_end))
     return FALSE;
 
-  if ((node->background_image != NULL) &&
-      (other->background_image != NULL) &&
-      !g_file_equal (node->background_image, other->background_image))
+  if ((node->style->background_image != NULL) &&
+      (other->style->background_image != NULL) &&
+      !g_file_equal (node->style->background_image, other->style->background_image))
     return FALSE;
 
   _st_theme_node_ensure_geometry (node);
@@ -4494,22 +5032,22 @@ st_theme_node_paint_equal (StThemeNode *node,
 
   for (i = 0; i < 4; i++)
     {
-      if (node->border_width[i] != other->border_width[i])
+      if (node->style->border_width[i] != other->style->border_width[i])
         return FALSE;
 
-      if (node->border_width[i] > 0 &&
-          !cogl_color_equal (&node->border_color[i], &other->border_color[i]))
+      if (node->style->border_width[i] > 0 &&
+          !cogl_color_equal (&node->style->border_color[i], &other->style->border_color[i]))
         return FALSE;
 
-      if (node->border_radius[i] != other->border_radius[i])
+      if (node->style->border_radius[i] != other->style->border_radius[i])
         return FALSE;
     }
 
-  if (node->outline_width != other->outline_width)
+  if (node->style->outline_width != other->style->outline_width)
     return FALSE;
 
-  if (node->outline_width > 0 &&
-      !cogl_color_equal (&node->outline_color, &other->outline_color))
+  if (node->style->outline_width > 0 &&
+      !cogl_color_equal (&node->style->outline_color, &other->style->outline_color))
     return FALSE;
 
   border_image = st_theme_node_get_border_image (node);
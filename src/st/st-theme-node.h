@@ -159,6 +159,7 @@ typedef enum {
 } StIconStyle;
 
 typedef struct _StThemeNodePaintState StThemeNodePaintState;
+typedef struct _StThemeNodePrerender StThemeNodePrerender;
 
 struct _StThemeNodePaintState {
   StThemeNode *node;
@@ -175,6 +176,24 @@ struct _StThemeNodePaintState {
   CoglTexture *prerendered_texture;
   CoglPipeline *prerendered_pipeline;
   CoglPipeline *corner_pipeline[4];
+
+  /* If set, the background, borders and box-shadow are drawn
+   * analytically by this pipeline, and nothing else is used */
+  CoglPipeline *sdf_pipeline;
+
+  /* If set, prerendered_texture is a prerendered_width x
+   * prerendered_height version of the background whose center,
+   * between the prerendered_slices (indexed by StSide), is stretched
+   * to fill the allocation */
+  gboolean prerendered_sliced;
+  float prerendered_width;
+  float prerendered_height;
+  float prerendered_slices[4];
+
+  /* Background being prerendered in a thread, see
+   * st_theme_node_paint_state_set_redraw_actor() */
+  StThemeNodePrerender *pending_prerender;
+  ClutterActor *redraw_actor;
 };
 
 StThemeNode *st_theme_node_new (StThemeContext *context,
@@ -366,5 +385,7 @@ gboolean st_theme_node_paint_state_invalidate_for_file (StThemeNodePaintState *s
 
 void st_theme_node_paint_state_set_node (StThemeNodePaintState *state,
                                          StThemeNode           *node);
+void st_theme_node_paint_state_set_redraw_actor (StThemeNodePaintState *state,
+                                                 ClutterActor          *actor);
 
 G_END_DECLS
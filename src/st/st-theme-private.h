@@ -33,6 +33,13 @@ GFile *_st_theme_resolve_url (StTheme      *theme,
                               CRStyleSheet *base_stylesheet,
                               const char   *url);
 
-CRDeclaration *_st_theme_parse_declaration_list (const char *str);
+CRDeclaration *_st_theme_parse_declaration_list (StTheme    *theme,
+                                                 const char *str);
+
+gboolean _st_theme_is_ancestor_class        (StTheme    *theme,
+                                             const char *class_name);
+gboolean _st_theme_is_ancestor_pseudo_class (StTheme    *theme,
+                                             const char *pseudo_class);
+gboolean _st_theme_uses_inherit             (StTheme    *theme);
 
 G_END_DECLS
@@ -42,6 +42,7 @@
 
 #include <gio/gio.h>
 
+#include "st-compiled-stylesheet.h"
 #include "st-private.h"
 #include "st-theme-node.h"
 #include "st-theme-private.h"
@@ -69,9 +70,50 @@ struct _StTheme
   GHashTable *stylesheets_by_file;
   GHashTable *files_by_stylesheet;
 
+  /* CRStyleSheet => StRuleIndex */
+  GHashTable *rule_indexes;
+
+  /* Whether an inline style parsed since the stylesheets last changed
+   * has an 'inherit' value */
+  gboolean inline_styles_use_inherit;
+
   CRCascade *cascade;
 };
 
+/* A selector of a ruleset, or an @import rule if @selector is %NULL */
+typedef struct
+{
+  CRStatement *statement;
+  CRSelector *selector;
+} StRuleIndexEntry;
+
+/* To avoid evaluating every selector of a stylesheet against every node,
+ * selectors are bucketed by the rightmost compound selector (the one that
+ * has to match the node itself): by ID if it has one, otherwise by class,
+ * otherwise by element type. Everything else, including @import rules,
+ * ends up in the universal bucket. The buckets hold indices into @entries,
+ * which is in stylesheet order.
+ */
+typedef struct
+{
+  GArray *entries;
+  GHashTable *by_id;
+  GHashTable *by_class;
+  GHashTable *by_type;
+  GArray *universal;
+
+  /* GType => indices of the by_type entries the type matches */
+  GHashTable *by_element_type;
+
+  /* Sets of the classes and pseudo-classes used left of a combinator,
+   * which are the only ones that the style of descendants depends on */
+  GHashTable *ancestor_classes;
+  GHashTable *ancestor_pseudo_classes;
+
+  /* Whether any declaration has an 'inherit' value */
+  gboolean uses_inherit;
+} StRuleIndex;
+
 enum
 {
   PROP_0,
@@ -94,6 +136,213 @@ G_DEFINE_TYPE (StTheme, st_theme, G_TYPE_OBJECT)
 #define strqcmp(str,lit,lit_len) \
   (strlen (str) != (lit_len) || memcmp (str, lit, lit_len))
 
+static GHashTable *
+rule_index_buckets_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal,
+                                g_free, (GDestroyNotify) g_array_unref);
+}
+
+static void
+rule_index_add (GHashTable *buckets,
+                const char *key,
+                guint       entry)
+{
+  GArray *bucket = g_hash_table_lookup (buckets, key);
+
+  if (bucket == NULL)
+    {
+      bucket = g_array_new (FALSE, FALSE, sizeof (guint));
+      g_hash_table_insert (buckets, g_strdup (key), bucket);
+    }
+
+  g_array_append_val (bucket, entry);
+}
+
+static void
+rule_index_add_selector (StRuleIndex *index,
+                         CRSelector  *selector,
+                         guint        entry)
+{
+  CRSimpleSel *sel;
+  CRAdditionalSel *add_sel;
+  const char *class_name = NULL;
+
+  for (sel = selector->simple_sel; sel->next; sel = sel->next)
+    ;
+
+  /* All additional selectors of a compound selector have to match, so
+   * an ID or a class is enough to rule out a node. */
+  for (add_sel = sel->add_sel; add_sel; add_sel = add_sel->next)
+    {
+      if (add_sel->type == ID_ADD_SELECTOR &&
+          add_sel->content.id_name &&
+          add_sel->content.id_name->stryng &&
+          add_sel->content.id_name->stryng->str)
+        {
+          rule_index_add (index->by_id,
+                          add_sel->content.id_name->stryng->str,
+                          entry);
+          return;
+        }
+      else if (add_sel->type == CLASS_ADD_SELECTOR &&
+               class_name == NULL &&
+               add_sel->content.class_name &&
+               add_sel->content.class_name->stryng &&
+               add_sel->content.class_name->stryng->str)
+        {
+          class_name = add_sel->content.class_name->stryng->str;
+        }
+    }
+
+  if (class_name != NULL)
+    {
+      rule_index_add (index->by_class, class_name, entry);
+      return;
+    }
+
+  if ((sel->type_mask & TYPE_SELECTOR) &&
+      !(sel->type_mask & UNIVERSAL_SELECTOR) &&
+      sel->name && sel->name->stryng && sel->name->stryng->str)
+    {
+      rule_index_add (index->by_type, sel->name->stryng->str, entry);
+      return;
+    }
+
+  g_array_append_val (index->universal, entry);
+}
+
+static void
+rule_index_add_ancestor_selectors (StRuleIndex *index,
+                                   CRSelector  *selector)
+{
+  CRSimpleSel *sel;
+  CRAdditionalSel *add_sel;
+
+  for (sel = selector->simple_sel; sel->next; sel = sel->next)
+    {
+      for (add_sel = sel->add_sel; add_sel; add_sel = add_sel->next)
+        {
+          if (add_sel->type == CLASS_ADD_SELECTOR &&
+              add_sel->content.class_name &&
+              add_sel->content.class_name->stryng &&
+              add_sel->content.class_name->stryng->str)
+            {
+              g_hash_table_add (index->ancestor_classes,
+                                g_strdup (add_sel->content.class_name->stryng->str));
+            }
+          else if (add_sel->type == PSEUDO_CLASS_ADD_SELECTOR &&
+                   add_sel->content.pseudo &&
+                   add_sel->content.pseudo->name &&
+                   add_sel->content.pseudo->name->stryng &&
+                   add_sel->content.pseudo->name->stryng->str)
+            {
+              g_hash_table_add (index->ancestor_pseudo_classes,
+                                g_strdup (add_sel->content.pseudo->name->stryng->str));
+            }
+        }
+    }
+}
+
+static gboolean
+declarations_use_inherit (CRDeclaration *decl)
+{
+  for (; decl; decl = decl->next)
+    {
+      CRTerm *term;
+
+      for (term = decl->value; term; term = term->next)
+        {
+          if (term->type == TERM_IDENT &&
+              strcmp (term->content.str->stryng->str, "inherit") == 0)
+            return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static StRuleIndex *
+rule_index_new (CRStyleSheet *stylesheet)
+{
+  StRuleIndex *index = g_new0 (StRuleIndex, 1);
+  CRStatement *cur_stmt;
+
+  index->entries = g_array_new (FALSE, FALSE, sizeof (StRuleIndexEntry));
+  index->by_id = rule_index_buckets_new ();
+  index->by_class = rule_index_buckets_new ();
+  index->by_type = rule_index_buckets_new ();
+  index->universal = g_array_new (FALSE, FALSE, sizeof (guint));
+  index->by_element_type = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                  NULL, (GDestroyNotify) g_array_unref);
+  index->ancestor_classes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, NULL);
+  index->ancestor_pseudo_classes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                          g_free, NULL);
+
+  for (cur_stmt = stylesheet->statements; cur_stmt; cur_stmt = cur_stmt->next)
+    {
+      StRuleIndexEntry entry = { cur_stmt, NULL };
+      CRSelector *cur_sel;
+
+      switch (cur_stmt->type)
+        {
+        case RULESET_STMT:
+          if (cur_stmt->kind.ruleset == NULL)
+            break;
+
+          for (cur_sel = cur_stmt->kind.ruleset->sel_list; cur_sel; cur_sel = cur_sel->next)
+            {
+              if (!cur_sel->simple_sel)
+                continue;
+
+              entry.selector = cur_sel;
+              g_array_append_val (index->entries, entry);
+              rule_index_add_selector (index, cur_sel, index->entries->len - 1);
+              rule_index_add_ancestor_selectors (index, cur_sel);
+            }
+
+          if (!index->uses_inherit)
+            index->uses_inherit = declarations_use_inherit (cur_stmt->kind.ruleset->decl_list);
+          break;
+
+        case AT_IMPORT_RULE_STMT:
+          {
+            guint i;
+
+            g_array_append_val (index->entries, entry);
+            i = index->entries->len - 1;
+            g_array_append_val (index->universal, i);
+          }
+          break;
+
+        case AT_MEDIA_RULE_STMT:
+        case AT_RULE_STMT:
+        case AT_PAGE_RULE_STMT:
+        case AT_CHARSET_RULE_STMT:
+        case AT_FONT_FACE_RULE_STMT:
+        default:
+          break;
+        }
+    }
+
+  return index;
+}
+
+static void
+rule_index_free (StRuleIndex *index)
+{
+  g_array_unref (index->entries);
+  g_hash_table_destroy (index->by_id);
+  g_hash_table_destroy (index->by_class);
+  g_hash_table_destroy (index->by_type);
+  g_array_unref (index->universal);
+  g_hash_table_destroy (index->by_element_type);
+  g_hash_table_destroy (index->ancestor_classes);
+  g_hash_table_destroy (index->ancestor_pseudo_classes);
+  g_free (index);
+}
+
 static gboolean
 file_equal0 (GFile *file1,
              GFile *file2)
@@ -113,6 +362,8 @@ st_theme_init (StTheme *theme)
   theme->stylesheets_by_file = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
                                                       (GDestroyNotify)g_object_unref, (GDestroyNotify)cr_stylesheet_unref);
   theme->files_by_stylesheet = g_hash_table_new (g_direct_hash, g_direct_equal);
+  theme->rule_indexes = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                               NULL, (GDestroyNotify) rule_index_free);
 }
 
 static void
@@ -170,26 +421,72 @@ st_theme_class_init (StThemeClass *klass)
                   G_TYPE_NONE, 0);
 }
 
+static CRStyleSheet *
+load_compiled_stylesheet (GFile  *file,
+                          GBytes *source)
+{
+  g_autofree char *uri = NULL;
+  g_autofree char *compiled_uri = NULL;
+  g_autoptr (GFile) compiled_file = NULL;
+  g_autoptr (GBytes) compiled = NULL;
+  const char *path;
+
+  uri = g_file_get_uri (file);
+  compiled_uri = g_strconcat (uri, ST_COMPILED_STYLESHEET_SUFFIX, NULL);
+  compiled_file = g_file_new_for_uri (compiled_uri);
+
+  /* Resources are already mapped, so only local files need mapping;
+   * most of them simply don't have a compiled form */
+  path = g_file_peek_path (compiled_file);
+  if (path != NULL)
+    {
+      GMappedFile *mapped_file = g_mapped_file_new (path, FALSE, NULL);
+
+      if (mapped_file == NULL)
+        return NULL;
+
+      compiled = g_mapped_file_get_bytes (mapped_file);
+      g_mapped_file_unref (mapped_file);
+    }
+  else
+    {
+      compiled = g_file_load_bytes (compiled_file, NULL, NULL, NULL);
+      if (compiled == NULL)
+        return NULL;
+    }
+
+  return _st_compiled_stylesheet_load (compiled, source);
+}
+
 static CRStyleSheet *
 parse_stylesheet (GFile   *file,
                   GError **error)
 {
   enum CRStatus status;
   CRStyleSheet *stylesheet;
-  char *contents;
+  GBytes *source;
   gsize length;
+  const char *contents;
 
   if (file == NULL)
     return NULL;
 
-  if (!g_file_load_contents (file, NULL, &contents, &length, NULL, error))
+  source = g_file_load_bytes (file, NULL, NULL, error);
+  if (source == NULL)
     return NULL;
 
-  status = cr_om_parser_simply_parse_buf ((const guchar *) contents,
-                                          length,
-                                          CR_UTF_8,
-                                          &stylesheet);
-  g_free (contents);
+  stylesheet = load_compiled_stylesheet (file, source);
+  if (stylesheet != NULL)
+    status = CR_OK;
+  else
+    {
+      contents = g_bytes_get_data (source, &length);
+      status = cr_om_parser_simply_parse_buf ((const guchar *) contents,
+                                              length,
+                                              CR_UTF_8,
+                                              &stylesheet);
+    }
+  g_bytes_unref (source);
 
   if (status != CR_OK)
     {
@@ -207,26 +504,27 @@ parse_stylesheet (GFile   *file,
 }
 
 CRDeclaration *
-_st_theme_parse_declaration_list (const char *str)
+_st_theme_parse_declaration_list (StTheme    *theme,
+                                  const char *str)
 {
-  return cr_declaration_parse_list_from_buf ((const guchar *)str,
-                                             CR_UTF_8);
+  CRDeclaration *declarations;
+
+  declarations = cr_declaration_parse_list_from_buf ((const guchar *)str,
+                                                     CR_UTF_8);
+
+  if (theme != NULL && !theme->inline_styles_use_inherit)
+    theme->inline_styles_use_inherit = declarations_use_inherit (declarations);
+
+  return declarations;
 }
 
-/* Just g_warning for now until we have something nicer to do */
-static CRStyleSheet *
-parse_stylesheet_nofail (GFile *file)
+/* The matched properties of all nodes are dropped when the stylesheets
+ * change, and inline styles parsed again as the nodes are restyled */
+static void
+emit_stylesheets_changed (StTheme *theme)
 {
-  GError *error = NULL;
-  CRStyleSheet *result;
-
-  result = parse_stylesheet (file, &error);
-  if (error)
-    {
-      g_warning ("%s", error->message);
-      g_clear_error (&error);
-    }
-  return result;
+  theme->inline_styles_use_inherit = FALSE;
+  g_signal_emit (theme, signals[STYLESHEETS_CHANGED], 0);
 }
 
 static void
@@ -242,6 +540,164 @@ insert_stylesheet (StTheme      *theme,
 
   g_hash_table_insert (theme->stylesheets_by_file, file, stylesheet);
   g_hash_table_insert (theme->files_by_stylesheet, stylesheet, file);
+  g_hash_table_insert (theme->rule_indexes, stylesheet, rule_index_new (stylesheet));
+}
+
+static GFile *
+resolve_url (GFile      *base_file,
+             const char *url)
+{
+  char *scheme;
+  GFile *resource;
+
+  if ((scheme = g_uri_parse_scheme (url)))
+    {
+      g_free (scheme);
+      resource = g_file_new_for_uri (url);
+    }
+  else if (base_file != NULL)
+    {
+      GFile *parent;
+
+      parent = g_file_get_parent (base_file);
+      resource = g_file_resolve_relative_path (parent, url);
+
+      g_object_unref (parent);
+    }
+  else
+    {
+      resource = g_file_new_for_path (url);
+    }
+
+  return resource;
+}
+
+/* A stylesheet and everything it @imports, parsed but not yet
+ * added to a theme. Building one doesn't touch any theme, so it
+ * can happen in a worker thread. */
+typedef struct
+{
+  GHashTable *stylesheets_by_file;
+  /* Only the stylesheets not yet adopted by a theme */
+  GHashTable *files_by_stylesheet;
+} StParsedStylesheets;
+
+static StParsedStylesheets *
+parsed_stylesheets_new (void)
+{
+  StParsedStylesheets *parsed = g_new0 (StParsedStylesheets, 1);
+
+  parsed->stylesheets_by_file = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                                       (GDestroyNotify) g_object_unref, NULL);
+  parsed->files_by_stylesheet = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return parsed;
+}
+
+static void
+parsed_stylesheets_free (StParsedStylesheets *parsed)
+{
+  GHashTableIter iter;
+  gpointer stylesheet;
+
+  g_hash_table_iter_init (&iter, parsed->files_by_stylesheet);
+  while (g_hash_table_iter_next (&iter, &stylesheet, NULL))
+    cr_stylesheet_destroy (stylesheet);
+
+  g_hash_table_destroy (parsed->files_by_stylesheet);
+  g_hash_table_destroy (parsed->stylesheets_by_file);
+  g_free (parsed);
+}
+
+/* Parses @file and resolves its @imports right away, so that matching
+ * never has to stop and parse a stylesheet */
+static CRStyleSheet *
+parse_stylesheet_tree (StParsedStylesheets  *parsed,
+                       GFile                *file,
+                       GError              **error)
+{
+  CRStyleSheet *stylesheet;
+  CRStatement *stmt;
+
+  /* Imported twice, or an import cycle */
+  stylesheet = g_hash_table_lookup (parsed->stylesheets_by_file, file);
+  if (stylesheet)
+    return stylesheet;
+
+  stylesheet = parse_stylesheet (file, error);
+  if (!stylesheet)
+    return NULL;
+
+  g_hash_table_insert (parsed->stylesheets_by_file, g_object_ref (file), stylesheet);
+  g_hash_table_insert (parsed->files_by_stylesheet, stylesheet, file);
+
+  for (stmt = stylesheet->statements; stmt; stmt = stmt->next)
+    {
+      CRAtImportRule *import_rule;
+      CRStyleSheet *sheet = NULL;
+
+      if (stmt->type != AT_IMPORT_RULE_STMT)
+        continue;
+
+      import_rule = stmt->kind.import_rule;
+
+      if (import_rule->url->stryng && import_rule->url->stryng->str)
+        {
+          GFile *import_file = resolve_url (file, import_rule->url->stryng->str);
+
+          sheet = parse_stylesheet_tree (parsed, import_file, NULL);
+          g_object_unref (import_file);
+        }
+
+      /* Same marker as add_matched_properties() uses for broken imports */
+      import_rule->sheet = sheet ? sheet : (CRStyleSheet *) - 1;
+    }
+
+  return stylesheet;
+}
+
+/* Moves @stylesheet and its imports into @theme, sharing whatever
+ * the theme already has loaded. Returns a reference the same way
+ * resolve_stylesheet() does. */
+static CRStyleSheet *
+adopt_stylesheet (StTheme             *theme,
+                  StParsedStylesheets *parsed,
+                  GFile               *file,
+                  CRStyleSheet        *stylesheet)
+{
+  CRStyleSheet *existing;
+  CRStatement *stmt;
+
+  existing = g_hash_table_lookup (theme->stylesheets_by_file, file);
+  if (existing)
+    {
+      cr_stylesheet_ref (existing);
+      return existing;
+    }
+
+  g_hash_table_remove (parsed->files_by_stylesheet, stylesheet);
+  insert_stylesheet (theme, file, stylesheet);
+
+  for (stmt = stylesheet->statements; stmt; stmt = stmt->next)
+    {
+      CRAtImportRule *import_rule;
+      GFile *import_file;
+
+      if (stmt->type != AT_IMPORT_RULE_STMT)
+        continue;
+
+      import_rule = stmt->kind.import_rule;
+      if (import_rule->sheet == NULL || import_rule->sheet == (CRStyleSheet *) - 1)
+        continue;
+
+      import_file = g_hash_table_lookup (parsed->files_by_stylesheet, import_rule->sheet);
+      if (import_file)
+        import_rule->sheet = adopt_stylesheet (theme, parsed, import_file, import_rule->sheet);
+      else
+        cr_stylesheet_ref (import_rule->sheet); /* adopted through another import */
+    }
+
+  return stylesheet;
 }
 
 static CRStyleSheet *
@@ -249,8 +705,12 @@ resolve_stylesheet (StTheme  *theme,
                     GFile    *file,
                     GError  **error)
 {
+  StParsedStylesheets *parsed;
   CRStyleSheet *sheet;
 
+  if (file == NULL)
+    return NULL;
+
   sheet = g_hash_table_lookup (theme->stylesheets_by_file, file);
   if (sheet)
     {
@@ -258,13 +718,45 @@ resolve_stylesheet (StTheme  *theme,
       return sheet;
     }
 
-  sheet = parse_stylesheet (file, error);
+  parsed = parsed_stylesheets_new ();
+
+  sheet = parse_stylesheet_tree (parsed, file, error);
   if (sheet)
-    insert_stylesheet (theme, file, sheet);
+    sheet = adopt_stylesheet (theme, parsed, file, sheet);
+
+  parsed_stylesheets_free (parsed);
 
   return sheet;
 }
 
+/* Just g_warning for now until we have something nicer to do */
+static CRStyleSheet *
+resolve_stylesheet_nofail (StTheme *theme,
+                           GFile   *file)
+{
+  GError *error = NULL;
+  CRStyleSheet *result;
+
+  result = resolve_stylesheet (theme, file, &error);
+  if (error)
+    {
+      g_warning ("%s", error->message);
+      g_clear_error (&error);
+    }
+  return result;
+}
+
+static void
+add_custom_stylesheet (StTheme      *theme,
+                       CRStyleSheet *stylesheet)
+{
+  stylesheet->app_data = GUINT_TO_POINTER (TRUE);
+
+  cr_stylesheet_ref (stylesheet);
+  theme->custom_stylesheets = g_slist_prepend (theme->custom_stylesheets, stylesheet);
+  emit_stylesheets_changed (theme);
+}
+
 /**
  * st_theme_load_stylesheet:
  * @theme: a #StTheme
@@ -286,15 +778,119 @@ st_theme_load_stylesheet (StTheme    *theme,
   if (!stylesheet)
     return FALSE;
 
-  stylesheet->app_data = GUINT_TO_POINTER (TRUE);
-
-  cr_stylesheet_ref (stylesheet);
-  theme->custom_stylesheets = g_slist_prepend (theme->custom_stylesheets, stylesheet);
-  g_signal_emit (theme, signals[STYLESHEETS_CHANGED], 0);
+  add_custom_stylesheet (theme, stylesheet);
 
   return TRUE;
 }
 
+static void
+load_stylesheet_thread (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+  GFile *file = task_data;
+  StParsedStylesheets *parsed;
+  GError *error = NULL;
+
+  parsed = parsed_stylesheets_new ();
+
+  if (!parse_stylesheet_tree (parsed, file, &error))
+    {
+      parsed_stylesheets_free (parsed);
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_task_return_pointer (task, parsed, (GDestroyNotify) parsed_stylesheets_free);
+}
+
+static void
+on_stylesheet_parsed (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+  StTheme *theme = ST_THEME (source_object);
+  GTask *task = user_data;
+  GFile *file = g_task_get_task_data (task);
+  StParsedStylesheets *parsed;
+  CRStyleSheet *stylesheet;
+  GError *error = NULL;
+
+  parsed = g_task_propagate_pointer (G_TASK (result), &error);
+  if (parsed == NULL)
+    {
+      g_task_return_error (task, error);
+      g_object_unref (task);
+      return;
+    }
+
+  stylesheet = g_hash_table_lookup (parsed->stylesheets_by_file, file);
+  stylesheet = adopt_stylesheet (theme, parsed, file, stylesheet);
+  parsed_stylesheets_free (parsed);
+
+  add_custom_stylesheet (theme, stylesheet);
+
+  g_task_return_boolean (task, TRUE);
+  g_object_unref (task);
+}
+
+/**
+ * st_theme_load_stylesheet_async:
+ * @theme: a #StTheme
+ * @file: a #GFile
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore
+ * @callback: (scope async) (closure user_data): a #GAsyncReadyCallback to call
+ *     when the stylesheet is loaded
+ * @user_data: the data to pass to callback function
+ *
+ * Asynchronously load the stylesheet associated with @file. The file
+ * and the stylesheets it imports are read and parsed in a thread.
+ *
+ * See st_theme_load_stylesheet() for the synchronous version of this call.
+ */
+void
+st_theme_load_stylesheet_async (StTheme             *theme,
+                                GFile               *file,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+  GTask *task, *parse_task;
+
+  g_return_if_fail (ST_IS_THEME (theme));
+  g_return_if_fail (G_IS_FILE (file));
+
+  task = g_task_new (theme, cancellable, callback, user_data);
+  g_task_set_source_tag (task, st_theme_load_stylesheet_async);
+  g_task_set_task_data (task, g_object_ref (file), g_object_unref);
+
+  parse_task = g_task_new (theme, cancellable, on_stylesheet_parsed, task);
+  g_task_set_task_data (parse_task, g_object_ref (file), g_object_unref);
+  g_task_run_in_thread (parse_task, load_stylesheet_thread);
+  g_object_unref (parse_task);
+}
+
+/**
+ * st_theme_load_stylesheet_finish:
+ * @theme: a #StTheme
+ * @result: a #GAsyncResult
+ * @error: a #GError
+ *
+ * Finishes a stylesheet load started with st_theme_load_stylesheet_async().
+ *
+ * Returns: %TRUE if successful
+ */
+gboolean
+st_theme_load_stylesheet_finish (StTheme       *theme,
+                                 GAsyncResult  *result,
+                                 GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, theme), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 /**
  * st_theme_unload_stylesheet:
  * @theme: a #StTheme
@@ -318,12 +914,13 @@ st_theme_unload_stylesheet (StTheme    *theme,
 
   theme->custom_stylesheets = g_slist_remove (theme->custom_stylesheets, stylesheet);
 
-  g_signal_emit (theme, signals[STYLESHEETS_CHANGED], 0);
+  emit_stylesheets_changed (theme);
 
   /* We need to remove the entry from the hashtable after emitting the signal
    * since we might still access the files_by_stylesheet hashtable in
    * _st_theme_resolve_url() during the signal emission.
    */
+  g_hash_table_remove (theme->rule_indexes, stylesheet);
   g_hash_table_remove (theme->stylesheets_by_file, file);
   g_hash_table_remove (theme->files_by_stylesheet, stylesheet);
   cr_stylesheet_unref (stylesheet);
@@ -365,9 +962,9 @@ st_theme_constructed (GObject *object)
 
   G_OBJECT_CLASS (st_theme_parent_class)->constructed (object);
 
-  application_stylesheet = parse_stylesheet_nofail (theme->application_stylesheet);
-  theme_stylesheet = parse_stylesheet_nofail (theme->theme_stylesheet);
-  default_stylesheet = parse_stylesheet_nofail (theme->default_stylesheet);
+  application_stylesheet = resolve_stylesheet_nofail (theme, theme->application_stylesheet);
+  theme_stylesheet = resolve_stylesheet_nofail (theme, theme->theme_stylesheet);
+  default_stylesheet = resolve_stylesheet_nofail (theme, theme->default_stylesheet);
 
   theme->cascade = cr_cascade_new (application_stylesheet,
                                    theme_stylesheet,
@@ -375,10 +972,6 @@ st_theme_constructed (GObject *object)
 
   if (theme->cascade == NULL)
     g_error ("Out of memory when creating cascade object");
-
-  insert_stylesheet (theme, theme->application_stylesheet, application_stylesheet);
-  insert_stylesheet (theme, theme->theme_stylesheet, theme_stylesheet);
-  insert_stylesheet (theme, theme->default_stylesheet, default_stylesheet);
 }
 
 static void
@@ -390,6 +983,7 @@ st_theme_finalize (GObject * object)
   g_slist_free (theme->custom_stylesheets);
   theme->custom_stylesheets = NULL;
 
+  g_hash_table_destroy (theme->rule_indexes);
   g_hash_table_destroy (theme->stylesheets_by_file);
   g_hash_table_destroy (theme->files_by_stylesheet);
 
@@ -859,132 +1453,215 @@ done:
   return CR_OK;
 }
 
+static void
+rule_index_collect (GArray     *candidates,
+                    GHashTable *buckets,
+                    const char *key)
+{
+  GArray *bucket = g_hash_table_lookup (buckets, key);
+
+  if (bucket != NULL)
+    g_array_append_vals (candidates, bucket->data, bucket->len);
+}
+
+static GArray *
+rule_index_get_type_entries (StRuleIndex *index,
+                             GType        element_type)
+{
+  GArray *entries;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  entries = g_hash_table_lookup (index->by_element_type,
+                                 GSIZE_TO_POINTER (element_type));
+  if (entries != NULL)
+    return entries;
+
+  /* A type only ever matches the element names of its ancestors and
+   * interfaces, which are all registered by the time a node has that
+   * type, so the result can be cached for the lifetime of the index.
+   */
+  entries = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  g_hash_table_iter_init (&iter, index->by_type);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GArray *bucket = value;
+
+      if (element_name_matches_type (key, element_type))
+        g_array_append_vals (entries, bucket->data, bucket->len);
+    }
+
+  g_hash_table_insert (index->by_element_type,
+                       GSIZE_TO_POINTER (element_type), entries);
+
+  return entries;
+}
+
+static int
+compare_entry_indices (gconstpointer a,
+                       gconstpointer b)
+{
+  guint index_a = *(const guint *) a;
+  guint index_b = *(const guint *) b;
+
+  return (index_a > index_b) - (index_a < index_b);
+}
+
+/* Returns the indices of all entries of @index that can possibly match
+ * @node, in stylesheet order and possibly with duplicates.
+ */
+static GArray *
+rule_index_get_candidates (StRuleIndex *index,
+                           StThemeNode *node)
+{
+  GArray *candidates;
+  GArray *type_entries;
+  const char *id;
+  GStrv classes;
+
+  candidates = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+                                  index->universal->len);
+
+  g_array_append_vals (candidates, index->universal->data, index->universal->len);
+
+  id = st_theme_node_get_element_id (node);
+  if (id != NULL)
+    rule_index_collect (candidates, index->by_id, id);
+
+  classes = st_theme_node_get_element_classes (node);
+  if (classes != NULL)
+    {
+      gchar **it;
+
+      for (it = classes; *it != NULL; it++)
+        rule_index_collect (candidates, index->by_class, *it);
+    }
+
+  type_entries = rule_index_get_type_entries (index,
+                                              st_theme_node_get_element_type (node));
+  g_array_append_vals (candidates, type_entries->data, type_entries->len);
+
+  g_array_sort (candidates, compare_entry_indices);
+
+  return candidates;
+}
+
+static StRuleIndex *
+get_rule_index (StTheme      *theme,
+                CRStyleSheet *stylesheet)
+{
+  StRuleIndex *index = g_hash_table_lookup (theme->rule_indexes, stylesheet);
+
+  if (index == NULL)
+    {
+      index = rule_index_new (stylesheet);
+      g_hash_table_insert (theme->rule_indexes, stylesheet, index);
+    }
+
+  return index;
+}
+
 static void
 add_matched_properties (StTheme      *a_this,
                         CRStyleSheet *a_nodesheet,
                         StThemeNode  *a_node,
                         GPtrArray    *props)
 {
-  CRStatement *cur_stmt = NULL;
-  CRSelector *sel_list = NULL;
-  CRSelector *cur_sel = NULL;
+  StRuleIndex *index;
+  GArray *candidates;
   gboolean matches = FALSE;
   enum CRStatus status = CR_OK;
+  guint i;
+
+  index = get_rule_index (a_this, a_nodesheet);
+  candidates = rule_index_get_candidates (index, a_node);
 
   /*
-   *walk through the list of statements and,
-   *get the selectors list inside the statements that
-   *contain some, and try to match our style node in these
-   *selectors lists.
+   *walk through the candidate selectors in stylesheet order and
+   *try to match our style node against them.
    */
-  for (cur_stmt = a_nodesheet->statements; cur_stmt; cur_stmt = cur_stmt->next)
+  for (i = 0; i < candidates->len; i++)
     {
-      /*
-       *initialize the selector list in which we will
-       *really perform the search.
-       */
-      sel_list = NULL;
-
-      /*
-       *get the the damn selector list in
-       *which we have to look
-       */
-      switch (cur_stmt->type)
-        {
-        case RULESET_STMT:
-          if (cur_stmt->kind.ruleset && cur_stmt->kind.ruleset->sel_list)
-            {
-              sel_list = cur_stmt->kind.ruleset->sel_list;
-            }
-          break;
+      guint entry_index = g_array_index (candidates, guint, i);
+      StRuleIndexEntry *entry;
+      CRStatement *cur_stmt;
 
-        case AT_IMPORT_RULE_STMT:
-          {
-            CRAtImportRule *import_rule = cur_stmt->kind.import_rule;
+      /* A node with a class listed twice hits the same bucket twice */
+      if (i > 0 && entry_index == g_array_index (candidates, guint, i - 1))
+        continue;
 
-            if (import_rule->sheet == NULL)
-              {
-                CRStyleSheet *sheet = NULL;
-                GFile *file = NULL;
+      entry = &g_array_index (index->entries, StRuleIndexEntry, entry_index);
+      cur_stmt = entry->statement;
 
-                if (import_rule->url->stryng && import_rule->url->stryng->str)
-                  {
-                    file = _st_theme_resolve_url (a_this,
-                                                  a_nodesheet,
-                                                  import_rule->url->stryng->str);
-                    sheet = resolve_stylesheet (a_this, file, NULL);
-                  }
+      if (cur_stmt->type == AT_IMPORT_RULE_STMT)
+        {
+          CRAtImportRule *import_rule = cur_stmt->kind.import_rule;
 
-                if (sheet)
-                  {
-                    import_rule->sheet = sheet;
-                  }
-                else
-                  {
-                    /* Set a marker to avoid repeatedly trying to parse a non-existent or
-                     * broken stylesheet
-                     */
-                    import_rule->sheet = (CRStyleSheet *) - 1;
-                  }
+          if (import_rule->sheet == NULL)
+            {
+              CRStyleSheet *sheet = NULL;
+              GFile *file = NULL;
+
+              if (import_rule->url->stryng && import_rule->url->stryng->str)
+                {
+                  file = _st_theme_resolve_url (a_this,
+                                                a_nodesheet,
+                                                import_rule->url->stryng->str);
+                  sheet = resolve_stylesheet (a_this, file, NULL);
+                }
+
+              if (sheet)
+                {
+                  import_rule->sheet = sheet;
+                }
+              else
+                {
+                  /* Set a marker to avoid repeatedly trying to parse a non-existent or
+                   * broken stylesheet
+                   */
+                  import_rule->sheet = (CRStyleSheet *) - 1;
+                }
+
+              if (file)
+                g_object_unref (file);
+            }
 
-                if (file)
-                  g_object_unref (file);
-              }
+          if (import_rule->sheet != (CRStyleSheet *) - 1)
+            {
+              add_matched_properties (a_this, import_rule->sheet,
+                                      a_node, props);
+            }
 
-            if (import_rule->sheet != (CRStyleSheet *) - 1)
-              {
-                add_matched_properties (a_this, import_rule->sheet,
-                                        a_node, props);
-              }
-          }
-          break;
-        case AT_MEDIA_RULE_STMT:
-        case AT_RULE_STMT:
-        case AT_PAGE_RULE_STMT:
-        case AT_CHARSET_RULE_STMT:
-        case AT_FONT_FACE_RULE_STMT:
-        default:
-          break;
+          continue;
         }
 
-      if (!sel_list)
-        continue;
+      status = sel_matches_style_real (a_this, entry->selector->simple_sel, a_node, &matches, TRUE, TRUE);
 
-      /*
-       *now, we have a comma separated selector list to look in.
-       *let's walk it and try to match the style node
-       *on each item of the list.
-       */
-      for (cur_sel = sel_list; cur_sel; cur_sel = cur_sel->next)
+      if (status == CR_OK && matches)
         {
-          if (!cur_sel->simple_sel)
-            continue;
+          CRDeclaration *cur_decl = NULL;
+
+          /* In order to sort the matching properties, we need to compute the
+           * specificity of the selector that actually matched this
+           * element. In a non-thread-safe fashion, we store it in the
+           * ruleset. (Fixing this would mean cut-and-pasting
+           * cr_simple_sel_compute_specificity(), and have no need for
+           * thread-safety anyways.)
+           *
+           * Once we've sorted the properties, the specificity no longer
+           * matters and it can be safely overridden.
+           */
+          cr_simple_sel_compute_specificity (entry->selector->simple_sel);
 
-          status = sel_matches_style_real (a_this, cur_sel->simple_sel, a_node, &matches, TRUE, TRUE);
+          cur_stmt->specificity = entry->selector->simple_sel->specificity;
 
-          if (status == CR_OK && matches)
-            {
-              CRDeclaration *cur_decl = NULL;
-
-              /* In order to sort the matching properties, we need to compute the
-               * specificity of the selector that actually matched this
-               * element. In a non-thread-safe fashion, we store it in the
-               * ruleset. (Fixing this would mean cut-and-pasting
-               * cr_simple_sel_compute_specificity(), and have no need for
-               * thread-safety anyways.)
-               *
-               * Once we've sorted the properties, the specificity no longer
-               * matters and it can be safely overridden.
-               */
-              cr_simple_sel_compute_specificity (cur_sel->simple_sel);
-
-              cur_stmt->specificity = cur_sel->simple_sel->specificity;
-
-              for (cur_decl = cur_stmt->kind.ruleset->decl_list; cur_decl; cur_decl = cur_decl->next)
-                g_ptr_array_add (props, cur_decl);
-            }
+          for (cur_decl = cur_stmt->kind.ruleset->decl_list; cur_decl; cur_decl = cur_decl->next)
+            g_ptr_array_add (props, cur_decl);
         }
     }
+
+  g_array_unref (candidates);
 }
 
 #define ORIGIN_OFFSET_IMPORTANT (NB_ORIGINS)
@@ -1058,6 +1735,71 @@ _st_theme_get_matched_properties (StTheme        *theme,
   return props;
 }
 
+/* Whether adding or removing @class_name on a node can change the rules
+ * matching its descendants */
+gboolean
+_st_theme_is_ancestor_class (StTheme    *theme,
+                             const char *class_name)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, theme->rule_indexes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      StRuleIndex *index = value;
+
+      if (g_hash_table_contains (index->ancestor_classes, class_name))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Like _st_theme_is_ancestor_class(), for pseudo-classes */
+gboolean
+_st_theme_is_ancestor_pseudo_class (StTheme    *theme,
+                                    const char *pseudo_class)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, theme->rule_indexes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      StRuleIndex *index = value;
+
+      if (g_hash_table_contains (index->ancestor_pseudo_classes, pseudo_class))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Whether any property may be explicitly inherited from the parent, in
+ * addition to the ones that are always inherited */
+gboolean
+_st_theme_uses_inherit (StTheme *theme)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  /* Inline styles of nodes without a theme aren't tracked */
+  if (theme == NULL || theme->inline_styles_use_inherit)
+    return TRUE;
+
+  g_hash_table_iter_init (&iter, theme->rule_indexes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      StRuleIndex *index = value;
+
+      if (index->uses_inherit)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
 /* Resolve an url from an url() reference in a stylesheet into a GFile,
  * if possible. The resolution here is distinctly lame and
  * will fail on many examples.
@@ -1067,35 +1809,23 @@ _st_theme_resolve_url (StTheme      *theme,
                        CRStyleSheet *base_stylesheet,
                        const char   *url)
 {
+  GFile *base_file = NULL;
   char *scheme;
-  GFile *resource;
 
-  if ((scheme = g_uri_parse_scheme (url)))
-    {
-      g_free (scheme);
-      resource = g_file_new_for_uri (url);
-    }
-  else if (base_stylesheet != NULL)
-    {
-      GFile *base_file = NULL, *parent;
+  scheme = g_uri_parse_scheme (url);
 
+  if (scheme == NULL && base_stylesheet != NULL)
+    {
       base_file = g_hash_table_lookup (theme->files_by_stylesheet, base_stylesheet);
 
       /* This is an internal function, if we get here with
          a bad @base_stylesheet we have a problem. */
       g_assert (base_file);
-
-      parent = g_file_get_parent (base_file);
-      resource = g_file_resolve_relative_path (parent, url);
-
-      g_object_unref (parent);
-    }
-  else
-    {
-      resource = g_file_new_for_path (url);
     }
 
-  return resource;
+  g_free (scheme);
+
+  return resolve_url (base_file, url);
 }
 
 /**
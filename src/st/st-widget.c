@@ -522,8 +522,12 @@ st_widget_style_changed (StWidget *widget)
 
   /* Descend through all children. If the actor is not mapped,
    * children will clear their theme node without recomputing style.
+   * If it is, children can keep their style unless it may depend on
+   * what changed.
    */
-  notify_children_of_style_change (CLUTTER_ACTOR (widget));
+  if (old_theme_node == NULL || priv->theme_node == NULL ||
+      _st_theme_node_descendants_need_restyle (old_theme_node, priv->theme_node))
+    notify_children_of_style_change (CLUTTER_ACTOR (widget));
 
   if (old_theme_node)
     g_object_unref (old_theme_node);
@@ -1616,7 +1620,11 @@ st_widget_init (StWidget *actor)
                                                     G_CALLBACK (st_widget_texture_cache_changed), actor);
 
   for (i = 0; i < G_N_ELEMENTS (priv->paint_states); i++)
-    st_theme_node_paint_state_init (&priv->paint_states[i]);
+    {
+      st_theme_node_paint_state_init (&priv->paint_states[i]);
+      st_theme_node_paint_state_set_redraw_actor (&priv->paint_states[i],
+                                                  CLUTTER_ACTOR (actor));
+    }
 }
 
 static void
@@ -0,0 +1,276 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * test-icon-raster-cache.c: Tests for the persistent cache of rendered icons
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <utime.h>
+#include <glib/gstdio.h>
+
+#include "st-icon-raster-cache.h"
+
+#define ICON_SIZE 16
+#define THEME_MTIME 1000
+
+/* 255, 128, 0 at half opacity, premultiplied */
+static const guint8 pixel[] = { 255, 128, 0, 128 };
+static const guint8 premultiplied_pixel[] = { 128, 64, 0, 128 };
+
+static char *tmp_dir;
+static char *icon_path;
+static const char *test;
+static gboolean fail;
+
+static GdkPixbuf *
+create_pixbuf (int size)
+{
+  GdkPixbuf *pixbuf;
+  guint8 *pixels;
+  int rowstride;
+  int x, y;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, size, size);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+
+  for (y = 0; y < size; y++)
+    for (x = 0; x < size; x++)
+      memcpy (pixels + y * rowstride + x * 4, pixel, sizeof (pixel));
+
+  return pixbuf;
+}
+
+static void
+init_key (StIconRasterKey *key,
+          int              size)
+{
+  GStatBuf stat_buf;
+
+  if (g_stat (icon_path, &stat_buf) != 0)
+    g_error ("Failed to stat %s: %s", icon_path, g_strerror (errno));
+
+  memset (key, 0, sizeof (StIconRasterKey));
+  key->filename = icon_path;
+  key->mtime = stat_buf.st_mtime;
+  key->theme_mtime = THEME_MTIME;
+  key->size = size;
+  key->scale = 1;
+}
+
+static void
+assert_cached (StIconRasterCache     *cache,
+               const StIconRasterKey *key,
+               const char            *description)
+{
+  g_autoptr (GBytes) pixels = NULL;
+  const guint8 *data;
+  int width, height, rowstride;
+
+  pixels = _st_icon_raster_cache_lookup (cache, key, &width, &height, &rowstride);
+  if (pixels == NULL)
+    {
+      g_print ("%s: %s: expected a cached icon\n", test, description);
+      fail = TRUE;
+      return;
+    }
+
+  data = g_bytes_get_data (pixels, NULL);
+
+  if (width != key->size || height != key->size ||
+      memcmp (data, premultiplied_pixel, sizeof (premultiplied_pixel)) != 0)
+    {
+      g_print ("%s: %s: expected %dx%d %d,%d,%d,%d, got %dx%d %d,%d,%d,%d\n",
+               test, description,
+               key->size, key->size,
+               premultiplied_pixel[0], premultiplied_pixel[1],
+               premultiplied_pixel[2], premultiplied_pixel[3],
+               width, height, data[0], data[1], data[2], data[3]);
+      fail = TRUE;
+    }
+}
+
+static gboolean
+is_cached (StIconRasterCache     *cache,
+           const StIconRasterKey *key)
+{
+  g_autoptr (GBytes) pixels = NULL;
+  int width, height, rowstride;
+
+  pixels = _st_icon_raster_cache_lookup (cache, key, &width, &height, &rowstride);
+
+  return pixels != NULL;
+}
+
+static void
+assert_not_cached (StIconRasterCache     *cache,
+                   const StIconRasterKey *key,
+                   const char            *description)
+{
+  if (is_cached (cache, key))
+    {
+      g_print ("%s: %s: expected no cached icon\n", test, description);
+      fail = TRUE;
+    }
+}
+
+static void
+test_round_trip (const char *cache_path)
+{
+  g_autoptr (GdkPixbuf) pixbuf = create_pixbuf (ICON_SIZE);
+  StIconRasterCache *cache;
+  StIconRasterKey key;
+
+  test = "round_trip";
+
+  init_key (&key, ICON_SIZE);
+
+  cache = _st_icon_raster_cache_new (cache_path);
+  assert_not_cached (cache, &key, "empty cache");
+  _st_icon_raster_cache_insert (cache, &key, pixbuf);
+  assert_cached (cache, &key, "same session");
+  _st_icon_raster_cache_unref (cache);
+
+  cache = _st_icon_raster_cache_new (cache_path);
+  assert_cached (cache, &key, "next session");
+
+  key.size = ICON_SIZE * 2;
+  assert_not_cached (cache, &key, "other size");
+  _st_icon_raster_cache_unref (cache);
+}
+
+static void
+test_invalidation (const char *cache_path)
+{
+  g_autoptr (GdkPixbuf) pixbuf = create_pixbuf (ICON_SIZE);
+  StIconRasterCache *cache;
+  StIconRasterKey key, old_key;
+  struct utimbuf times;
+
+  test = "invalidation";
+
+  init_key (&key, ICON_SIZE);
+  old_key = key;
+
+  cache = _st_icon_raster_cache_new (cache_path);
+  _st_icon_raster_cache_insert (cache, &key, pixbuf);
+  _st_icon_raster_cache_unref (cache);
+
+  cache = _st_icon_raster_cache_new (cache_path);
+
+  key.theme_mtime = THEME_MTIME + 1;
+  assert_not_cached (cache, &key, "changed theme");
+
+  /* Pretend the icon was updated */
+  times.actime = times.modtime = old_key.mtime + 60;
+  if (g_utime (icon_path, &times) != 0)
+    g_error ("Failed to set the time of %s: %s", icon_path, g_strerror (errno));
+
+  init_key (&key, ICON_SIZE);
+  assert_not_cached (cache, &key, "changed icon");
+
+  /* Adding the updated icon causes the file to be written again,
+   * without the icon rendered from the old file */
+  _st_icon_raster_cache_insert (cache, &key, pixbuf);
+  _st_icon_raster_cache_unref (cache);
+
+  cache = _st_icon_raster_cache_new (cache_path);
+  assert_not_cached (cache, &old_key, "changed icon, next session");
+  assert_cached (cache, &key, "updated icon, next session");
+  _st_icon_raster_cache_unref (cache);
+}
+
+static void
+test_eviction (const char *cache_path)
+{
+  g_autoptr (GdkPixbuf) pixbuf = create_pixbuf (512);
+  gsize icon_bytes = 512 * 512 * 4;
+  int n_icons = ST_ICON_RASTER_CACHE_MAX_BYTES / icon_bytes + 2;
+  StIconRasterCache *cache;
+  StIconRasterKey key;
+  int i;
+
+  test = "eviction";
+
+  cache = _st_icon_raster_cache_new (cache_path);
+
+  /* The key only needs to differ, the size isn't checked */
+  for (i = 0; i < n_icons; i++)
+    {
+      init_key (&key, i);
+      _st_icon_raster_cache_insert (cache, &key, pixbuf);
+
+      /* Keeps the first icon in use */
+      init_key (&key, 0);
+      is_cached (cache, &key);
+    }
+
+  init_key (&key, 0);
+  if (!is_cached (cache, &key))
+    {
+      g_print ("%s: the most recently used icon was evicted\n", test);
+      fail = TRUE;
+    }
+
+  init_key (&key, 1);
+  assert_not_cached (cache, &key, "least recently used icon");
+
+  init_key (&key, n_icons - 1);
+  if (!is_cached (cache, &key))
+    {
+      g_print ("%s: the last icon was not added\n", test);
+      fail = TRUE;
+    }
+
+  _st_icon_raster_cache_unref (cache);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree char *round_trip_path = NULL;
+  g_autofree char *invalidation_path = NULL;
+  g_autofree char *eviction_path = NULL;
+
+  tmp_dir = g_dir_make_tmp ("st-icon-raster-cache-XXXXXX", &error);
+  if (tmp_dir == NULL)
+    g_error ("Failed to create a temporary directory: %s", error->message);
+
+  /* Only the modification time of the icon file is looked at */
+  icon_path = g_build_filename (tmp_dir, "icon.svg", NULL);
+  if (!g_file_set_contents (icon_path, "", 0, &error))
+    g_error ("Failed to create %s: %s", icon_path, error->message);
+
+  round_trip_path = g_build_filename (tmp_dir, "round-trip", NULL);
+  invalidation_path = g_build_filename (tmp_dir, "invalidation", NULL);
+  eviction_path = g_build_filename (tmp_dir, "eviction", NULL);
+
+  test_round_trip (round_trip_path);
+  test_invalidation (invalidation_path);
+  test_eviction (eviction_path);
+
+  g_unlink (eviction_path);
+  g_unlink (invalidation_path);
+  g_unlink (round_trip_path);
+  g_unlink (icon_path);
+  g_rmdir (tmp_dir);
+
+  g_free (icon_path);
+  g_free (tmp_dir);
+
+  return fail ? 1 : 0;
+}
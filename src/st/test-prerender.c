@@ -0,0 +1,237 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * test-prerender.c: checks backgrounds prerendered in a thread
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <clutter/clutter.h>
+
+#include "st-theme.h"
+#include "st-theme-context.h"
+#include "st-theme-node-private.h"
+#include <meta-test/meta-context-test.h>
+#include <meta/meta-backend.h>
+
+#define IMAGE_WIDTH 256
+#define IMAGE_HEIGHT 256
+
+static ClutterActor *stage;
+static StThemeContext *theme_context;
+static const char *test;
+static gboolean fail;
+
+static void
+paint_node (StThemeNode           *node,
+            StThemeNodePaintState *state,
+            float                  width,
+            float                  height)
+{
+  ClutterContext *clutter_context = clutter_actor_get_context (stage);
+  ClutterBackend *backend = clutter_context_get_backend (clutter_context);
+  CoglContext *cogl_context = clutter_backend_get_cogl_context (backend);
+  ClutterColorState *color_state = clutter_actor_get_color_state (stage);
+  g_autoptr (ClutterPaintNode) root_node = NULL;
+  g_autoptr (CoglTexture) texture = NULL;
+  g_autoptr (CoglOffscreen) offscreen = NULL;
+  g_autoptr (GError) error = NULL;
+  ClutterPaintContext *paint_context;
+  ClutterActorBox box = { 0, 0, width, height };
+  CoglFramebuffer *framebuffer;
+  CoglColor clear_color;
+
+  texture = cogl_texture_2d_new_with_size (cogl_context,
+                                           IMAGE_WIDTH, IMAGE_HEIGHT);
+  offscreen = cogl_offscreen_new_with_texture (texture);
+  framebuffer = COGL_FRAMEBUFFER (offscreen);
+
+  if (!cogl_framebuffer_allocate (framebuffer, &error))
+    g_error ("Failed to allocate framebuffer: %s", error->message);
+
+  cogl_framebuffer_orthographic (framebuffer, 0, 0,
+                                 IMAGE_WIDTH, IMAGE_HEIGHT, 0, 1.0);
+
+  cogl_color_init_from_4f (&clear_color, 0, 0, 0, 0);
+  root_node = clutter_root_node_new (framebuffer,
+                                     color_state,
+                                     &clear_color,
+                                     COGL_BUFFER_BIT_COLOR);
+  paint_context =
+    clutter_paint_context_new_for_framebuffer (framebuffer,
+                                               NULL,
+                                               CLUTTER_PAINT_FLAG_NONE,
+                                               color_state);
+
+  st_theme_node_paint (node, state, cogl_context, paint_context,
+                       root_node, &box, 0xff, 1.0);
+
+  clutter_paint_node_paint (root_node, paint_context);
+  clutter_paint_context_destroy (paint_context);
+}
+
+static void
+wait_for_prerender (StThemeNodePaintState *state)
+{
+  if (state->pending_prerender == NULL)
+    {
+      g_print ("%s: expected the background to be prerendered in a thread\n",
+               test);
+      fail = TRUE;
+      return;
+    }
+
+  while (_st_theme_node_paint_state_is_prerendering (state))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+assert_prerendered_size (StThemeNodePaintState *state,
+                         const char            *description,
+                         float                  width,
+                         float                  height)
+{
+  if (state->prerendered_texture == NULL ||
+      state->prerendered_width != width ||
+      state->prerendered_height != height)
+    {
+      g_print ("%s: %s: expected a %gx%g background, got %gx%g\n",
+               test, description, width, height,
+               state->prerendered_texture ? state->prerendered_width : 0,
+               state->prerendered_texture ? state->prerendered_height : 0);
+      fail = TRUE;
+    }
+}
+
+static void
+test_resize (void)
+{
+  g_autoptr (ClutterActor) actor = NULL;
+  g_autoptr (CoglTexture) old_texture = NULL;
+  g_autoptr (CoglPipeline) old_box_shadow = NULL;
+  StThemeNodePrerender *prerender;
+  StThemeNodePaintState state;
+  StThemeNode *node;
+
+  test = "resize";
+
+  node = st_theme_node_new (theme_context,
+                            st_theme_context_get_root_node (theme_context),
+                            NULL, CLUTTER_TYPE_ACTOR, NULL, "radial-box",
+                            NULL, NULL);
+  actor = g_object_ref_sink (clutter_actor_new ());
+
+  st_theme_node_paint_state_init (&state);
+  st_theme_node_paint_state_set_redraw_actor (&state, actor);
+
+  paint_node (node, &state, 100, 50);
+  wait_for_prerender (&state);
+  paint_node (node, &state, 100, 50);
+  assert_prerendered_size (&state, "initial size", 100, 50);
+
+  if (state.box_shadow_pipeline == NULL)
+    {
+      g_print ("%s: expected a box-shadow\n", test);
+      fail = TRUE;
+    }
+
+  old_texture = g_object_ref (state.prerendered_texture);
+  if (state.box_shadow_pipeline != NULL)
+    old_box_shadow = g_object_ref (state.box_shadow_pipeline);
+
+  /* Until the new background is ready, the old one is stretched */
+  paint_node (node, &state, 120, 60);
+  prerender = state.pending_prerender;
+  if (prerender == NULL ||
+      state.prerendered_texture != old_texture ||
+      state.box_shadow_pipeline != old_box_shadow)
+    {
+      g_print ("%s: resources dropped while the background is prerendered\n",
+               test);
+      fail = TRUE;
+    }
+
+  /* and further size changes don't restart it */
+  paint_node (node, &state, 140, 70);
+  if (state.pending_prerender != prerender ||
+      state.prerendered_texture != old_texture ||
+      state.box_shadow_pipeline != old_box_shadow)
+    {
+      g_print ("%s: prerender restarted by a size change\n", test);
+      fail = TRUE;
+    }
+
+  /* Once done, it replaces the old resources, and the size that was
+   * missed is prerendered next */
+  wait_for_prerender (&state);
+  paint_node (node, &state, 140, 70);
+  assert_prerendered_size (&state, "intermediate size", 120, 60);
+
+  if (state.prerendered_texture == old_texture ||
+      state.box_shadow_pipeline == NULL ||
+      state.box_shadow_pipeline == old_box_shadow)
+    {
+      g_print ("%s: resources not replaced once prerendered\n", test);
+      fail = TRUE;
+    }
+
+  wait_for_prerender (&state);
+  paint_node (node, &state, 140, 70);
+  assert_prerendered_size (&state, "final size", 140, 70);
+
+  st_theme_node_paint_state_free (&state);
+  g_object_unref (node);
+}
+
+int
+main (int argc, char **argv)
+{
+  MetaContext *context;
+  g_autoptr (GError) error = NULL;
+  MetaBackend *backend;
+  StTheme *theme;
+  GFile *file;
+  g_autofree char *cwd = NULL;
+
+  /* meta_init() cds to $HOME */
+  cwd = g_get_current_dir ();
+
+  context = meta_create_test_context (META_CONTEXT_TEST_TYPE_TEST,
+                                      META_CONTEXT_TEST_FLAG_NONE);
+  if (!meta_context_configure (context, &argc, &argv, &error))
+    g_error ("Failed to configure: %s", error->message);
+
+  if (!meta_context_setup (context, &error))
+    g_error ("Failed to setup: %s", error->message);
+
+  if (chdir (cwd) < 0)
+    g_error ("chdir('%s') failed: %s", cwd, g_strerror (errno));
+
+  backend = meta_context_get_backend (context);
+  stage = meta_backend_get_stage (backend);
+
+  file = g_file_new_for_path ("test-prerender.css");
+  theme = st_theme_new (file, NULL, NULL);
+  g_object_unref (file);
+
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+  st_theme_context_set_theme (theme_context, theme);
+
+  test_resize ();
+
+  g_object_unref (theme);
+
+  g_object_unref (context);
+
+  return fail ? 1 : 0;
+}
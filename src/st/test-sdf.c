@@ -0,0 +1,238 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * test-sdf.c: compares the analytic and the textured rendering of boxes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Paints the nodes of test-sdf.css offscreen, once with ST_SDF_RENDERING
+ * as set in the environment and once with the textured path, and fails
+ * if they differ by more than antialiasing does. Meant to be run with
+ * ST_SDF_RENDERING=1 and LIBGL_ALWAYS_SOFTWARE=1, so that the shader is
+ * exercised on llvmpipe.
+ */
+
+#include <clutter/clutter.h>
+
+#include "st-theme.h"
+#include "st-theme-context.h"
+#include "st-theme-node-private.h"
+#include <meta-test/meta-context-test.h>
+#include <meta/meta-backend.h>
+
+#define BOX_WIDTH 160
+#define BOX_HEIGHT 96
+
+/* Room around the box for the box-shadow */
+#define MARGIN 24
+
+#define IMAGE_WIDTH (BOX_WIDTH + 2 * MARGIN)
+#define IMAGE_HEIGHT (BOX_HEIGHT + 2 * MARGIN)
+
+/* Edges are antialiased differently by cairo and the shader, and the
+ * blur of the textured path truncates at every tap, so its shadows are
+ * fainter than the Gaussian the shader evaluates. Geometry errors, like
+ * a misplaced border or a wrong radius, are well above these. */
+#define MAX_ERROR 64
+#define MAX_MEAN_ERROR 2.0
+
+/* Inside the border and away from the corners both paths must agree */
+#define MAX_INTERIOR_ERROR 2
+
+static ClutterActor *stage;
+static StThemeContext *theme_context;
+static gboolean fail;
+
+static guint8 *
+render_node (const char *element_class,
+             gboolean    use_sdf)
+{
+  ClutterContext *clutter_context = clutter_actor_get_context (stage);
+  ClutterBackend *backend = clutter_context_get_backend (clutter_context);
+  CoglContext *cogl_context = clutter_backend_get_cogl_context (backend);
+  ClutterColorState *color_state = clutter_actor_get_color_state (stage);
+  g_autoptr (ClutterPaintNode) root_node = NULL;
+  g_autoptr (CoglTexture) texture = NULL;
+  g_autoptr (CoglOffscreen) offscreen = NULL;
+  g_autoptr (GError) error = NULL;
+  ClutterPaintContext *paint_context;
+  ClutterActorBox box = { 0, 0, BOX_WIDTH, BOX_HEIGHT };
+  StThemeNodePaintState state;
+  CoglFramebuffer *framebuffer;
+  StThemeNode *node;
+  CoglColor clear_color;
+  guint8 *pixels;
+
+  _st_theme_node_set_sdf_rendering (use_sdf);
+
+  /* A new node each time, so that nothing rendered for the other path
+   * is reused */
+  node = st_theme_node_new (theme_context,
+                            st_theme_context_get_root_node (theme_context),
+                            NULL, CLUTTER_TYPE_ACTOR, NULL, element_class,
+                            NULL, NULL);
+
+  texture = cogl_texture_2d_new_with_size (cogl_context,
+                                           IMAGE_WIDTH, IMAGE_HEIGHT);
+  offscreen = cogl_offscreen_new_with_texture (texture);
+  framebuffer = COGL_FRAMEBUFFER (offscreen);
+
+  if (!cogl_framebuffer_allocate (framebuffer, &error))
+    g_error ("Failed to allocate framebuffer: %s", error->message);
+
+  cogl_framebuffer_orthographic (framebuffer, 0, 0,
+                                 IMAGE_WIDTH, IMAGE_HEIGHT, 0, 1.0);
+  cogl_framebuffer_translate (framebuffer, MARGIN, MARGIN, 0);
+
+  cogl_color_init_from_4f (&clear_color, 0, 0, 0, 0);
+  root_node = clutter_root_node_new (framebuffer,
+                                     color_state,
+                                     &clear_color,
+                                     COGL_BUFFER_BIT_COLOR);
+  paint_context =
+    clutter_paint_context_new_for_framebuffer (framebuffer,
+                                               NULL,
+                                               CLUTTER_PAINT_FLAG_NONE,
+                                               color_state);
+
+  st_theme_node_paint_state_init (&state);
+  st_theme_node_paint (node, &state, cogl_context, paint_context,
+                       root_node, &box, 0xff, 1.0);
+
+  if ((state.sdf_pipeline != NULL) != use_sdf)
+    {
+      g_print ("%s: expected the %s path to be used\n",
+               element_class, use_sdf ? "analytic" : "textured");
+      fail = TRUE;
+    }
+
+  clutter_paint_node_paint (root_node, paint_context);
+  clutter_paint_context_destroy (paint_context);
+
+  pixels = g_malloc (IMAGE_WIDTH * IMAGE_HEIGHT * 4);
+  if (!cogl_framebuffer_read_pixels (framebuffer, 0, 0,
+                                     IMAGE_WIDTH, IMAGE_HEIGHT,
+                                     COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                     pixels))
+    g_error ("Failed to read back %s", element_class);
+
+  st_theme_node_paint_state_free (&state);
+  g_object_unref (node);
+
+  return pixels;
+}
+
+static gboolean
+is_interior (int   x,
+             int   y,
+             float inset)
+{
+  return x >= MARGIN + inset && x < MARGIN + BOX_WIDTH - inset &&
+         y >= MARGIN + inset && y < MARGIN + BOX_HEIGHT - inset;
+}
+
+static void
+compare_paths (const char *element_class,
+               float       corner_inset)
+{
+  g_autofree guint8 *analytic = NULL;
+  g_autofree guint8 *textured = NULL;
+  guint64 total_error = 0;
+  int max_error = 0, max_interior_error = 0;
+  double mean_error;
+  int x, y, i;
+
+  analytic = render_node (element_class, TRUE);
+  textured = render_node (element_class, FALSE);
+
+  for (y = 0; y < IMAGE_HEIGHT; y++)
+    {
+      for (x = 0; x < IMAGE_WIDTH; x++)
+        {
+          for (i = 0; i < 4; i++)
+            {
+              int offset = (y * IMAGE_WIDTH + x) * 4 + i;
+              int error = ABS (analytic[offset] - textured[offset]);
+
+              total_error += error;
+              max_error = MAX (max_error, error);
+
+              if (is_interior (x, y, corner_inset))
+                max_interior_error = MAX (max_interior_error, error);
+            }
+        }
+    }
+
+  mean_error = (double) total_error / (IMAGE_WIDTH * IMAGE_HEIGHT * 4);
+
+  if (max_error > MAX_ERROR ||
+      mean_error > MAX_MEAN_ERROR ||
+      max_interior_error > MAX_INTERIOR_ERROR)
+    {
+      g_print ("%s: paths differ: max error %d, mean error %.2f, "
+               "max interior error %d\n",
+               element_class, max_error, mean_error, max_interior_error);
+      fail = TRUE;
+    }
+}
+
+static void
+test_rounded_box (void)
+{
+  /* border-radius of test-sdf.css */
+  compare_paths ("rounded-box", 12);
+}
+
+int
+main (int argc, char **argv)
+{
+  MetaContext *context;
+  g_autoptr (GError) error = NULL;
+  MetaBackend *backend;
+  StTheme *theme;
+  GFile *file;
+  g_autofree char *cwd = NULL;
+
+  /* meta_init() cds to $HOME */
+  cwd = g_get_current_dir ();
+
+  context = meta_create_test_context (META_CONTEXT_TEST_TYPE_TEST,
+                                      META_CONTEXT_TEST_FLAG_NONE);
+  if (!meta_context_configure (context, &argc, &argv, &error))
+    g_error ("Failed to configure: %s", error->message);
+
+  if (!meta_context_setup (context, &error))
+    g_error ("Failed to setup: %s", error->message);
+
+  if (chdir (cwd) < 0)
+    g_error ("chdir('%s') failed: %s", cwd, g_strerror (errno));
+
+  backend = meta_context_get_backend (context);
+  stage = meta_backend_get_stage (backend);
+
+  file = g_file_new_for_path ("test-sdf.css");
+  theme = st_theme_new (file, NULL, NULL);
+  g_object_unref (file);
+
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+  st_theme_context_set_theme (theme_context, theme);
+
+  test_rounded_box ();
+
+  g_object_unref (theme);
+
+  g_object_unref (context);
+
+  return fail ? 1 : 0;
+}
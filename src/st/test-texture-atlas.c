@@ -0,0 +1,414 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * test-texture-atlas.c: Tests for the shared textures of small images
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <clutter/clutter.h>
+
+#include "st-texture-atlas.h"
+#include "st-texture-cache.h"
+#include "st-texture-cache-private.h"
+#include <meta-test/meta-context-test.h>
+#include <meta/meta-backend.h>
+
+/* With the padding, 16 x 16 of these fill a page */
+#define IMAGE_SIZE (ST_TEXTURE_ATLAS_PAGE_SIZE / 16 - 2)
+#define IMAGES_PER_PAGE (16 * 16)
+
+static CoglContext *cogl_context;
+static guint8 *image_data;
+static const char *test;
+static gboolean fail;
+
+static CoglTexture *
+add_image (StTextureAtlas *atlas,
+           int             size)
+{
+  return _st_texture_atlas_add (atlas, cogl_context,
+                                size, size,
+                                COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                size * 4, image_data);
+}
+
+static CoglTexture *
+get_page (CoglTexture *texture)
+{
+  if (texture == NULL || !COGL_IS_SUB_TEXTURE (texture))
+    return NULL;
+
+  return cogl_sub_texture_get_parent (COGL_SUB_TEXTURE (texture));
+}
+
+static void
+assert_stats (StTextureAtlas *atlas,
+              const char     *description,
+              guint           expected_pages,
+              guint           expected_images)
+{
+  guint n_pages, n_images;
+
+  _st_texture_atlas_get_stats (atlas, &n_pages, &n_images, NULL);
+
+  if (n_pages != expected_pages || n_images != expected_images)
+    {
+      g_print ("%s: %s: expected %u pages with %u images, got %u with %u\n",
+               test, description,
+               expected_pages, expected_images, n_pages, n_images);
+      fail = TRUE;
+    }
+}
+
+/* Adds images until @atlas has @n_pages full pages */
+static GPtrArray *
+fill_pages (StTextureAtlas *atlas,
+            guint           n_pages)
+{
+  GPtrArray *images = g_ptr_array_new_with_free_func (g_object_unref);
+  guint i;
+
+  for (i = 0; i < n_pages * IMAGES_PER_PAGE; i++)
+    {
+      CoglTexture *texture = add_image (atlas, IMAGE_SIZE);
+
+      if (texture == NULL)
+        g_error ("%s: atlas full after %u images", test, i);
+
+      g_ptr_array_add (images, texture);
+    }
+
+  return images;
+}
+
+static void
+test_packing (void)
+{
+  StTextureAtlas *atlas = _st_texture_atlas_new ();
+  g_autoptr (CoglTexture) small = NULL;
+  g_autoptr (CoglTexture) wide = NULL;
+  g_autoptr (CoglTexture) large = NULL;
+
+  test = "packing";
+
+  small = add_image (atlas, 16);
+  wide = _st_texture_atlas_add (atlas, cogl_context, 48, 16,
+                                COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                48 * 4, image_data);
+
+  if (get_page (small) == NULL || get_page (small) != get_page (wide))
+    {
+      g_print ("%s: images not packed into the same page\n", test);
+      fail = TRUE;
+    }
+
+  if (wide != NULL &&
+      (cogl_texture_get_width (wide) != 48 || cogl_texture_get_height (wide) != 16))
+    {
+      g_print ("%s: expected a 48x16 texture, got %dx%d\n", test,
+               cogl_texture_get_width (wide), cogl_texture_get_height (wide));
+      fail = TRUE;
+    }
+
+  large = add_image (atlas, ST_TEXTURE_ATLAS_MAX_IMAGE_SIZE + 1);
+  if (large != NULL)
+    {
+      g_print ("%s: image larger than the maximum was packed\n", test);
+      fail = TRUE;
+    }
+
+  assert_stats (atlas, "two images", 1, 2);
+
+  g_clear_object (&small);
+  g_clear_object (&wide);
+  assert_stats (atlas, "images freed", 1, 0);
+
+  _st_texture_atlas_free (atlas);
+}
+
+static void
+test_reuse (void)
+{
+  StTextureAtlas *atlas = _st_texture_atlas_new ();
+  g_autoptr (GPtrArray) images = NULL;
+  CoglTexture *first_page;
+  CoglTexture *texture;
+
+  test = "reuse";
+
+  images = fill_pages (atlas, 1);
+  first_page = get_page (images->pdata[0]);
+  assert_stats (atlas, "full page", 1, IMAGES_PER_PAGE);
+
+  /* A full page makes room on a new one */
+  texture = add_image (atlas, IMAGE_SIZE);
+  if (get_page (texture) == NULL || get_page (texture) == first_page)
+    {
+      g_print ("%s: image on a full page\n", test);
+      fail = TRUE;
+    }
+  assert_stats (atlas, "second page", 2, IMAGES_PER_PAGE + 1);
+
+  /* ... which goes away with its last image */
+  g_clear_object (&texture);
+  assert_stats (atlas, "second page emptied", 1, IMAGES_PER_PAGE);
+
+  /* The span of a freed image in the middle of a shelf is reused */
+  g_ptr_array_remove_index (images, IMAGES_PER_PAGE / 2 + 3);
+  texture = add_image (atlas, IMAGE_SIZE);
+  if (get_page (texture) != first_page)
+    {
+      g_print ("%s: span of a freed image not reused\n", test);
+      fail = TRUE;
+    }
+  assert_stats (atlas, "span reused", 1, IMAGES_PER_PAGE);
+  g_ptr_array_add (images, texture);
+
+  /* So is a whole shelf, with smaller images */
+  g_ptr_array_remove_range (images, 0, 16);
+  texture = add_image (atlas, IMAGE_SIZE / 2);
+  if (get_page (texture) != first_page)
+    {
+      g_print ("%s: emptied shelf not reused\n", test);
+      fail = TRUE;
+    }
+  assert_stats (atlas, "shelf reused", 1, IMAGES_PER_PAGE - 15);
+  g_ptr_array_add (images, texture);
+
+  g_clear_pointer (&images, g_ptr_array_unref);
+  assert_stats (atlas, "all images freed", 1, 0);
+
+  _st_texture_atlas_free (atlas);
+}
+
+typedef struct
+{
+  GPtrArray *images;
+  guint n_calls;
+  gboolean drop;
+} EvictData;
+
+static void
+evict_page (CoglTexture *page_texture,
+            gpointer     user_data)
+{
+  EvictData *data = user_data;
+  guint i = 0;
+
+  data->n_calls++;
+
+  if (!data->drop)
+    return;
+
+  while (i < data->images->len)
+    {
+      if (get_page (data->images->pdata[i]) == page_texture)
+        g_ptr_array_remove_index (data->images, i);
+      else
+        i++;
+    }
+}
+
+static void
+test_eviction (void)
+{
+  StTextureAtlas *atlas = _st_texture_atlas_new ();
+  g_autoptr (GPtrArray) images = NULL;
+  g_autoptr (CoglTexture) texture = NULL;
+  EvictData data = { 0, };
+  guint n_evictions;
+
+  test = "eviction";
+
+  images = fill_pages (atlas, ST_TEXTURE_ATLAS_MAX_PAGES);
+  assert_stats (atlas, "full atlas",
+                ST_TEXTURE_ATLAS_MAX_PAGES,
+                ST_TEXTURE_ATLAS_MAX_PAGES * IMAGES_PER_PAGE);
+
+  /* Without an evict function, images don't fit anymore */
+  texture = add_image (atlas, IMAGE_SIZE);
+  if (texture != NULL)
+    {
+      g_print ("%s: image added to a full atlas\n", test);
+      fail = TRUE;
+    }
+
+  /* Every page is asked once when nothing is dropped */
+  data.images = images;
+  _st_texture_atlas_set_evict_func (atlas, evict_page, &data);
+
+  g_clear_object (&texture);
+  texture = add_image (atlas, IMAGE_SIZE);
+  if (texture != NULL || data.n_calls != ST_TEXTURE_ATLAS_MAX_PAGES)
+    {
+      g_print ("%s: expected %d evictions without room, got %u\n",
+               test, ST_TEXTURE_ATLAS_MAX_PAGES, data.n_calls);
+      fail = TRUE;
+    }
+
+  /* Dropping the images of a page makes room on it */
+  data.n_calls = 0;
+  data.drop = TRUE;
+
+  g_clear_object (&texture);
+  texture = add_image (atlas, IMAGE_SIZE);
+  if (texture == NULL || data.n_calls != 1)
+    {
+      g_print ("%s: expected an image after 1 eviction, got %s after %u\n",
+               test, texture ? "one" : "none", data.n_calls);
+      fail = TRUE;
+    }
+
+  _st_texture_atlas_get_stats (atlas, NULL, NULL, &n_evictions);
+  if (n_evictions != ST_TEXTURE_ATLAS_MAX_PAGES + 1)
+    {
+      g_print ("%s: expected %d evictions, got %u\n",
+               test, ST_TEXTURE_ATLAS_MAX_PAGES + 1, n_evictions);
+      fail = TRUE;
+    }
+
+  g_clear_object (&texture);
+  g_clear_pointer (&images, g_ptr_array_unref);
+  _st_texture_atlas_free (atlas);
+}
+
+/* Fills the atlas of the texture cache with corners only the cache holds
+ * on to, except for the first one */
+static void
+test_cache_eviction (void)
+{
+  StTextureCache *cache = st_texture_cache_get_default ();
+  g_autoptr (CoglTexture) held = NULL;
+  g_autoptr (CoglTexture) texture = NULL;
+  g_autoptr (CoglTexture) cached = NULL;
+  StCornerSpec corner = { 0, };
+  guint n_evictions, n_evictions_before;
+  guint n_images;
+  guint i;
+
+  test = "cache_eviction";
+
+  st_texture_cache_get_atlas_stats (cache, NULL, NULL, &n_evictions_before);
+
+  for (i = 0; i < ST_TEXTURE_ATLAS_MAX_PAGES * IMAGES_PER_PAGE; i++)
+    {
+      texture = _st_texture_cache_create_texture (cache, cogl_context,
+                                                  IMAGE_SIZE, IMAGE_SIZE,
+                                                  COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                                  IMAGE_SIZE * 4, image_data,
+                                                  NULL);
+      if (get_page (texture) == NULL)
+        g_error ("%s: atlas full after %u corners", test, i);
+
+      corner.radius = i;
+      _st_texture_cache_insert_corner (cache, &corner, texture);
+
+      if (i == 0)
+        held = g_steal_pointer (&texture);
+      else
+        g_clear_object (&texture);
+    }
+
+  /* The first page is the emptiest one, since all are as full */
+  texture = _st_texture_cache_create_texture (cache, cogl_context,
+                                              IMAGE_SIZE, IMAGE_SIZE,
+                                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                              IMAGE_SIZE * 4, image_data,
+                                              NULL);
+  if (get_page (texture) != get_page (held))
+    {
+      g_print ("%s: image not added to the evicted page\n", test);
+      fail = TRUE;
+    }
+
+  st_texture_cache_get_atlas_stats (cache, NULL, &n_images, &n_evictions);
+  if (n_evictions != n_evictions_before + 1)
+    {
+      g_print ("%s: expected 1 eviction, got %u\n",
+               test, n_evictions - n_evictions_before);
+      fail = TRUE;
+    }
+
+  /* The held corner, the new image and the 3 other pages remain */
+  if (n_images != (ST_TEXTURE_ATLAS_MAX_PAGES - 1) * IMAGES_PER_PAGE + 2)
+    {
+      g_print ("%s: expected %d images, got %u\n", test,
+               (ST_TEXTURE_ATLAS_MAX_PAGES - 1) * IMAGES_PER_PAGE + 2, n_images);
+      fail = TRUE;
+    }
+
+  corner.radius = 0;
+  cached = _st_texture_cache_lookup_corner (cache, &corner);
+  if (cached != held)
+    {
+      g_print ("%s: corner in use was evicted\n", test);
+      fail = TRUE;
+    }
+
+  corner.radius = 1;
+  g_clear_object (&cached);
+  cached = _st_texture_cache_lookup_corner (cache, &corner);
+  if (cached != NULL)
+    {
+      g_print ("%s: unused corner on the evicted page was kept\n", test);
+      fail = TRUE;
+    }
+
+  corner.radius = IMAGES_PER_PAGE;
+  g_clear_object (&cached);
+  cached = _st_texture_cache_lookup_corner (cache, &corner);
+  if (cached == NULL)
+    {
+      g_print ("%s: corner on another page was evicted\n", test);
+      fail = TRUE;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  MetaContext *context;
+  g_autoptr (GError) error = NULL;
+  MetaBackend *backend;
+  ClutterActor *stage;
+  ClutterContext *clutter_context;
+
+  context = meta_create_test_context (META_CONTEXT_TEST_TYPE_TEST,
+                                      META_CONTEXT_TEST_FLAG_NONE);
+  if (!meta_context_configure (context, &argc, &argv, &error))
+    g_error ("Failed to configure: %s", error->message);
+
+  if (!meta_context_setup (context, &error))
+    g_error ("Failed to setup: %s", error->message);
+
+  backend = meta_context_get_backend (context);
+  stage = meta_backend_get_stage (backend);
+  clutter_context = clutter_actor_get_context (stage);
+  cogl_context =
+    clutter_backend_get_cogl_context (clutter_context_get_backend (clutter_context));
+
+  image_data = g_malloc0 (ST_TEXTURE_ATLAS_MAX_IMAGE_SIZE *
+                          ST_TEXTURE_ATLAS_MAX_IMAGE_SIZE * 4);
+
+  test_packing ();
+  test_reuse ();
+  test_eviction ();
+  test_cache_eviction ();
+
+  g_free (image_data);
+
+  g_object_unref (context);
+
+  return fail ? 1 : 0;
+}
@@ -25,6 +25,9 @@
 #include "st-theme-context.h"
 #include "st-label.h"
 #include "st-button.h"
+#include "st-compiled-stylesheet.h"
+#include "st-theme-node-private.h"
+#include "st-theme-private.h"
 #include <math.h>
 #include <string.h>
 #include <meta-test/meta-context-test.h>
@@ -537,6 +540,365 @@ test_inline_style (void)
                  st_theme_node_get_padding (text3, ST_SIDE_BOTTOM));
 }
 
+static void
+test_style_sharing (void)
+{
+  StThemeContext *theme_context;
+  StThemeNode *text1_copy;
+  guint hits, new_hits;
+
+  test = "style_sharing";
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+  st_theme_context_get_style_cache_stats (theme_context, &hits, NULL);
+
+  /* A node with the same matching inputs as text1 reuses its cascade */
+  text1_copy = st_theme_node_new (theme_context, group1, NULL,
+                                  CLUTTER_TYPE_TEXT, "text1", "special-text", NULL, NULL);
+  assert_foreground_color (text1_copy, "text1_copy", "#00ff00ff");
+
+  /* ... and the same computed geometry and background */
+  st_theme_node_get_padding (text1, ST_SIDE_TOP);
+  st_theme_node_get_padding (text1_copy, ST_SIDE_TOP);
+  if (text1_copy->style != text1->style)
+    {
+      g_print ("%s: expected text1_copy to share the computed style of text1\n",
+               test);
+      fail = TRUE;
+    }
+
+  /* text3 has an inline padding-bottom */
+  st_theme_node_get_padding (text3, ST_SIDE_TOP);
+  if (text3->style == text1->style)
+    {
+      g_print ("%s: expected text3 to have its own computed style\n", test);
+      fail = TRUE;
+    }
+
+  g_object_unref (text1_copy);
+
+  st_theme_context_get_style_cache_stats (theme_context, &new_hits, NULL);
+  if (new_hits != hits + 1)
+    {
+      g_print ("%s: expected one style cache hit, got %u\n",
+               test, new_hits - hits);
+      fail = TRUE;
+    }
+}
+
+static void
+test_node_eviction (void)
+{
+  StThemeContext *theme_context;
+  StThemeNode *node;
+  guint max_nodes, n_evicted, new_n_evicted;
+
+  test = "node_eviction";
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+  max_nodes = st_theme_context_get_max_interned_nodes (theme_context);
+  st_theme_context_get_node_cache_stats (theme_context, NULL, &n_evicted);
+
+  st_theme_context_set_max_interned_nodes (theme_context, 1);
+
+  /* Once no longer referenced, an interned node can be evicted */
+  node = st_theme_node_new (theme_context, group1, NULL,
+                            CLUTTER_TYPE_TEXT, "unused", NULL, NULL, NULL);
+  st_theme_context_intern_node (theme_context, node);
+  g_object_unref (node);
+
+  node = st_theme_node_new (theme_context, group1, NULL,
+                            CLUTTER_TYPE_TEXT, "unused2", NULL, NULL, NULL);
+  st_theme_context_intern_node (theme_context, node);
+  g_object_unref (node);
+
+  st_theme_context_get_node_cache_stats (theme_context, NULL, &new_n_evicted);
+  if (new_n_evicted <= n_evicted)
+    {
+      g_print ("%s: expected unused nodes to be evicted\n", test);
+      fail = TRUE;
+    }
+
+  st_theme_context_set_max_interned_nodes (theme_context, max_nodes);
+}
+
+static void
+test_compiled_stylesheet (void)
+{
+  g_autoptr (GBytes) source = NULL;
+  g_autoptr (GBytes) compiled = NULL;
+  g_autoptr (GBytes) edited = NULL;
+  g_autoptr (GError) error = NULL;
+  CRStyleSheet *parsed, *loaded;
+  char *contents;
+  gsize length;
+
+  test = "compiled_stylesheet";
+  if (!g_file_get_contents ("test-theme.css", &contents, &length, &error))
+    g_error ("Failed to read test-theme.css: %s", error->message);
+  source = g_bytes_new_take (contents, length);
+
+  cr_om_parser_simply_parse_buf ((const guchar *) contents, length,
+                                 CR_UTF_8, &parsed);
+  compiled = _st_compiled_stylesheet_new (parsed, source, &error);
+  if (compiled == NULL)
+    {
+      g_print ("%s: failed to compile: %s\n", test, error->message);
+      fail = TRUE;
+      cr_stylesheet_destroy (parsed);
+      return;
+    }
+
+  /* Loading back gives the same rules as parsing */
+  loaded = _st_compiled_stylesheet_load (compiled, source);
+  if (loaded == NULL)
+    {
+      g_print ("%s: failed to load compiled stylesheet\n", test);
+      fail = TRUE;
+    }
+  else
+    {
+      char *expected = cr_stylesheet_to_string (parsed);
+      char *value = cr_stylesheet_to_string (loaded);
+
+      if (g_strcmp0 (expected, value) != 0)
+        {
+          g_print ("%s: compiled stylesheet differs from parsed one\n", test);
+          fail = TRUE;
+        }
+
+      g_free (expected);
+      g_free (value);
+      cr_stylesheet_destroy (loaded);
+    }
+
+  /* An edited source doesn't match anymore */
+  edited = g_bytes_new_from_bytes (source, 0, length - 1);
+  loaded = _st_compiled_stylesheet_load (compiled, edited);
+  if (loaded != NULL)
+    {
+      g_print ("%s: compiled stylesheet loaded for a different source\n", test);
+      fail = TRUE;
+      cr_stylesheet_destroy (loaded);
+    }
+
+  cr_stylesheet_destroy (parsed);
+}
+
+static GFile *
+new_stylesheet_file (const char *contents)
+{
+  g_autoptr (GFileIOStream) stream = NULL;
+  g_autoptr (GError) error = NULL;
+  GFile *file;
+
+  file = g_file_new_tmp ("test-theme-XXXXXX.css", &stream, &error);
+  if (file == NULL ||
+      !g_file_replace_contents (file, contents, strlen (contents), NULL, FALSE,
+                                G_FILE_CREATE_NONE, NULL, NULL, &error))
+    g_error ("Failed to write stylesheet: %s", error->message);
+
+  return file;
+}
+
+static void
+assert_descendants_need_restyle (StTheme    *theme,
+                                 const char *old_style,
+                                 const char *new_style,
+                                 gboolean    expected)
+{
+  StThemeContext *theme_context;
+  StThemeNode *old_node, *new_node, *child;
+  gboolean value;
+
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+
+  old_node = st_theme_node_new (theme_context, NULL, theme, CLUTTER_TYPE_ACTOR,
+                                NULL, NULL, NULL, old_style);
+  new_node = st_theme_node_new (theme_context, NULL, theme, CLUTTER_TYPE_ACTOR,
+                                NULL, NULL, NULL, new_style);
+
+  /* Whether descendants looked anything up beforehand doesn't matter */
+  child = st_theme_node_new (theme_context, old_node, theme, CLUTTER_TYPE_TEXT,
+                             NULL, NULL, NULL, NULL);
+
+  value = _st_theme_node_descendants_need_restyle (old_node, new_node);
+  if (value != expected)
+    {
+      g_print ("%s: '%s' => '%s': expected %s, got %s\n",
+               test, old_style, new_style,
+               expected ? "a restyle" : "no restyle",
+               value ? "a restyle" : "no restyle");
+      fail = TRUE;
+    }
+
+  g_object_unref (child);
+  g_object_unref (old_node);
+  g_object_unref (new_node);
+}
+
+static void
+test_inherited_properties (void)
+{
+  StThemeContext *theme_context;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) custom_file = NULL;
+  StTheme *theme;
+  StThemeNode *parent, *inline_inherit;
+
+  test = "inherited_properties";
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+
+  /* test-theme.css has 'inherit' values, which make every property
+   * count as inherited, so use a stylesheet without them */
+  file = new_stylesheet_file ("#group1 { padding: 1px; }");
+  custom_file = new_stylesheet_file ("#group2 { padding: 2px; }");
+  theme = st_theme_new (file, NULL, NULL);
+
+  /* Properties that are never inherited don't affect descendants */
+  assert_descendants_need_restyle (theme, "padding: 1px;", "padding: 2px;", FALSE);
+  assert_descendants_need_restyle (theme,
+                                   "background-color: red; border: 1px solid black;",
+                                   "background-color: blue; border: 2px solid black;",
+                                   FALSE);
+  assert_descendants_need_restyle (theme, "min-width: 1px;", "min-width: 2px;", FALSE);
+
+  /* Inherited properties do, even before a descendant looked them up */
+  assert_descendants_need_restyle (theme, "color: red;", "color: blue;", TRUE);
+  assert_descendants_need_restyle (theme, "font-size: 10px;", "font-size: 12px;", TRUE);
+  assert_descendants_need_restyle (theme, "color: red;", "padding: 1px;", TRUE);
+
+  /* So do properties St doesn't know, since any of them can be looked
+   * up with inheritance */
+  assert_descendants_need_restyle (theme, "-st-test-length: 1px;", "-st-test-length: 2px;", TRUE);
+  assert_descendants_need_restyle (theme, "caret-color: red;", "caret-color: blue;", TRUE);
+
+  /* Inline 'inherit' values are tracked per theme, until the
+   * stylesheets change */
+  parent = st_theme_node_new (theme_context, NULL, theme, CLUTTER_TYPE_ACTOR,
+                              NULL, NULL, NULL, "padding: 1px;");
+  inline_inherit = st_theme_node_new (theme_context, parent, theme, CLUTTER_TYPE_TEXT,
+                                      NULL, NULL, NULL, "padding: inherit;");
+  st_theme_node_get_padding (inline_inherit, ST_SIDE_TOP);
+
+  if (!_st_theme_uses_inherit (theme))
+    {
+      g_print ("%s: inline 'inherit' value not tracked\n", test);
+      fail = TRUE;
+    }
+
+  st_theme_load_stylesheet (theme, custom_file, NULL);
+  if (_st_theme_uses_inherit (theme))
+    {
+      g_print ("%s: inline 'inherit' value tracked after a stylesheet change\n", test);
+      fail = TRUE;
+    }
+
+  g_object_unref (inline_inherit);
+  g_object_unref (parent);
+  g_object_unref (theme);
+
+  g_file_delete (file, NULL, NULL);
+  g_file_delete (custom_file, NULL, NULL);
+}
+
+typedef struct
+{
+  gboolean done;
+  gboolean result;
+  GError *error;
+} AsyncLoad;
+
+static void
+on_stylesheet_loaded (GObject      *source,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+  AsyncLoad *load = user_data;
+
+  load->result = st_theme_load_stylesheet_finish (ST_THEME (source), result,
+                                                  &load->error);
+  load->done = TRUE;
+}
+
+static gboolean
+load_stylesheet_async (StTheme  *theme,
+                       GFile    *file,
+                       GError  **error)
+{
+  AsyncLoad load = { 0, };
+
+  st_theme_load_stylesheet_async (theme, file, NULL,
+                                  on_stylesheet_loaded, &load);
+  while (!load.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  if (load.error)
+    g_propagate_error (error, load.error);
+
+  return load.result;
+}
+
+static void
+test_async_stylesheet (void)
+{
+  StThemeContext *theme_context;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) custom_file = NULL;
+  g_autoptr (GFile) tmp_dir = NULL;
+  g_autoptr (GFile) missing_file = NULL;
+  g_autoptr (GError) error = NULL;
+  GSList *custom_stylesheets;
+  StTheme *theme;
+  StThemeNode *node;
+
+  test = "async_stylesheet";
+  theme_context = st_theme_context_get_for_stage (CLUTTER_STAGE (stage));
+
+  file = new_stylesheet_file ("#group1 { color: #ff0000; }");
+  custom_file = new_stylesheet_file ("#group1 { color: #00ff00; }");
+  theme = st_theme_new (file, NULL, NULL);
+
+  if (!load_stylesheet_async (theme, custom_file, &error))
+    {
+      g_print ("%s: failed to load stylesheet: %s\n", test, error->message);
+      fail = TRUE;
+      g_clear_error (&error);
+    }
+
+  node = st_theme_node_new (theme_context, NULL, theme, CLUTTER_TYPE_ACTOR,
+                            "group1", NULL, NULL, NULL);
+  assert_foreground_color (node, "group1", "#00ff00ff");
+  g_object_unref (node);
+
+  /* A failed load reports the error and doesn't add the stylesheet */
+  tmp_dir = g_file_get_parent (custom_file);
+  missing_file = g_file_get_child (tmp_dir, "test-theme-missing.css");
+  if (load_stylesheet_async (theme, missing_file, &error))
+    {
+      g_print ("%s: loaded a missing stylesheet\n", test);
+      fail = TRUE;
+    }
+  else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    {
+      g_print ("%s: expected a not found error, got: %s\n",
+               test, error ? error->message : "none");
+      fail = TRUE;
+    }
+
+  custom_stylesheets = st_theme_get_custom_stylesheets (theme);
+  if (g_slist_length (custom_stylesheets) != 1)
+    {
+      g_print ("%s: expected 1 custom stylesheet, got %u\n",
+               test, g_slist_length (custom_stylesheets));
+      fail = TRUE;
+    }
+  g_slist_free_full (custom_stylesheets, g_object_unref);
+
+  g_object_unref (theme);
+
+  g_file_delete (file, NULL, NULL);
+  g_file_delete (custom_file, NULL, NULL);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -620,6 +982,11 @@ main (int argc, char **argv)
   test_font_features ();
   test_pseudo_class ();
   test_inline_style ();
+  test_style_sharing ();
+  test_node_eviction ();
+  test_compiled_stylesheet ();
+  test_inherited_properties ();
+  test_async_stylesheet ();
 
   g_object_unref (button);
   g_object_unref (group1);
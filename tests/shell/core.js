@@ -1,4 +1,4 @@
-/* eslint camelcase: ["error", { properties: "never", allow: ["^script_", "^malloc", "^glx", "^clutter"] }] */
+/* eslint camelcase: ["error", { properties: "never", allow: ["^script_", "^malloc", "^glx", "^clutter", "^st_"] }] */
 
 import * as System from 'system';
 
@@ -67,6 +67,30 @@ export var METRICS = {
         description: 'Time to switch to applications view, second time',
         units: 'us',
     },
+    overviewTextureDraws: {
+        description: 'Textures drawn by St while showing and hiding the overview, second time',
+        units: 'draws',
+    },
+    overviewTextureSwitches: {
+        description: 'St texture draws that switched GL textures while showing and hiding the overview, second time',
+        units: 'draws',
+    },
+    panelTextureDraws: {
+        description: 'Textures drawn by St while redrawing the top bar',
+        units: 'draws',
+    },
+    panelTextureSwitches: {
+        description: 'St texture draws that switched GL textures while redrawing the top bar',
+        units: 'draws',
+    },
+    quickSettingsTextureDraws: {
+        description: 'Textures drawn by St while opening and closing the quick settings, second time',
+        units: 'draws',
+    },
+    quickSettingsTextureSwitches: {
+        description: 'St texture draws that switched GL textures while opening and closing the quick settings, second time',
+        units: 'draws',
+    },
 };
 
 const WINDOW_CONFIGS = [{
@@ -100,6 +124,10 @@ export async function run() {
     Scripting.defineScriptEvent('afterShowHide', 'After a show/hide cycle for the overview');
     Scripting.defineScriptEvent('applicationsShowStart', 'Starting to switch to applications view');
     Scripting.defineScriptEvent('applicationsShowDone', 'Done switching to applications view');
+    Scripting.defineScriptEvent('panelRedrawStart', 'Starting to redraw the top bar');
+    Scripting.defineScriptEvent('panelRedrawDone', 'Done redrawing the top bar');
+    Scripting.defineScriptEvent('quickSettingsStart', 'Starting to open the quick settings');
+    Scripting.defineScriptEvent('quickSettingsDone', 'Done opening and closing the quick settings');
 
     // Enable recording of timestamps for different points in the frame cycle
     global.frame_timestamps = true;
@@ -159,6 +187,30 @@ export async function run() {
         Main.overview.dash.showAppsButton.checked = false;
         await Scripting.waitLeisure();
     }
+
+    Main.overview.hide();
+    await Scripting.waitLeisure();
+
+    Scripting.collectStatistics();
+    Scripting.scriptEvent('panelRedrawStart');
+    Main.panel.queue_redraw();
+    await Scripting.waitLeisure();
+    Scripting.collectStatistics();
+    Scripting.scriptEvent('panelRedrawDone');
+
+    // The first time the quick settings are opened, their icons are
+    // loaded, so only the second time is counted
+    const quickSettingsMenu = Main.panel.statusArea.quickSettings.menu;
+    for (let i = 0; i < 2; i++) {
+        Scripting.collectStatistics();
+        Scripting.scriptEvent('quickSettingsStart');
+        quickSettingsMenu.open();
+        await Scripting.waitLeisure();
+        quickSettingsMenu.close();
+        await Scripting.waitLeisure();
+        Scripting.collectStatistics();
+        Scripting.scriptEvent('quickSettingsDone');
+    }
     /* eslint-enable no-await-in-loop */
 }
 
@@ -172,6 +224,13 @@ let overviewShowCount = 0;
 let haveSwapComplete = false;
 let applicationsShowStart;
 let applicationsShowCount = 0;
+let textureDraws = 0;
+let textureSwitches = 0;
+let textureDrawsAfterFirst = 0;
+let textureSwitchesAfterFirst = 0;
+let textureDrawsBefore = 0;
+let textureSwitchesBefore = 0;
+let quickSettingsCount = 0;
 
 /**
  * @param {number} time - event timestamp
@@ -226,6 +285,53 @@ export function script_afterShowHide(_time) {
         METRICS.usedAfterOverview.value = mallocUsedSize;
     else
         METRICS.leakedAfterOverview.value = mallocUsedSize - METRICS.usedAfterOverview.value;
+
+    if (overviewShowCount === 1) {
+        textureDrawsAfterFirst = textureDraws;
+        textureSwitchesAfterFirst = textureSwitches;
+    } else if (overviewShowCount === 2) {
+        METRICS.overviewTextureDraws.value = textureDraws - textureDrawsAfterFirst;
+        METRICS.overviewTextureSwitches.value = textureSwitches - textureSwitchesAfterFirst;
+    }
+}
+
+/**
+ * @param {number} _time - event timestamp
+ * @returns {void}
+ */
+export function script_panelRedrawStart(_time) {
+    textureDrawsBefore = textureDraws;
+    textureSwitchesBefore = textureSwitches;
+}
+
+/**
+ * @param {number} _time - event timestamp
+ * @returns {void}
+ */
+export function script_panelRedrawDone(_time) {
+    METRICS.panelTextureDraws.value = textureDraws - textureDrawsBefore;
+    METRICS.panelTextureSwitches.value = textureSwitches - textureSwitchesBefore;
+}
+
+/**
+ * @param {number} _time - event timestamp
+ * @returns {void}
+ */
+export function script_quickSettingsStart(_time) {
+    textureDrawsBefore = textureDraws;
+    textureSwitchesBefore = textureSwitches;
+}
+
+/**
+ * @param {number} _time - event timestamp
+ * @returns {void}
+ */
+export function script_quickSettingsDone(_time) {
+    quickSettingsCount++;
+    if (quickSettingsCount === 2) {
+        METRICS.quickSettingsTextureDraws.value = textureDraws - textureDrawsBefore;
+        METRICS.quickSettingsTextureSwitches.value = textureSwitches - textureSwitchesBefore;
+    }
 }
 
 /**
@@ -237,6 +343,24 @@ export function malloc_usedSize(time, bytes) {
     mallocUsedSize = bytes;
 }
 
+/**
+ * @param {number} time - event timestamp
+ * @param {number} count - event data
+ * @returns {void}
+ */
+export function st_textureDraws(time, count) {
+    textureDraws = count;
+}
+
+/**
+ * @param {number} time - event timestamp
+ * @param {number} count - event data
+ * @returns {void}
+ */
+export function st_textureSwitches(time, count) {
+    textureSwitches = count;
+}
+
 /**
  * @param {number} time - event timestamp
  * @returns {void}